@@ -26,17 +26,22 @@
 #############################################################
 # Create a new CoreArray Genomic Data Structure (GDS) file
 #
-createfn.gds <- function(filename, allow.duplicate=FALSE)
+createfn.gds <- function(filename, allow.duplicate=FALSE, write.behind=FALSE,
+    extent.growth=0, compress.threads=0L)
 {
     stopifnot(is.character(filename), length(filename)==1L)
     stopifnot(is.logical(allow.duplicate))
+    stopifnot(is.logical(write.behind), length(write.behind)==1L)
+    stopifnot(is.numeric(extent.growth), length(extent.growth)==1L)
+    stopifnot(is.numeric(compress.threads), length(compress.threads)==1L)
 
     # 'normalizePath' does not work if the file does not exist
     tmpf <- file(filename, "wb")
     close(tmpf)
 
     filename <- normalizePath(filename, mustWork=FALSE)
-    ans <- .Call(gdsCreateGDS, filename, allow.duplicate)
+    ans <- .Call(gdsCreateGDS, filename, allow.duplicate, write.behind,
+        extent.growth, compress.threads)
     names(ans) <- c("filename", "id", "root", "readonly")
     ans$filename <- filename
     class(ans) <- "gds.class"
@@ -48,13 +53,22 @@ createfn.gds <- function(filename, allow.duplicate=FALSE)
 # Open an existing file
 #
 openfn.gds <- function(filename, readonly=TRUE, allow.duplicate=FALSE,
-    allow.fork=FALSE)
+    allow.fork=FALSE, use.mmap=FALSE, read.ahead=FALSE, write.behind=FALSE,
+    extent.growth=0, compress.threads=0L, decompress.threads=0L)
 {
     stopifnot(is.character(filename), length(filename)==1L)
+    stopifnot(is.logical(use.mmap), length(use.mmap)==1L)
+    stopifnot(is.logical(read.ahead), length(read.ahead)==1L)
+    stopifnot(is.logical(write.behind), length(write.behind)==1L)
+    stopifnot(is.numeric(extent.growth), length(extent.growth)==1L)
+    stopifnot(is.numeric(compress.threads), length(compress.threads)==1L)
+    stopifnot(is.numeric(decompress.threads),
+        length(decompress.threads)==1L)
 
     filename <- normalizePath(filename, mustWork=FALSE)
     ans <- .Call(gdsOpenGDS, filename, readonly, allow.duplicate,
-        allow.fork)
+        allow.fork, use.mmap, read.ahead, write.behind, extent.growth,
+        compress.threads, decompress.threads)
     names(ans) <- c("filename", "id", "root", "readonly")
     ans$filename <- filename
     class(ans) <- "gds.class"
@@ -87,11 +101,14 @@ sync.gds <- function(gdsfile)
 #############################################################
 # Clean up fragments of a GDS file
 #
-cleanup.gds <- function(filename, verbose=TRUE)
+cleanup.gds <- function(filename, verbose=TRUE, in.place=FALSE,
+    time.limit=NA_real_)
 {
     stopifnot(is.character(filename), length(filename)==1L)
-    .Call(gdsTidyUp, filename, verbose)
-    invisible()
+    stopifnot(is.logical(in.place), length(in.place)==1L)
+    stopifnot(is.numeric(time.limit), length(time.limit)==1L)
+    rv <- .Call(gdsTidyUp, filename, verbose, in.place, time.limit)
+    invisible(rv)
 }
 
 
@@ -269,7 +286,8 @@ objdesp.gdsn <- function(node)
 # Add a GDS node
 #
 add.gdsn <- function(node, name, val=NULL, storage=storage.mode(val),
-    valdim=NULL, compress=c("", "ZIP", "ZIP_RA", "LZMA", "LZMA_RA", "LZ4", "LZ4_RA"),
+    valdim=NULL, compress=c("", "ZIP", "ZIP_RA", "LZMA", "LZMA_RA", "LZ4", "LZ4_RA",
+        "ZSTD", "ZSTD_RA"),
     closezip=FALSE, check=TRUE, replace=FALSE, visible=TRUE, ...)
 {
     if (inherits(node, "gds.class"))
@@ -298,7 +316,8 @@ add.gdsn <- function(node, name, val=NULL, storage=storage.mode(val),
             if (is.numeric(valdim))
                 valdim[length(valdim)] <- 0L
         }
-        if (identical(compress, c("", "ZIP", "ZIP_RA", "LZMA", "LZMA_RA", "LZ4", "LZ4_RA")))
+        if (identical(compress, c("", "ZIP", "ZIP_RA", "LZMA", "LZMA_RA", "LZ4",
+            "LZ4_RA", "ZSTD", "ZSTD_RA")))
         {
             compress <- dp$compress
         }
@@ -393,7 +412,8 @@ addfolder.gdsn <- function(node, name, type=c("directory", "virtual"),
 # Add a GDS node with a file
 #
 addfile.gdsn <- function(node, name, filename,
-    compress=c("ZIP", "ZIP_RA", "LZMA", "LZMA_RA", "LZ4", "LZ4_RA"),
+    compress=c("ZIP", "ZIP_RA", "LZMA", "LZMA_RA", "LZ4", "LZ4_RA", "ZSTD",
+        "ZSTD_RA"),
     replace=FALSE, visible=TRUE)
 {
     if (inherits(node, "gds.class"))
@@ -508,7 +528,8 @@ delete.attr.gdsn <- function(node, name)
 # Modify the data compression mode of data field
 #
 compression.gdsn <- function(node,
-    compress=c("", "ZIP", "ZIP_RA", "LZMA", "LZMA_RA", "LZ4", "LZ4_RA"))
+    compress=c("", "ZIP", "ZIP_RA", "LZMA", "LZMA_RA", "LZ4", "LZ4_RA", "ZSTD",
+        "ZSTD_RA"))
 {
     stopifnot(inherits(node, "gdsn.class"))
     stopifnot(is.character(compress), length(compress)>0L)
@@ -628,10 +649,15 @@ append.gdsn <- function(node, val, check=TRUE)
 #
 read.gdsn <- function(node, start=NULL, count=NULL,
     simplify=c("auto", "none", "force"), .useraw=FALSE, .value=NULL,
-    .substitute=NULL)
+    .substitute=NULL, .sparse=FALSE)
 {
     stopifnot(inherits(node, "gdsn.class"))
     simplify <- match.arg(simplify)
+    stopifnot(is.logical(.sparse), length(.sparse)==1L)
+
+    # nonzero entries of a sparse array
+    if (isTRUE(.sparse))
+        return(.Call(gdsObjReadSparse, node, start, count, NULL))
 
     if (is.null(start) & is.null(count))
     {
@@ -674,10 +700,36 @@ read.gdsn <- function(node, start=NULL, count=NULL,
 # Read data field of a GDS node
 #
 readex.gdsn <- function(node, sel=NULL, simplify=c("auto", "none", "force"),
-    .useraw=FALSE, .value=NULL, .substitute=NULL)
+    .useraw=FALSE, .value=NULL, .substitute=NULL, .sparse=FALSE)
 {
     stopifnot(inherits(node, "gdsn.class"))
     simplify <- match.arg(simplify)
+    stopifnot(is.logical(.sparse), length(.sparse)==1L)
+
+    if (isTRUE(.sparse))
+    {
+        # nonzero entries of a sparse array, with logical selection
+        if (!is.null(sel))
+        {
+            stopifnot(is.logical(sel) | is.numeric(sel) | is.list(sel))
+            if (!is.list(sel)) sel <- list(sel)
+            dm <- objdesp.gdsn(node)$dim
+            if (length(sel) != length(dm))
+                stop("The dimension of 'sel' is not correct.")
+            for (i in seq_along(sel))
+            {
+                s <- sel[[i]]
+                if (is.numeric(s))
+                {
+                    if (any(s < 0, na.rm=TRUE))
+                        sel[[i]] <- !(seq_len(dm[i]) %in% -s)
+                    else
+                        sel[[i]] <- seq_len(dm[i]) %in% s
+                }
+            }
+        }
+        return(.Call(gdsObjReadSparse, node, NULL, NULL, sel))
+    }
 
     if (!is.null(sel))
     {
@@ -698,13 +750,84 @@ readex.gdsn <- function(node, sel=NULL, simplify=c("auto", "none", "force"),
 }
 
 
+#############################################################
+# Apply functions over the rows or columns of a sparse matrix
+#
+.apply_sparse <- function(node, margin, FUN, selection, as.is, var.index,
+    target.node, ...)
+{
+    dm <- objdesp.gdsn(node)$dim
+    if (length(dm) != 2L)
+        stop("'.sparse=TRUE' requires a two-dimensional sparse array.")
+    if (!(margin %in% 1:2))
+        stop("'margin' should be 1 or 2.")
+    if (is.null(selection))
+        selection <- list(NULL, NULL)
+    stopifnot(length(selection) == 2L)
+    sel <- lapply(1:2, function(i) {
+        s <- selection[[i]]
+        if (is.null(s)) rep(TRUE, dm[i]) else s })
+    idx <- which(sel[[margin]])
+
+    ans <- if (as.is %in% c("list", "none", "gdsnode")) vector("list",
+        length(idx)) else vector(as.is, length(idx))
+    do_call <- function(k, v)
+    {
+        rv <- switch(var.index,
+            none = FUN(v, ...),
+            relative = FUN(k, v, ...),
+            absolute = FUN(idx[k], v, ...))
+        if (as.is == "gdsnode")
+            append.gdsn(target.node[[1L]], rv)
+        else if (as.is == "list")
+            ans[k] <<- list(rv)
+        else if (as.is != "none")
+            ans[k] <<- rv
+    }
+
+    if (margin == 2L)
+    {
+        # columns are stored contiguously, read them in blocks
+        st <- 1L
+        while (st <= length(idx))
+        {
+            ed <- min(st + 1023L, length(idx))
+            c0 <- idx[st]; c1 <- idx[ed]
+            v <- .Call(gdsObjReadSparse, node, c(1L, c0), c(-1L, c1-c0+1L),
+                list(sel[[1L]], sel[[2L]][c0:c1]))
+            g <- split(seq_along(v$j), factor(v$j, levels=seq_len(ed-st+1L)))
+            for (k in seq_along(g))
+            {
+                i <- g[[k]]
+                do_call(st + k - 1L, list(i=v$i[i], x=v$x[i]))
+            }
+            st <- ed + 1L
+        }
+    } else {
+        v <- .Call(gdsObjReadSparse, node, NULL, NULL, sel)
+        g <- split(seq_along(v$i), factor(v$i, levels=seq_along(idx)))
+        for (k in seq_along(g))
+        {
+            i <- g[[k]]
+            do_call(k, list(i=v$j[i], x=v$x[i]))
+        }
+    }
+
+    if (as.is %in% c("none", "gdsnode"))
+        invisible()
+    else
+        ans
+}
+
+
 #############################################################
 # Apply functions over array margins of a GDS node
 #
 apply.gdsn <- function(node, margin, FUN, selection=NULL,
     as.is=c("list", "none", "integer", "double", "character", "logical",
     "raw", "gdsnode"), var.index=c("none", "relative", "absolute"),
-    target.node=NULL, .useraw=FALSE, .value=NULL, .substitute=NULL, ...)
+    target.node=NULL, .useraw=FALSE, .value=NULL, .substitute=NULL,
+    .sparse=FALSE, ...)
 {
     # check
     if (inherits(node, "gdsn.class"))
@@ -759,6 +882,16 @@ apply.gdsn <- function(node, margin, FUN, selection=NULL,
             stop("'target.node' should be NULL.")
     }
 
+    # sparse rows or columns
+    stopifnot(is.logical(.sparse), length(.sparse)==1L)
+    if (isTRUE(.sparse))
+    {
+        if (length(node) != 1L)
+            stop("'.sparse=TRUE' requires a single GDS node.")
+        return(.apply_sparse(node[[1L]], margin, FUN, selection[[1L]], as.is,
+            var.index, target.node, ...))
+    }
+
     # call C function -- set starting index
     .Call(gdsApplySetStart, 1L)
 
@@ -1250,6 +1383,102 @@ summarize.gdsn <- function(node)
 }
 
 
+#############################################################
+# Zone map of compressed blocks
+#
+zonemap.gdsn <- function(node, range=NULL)
+{
+    stopifnot(inherits(node, "gdsn.class"))
+    stopifnot(is.null(range) || (is.numeric(range) && length(range)==2L))
+    if (!is.null(range)) range <- as.double(range)
+    rv <- .Call(gdsZoneMap, node, range)
+    if (!is.null(rv))
+        rv <- as.data.frame(rv, stringsAsFactors=FALSE)
+    rv
+}
+
+
+#############################################################
+# Record the access trace of a node
+#
+accesstrace.gdsn <- function(node, enable=NULL, file=NULL)
+{
+    stopifnot(inherits(node, "gdsn.class"))
+    stopifnot(is.null(enable) || (is.logical(enable) && length(enable)==1L))
+    stopifnot(is.null(file) || (is.character(file) && length(file)==1L))
+
+    rv <- as.data.frame(.Call(gdsAccessTrace, node, enable),
+        stringsAsFactors=FALSE)
+    if (!is.null(file))
+        write.table(rv, file, sep="\t", quote=FALSE, row.names=FALSE)
+    rv
+}
+
+
+#############################################################
+# Recommend the block size and codec from an access trace
+#
+blocksize.gdsn <- function(node, trace, max.amplification=2, apply=FALSE)
+{
+    stopifnot(inherits(node, "gdsn.class"))
+    if (is.character(trace))
+    {
+        stopifnot(length(trace) == 1L)
+        trace <- read.table(trace, header=TRUE, sep="\t")
+    }
+    stopifnot(is.data.frame(trace))
+    if (!all(c("offset", "size") %in% names(trace)))
+        stop("'trace' should have the columns 'offset' and 'size'.")
+    if (nrow(trace) <= 0L)
+        stop("'trace' is empty.")
+    stopifnot(is.numeric(max.amplification), length(max.amplification)==1L,
+        max.amplification >= 1)
+    stopifnot(is.logical(apply), length(apply)==1L)
+
+    # the uncompressed size of a block, according to the current ratio
+    d <- objdesp.gdsn(node)
+    ratio <- 1 / d$cpratio
+    if (!is.finite(ratio) || ratio < 1) ratio <- 1
+
+    # the uncompressed data decompressed for the trace per the data read
+    bsize <- c(16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192) * 1024
+    names(bsize) <- c("16K", "32K", "64K", "128K", "256K", "512K", "1M",
+        "2M", "4M", "8M")
+    st <- as.double(trace$offset)
+    sz <- pmax(as.double(trace$size), 1)
+    amp <- vapply(bsize, function(b) {
+        rb <- b * ratio
+        nblk <- floor((st + sz - 1) / rb) - floor(st / rb) + 1
+        sum(nblk * rb) / sum(sz)
+    }, 0)
+
+    # the largest block within the read amplification
+    i <- which(amp <= max.amplification)
+    k <- if (length(i)) max(i) else 1L
+
+    # small random reads prefer a fast decoder
+    random <- mean(sz < 65536)
+    enc <- system.gds()$compression.encoder$encoder
+    codec <- if (random > 0.5) "LZ4_RA" else
+        if ("ZSTD_ra" %in% enc) "ZSTD_RA" else "ZIP_RA"
+
+    # keep the filter and zone map of the node
+    opt <- strsplit(d$compress, ":", fixed=TRUE)[[1L]][-1L]
+    opt <- opt[opt %in% c("shuffle", "bitshuffle", "delta", "delta2",
+        "zonemap")]
+    compress <- paste(c(codec, names(bsize)[k], opt), collapse=":")
+
+    if (apply)
+    {
+        compression.gdsn(node, compress)
+        readmode.gdsn(node)
+    }
+
+    list(compress=compress, codec=codec, block.size=names(bsize)[k],
+        amplification=amp, random=random)
+}
+
+
 
 ##############################################################################
 # Error function
@@ -1289,6 +1518,17 @@ system.gds <- function()
 }
 
 
+#############################################################
+# Configure the shared cache of decompressed blocks
+#
+blockcache.gds <- function(budget=NULL, reset=FALSE)
+{
+    stopifnot(is.null(budget) || (is.numeric(budget) && length(budget)==1L))
+    stopifnot(is.logical(reset), length(reset)==1L)
+    .Call(gdsBlockCache, budget, reset)
+}
+
+
 
 ##############################################################################
 # R Generic functions
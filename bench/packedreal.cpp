@@ -0,0 +1,180 @@
+// ===========================================================
+//
+// packedreal.cpp: Benchmark of encoding and decoding packed real numbers
+//
+// Copyright (C) 2026    Xiuwen Zheng
+//
+// This file is part of CoreArray.
+//
+// CoreArray is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License Version 3 as
+// published by the Free Software Foundation.
+//
+// CoreArray is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with CoreArray.
+// If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ *	\file     packedreal.cpp
+ *	\author   Xiuwen Zheng [zhengxwen@gmail.com]
+ *	\version  1.0
+ *	\date     2026
+ *	\brief    Benchmark of encoding and decoding packed real numbers
+ *	\details  Build with 'make' in this directory, and run './packedreal'.
+ *	          It reports the time in milliseconds of
+ *	          (1) writing 20M doubles, and reading them into int32, float32
+ *	              and float64 buffers (memory-bound);
+ *	          (2) reading 32K elements 1000 times (in cache).
+ *	          To compare with the scalar code before the vectorized kernels,
+ *	          build it again in a checkout of the earlier version, e.g.,
+ *	          'git worktree add /tmp/before <commit>^', then
+ *	          'make -C /tmp/before/bench'.
+**/
+
+#include "CoreArray.h"
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include <string>
+
+using namespace std;
+using namespace CoreArray;
+
+
+/// the elapsed time in milliseconds
+static double Elapsed(const timespec &t0)
+{
+	timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+}
+
+static void Now(timespec &t)
+{
+	clock_gettime(CLOCK_MONOTONIC, &t);
+}
+
+/// values in the range of the type with a scale of 0.01
+static void FillData(vector<C_Float64> &Buf, bool Unsigned, double Range)
+{
+	srand(1000);
+	for (size_t i=0; i < Buf.size(); i++)
+	{
+		double v = (double)rand() / RAND_MAX * Range;
+		if (!Unsigned) v = 2*v - Range;
+		Buf[i] = (int)(v * 100) / 100.0;
+	}
+}
+
+/// create a packed real array with a scale of 0.01
+template<typename TYPE> static CdAllocArray *NewArray()
+{
+	TYPE *Obj = new TYPE;
+	Obj->SetScale(0.01);
+	return Obj;
+}
+
+/// read all elements of Obj into Buf
+template<typename TYPE>
+	static double ReadAll(CdAllocArray *Obj, vector<TYPE> &Buf,
+		C_SVType SV, int Repeat)
+{
+	C_Int32 st=0, cnt=Buf.size();
+	timespec t0;
+	Now(t0);
+	for (int i=0; i < Repeat; i++)
+		Obj->ReadData(&st, &cnt, &Buf[0], SV);
+	return Elapsed(t0);
+}
+
+
+struct TType
+{
+	const char *Name;
+	CdAllocArray *(*New)();
+	bool Unsigned;
+	double Range;
+};
+
+int main(int argc, char *argv[])
+{
+	const char *fn = (argc > 1) ? argv[1] : "packedreal.gds";
+	RegisterClass();
+
+	const TType Large[] = {
+		{ "packedreal16", NewArray<CdPackedReal16>, false, 300 },
+		{ "packedreal24", NewArray<CdPackedReal24>, false, 80000 },
+		{ "packedreal32", NewArray<CdPackedReal32>, false, 2e7 },
+		{ "packedreal8",  NewArray<CdPackedReal8>,  false, 1.2 } };
+	const TType Small[] = {
+		{ "packedreal16",  NewArray<CdPackedReal16>,  false, 300 },
+		{ "packedreal24",  NewArray<CdPackedReal24>,  false, 80000 },
+		{ "packedreal24u", NewArray<CdPackedReal24U>, true,  160000 },
+		{ "packedreal32",  NewArray<CdPackedReal32>,  false, 2e7 } };
+
+	// memory-bound
+	{
+		const int N = 20000000;
+		vector<C_Float64> Data(N), F64(N);
+		vector<C_Float32> F32(N);
+		vector<C_Int32> I32(N);
+		printf("%d elements, memory-bound, in ms:\n", N);
+		printf("%-16s %8s %8s %8s %8s\n", "type", "write", "i32 read",
+			"f32 read", "f64 read");
+		for (size_t k=0; k < sizeof(Large)/sizeof(TType); k++)
+		{
+			const TType &T = Large[k];
+			FillData(Data, T.Unsigned, T.Range);
+			CdGDSFile File;
+			File.SaveAsFile(fn);
+			CdAllocArray *Obj = T.New();
+			File.Root().AddObj("x", Obj);
+			timespec t0;
+			Now(t0);
+			Obj->Append(&Data[0], N, svFloat64);
+			Obj->CloseWriter();
+			double tw = Elapsed(t0);
+			double ti = ReadAll(Obj, I32, svInt32, 1);
+			double tf = ReadAll(Obj, F32, svFloat32, 1);
+			double td = ReadAll(Obj, F64, svFloat64, 1);
+			printf("%-16s %8.1f %8.1f %8.1f %8.1f\n", T.Name, tw, ti, tf, td);
+			File.CloseFile();
+		}
+	}
+
+	// in cache
+	{
+		const int N = 32768, Repeat = 1000;
+		vector<C_Float64> Data(N), F64(N);
+		vector<C_Float32> F32(N);
+		vector<C_Int32> I32(N);
+		printf("\n%d elements read %d times, in cache, in ms:\n", N, Repeat);
+		printf("%-16s %8s %8s %8s\n", "type", "f64 read", "f32 read",
+			"i32 read");
+		for (size_t k=0; k < sizeof(Small)/sizeof(TType); k++)
+		{
+			const TType &T = Small[k];
+			FillData(Data, T.Unsigned, T.Range);
+			CdGDSFile File;
+			File.SaveAsFile(fn);
+			CdAllocArray *Obj = T.New();
+			File.Root().AddObj("x", Obj);
+			Obj->Append(&Data[0], N, svFloat64);
+			Obj->CloseWriter();
+			double td = ReadAll(Obj, F64, svFloat64, Repeat);
+			double tf = ReadAll(Obj, F32, svFloat32, Repeat);
+			double ti = ReadAll(Obj, I32, svInt32, Repeat);
+			printf("%-16s %8.1f %8.1f %8.1f\n", T.Name, td, tf, ti);
+			File.CloseFile();
+		}
+	}
+
+	remove(fn);
+	return 0;
+}
@@ -978,6 +978,35 @@
 #endif
 
 
+// the SIMD kernels of higher instruction sets are compiled with the target
+// attribute, and selected by the CPU features at run time
+#ifdef COREARRAY_TARGET_DISPATCH
+#   undef COREARRAY_TARGET_DISPATCH
+#endif
+#
+#if defined(COREARRAY_SIMD_SSE2) && !defined(COREARRAY_NO_TARGET_DISPATCH)
+#   if defined(__clang__)
+#       if (__clang_major__ > 3) || ((__clang_major__ == 3) && (__clang_minor__ >= 8))
+#           define COREARRAY_TARGET_DISPATCH
+#       endif
+#   elif defined(__GNUC__)
+#       if (__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))
+#           define COREARRAY_TARGET_DISPATCH
+#       endif
+#   endif
+#endif
+#
+#ifdef COREARRAY_TARGET
+#   undef COREARRAY_TARGET
+#endif
+#
+#ifdef COREARRAY_TARGET_DISPATCH
+#   define COREARRAY_TARGET(isa)    __attribute__((target(isa)))
+#else
+#   define COREARRAY_TARGET(isa)
+#endif
+
+
 
 
 // ===========================================================================
@@ -16,7 +16,67 @@ type.list <- c("int8", "int16", "int24", "int32", "int64",
 
 # a list of compression algorithms
 compress.list <- c("ZIP", "ZIP_RA:16K", "LZ4", "LZ4.fast",
-	"LZ4_RA:16K", "LZ4_RA.fast:16K", "LZMA", "LZMA_RA:32K")
+	"LZ4_RA:16K", "LZ4_RA.fast:16K", "LZMA", "LZMA_RA:32K",
+	"ZIP_RA:16K:shuffle", "LZ4_RA:16K:bitshuffle", "ZIP_RA:16K:delta2")
+
+# zstd is optional (not available if libzstd is missing at installation)
+has.zstd <- "ZSTD" %in% system.gds()$compression.encoder$encoder
+if (has.zstd)
+	compress.list <- c(compress.list, "ZSTD", "ZSTD_RA:16K", "ZSTD_RA:16K:delta")
+
+# the random-access compression algorithms
+ra.list <- grep("_RA", compress.list, value=TRUE)
+
+# create "tmp.gds" with an integer matrix compressed by each algorithm in
+#   'compress' (variable names "data" + compression method), appended column
+#   by column if 'append=TRUE', and return the matrix
+create.test.gds <- function(compress, append=FALSE, ...)
+{
+	set.seed(1000)
+	dta <- matrix(as.integer(runif(500000) * 1000), nrow=500)
+
+	gfile <- createfn.gds("tmp.gds", allow.duplicate=TRUE, ...)
+	for (cp in compress)
+	{
+		if (append)
+		{
+			node <- add.gdsn(gfile, paste0("data", cp), storage="int32",
+				valdim=c(500L, 0L), compress=cp)
+			for (i in seq(1L, ncol(dta), 100L))
+				append.gdsn(node, dta[, i:(i+99L)])
+			readmode.gdsn(node)
+		} else {
+			add.gdsn(gfile, paste0("data", cp), dta, compress=cp,
+				closezip=TRUE)
+		}
+	}
+	closefn.gds(gfile)
+
+	dta
+}
+
+# create "test.gds" with four integer variables "v1" to "v4" of 'n' values,
+#   appended in turn by 1000 values with synchronization, so that their
+#   blocks are interleaved in the file, and return the list of values
+create.interleaved.gds <- function(n=200000L, ...)
+{
+	set.seed(100)
+	val <- lapply(1:4, function(i) sample.int(2^28, n, replace=TRUE))
+
+	f <- createfn.gds("test.gds", ...)
+	nd <- lapply(1:4, function(i) add.gdsn(f, paste0("v", i), storage="int"))
+	for (j in seq(1L, n, 1000L))
+	{
+		for (i in 1:4)
+		{
+			append.gdsn(nd[[i]], val[[i]][j:(j+999L)])
+			sync.gds(f)
+		}
+	}
+	closefn.gds(f)
+
+	val
+}
 
 # unittest.gdsfmt path
 base.path <- system.file("unitTests", package="gdsfmt")
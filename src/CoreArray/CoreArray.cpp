@@ -62,6 +62,7 @@ namespace CoreArray
 	extern COREARRAY_DLL_LOCAL void RegisterClass_VLInt();
 	extern COREARRAY_DLL_LOCAL void RegisterClass_PackedReal();
 	extern COREARRAY_DLL_LOCAL void RegisterClass_String();
+	extern COREARRAY_DLL_LOCAL void RegisterClass_Sparse();
 
 
 	COREARRAY_DLL_DEFAULT void RegisterClass()
@@ -104,6 +105,9 @@ namespace CoreArray
 		// variable-length strings allowing null character
 		RegisterClass_String();
 
+		// sparse arrays
+		RegisterClass_Sparse();
+
 		// stream container
 		dObjManager().AddClass("dStream", OnObjCreate<CdGDSStreamContainer>,
 			CdObjClassMgr::ctStream, "stream container");
@@ -39,7 +39,7 @@
 #ifdef COREARRAY_SIMD_SSE2
 #include <emmintrin.h>
 #endif
-#ifdef COREARRAY_SIMD_AVX
+#if defined(COREARRAY_SIMD_AVX) || defined(COREARRAY_TARGET_DISPATCH)
 #include <immintrin.h>
 #endif
 
@@ -337,8 +337,92 @@ ErrAllocWrite::ErrAllocWrite(): ErrAllocator(ERR_WRITE_ONLY)
 
 static const __m128i MASK_B4_0xFF = _mm_set1_epi32(0xFF);
 
+#if defined(COREARRAY_SIMD_AVX2) || defined(COREARRAY_TARGET_DISPATCH)
+
+COREARRAY_TARGET("avx2")
+static size_t i32_to_i8_avx2(C_Int8 *p, const C_Int32 *s, size_t n)
+{
+	const __m256i mask = _mm256_set1_epi32(0xFF);
+	const __m256i idx = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	const size_t n0 = n;
+	for (; n >= 32; n-=32)
+	{
+		__m256i v1 = _mm256_loadu_si256((__m256i const*)s) & mask;
+		__m256i v2 = _mm256_loadu_si256((__m256i const*)(s+8)) & mask;
+		__m256i w1 = _mm256_packs_epi32(v1, v2);
+		v1 = _mm256_loadu_si256((__m256i const*)(s+16)) & mask;
+		v2 = _mm256_loadu_si256((__m256i const*)(s+24)) & mask;
+		__m256i w2 = _mm256_packs_epi32(v1, v2);
+		__m256i v = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(w1, w2), idx);
+		_mm256_storeu_si256((__m256i*)p, v);
+		s += 32; p += 32;
+	}
+	return n0 - n;
+}
+
+#endif
+
+#if defined(COREARRAY_TARGET_DISPATCH) || defined(__AVX512F__)
+
+COREARRAY_TARGET("avx512f")
+static size_t i32_to_i8_avx512(C_Int8 *p, const C_Int32 *s, size_t n)
+{
+	const size_t n0 = n;
+	for (; n >= 32; n-=32)
+	{
+		// the zero-masking form, avoiding -Wmaybe-uninitialized in GCC
+		__m128i v1 = _mm512_maskz_cvtepi32_epi8(0xFFFF,
+			_mm512_loadu_si512((void const*)s));
+		__m128i v2 = _mm512_maskz_cvtepi32_epi8(0xFFFF,
+			_mm512_loadu_si512((void const*)(s+16)));
+		_mm_storeu_si128((__m128i*)p, v1);
+		_mm_storeu_si128((__m128i*)(p+16), v2);
+		s += 32; p += 32;
+	}
+	return n0 - n;
+}
+
+#endif
+
+/// the kernel of int32 to int8 selected by the CPU features, or NULL
+static size_t (*i32_to_i8_kernel)(C_Int8 *p, const C_Int32 *s, size_t n) =
+	NULL;
+
+static bool i32_to_i8_select()
+{
+	C_UInt32 Flag = Mach::GetCPU_Features();
+	(void)Flag;  // unused without the wider kernels
+	const char *ISA = "SSE2";
+#if defined(COREARRAY_SIMD_AVX2) || defined(COREARRAY_TARGET_DISPATCH)
+#   ifdef COREARRAY_SIMD_AVX2
+	Flag |= Mach::cpuAVX2;
+#   endif
+	if (Flag & Mach::cpuAVX2)
+		{ i32_to_i8_kernel = i32_to_i8_avx2; ISA = "AVX2"; }
+#endif
+#if defined(COREARRAY_TARGET_DISPATCH) || defined(__AVX512F__)
+#   ifdef __AVX512F__
+	Flag |= Mach::cpuAVX512F;
+#   endif
+	if (Flag & Mach::cpuAVX512F)
+		{ i32_to_i8_kernel = i32_to_i8_avx512; ISA = "AVX512F"; }
+#endif
+	Mach::SetSIMD_Kernel("int32.to.int8", ISA);
+	return true;
+}
+
+static const bool i32_to_i8_selected = i32_to_i8_select();
+
+
 C_Int8* CoreArray::vec_simd_i32_to_i8(C_Int8 *p, const C_Int32 *s, size_t n)
 {
+	// wider kernels
+	if (i32_to_i8_kernel)
+	{
+		size_t m = i32_to_i8_kernel(p, s, n);
+		p += m; s += m; n -= m;
+	}
+
 	// header 1, 16-byte aligned
 	size_t h = (16 - ((size_t)p & 0x0F)) & 0x0F;
 	for (; (n > 0) && (h > 0); n--, h--) *p++ = *s++;
@@ -139,6 +139,9 @@ namespace CoreArray
 
 		COREARRAY_FORCEINLINE CdBufStream *BufStream()
 			{ return _BufStream; }
+		/// whether the data can be written
+		COREARRAY_FORCEINLINE bool CanWrite() const
+			{ return (_Write != _NoWrite); }
 
 	protected:
 		typedef void (*TAllocFree)(CdAllocator &Obj);
@@ -372,6 +372,28 @@ SIZE64 CdStream::GetSize()
 	return rv;
 }
 
+ssize_t CdStream::ReadAt(SIZE64 Pos, void *Buffer, ssize_t Count)
+{
+	SetPosition(Pos);
+	return Read(Buffer, Count);
+}
+
+ssize_t CdStream::WriteAt(SIZE64 Pos, const void *Buffer, ssize_t Count)
+{
+	SetPosition(Pos);
+	return Write(Buffer, Count);
+}
+
+bool CdStream::Preallocate(SIZE64 Pos, SIZE64 Count)
+{
+	return false;
+}
+
+bool CdStream::Sync()
+{
+	return false;
+}
+
 SIZE64 CdStream::Position()
 {
 	return Seek(0, soCurrent);
@@ -511,11 +533,404 @@ void CdStream::CopyFromBuf(CdBufStream &Source, SIZE64 Pos, SIZE64 Count)
 // Stream Buffer Object
 // =====================================================================
 
+namespace CoreArray
+{
+	/// The number of windows prefetched ahead of a CdBufStream
+	static const int READ_AHEAD_NUM_WINDOW = 4;
+
+#ifdef COREARRAY_POSIX_THREAD
+	// A helper thread may be inside a decoder when the process forks, so
+	// fork() waits until no helper is reading, and the decoders are copied
+	// to the child in a consistent state
+
+	static CdThreadMutex ReadAhead_ForkMutex;
+	static CdThreadCondition ReadAhead_ForkCond;
+	static int ReadAhead_NumReading = 0;   ///< the number of helpers reading
+	static bool ReadAhead_Forking = false;
+	static TProcessID ReadAhead_PID = 0;   ///< the process allowing helpers
+	static pthread_once_t ReadAhead_Once = PTHREAD_ONCE_INIT;
+
+	static void ReadAhead_Prepare()
+	{
+		ReadAhead_ForkMutex.Lock();
+		ReadAhead_Forking = true;
+		while (ReadAhead_NumReading > 0)
+			ReadAhead_ForkCond.Wait(ReadAhead_ForkMutex);
+	}
+	static void ReadAhead_Parent()
+	{
+		ReadAhead_Forking = false;
+		ReadAhead_ForkCond.Broadcast();
+		ReadAhead_ForkMutex.Unlock();
+	}
+	static void ReadAhead_Child()
+	{
+		// no helper thread exists in the child
+		ReadAhead_Forking = false;
+		ReadAhead_ForkMutex.Unlock();
+	}
+	static void ReadAhead_Init()
+	{
+		ReadAhead_PID = GetCurrentProcessID();
+		pthread_atfork(ReadAhead_Prepare, ReadAhead_Parent, ReadAhead_Child);
+	}
+#endif
+
+	/// Prefetch the following windows of a CdBufStream on a helper thread
+	class COREARRAY_DLL_LOCAL CdBufReadAhead
+	{
+	public:
+		SIZE64 LastEnd;  ///< the end of the last refill
+
+		CdBufReadAhead(ssize_t Size)
+		{
+			LastEnd = -1;
+			fStream = NULL; fSize = 0;
+			memset((void*)fWin, 0, sizeof(fWin));
+			fHead = fCount = 0; fNext = 0;
+			fStop = fDone = false;
+			fThread = NULL; fPID = 0;
+			fMutex = new CdThreadMutex;
+			fCond = new CdThreadCondition;
+			Resize(Size);
+		#ifdef COREARRAY_POSIX_THREAD
+			pthread_once(&ReadAhead_Once, ReadAhead_Init);
+		#endif
+		}
+		~CdBufReadAhead()
+		{
+			Stop();
+			for (int i=0; i < READ_AHEAD_NUM_WINDOW; i++)
+				if (fWin[i].Buf) free((void*)fWin[i].Buf);
+			delete fCond;
+			delete fMutex;
+		}
+
+		/// whether the helper thread is running
+		COREARRAY_INLINE bool Running() const { return fThread!=NULL; }
+
+		void Resize(ssize_t Size)
+		{
+			Stop();
+			fSize = Size;
+			for (int i=0; i < READ_AHEAD_NUM_WINDOW; i++)
+			{
+				fWin[i].Buf = (C_UInt8*)realloc((void*)fWin[i].Buf, Size);
+				COREARRAY_ALLOCCHECK(fWin[i].Buf);
+			}
+		}
+
+		/// start prefetching vStream from Pos on the helper thread
+		void Start(CdStream *vStream, SIZE64 Pos)
+		{
+			Stop();
+		#ifdef COREARRAY_POSIX_THREAD
+			// disabled in a forked child, where the file may be reopened on
+			// first access by CdForkFileStream
+			if (GetCurrentProcessID() != ReadAhead_PID) return;
+		#endif
+			fStream = vStream;
+			fNext = Pos;
+			fPID = GetCurrentProcessID();
+			fThread = new CdThread;
+			try {
+				fThread->BeginThread(_Proc, this);
+			} catch (...) {
+				delete fThread;
+				fThread = NULL;
+			}
+		}
+
+		/// stop the helper thread and discard the prefetched windows
+		void Stop()
+		{
+			if (fThread)
+			{
+				if (fPID == GetCurrentProcessID())
+				{
+					fMutex->Lock();
+					fStop = true;
+					fCond->Broadcast();
+					fMutex->Unlock();
+					try {
+						fThread->EndThread();
+					} catch (...) { }
+					delete fThread;
+				} else {
+					// forked, the helper thread does not exist in the child,
+					// and its mutex might be left locked
+					fMutex = new CdThreadMutex;
+					fCond = new CdThreadCondition;
+				}
+				fThread = NULL;
+			}
+			fHead = fCount = 0;
+			fStop = fDone = false;
+			LastEnd = -1;
+		}
+
+		/// swap the window starting at Pos with Buf, return its end or -1
+		SIZE64 Take(SIZE64 Pos, C_UInt8 *&Buf)
+		{
+			if (!fThread || (fPID != GetCurrentProcessID()))
+				return -1;
+			SIZE64 rv = -1;
+			TdAutoMutex _m(fMutex);
+			while ((fCount <= 0) && !fDone)
+				fCond->Wait(*fMutex);
+			if (fCount > 0)
+			{
+				TWindow &W = fWin[fHead];
+				if ((W.Start == Pos) && (W.End > Pos))
+				{
+					std::swap(Buf, W.Buf);
+					rv = W.End;
+					fHead = (fHead + 1) % READ_AHEAD_NUM_WINDOW;
+					fCount --;
+					fCond->Broadcast();
+				}
+			}
+			return rv;
+		}
+
+	private:
+		struct TWindow
+		{
+			C_UInt8 *Buf;
+			SIZE64 Start, End;
+		};
+
+		CdStream *fStream;  ///< the stream read by the helper thread
+		ssize_t fSize;      ///< the size of each window
+		TWindow fWin[READ_AHEAD_NUM_WINDOW];  ///< a ring of windows
+		int fHead, fCount;  ///< the first filled window, and the count
+		SIZE64 fNext;       ///< the start of the next window to be read
+		bool fStop, fDone;
+		CdThread *fThread;
+		TProcessID fPID;
+		CdThreadMutex *fMutex;
+		CdThreadCondition *fCond;
+
+		static int _Proc(CdThread *Thread, CdBufReadAhead *Obj)
+		{
+			TdAutoMutex _m(Obj->fMutex);
+			while (!Obj->fStop)
+			{
+				if ((Obj->fCount >= READ_AHEAD_NUM_WINDOW) || Obj->fDone)
+				{
+					Obj->fCond->Wait(*Obj->fMutex);
+					continue;
+				}
+				// the slot is not visible to the main thread until counted
+				TWindow &W = Obj->fWin[(Obj->fHead + Obj->fCount) %
+					READ_AHEAD_NUM_WINDOW];
+				SIZE64 Pos = Obj->fNext;
+				ssize_t L = 0;
+				Obj->fMutex->Unlock();
+			#ifdef COREARRAY_POSIX_THREAD
+				ReadAhead_ForkMutex.Lock();
+				while (ReadAhead_Forking)
+					ReadAhead_ForkCond.Wait(ReadAhead_ForkMutex);
+				ReadAhead_NumReading ++;
+				ReadAhead_ForkMutex.Unlock();
+			#endif
+				try {
+					Obj->fStream->SetPosition(Pos);
+					L = Obj->fStream->Read(W.Buf, Obj->fSize);
+				} catch (...) {
+					// leave it to the synchronous read, which reports the error
+					L = -1;
+				}
+			#ifdef COREARRAY_POSIX_THREAD
+				ReadAhead_ForkMutex.Lock();
+				ReadAhead_NumReading --;
+				ReadAhead_ForkCond.Broadcast();
+				ReadAhead_ForkMutex.Unlock();
+			#endif
+				Obj->fMutex->Lock();
+				if (L > 0)
+				{
+					W.Start = Pos; W.End = Pos + L;
+					Obj->fNext = W.End;
+					Obj->fCount ++;
+				}
+				if (L < Obj->fSize) Obj->fDone = true;
+				Obj->fCond->Broadcast();
+			}
+			return 0;
+		}
+	};
+
+	/// The number of buffers queued for a background writer of CdBufStream
+	static const int WRITE_BEHIND_NUM_BUFFER = 4;
+
+	/// Write the flushed buffers of a CdBufStream on a helper thread
+	class COREARRAY_DLL_LOCAL CdBufWriteBehind
+	{
+	public:
+		CdBufWriteBehind(ssize_t Size)
+		{
+			fSize = 0;
+			memset((void*)fQueue, 0, sizeof(fQueue));
+			fHead = fCount = 0;
+			fStop = fFailed = false;
+			fThread = NULL;
+			Resize(Size);
+		}
+		~CdBufWriteBehind()
+		{
+			try {
+				Finish();
+			} catch (...) { }
+			for (int i=0; i < WRITE_BEHIND_NUM_BUFFER; i++)
+				if (fQueue[i].Buf) free((void*)fQueue[i].Buf);
+		}
+
+		void Resize(ssize_t Size)
+		{
+			Finish();
+			fSize = Size;
+			for (int i=0; i < WRITE_BEHIND_NUM_BUFFER; i++)
+			{
+				fQueue[i].Buf = (C_UInt8*)realloc((void*)fQueue[i].Buf, Size);
+				COREARRAY_ALLOCCHECK(fQueue[i].Buf);
+			}
+		}
+
+		/// queue a copy of Buf for writing at Start of vStream
+		void Push(CdStream *vStream, SIZE64 Start, const C_UInt8 *Buf,
+			ssize_t Len)
+		{
+			if (!fThread)
+			{
+				_CheckError();
+				fHead = fCount = 0;
+				fStop = false;
+				fThread = new CdThread;
+				try {
+					fThread->BeginThread(_Proc, this);
+				} catch (...) {
+					delete fThread;
+					fThread = NULL;
+					// write it on the calling thread
+					vStream->SetPosition(Start);
+					vStream->WriteData(Buf, Len);
+					return;
+				}
+			}
+
+			TdAutoMutex _m(&fMutex);
+			while ((fCount >= WRITE_BEHIND_NUM_BUFFER) && !fFailed)
+				fCond.Wait(fMutex);
+			if (fFailed)
+			{
+				_m.Reset(NULL);
+				Finish();
+			}
+			TItem &I = fQueue[(fHead + fCount) % WRITE_BEHIND_NUM_BUFFER];
+			memcpy(I.Buf, Buf, Len);
+			I.Stream = vStream; I.Start = Start; I.Len = Len;
+			fCount ++;
+			fCond.Broadcast();
+		}
+
+		/// wait until all queued buffers are written, and throw the error
+		/// of the background writer if any
+		void Finish()
+		{
+			if (fThread)
+			{
+				fMutex.Lock();
+				fStop = true;
+				fCond.Broadcast();
+				fMutex.Unlock();
+				try {
+					fThread->EndThread();
+				} catch (...) { }
+				delete fThread;
+				fThread = NULL;
+			}
+			_CheckError();
+		}
+
+	private:
+		struct TItem
+		{
+			C_UInt8 *Buf;
+			CdStream *Stream;
+			SIZE64 Start;
+			ssize_t Len;
+		};
+
+		ssize_t fSize;      ///< the size of each buffer
+		TItem fQueue[WRITE_BEHIND_NUM_BUFFER];  ///< a ring of queued buffers
+		int fHead, fCount;  ///< the first queued buffer, and the count
+		bool fStop, fFailed;
+		string fErrMsg;     ///< the error message of the background writer
+		CdThread *fThread;
+		CdThreadMutex fMutex;
+		CdThreadCondition fCond;
+
+		void _CheckError()
+		{
+			if (fFailed)
+			{
+				fFailed = false;
+				fHead = fCount = 0;
+				throw ErrStream(fErrMsg);
+			}
+		}
+
+		static int _Proc(CdThread *Thread, CdBufWriteBehind *Obj)
+		{
+			TdAutoMutex _m(&Obj->fMutex);
+			while (true)
+			{
+				if (Obj->fCount <= 0)
+				{
+					if (Obj->fStop) break;
+					Obj->fCond.Wait(Obj->fMutex);
+					continue;
+				}
+				// the buffer is not reused by the main thread until popped
+				TItem &I = Obj->fQueue[Obj->fHead];
+				Obj->fMutex.Unlock();
+				string Msg;
+				bool Failed = false;
+				if (!Obj->fFailed)
+				{
+					try {
+						I.Stream->SetPosition(I.Start);
+						I.Stream->WriteData(I.Buf, I.Len);
+					} catch (exception &E) {
+						Msg = E.what(); Failed = true;
+					} catch (...) {
+						Msg = "write-behind error"; Failed = true;
+					}
+				}
+				Obj->fMutex.Lock();
+				if (Failed)
+				{
+					// the remaining buffers are dropped
+					Obj->fErrMsg = Msg;
+					Obj->fFailed = true;
+				}
+				Obj->fHead = (Obj->fHead + 1) % WRITE_BEHIND_NUM_BUFFER;
+				Obj->fCount --;
+				Obj->fCond.Broadcast();
+			}
+			return 0;
+		}
+	};
+}
+
 CdBufStream::CdBufStream(CdStream *vStream, ssize_t vBufSize): CdRef()
 {
 	_Buffer = NULL;
 	_Position = _BufStart = _BufEnd = 0;
 	_BufWriteFlag = false;
+	_ReadAhead = NULL;
+	_WriteBehind = NULL;
 
 	_Stream = _BaseStream = vStream;
 	if (vStream)
@@ -526,12 +941,104 @@ CdBufStream::CdBufStream(CdStream *vStream, ssize_t vBufSize): CdRef()
 
 CdBufStream::~CdBufStream()
 {
-	ClearPipe();
-	FlushWrite();
+	_StopReadAhead();
+	// a write error is reported by FlushWrite() when the owner synchronizes
+	// or closes the stream, and a destructor must not throw
+	try {
+		ClearPipe();
+		FlushWrite();
+	} catch (...) { }
 	if (_Stream)
 		_Stream->Release();
 	if (_Buffer)
 		free((void*)_Buffer);
+	if (_ReadAhead)
+		delete _ReadAhead;
+	if (_WriteBehind)
+		delete _WriteBehind;
+}
+
+void CdBufStream::_LoadBuffer(SIZE64 Start)
+{
+	_SyncWriteBehind();
+	_BufStart = Start;
+	if (_ReadAhead)
+	{
+		CdBufReadAhead *RA = _ReadAhead;
+		if (RA->Running())
+		{
+			SIZE64 End = RA->Take(Start, _Buffer);
+			if (End >= 0)
+			{
+				// use the prefetched window
+				_BufEnd = RA->LastEnd = End;
+				return;
+			}
+		}
+		bool seq = (Start == RA->LastEnd);
+		RA->Stop();
+		_Stream->SetPosition(_BufStart);
+		_BufEnd = _BufStart + _Stream->Read(_Buffer, _BufSize);
+		// sequential access, prefetch the following windows unless at the end
+		if (seq && (_BufEnd - _BufStart >= _BufSize))
+			RA->Start(_Stream, _BufEnd);
+		RA->LastEnd = _BufEnd;
+	} else {
+		_Stream->SetPosition(_BufStart);
+		_BufEnd = _BufStart + _Stream->Read(_Buffer, _BufSize);
+	}
+}
+
+void CdBufStream::_StopReadAhead()
+{
+	if (_ReadAhead) _ReadAhead->Stop();
+}
+
+void CdBufStream::_SyncWriteBehind()
+{
+	if (_WriteBehind) _WriteBehind->Finish();
+}
+
+void CdBufStream::SetReadAhead(bool Enable)
+{
+	if (Enable)
+	{
+		if (!_ReadAhead)
+		{
+			if (_BufSize < STREAM_BUFFER_LARGE_SIZE)
+				SetBufSize(STREAM_BUFFER_LARGE_SIZE);
+			_ReadAhead = new CdBufReadAhead(_BufSize);
+		}
+	} else if (_ReadAhead)
+	{
+		delete _ReadAhead;
+		_ReadAhead = NULL;
+	}
+}
+
+void CdBufStream::SetWriteBehind(bool Enable)
+{
+	if (Enable)
+	{
+		if (!_WriteBehind)
+		{
+			if (_BufSize < STREAM_BUFFER_LARGE_SIZE)
+				SetBufSize(STREAM_BUFFER_LARGE_SIZE);
+			_WriteBehind = new CdBufWriteBehind(_BufSize);
+		}
+	} else if (_WriteBehind)
+	{
+		_WriteBehind->Finish();
+		delete _WriteBehind;
+		_WriteBehind = NULL;
+	}
+}
+
+CdStream *CdBufStream::Stream()
+{
+	_StopReadAhead();
+	_SyncWriteBehind();
+	return _Stream;
 }
 
 void CdBufStream::FlushBuffer()
@@ -541,8 +1048,14 @@ void CdBufStream::FlushBuffer()
 		_BufWriteFlag = false;
 		if (_BufEnd > _BufStart)
 		{
-			_Stream->SetPosition(_BufStart);
-			_Stream->WriteData(_Buffer, _BufEnd - _BufStart);
+			if (_WriteBehind)
+			{
+				_WriteBehind->Push(_Stream, _BufStart, _Buffer,
+					_BufEnd - _BufStart);
+			} else {
+				_Stream->SetPosition(_BufStart);
+				_Stream->WriteData(_Buffer, _BufEnd - _BufStart);
+			}
 		}
 		OnFlush.Notify(this);
 	}
@@ -550,6 +1063,8 @@ void CdBufStream::FlushBuffer()
 
 void CdBufStream::FlushWrite()
 {
+	// wait for the background writer, and report its error
+	_SyncWriteBehind();
 	if (_BufWriteFlag)
 	{
 		_BufWriteFlag = false;
@@ -567,19 +1082,38 @@ void CdBufStream::ReadData(void *Buf, ssize_t Count)
 {
 	if (Count > 0)
 	{
-		// Check in Range
-		if ((_Position<_BufStart) || (_Position>=_BufEnd))
+		C_UInt8 *p = (C_UInt8*)Buf;
+
+		// Copy what is already in the buffer
+		if ((_Position>=_BufStart) && (_Position<_BufEnd))
 		{
-			// Save to Buffer
-			FlushBuffer();
-			// Make it in range
-			_BufStart = (_Position >> BufStreamAlign) << BufStreamAlign;
-			_Stream->SetPosition(_BufStart);
-			_BufEnd = _BufStart + _Stream->Read(_Buffer, _BufSize);
+			ssize_t L = _BufEnd - _Position;
+			if (L > Count) L = Count;
+			memcpy(p, _Buffer + ssize_t(_Position - _BufStart), L);
+			_Position += L; p += L; Count -= L;
+			if (Count <= 0) return;
 		}
 
+		// Save to Buffer
+		FlushBuffer();
+
+		// A large block is read without the buffer
+		if ((Count >= _BufSize) && !_ReadAhead)
+		{
+			_SyncWriteBehind();
+			_Stream->SetPosition(_Position);
+			do {
+				ssize_t L = _Stream->Read(p, Count);
+				if (L <= 0) throw ErrStream(ERR_STREAM_READ);
+				_Position += L; p += L; Count -= L;
+			} while (Count > 0);
+			return;
+		}
+
+		// Make it in range
+		_LoadBuffer((_Position >> BufStreamAlign) << BufStreamAlign);
+
 		// Loop Copy
-		C_UInt8 *p = (C_UInt8*)Buf;
 		do {
 			ssize_t L = _BufEnd - _Position;
 			if (L <= 0) throw ErrStream(ERR_STREAM_READ);
@@ -587,12 +1121,7 @@ void CdBufStream::ReadData(void *Buf, ssize_t Count)
 			memcpy(p, _Buffer + ssize_t(_Position - _BufStart), L);
 			_Position += L; p += L; Count -= L;
 			if (Count > 0)
-			{
-				FlushBuffer();
-				_BufStart = _BufEnd;
-				_Stream->SetPosition(_BufStart);
-				_BufEnd = _BufStart + _Stream->Read(_Buffer, _BufSize);
-			}
+				_LoadBuffer(_BufEnd);
 		} while (Count > 0);
 	}
 }
@@ -605,9 +1134,7 @@ C_UInt8 CdBufStream::R8b()
 		// save to Buffer
 		FlushBuffer();
 		// make it in range
-		_BufStart = (_Position >> BufStreamAlign) << BufStreamAlign;
-		_Stream->SetPosition(_BufStart);
-		_BufEnd = _BufStart + _Stream->Read(_Buffer, _BufSize);
+		_LoadBuffer((_Position >> BufStreamAlign) << BufStreamAlign);
 		// check
 		if (_Position >= _BufEnd)
 			throw ErrStream(ERR_STREAM_READ);
@@ -643,6 +1170,7 @@ void CdBufStream::WriteData(const void *Buf, ssize_t Count)
 {
 	if (Count > 0)
 	{
+		_StopReadAhead();
 		// Check in Range
 		if ((_Position<_BufStart) || (_Position>_BufEnd))
 		{
@@ -696,6 +1224,7 @@ void CdBufStream::CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count)
 	if (Count < 0)
 		Count = Source.GetSize() - Pos;
 	FlushWrite();
+	_StopReadAhead();
 	_Stream->CopyFrom(Source, Pos, Count);
 	_Position += Count;
 }
@@ -718,6 +1247,7 @@ void CdBufStream::CopyFromBuf(CdBufStream &Source, SIZE64 Pos, SIZE64 Count)
 void CdBufStream::Truncate()
 {
     FlushWrite();
+	_StopReadAhead();
 	_Stream->SetSize(_Position);
 	_BufEnd = _BufStart = _Position = 0;
 }
@@ -726,6 +1256,7 @@ void CdBufStream::SetStream(CdStream *Value)
 {
 	if (_Stream != Value)
 	{
+		_StopReadAhead();
 		if (_Stream)
 		{
 			FlushWrite();
@@ -750,18 +1281,23 @@ void CdBufStream::SetBufSize(const ssize_t NewBufSize)
 		_BufSize = (NewBufSize >> BufStreamAlign) << BufStreamAlign;
 		_Buffer = (C_UInt8*)realloc((void*)_Buffer, _BufSize);
 		COREARRAY_ALLOCCHECK(_Buffer);
+		if (_ReadAhead) _ReadAhead->Resize(_BufSize);
+		if (_WriteBehind) _WriteBehind->Resize(_BufSize);
     }
 }
 
 SIZE64 CdBufStream::GetSize()
 {
 	FlushBuffer();
+	_StopReadAhead();
+	_SyncWriteBehind();
 	return _Stream->GetSize();
 }
 
 void CdBufStream::SetSize(SIZE64 Value)
 {
 	FlushWrite();
+	_StopReadAhead();
 	_Stream->SetSize(Value);
 	_BufEnd = _BufStart = _Position = 0;
 }
@@ -776,6 +1312,7 @@ void CdBufStream::PushPipe(CdStreamPipe *APipe)
 {
 	_PipeItems.push_back(APipe);
 	FlushWrite();
+	_StopReadAhead();
 	_Stream = APipe->InitPipe(this);
 	_Stream->AddRef();
 	_BufEnd = _BufStart = _Position = 0;
@@ -794,6 +1331,8 @@ void CdBufStream::PopPipe()
 		#endif
 			_PipeItems.pop_back();
 			FlushBuffer();
+			_StopReadAhead();
+			_SyncWriteBehind();
 			_Stream = FC->FreePipe();
 		}
 		_BufEnd = _BufStart = _Position = 0;
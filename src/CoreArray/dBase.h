@@ -570,6 +570,15 @@ namespace CoreArray
 		/// set or terminate the size of stream
 		virtual void SetSize(SIZE64 NewSize) = 0;
 
+		/// read block of data at Pos, the current position may be changed
+		virtual ssize_t ReadAt(SIZE64 Pos, void *Buffer, ssize_t Count);
+		/// write block of data at Pos, the current position may be changed
+		virtual ssize_t WriteAt(SIZE64 Pos, const void *Buffer, ssize_t Count);
+		/// reserve storage for [Pos, Pos+Count) if supported, false otherwise
+		virtual bool Preallocate(SIZE64 Pos, SIZE64 Count);
+		/// flush the written data to the storage device, false if unsupported
+		virtual bool Sync();
+
 		/// return the current position
 		SIZE64 Position();
 		/// reset the current position
@@ -632,6 +641,8 @@ namespace CoreArray
 	// CdBufStream
 
 	class COREARRAY_DLL_DEFAULT CdBufStream;
+	class COREARRAY_DLL_LOCAL CdBufReadAhead;
+	class COREARRAY_DLL_LOCAL CdBufWriteBehind;
 
 	/// The root class of stream pipe
 	class COREARRAY_DLL_DEFAULT CdStreamPipe: public CdAbstractItem
@@ -701,7 +712,9 @@ namespace CoreArray
 		COREARRAY_INLINE SIZE64 Position() { return _Position; }
 		COREARRAY_INLINE void SetPosition(const SIZE64 pos) { _Position = pos; }
 
-		COREARRAY_INLINE CdStream *Stream() const { return _Stream; }
+		/// the underlying stream, the read-ahead thread is stopped and
+		/// the write-behind thread is finished before returning
+		CdStream *Stream();
 		void SetStream(CdStream *Value);
 		COREARRAY_INLINE CdStream *BaseStream() const { return _BaseStream; }
 
@@ -710,6 +723,15 @@ namespace CoreArray
 		virtual SIZE64 GetSize();
 		virtual void SetSize(SIZE64 Value);
 
+		/// enable or disable prefetching the following windows on a helper thread
+		void SetReadAhead(bool Enable);
+		/// whether the background read-ahead is enabled
+		COREARRAY_INLINE bool ReadAhead() const { return _ReadAhead!=NULL; }
+		/// enable or disable writing the flushed buffers on a helper thread
+		void SetWriteBehind(bool Enable);
+		/// whether the background write-behind is enabled
+		COREARRAY_INLINE bool WriteBehind() const { return _WriteBehind!=NULL; }
+
 		TdOnNotify<CdBufStream> OnFlush;
 
 	protected:
@@ -721,6 +743,13 @@ namespace CoreArray
 		C_UInt8 *_Buffer;
 		bool _BufWriteFlag;
 		std::vector<CdStreamPipe*> _PipeItems;
+		CdBufReadAhead *_ReadAhead;
+		CdBufWriteBehind *_WriteBehind;
+
+	private:
+		void _LoadBuffer(SIZE64 Start);
+		void _StopReadAhead();
+		void _SyncWriteBehind();
 	};
 
 
@@ -318,6 +318,381 @@ COREARRAY_DLL_DEFAULT C_Int32 CoreArray::BitSet_IfSigned(C_Int32 val,
 }
 
 
+// =====================================================================
+// SIMD kernels of 2-bit integers
+// =====================================================================
+
+#ifdef COREARRAY_SIMD_SSE2
+
+#if defined(COREARRAY_SIMD_AVX2) || defined(COREARRAY_TARGET_DISPATCH)
+
+COREARRAY_TARGET("avx2")
+static size_t BIT2_Decode_UInt8_AVX2(const C_UInt8 *s, size_t n_byte,
+	C_UInt8 *p)
+{
+	const __m256i REP_x03 = _mm256_set1_epi8(0x03);
+	const size_t n = n_byte;
+	for (; n_byte >= 32; n_byte-=32)
+	{
+		__m256i v = _mm256_loadu_si256((__m256i const*)s); s += 32;
+		if (_mm256_testz_si256(v, v))
+		{
+			__m256i zero = _mm256_setzero_si256();
+			_mm256_storeu_si256((__m256i*)p, zero); p += 32;
+			_mm256_storeu_si256((__m256i*)p, zero); p += 32;
+			_mm256_storeu_si256((__m256i*)p, zero); p += 32;
+			_mm256_storeu_si256((__m256i*)p, zero); p += 32;
+		} else {
+			__m256i v1 = v & REP_x03;
+			__m256i v2 = _mm256_srli_epi32(v, 2) & REP_x03;
+			__m256i v3 = _mm256_srli_epi32(v, 4) & REP_x03;
+			__m256i v4 = _mm256_srli_epi32(v, 6) & REP_x03;
+
+			__m256i w1 = _mm256_unpacklo_epi8(v1, v2);
+			__m256i w2 = _mm256_unpacklo_epi8(v3, v4);
+			__m256i x1 = _mm256_unpacklo_epi16(w1, w2);
+			__m256i x2 = _mm256_unpackhi_epi16(w1, w2);
+
+			_mm256_storeu_si256((__m256i*)p,
+				_mm256_permute2x128_si256(x1, x2, 0x20));
+			_mm256_storeu_si256((__m256i*)(p + 64),
+				_mm256_permute2x128_si256(x1, x2, 0x31));
+
+			__m256i w3 = _mm256_unpackhi_epi8(v1, v2);
+			__m256i w4 = _mm256_unpackhi_epi8(v3, v4);
+			__m256i x3 = _mm256_unpacklo_epi16(w3, w4);
+			__m256i x4 = _mm256_unpackhi_epi16(w3, w4);
+
+			_mm256_storeu_si256((__m256i*)(p + 32),
+				_mm256_permute2x128_si256(x3, x4, 0x20));
+			_mm256_storeu_si256((__m256i*)(p + 96),
+				_mm256_permute2x128_si256(x3, x4, 0x31));
+			p += 128;
+		}
+	}
+	return n - n_byte;
+}
+
+COREARRAY_TARGET("avx2,popcnt")
+static size_t BIT2_Decode2_UInt8_AVX2(const C_UInt8 *s, size_t n_byte,
+	C_UInt8 *&p, const C_BOOL sel[], size_t &zero_len)
+{
+	const __m256i REP_x03 = _mm256_set1_epi8(0x03);
+	const size_t n = n_byte;
+	for (; n_byte >= 8; n_byte -= 8)
+	{
+		__m256i sv = _mm256_loadu_si256((__m256i const*)sel);
+		sv = _mm256_cmpeq_epi8(sv, _mm256_setzero_si256());
+		sel += 32;
+		C_UInt64 vv = *((const C_UInt64*)s);
+		s += 8;
+		if (vv == 0)
+		{
+			zero_len += 32 - _mm_popcnt_u32(_mm256_movemask_epi8(sv));
+		} else {
+			int sv32 = _mm256_movemask_epi8(sv);
+			if (sv32 == 0)  // all selected
+			{
+				WRITE_BIT2_ZERO_FILL(zero_len)
+				__m256i v = _mm256_set1_epi64x(vv);
+				__m256i v1 = v & REP_x03;
+				__m256i v2 = _mm256_srli_epi64(v, 2) & REP_x03;
+				__m256i v3 = _mm256_srli_epi64(v, 4) & REP_x03;
+				__m256i v4 = _mm256_srli_epi64(v, 6) & REP_x03;
+				__m256i w1 = _mm256_unpacklo_epi8(v1, v2);
+				__m256i w2 = _mm256_unpacklo_epi8(v3, v4);
+				__m256i wl = _mm256_unpacklo_epi16(w1, w2);
+				__m256i wh = _mm256_unpackhi_epi16(w1, w2);
+				__m256i w  = _mm256_permute2f128_si256(wl, wh, 0x20);
+				_mm256_storeu_si256((__m256i*)p, w);
+				p += 32;
+			} else if (sv32 != -1)  // at least one selected
+			{
+				// low 16 bits
+				int sv32_low = sv32 & 0xFFFF;
+				if (sv32_low == 0)  // all selected
+				{
+					WRITE_BIT2_ZERO_FILL(zero_len)
+					WRITE_BIT2_DECODE_B4_UINT8_RAW(vv)
+					p += 16;
+				} else if (sv32_low != 0xFFFF)  // at least one selected
+				{
+					WRITE_BIT2_ZERO_FILL(zero_len)
+					C_UInt32 vvv = vv;
+					WRITE_BIT2_SEL_DECODE_B4_PACKED(vvv, sv32_low)
+				}
+				// high 16 bits
+				int sv32_high = C_UInt32(sv32) >> 16;
+				if (sv32_high == 0)  // all selected
+				{
+					WRITE_BIT2_ZERO_FILL(zero_len)
+					WRITE_BIT2_DECODE_B4_UINT8_RAW(vv >> 32)
+					p += 16;
+				} else if (sv32_high != 0xFFFF)  // at least one selected
+				{
+					WRITE_BIT2_ZERO_FILL(zero_len)
+					C_UInt32 vvv = vv >> 32;
+					WRITE_BIT2_SEL_DECODE_B4_PACKED(vvv, sv32_high)
+				}
+			}
+		}
+	}
+	return n - n_byte;
+}
+
+COREARRAY_TARGET("avx2")
+static size_t BIT2_Encode_UInt8_AVX2(const C_UInt8 *s, C_UInt8 *p,
+	size_t n_byte)
+{
+	const size_t n = n_byte;
+	for (; n_byte >= 8; n_byte-=8)
+	{
+		__m256i v = _mm256_loadu_si256((__m256i const*)s);
+		s += 32;
+		__m256i w1 = _mm256_slli_epi32(v, 7);
+		__m256i w2 = _mm256_slli_epi32(v, 6);
+		__m256i x1 = _mm256_unpacklo_epi8(w1, w2);
+		__m256i x2 = _mm256_unpackhi_epi8(w1, w2);
+		C_UInt32 r1 = _mm256_movemask_epi8(_mm256_permute2x128_si256(x1, x2, 0x20));
+		C_UInt32 r2 = _mm256_movemask_epi8(_mm256_permute2x128_si256(x1, x2, 0x31));
+		*((C_UInt64*)p) = r1 | (C_UInt64(r2) << 32);
+		p += 8;
+	}
+	return n - n_byte;
+}
+
+COREARRAY_TARGET("avx2")
+static size_t BIT2_Decode_Int32_AVX2(const C_UInt8 *s, size_t n_byte,
+	C_Int32 *p)
+{
+	const __m256i UInt32_x03 = _mm256_set1_epi32(0x03);
+	const __m256i UInt64_SHR = _mm256_set_epi64x(0, 32, 0, 0);
+	const size_t n = n_byte;
+	for (; n_byte >= 8; n_byte-=8)
+	{
+		__m256i v = _mm256_set1_epi64x(*((const C_Int64*)s));
+		v = _mm256_srlv_epi64(v, UInt64_SHR);
+		s += 8;
+		const __m256i zero = _mm256_setzero_si256();
+		v = _mm256_unpacklo_epi16(_mm256_unpacklo_epi8(v, zero), zero);
+
+		__m256i v1 = v & UInt32_x03;
+		__m256i v2 = _mm256_srli_epi32(v, 2) & UInt32_x03;
+		__m256i v3 = _mm256_srli_epi32(v, 4) & UInt32_x03;
+		__m256i v4 = _mm256_srli_epi32(v, 6);
+
+		__m256i w1 = _mm256_unpacklo_epi32(v1, v2);
+		__m256i w2 = _mm256_unpacklo_epi32(v3, v4);
+		__m256i x1 = _mm256_unpacklo_epi64(w1, w2);
+		__m256i x2 = _mm256_unpackhi_epi64(w1, w2);
+		_mm256_storeu_si256((__m256i*)p, _mm256_permute2x128_si256(x1, x2, 0x20));
+		_mm256_storeu_si256((__m256i*)(p+16), _mm256_permute2x128_si256(x1, x2, 0x31));
+
+		w1 = _mm256_unpackhi_epi32(v1, v2);
+		w2 = _mm256_unpackhi_epi32(v3, v4);
+		x1 = _mm256_unpacklo_epi64(w1, w2);
+		x2 = _mm256_unpackhi_epi64(w1, w2);
+		_mm256_storeu_si256((__m256i*)(p+8), _mm256_permute2x128_si256(x1, x2, 0x20));
+		_mm256_storeu_si256((__m256i*)(p+24), _mm256_permute2x128_si256(x1, x2, 0x31));
+		p += 32;
+	}
+	return n - n_byte;
+}
+
+COREARRAY_TARGET("avx2,popcnt")
+static size_t BIT2_Decode2_Int32_AVX2(const C_UInt8 *s, size_t n_byte,
+	C_Int32 *&p, const C_BOOL sel[], size_t &zero_len)
+{
+	const __m256i UInt32_x03 = _mm256_set1_epi32(0x03);
+	const __m256i UInt64_SHR = _mm256_set_epi64x(0, 32, 0, 0);
+	const size_t n = n_byte;
+	const __m256i zero = _mm256_setzero_si256();
+	for (; n_byte >= 8; n_byte -= 8)
+	{
+		__m256i sv = _mm256_loadu_si256((__m256i const*)sel);
+		sv = _mm256_cmpeq_epi8(sv, zero);
+		sel += 32;
+		C_UInt64 vv = *((const C_UInt64*)s);
+		s += 8;
+		if (vv == 0)
+		{
+			zero_len += 32 - _mm_popcnt_u32(_mm256_movemask_epi8(sv));
+		} else {
+			int sv32 = _mm256_movemask_epi8(sv);
+			if (sv32 == 0)  // all selected
+			{
+				WRITE_BIT2_ZERO_FILL(zero_len << 2)
+
+				__m256i v = _mm256_set1_epi64x(vv);
+				v = _mm256_srlv_epi64(v, UInt64_SHR);
+				v = _mm256_unpacklo_epi16(_mm256_unpacklo_epi8(v, zero), zero);
+
+				__m256i v1 = v & UInt32_x03;
+				__m256i v2 = _mm256_srli_epi32(v, 2) & UInt32_x03;
+				__m256i v3 = _mm256_srli_epi32(v, 4) & UInt32_x03;
+				__m256i v4 = _mm256_srli_epi32(v, 6);
+
+				__m256i w1 = _mm256_unpacklo_epi32(v1, v2);
+				__m256i w2 = _mm256_unpacklo_epi32(v3, v4);
+				__m256i x1 = _mm256_unpacklo_epi64(w1, w2);
+				__m256i x2 = _mm256_unpackhi_epi64(w1, w2);
+				_mm256_storeu_si256((__m256i*)p, _mm256_permute2x128_si256(x1, x2, 0x20));
+				_mm256_storeu_si256((__m256i*)(p+16), _mm256_permute2x128_si256(x1, x2, 0x31));
+
+				w1 = _mm256_unpackhi_epi32(v1, v2);
+				w2 = _mm256_unpackhi_epi32(v3, v4);
+				x1 = _mm256_unpacklo_epi64(w1, w2);
+				x2 = _mm256_unpackhi_epi64(w1, w2);
+				_mm256_storeu_si256((__m256i*)(p+8), _mm256_permute2x128_si256(x1, x2, 0x20));
+				_mm256_storeu_si256((__m256i*)(p+24), _mm256_permute2x128_si256(x1, x2, 0x31));
+
+				p += 32;
+			} else if (sv32 != -1)  // at least one selected
+			{
+				// low 16 bits
+				int sv32_low = sv32 & 0xFFFF;
+				if (sv32_low == 0)  // all selected
+				{
+					WRITE_BIT2_ZERO_FILL(zero_len << 2)
+					WRITE_BIT2_DECODE_B4_INT32_RAW(vv)
+					p += 16;
+				} else if (sv32_low != 0xFFFF)  // at least one selected
+				{
+					WRITE_BIT2_ZERO_FILL(zero_len << 2)
+					C_UInt32 vvv = vv;
+					WRITE_BIT2_SEL_DECODE_B4_PACKED(vvv, sv32_low)
+				}
+				// high 16 bits
+				int sv32_high = C_UInt32(sv32) >> 16;
+				if (sv32_high == 0)  // all selected
+				{
+					WRITE_BIT2_ZERO_FILL(zero_len << 2)
+					WRITE_BIT2_DECODE_B4_INT32_RAW(vv >> 32)
+					p += 16;
+				} else if (sv32_high != 0xFFFF)  // at least one selected
+				{
+					WRITE_BIT2_ZERO_FILL(zero_len << 2)
+					C_UInt32 vvv = vv >> 32;
+					WRITE_BIT2_SEL_DECODE_B4_PACKED(vvv, sv32_high)
+				}
+			}
+		}
+	}
+	return n - n_byte;
+}
+
+#endif
+
+
+#if defined(COREARRAY_TARGET_DISPATCH) || defined(__AVX512F__)
+
+// the zero-masking forms with all lanes selected, since the plain
+//   intrinsics pass an undefined source to the masked builtins, which
+//   triggers -Wmaybe-uninitialized in GCC
+#define BIT2_AVX512_SLLI(v, n)    _mm512_maskz_slli_epi32(0xFFFF, v, n)
+#define BIT2_AVX512_CVT(v)        _mm512_maskz_cvtepu8_epi32(0xFFFF, v)
+#define BIT2_AVX512_EXTRACT(v, i)    _mm512_maskz_extracti32x4_epi32(0x0F, v, i)
+
+/// the four 2-bit values of each byte in v to the bytes of a 32-bit integer
+#define BIT2_AVX512_EXPAND(v)    \
+	_mm512_and_si512(_mm512_or_si512( \
+		_mm512_or_si512(v, BIT2_AVX512_SLLI(v, 6)), \
+		_mm512_or_si512(BIT2_AVX512_SLLI(v, 12), BIT2_AVX512_SLLI(v, 18))), \
+		_mm512_set1_epi32(0x03030303))
+
+COREARRAY_TARGET("avx512f")
+static size_t BIT2_Decode_UInt8_AVX512(const C_UInt8 *s, size_t n_byte,
+	C_UInt8 *p)
+{
+	const size_t n = n_byte;
+	for (; n_byte >= 16; n_byte-=16)
+	{
+		__m512i v = BIT2_AVX512_CVT(_mm_loadu_si128((__m128i const*)s));
+		s += 16;
+		_mm512_storeu_si512((void*)p, BIT2_AVX512_EXPAND(v));
+		p += 64;
+	}
+	return n - n_byte;
+}
+
+COREARRAY_TARGET("avx512f")
+static size_t BIT2_Decode_Int32_AVX512(const C_UInt8 *s, size_t n_byte,
+	C_Int32 *p)
+{
+	const size_t n = n_byte;
+	for (; n_byte >= 16; n_byte-=16)
+	{
+		__m512i v = BIT2_AVX512_CVT(_mm_loadu_si128((__m128i const*)s));
+		s += 16;
+		v = BIT2_AVX512_EXPAND(v);
+		_mm512_storeu_si512((void*)p,
+			BIT2_AVX512_CVT(BIT2_AVX512_EXTRACT(v, 0)));
+		_mm512_storeu_si512((void*)(p + 16),
+			BIT2_AVX512_CVT(BIT2_AVX512_EXTRACT(v, 1)));
+		_mm512_storeu_si512((void*)(p + 32),
+			BIT2_AVX512_CVT(BIT2_AVX512_EXTRACT(v, 2)));
+		_mm512_storeu_si512((void*)(p + 48),
+			BIT2_AVX512_CVT(BIT2_AVX512_EXTRACT(v, 3)));
+		p += 64;
+	}
+	return n - n_byte;
+}
+
+#undef BIT2_AVX512_EXPAND
+#undef BIT2_AVX512_SLLI
+#undef BIT2_AVX512_CVT
+#undef BIT2_AVX512_EXTRACT
+
+#endif
+
+
+/// select the kernels by the CPU features
+static TdBit2Kernel BIT2_SelectKernel()
+{
+	TdBit2Kernel K;
+	memset((void*)&K, 0, sizeof(K));
+	C_UInt32 Flag = Mach::GetCPU_Features();
+	(void)Flag;  // unused without the wider kernels
+	const char *Decode = "SSE2", *Other = "SSE2";
+
+#if defined(COREARRAY_SIMD_AVX2) || defined(COREARRAY_TARGET_DISPATCH)
+#   ifdef COREARRAY_SIMD_AVX2
+	Flag |= Mach::cpuAVX | Mach::cpuAVX2 | Mach::cpuPOPCNT;
+#   endif
+	if ((Flag & Mach::cpuAVX2) && (Flag & Mach::cpuPOPCNT))
+	{
+		K.Decode_UInt8  = BIT2_Decode_UInt8_AVX2;
+		K.Decode2_UInt8 = BIT2_Decode2_UInt8_AVX2;
+		K.Encode_UInt8  = BIT2_Encode_UInt8_AVX2;
+		K.Decode_Int32  = BIT2_Decode_Int32_AVX2;
+		K.Decode2_Int32 = BIT2_Decode2_Int32_AVX2;
+		Decode = Other = "AVX2";
+	}
+#endif
+
+#if defined(COREARRAY_TARGET_DISPATCH) || defined(__AVX512F__)
+#   ifdef __AVX512F__
+	Flag |= Mach::cpuAVX512F;
+#   endif
+	if (Flag & Mach::cpuAVX512F)
+	{
+		K.Decode_UInt8 = BIT2_Decode_UInt8_AVX512;
+		K.Decode_Int32 = BIT2_Decode_Int32_AVX512;
+		Decode = "AVX512F";
+	}
+#endif
+
+	Mach::SetSIMD_Kernel("bit2.decode", Decode);
+	Mach::SetSIMD_Kernel("bit2.decode.select", Other);
+	Mach::SetSIMD_Kernel("bit2.encode", Other);
+	return K;
+}
+
+TdBit2Kernel CoreArray::dBit2Kernel = BIT2_SelectKernel();
+
+#endif
+
+
 namespace CoreArray
 {
 	template<typename TClass> static CdObjRef *OnObjCreate()
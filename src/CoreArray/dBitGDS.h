@@ -47,7 +47,7 @@
 #ifdef COREARRAY_SIMD_SSE2
 #   include <emmintrin.h>
 #endif
-#ifdef COREARRAY_SIMD_AVX
+#if defined(COREARRAY_SIMD_AVX) || defined(COREARRAY_TARGET_DISPATCH)
 #   include <immintrin.h>
 #endif
 
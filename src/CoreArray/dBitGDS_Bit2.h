@@ -166,11 +166,6 @@ namespace CoreArray
 	static const __m128i BIT2_UInt16_x03 = _mm_set1_epi16(0x03);
 	static const __m128i BIT2_UInt32_x03 = _mm_set1_epi32(0x03);
 
-#ifdef COREARRAY_SIMD_AVX2
-	static const __m256i BIT2_AVX_REP_x03 = _mm256_set1_epi8(0x03);
-	static const __m256i BIT2_AVX_UInt32_x03 = _mm256_set1_epi32(0x03);
-	static const __m256i BIT2_AVX_UInt64_SHR = _mm256_set_epi64x(0, 32, 0, 0);
-#endif
 
 	#define WRITE_BIT2_DECODE_B4_UINT8_RAW(val)    \
 		{ \
@@ -238,50 +233,33 @@ namespace CoreArray
 		}
 
 
+	/// The SIMD kernels of 2-bit integers selected by the CPU features at run
+	/// time, NULL if SSE2 is used; a kernel converts the leading part of the
+	/// packed bytes, and returns the number of packed bytes processed
+	struct COREARRAY_DLL_DEFAULT TdBit2Kernel
+	{
+		size_t (*Decode_UInt8)(const C_UInt8 *s, size_t n_byte, C_UInt8 *p);
+		size_t (*Decode2_UInt8)(const C_UInt8 *s, size_t n_byte, C_UInt8 *&p,
+			const C_BOOL sel[], size_t &zero_len);
+		size_t (*Encode_UInt8)(const C_UInt8 *s, C_UInt8 *p, size_t n_byte);
+		size_t (*Decode_Int32)(const C_UInt8 *s, size_t n_byte, C_Int32 *p);
+		size_t (*Decode2_Int32)(const C_UInt8 *s, size_t n_byte, C_Int32 *&p,
+			const C_BOOL sel[], size_t &zero_len);
+	};
+
+	/// the SIMD kernels of 2-bit integers
+	extern TdBit2Kernel dBit2Kernel;
+
+
 	template<> struct COREARRAY_DLL_LOCAL BIT2_CONV<C_UInt8>
 	{
 		inline static C_UInt8* Decode(const C_UInt8 *s, size_t n_byte, C_UInt8 *p)
 		{
-		#ifdef COREARRAY_SIMD_AVX2
-			for (; n_byte >= 32; n_byte-=32)
+			if (dBit2Kernel.Decode_UInt8)
 			{
-				__m256i v = _mm256_loadu_si256((__m256i const*)s); s += 32;
-				if (_mm256_testz_si256(v, v))
-				{
-					__m256i zero = _mm256_setzero_si256();
-					_mm256_storeu_si256((__m256i*)p, zero); p += 32;
-					_mm256_storeu_si256((__m256i*)p, zero); p += 32;
-					_mm256_storeu_si256((__m256i*)p, zero); p += 32;
-					_mm256_storeu_si256((__m256i*)p, zero); p += 32;
-				} else {
-					__m256i v1 = v & BIT2_AVX_REP_x03;
-					__m256i v2 = _mm256_srli_epi32(v, 2) & BIT2_AVX_REP_x03;
-					__m256i v3 = _mm256_srli_epi32(v, 4) & BIT2_AVX_REP_x03;
-					__m256i v4 = _mm256_srli_epi32(v, 6) & BIT2_AVX_REP_x03;
-
-					__m256i w1 = _mm256_unpacklo_epi8(v1, v2);
-					__m256i w2 = _mm256_unpacklo_epi8(v3, v4);
-					__m256i x1 = _mm256_unpacklo_epi16(w1, w2);
-					__m256i x2 = _mm256_unpackhi_epi16(w1, w2);
-
-					_mm256_storeu_si256((__m256i*)p,
-						_mm256_permute2x128_si256(x1, x2, 0x20));
-					_mm256_storeu_si256((__m256i*)(p + 64),
-						_mm256_permute2x128_si256(x1, x2, 0x31));
-
-					__m256i w3 = _mm256_unpackhi_epi8(v1, v2);
-					__m256i w4 = _mm256_unpackhi_epi8(v3, v4);
-					__m256i x3 = _mm256_unpacklo_epi16(w3, w4);
-					__m256i x4 = _mm256_unpackhi_epi16(w3, w4);
-
-					_mm256_storeu_si256((__m256i*)(p + 32),
-						_mm256_permute2x128_si256(x3, x4, 0x20));
-					_mm256_storeu_si256((__m256i*)(p + 96),
-						_mm256_permute2x128_si256(x3, x4, 0x31));
-					p += 128;
-				}
+				size_t m = dBit2Kernel.Decode_UInt8(s, n_byte, p);
+				s += m; n_byte -= m; p += m << 2;
 			}
-		#endif
 			for (; n_byte >= 16; n_byte-=16)
 			{
 				__m128i v = _mm_loadu_si128((__m128i const*)s);
@@ -328,66 +306,11 @@ namespace CoreArray
 		{
 			size_t zero_len = 0;
 
-		#ifdef COREARRAY_SIMD_AVX2
-			for (; n_byte >= 8; n_byte -= 8)
+			if (dBit2Kernel.Decode2_UInt8)
 			{
-				__m256i sv = _mm256_loadu_si256((__m256i const*)sel);
-				sv = _mm256_cmpeq_epi8(sv, _mm256_setzero_si256());
-				sel += 32;
-				C_UInt64 vv = *((const C_UInt64*)s);
-				s += 8;
-				if (vv == 0)
-				{
-					zero_len += 32 - _mm_popcnt_u32(_mm256_movemask_epi8(sv));
-				} else {
-					int sv32 = _mm256_movemask_epi8(sv);
-					if (sv32 == 0)  // all selected
-					{
-						WRITE_BIT2_ZERO_FILL(zero_len)
-						__m256i v = _mm256_set1_epi64x(vv);
-						__m256i v1 = v & BIT2_AVX_REP_x03;
-						__m256i v2 = _mm256_srli_epi64(v, 2) & BIT2_AVX_REP_x03;
-						__m256i v3 = _mm256_srli_epi64(v, 4) & BIT2_AVX_REP_x03;
-						__m256i v4 = _mm256_srli_epi64(v, 6) & BIT2_AVX_REP_x03;
-						__m256i w1 = _mm256_unpacklo_epi8(v1, v2);
-						__m256i w2 = _mm256_unpacklo_epi8(v3, v4);
-						__m256i wl = _mm256_unpacklo_epi16(w1, w2);
-						__m256i wh = _mm256_unpackhi_epi16(w1, w2);
-						__m256i w  = _mm256_permute2f128_si256(wl, wh, 0x20);
-						_mm256_storeu_si256((__m256i*)p, w);
-						p += 32;
-					} else if (sv32 != -1)  // at least one selected
-					{
-						// low 16 bits
-						int sv32_low = sv32 & 0xFFFF;
-						if (sv32_low == 0)  // all selected
-						{
-							WRITE_BIT2_ZERO_FILL(zero_len)
-							WRITE_BIT2_DECODE_B4_UINT8_RAW(vv)
-							p += 16;
-						} else if (sv32_low != 0xFFFF)  // at least one selected
-						{
-							WRITE_BIT2_ZERO_FILL(zero_len)
-							C_UInt32 vvv = vv;
-							WRITE_BIT2_SEL_DECODE_B4_PACKED(vvv, sv32_low)
-						}
-						// high 16 bits
-						int sv32_high = C_UInt32(sv32) >> 16;
-						if (sv32_high == 0)  // all selected
-						{
-							WRITE_BIT2_ZERO_FILL(zero_len)
-							WRITE_BIT2_DECODE_B4_UINT8_RAW(vv >> 32)
-							p += 16;
-						} else if (sv32_high != 0xFFFF)  // at least one selected
-						{
-							WRITE_BIT2_ZERO_FILL(zero_len)
-							C_UInt32 vvv = vv >> 32;
-							WRITE_BIT2_SEL_DECODE_B4_PACKED(vvv, sv32_high)
-						}
-					}
-				}
+				size_t m = dBit2Kernel.Decode2_UInt8(s, n_byte, p, sel, zero_len);
+				s += m; n_byte -= m; sel += m << 2;
 			}
-		#endif
 			for (; n_byte >= 4; n_byte -= 4)
 			{
 				__m128i sv = _mm_loadu_si128((__m128i const*)sel);
@@ -429,21 +352,11 @@ namespace CoreArray
 		inline static const C_UInt8 *Encode(const C_UInt8 *s, C_UInt8 *p,
 			size_t n_byte)
 		{
-		#ifdef COREARRAY_SIMD_AVX2
-			for (; n_byte >= 8; n_byte-=8)
+			if (dBit2Kernel.Encode_UInt8)
 			{
-				__m256i v = _mm256_loadu_si256((__m256i const*)s);
-				s += 32;
-				__m256i w1 = _mm256_slli_epi32(v, 7);
-				__m256i w2 = _mm256_slli_epi32(v, 6);
-				__m256i x1 = _mm256_unpacklo_epi8(w1, w2);
-				__m256i x2 = _mm256_unpackhi_epi8(w1, w2);
-				C_UInt32 r1 = _mm256_movemask_epi8(_mm256_permute2x128_si256(x1, x2, 0x20));
-				C_UInt32 r2 = _mm256_movemask_epi8(_mm256_permute2x128_si256(x1, x2, 0x31));
-				*((C_UInt64*)p) = r1 | (C_UInt64(r2) << 32);
-				p += 8;
+				size_t m = dBit2Kernel.Encode_UInt8(s, p, n_byte);
+				s += m << 2; n_byte -= m; p += m;
 			}
-		#endif
 			for (; n_byte >= 4; n_byte-=4)
 			{
 				__m128i v = _mm_loadu_si128((__m128i const*)s);
@@ -540,36 +453,11 @@ namespace CoreArray
 	{
 		inline static C_Int32* Decode(const C_UInt8 *s, size_t n_byte, C_Int32 *p)
 		{
-		#ifdef COREARRAY_SIMD_AVX2
-			for (; n_byte >= 8; n_byte-=8)
+			if (dBit2Kernel.Decode_Int32)
 			{
-				__m256i v = _mm256_set1_epi64x(*((const C_Int64*)s));
-				v = _mm256_srlv_epi64(v, BIT2_AVX_UInt64_SHR);
-				s += 8;
-				const __m256i zero = _mm256_setzero_si256();
-				v = _mm256_unpacklo_epi16(_mm256_unpacklo_epi8(v, zero), zero);
-
-				__m256i v1 = v & BIT2_AVX_UInt32_x03;
-				__m256i v2 = _mm256_srli_epi32(v, 2) & BIT2_AVX_UInt32_x03;
-				__m256i v3 = _mm256_srli_epi32(v, 4) & BIT2_AVX_UInt32_x03;
-				__m256i v4 = _mm256_srli_epi32(v, 6);
-
-				__m256i w1 = _mm256_unpacklo_epi32(v1, v2);
-				__m256i w2 = _mm256_unpacklo_epi32(v3, v4);
-				__m256i x1 = _mm256_unpacklo_epi64(w1, w2);
-				__m256i x2 = _mm256_unpackhi_epi64(w1, w2);
-				_mm256_storeu_si256((__m256i*)p, _mm256_permute2x128_si256(x1, x2, 0x20));
-				_mm256_storeu_si256((__m256i*)(p+16), _mm256_permute2x128_si256(x1, x2, 0x31));
-
-				w1 = _mm256_unpackhi_epi32(v1, v2);
-				w2 = _mm256_unpackhi_epi32(v3, v4);
-				x1 = _mm256_unpacklo_epi64(w1, w2);
-				x2 = _mm256_unpackhi_epi64(w1, w2);
-				_mm256_storeu_si256((__m256i*)(p+8), _mm256_permute2x128_si256(x1, x2, 0x20));
-				_mm256_storeu_si256((__m256i*)(p+24), _mm256_permute2x128_si256(x1, x2, 0x31));
-				p += 32;
+				size_t m = dBit2Kernel.Decode_Int32(s, n_byte, p);
+				s += m; n_byte -= m; p += m << 2;
 			}
-		#endif
 			for (; n_byte >= 4; n_byte-=4)
 			{
 				WRITE_BIT2_DECODE_B4_INT32(*((const C_UInt32*)s));
@@ -584,80 +472,11 @@ namespace CoreArray
 		{
 			size_t zero_len = 0;
 
-		#ifdef COREARRAY_SIMD_AVX2
-			const __m256i zero = _mm256_setzero_si256();
-			for (; n_byte >= 8; n_byte -= 8)
+			if (dBit2Kernel.Decode2_Int32)
 			{
-				__m256i sv = _mm256_loadu_si256((__m256i const*)sel);
-				sv = _mm256_cmpeq_epi8(sv, zero);
-				sel += 32;
-				C_UInt64 vv = *((const C_UInt64*)s);
-				s += 8;
-				if (vv == 0)
-				{
-					zero_len += 32 - _mm_popcnt_u32(_mm256_movemask_epi8(sv));
-				} else {
-					int sv32 = _mm256_movemask_epi8(sv);
-					if (sv32 == 0)  // all selected
-					{
-						WRITE_BIT2_ZERO_FILL(zero_len << 2)
-
-						__m256i v = _mm256_set1_epi64x(vv);
-						v = _mm256_srlv_epi64(v, BIT2_AVX_UInt64_SHR);
-						v = _mm256_unpacklo_epi16(_mm256_unpacklo_epi8(v, zero), zero);
-
-						__m256i v1 = v & BIT2_AVX_UInt32_x03;
-						__m256i v2 = _mm256_srli_epi32(v, 2) & BIT2_AVX_UInt32_x03;
-						__m256i v3 = _mm256_srli_epi32(v, 4) & BIT2_AVX_UInt32_x03;
-						__m256i v4 = _mm256_srli_epi32(v, 6);
-
-						__m256i w1 = _mm256_unpacklo_epi32(v1, v2);
-						__m256i w2 = _mm256_unpacklo_epi32(v3, v4);
-						__m256i x1 = _mm256_unpacklo_epi64(w1, w2);
-						__m256i x2 = _mm256_unpackhi_epi64(w1, w2);
-						_mm256_storeu_si256((__m256i*)p, _mm256_permute2x128_si256(x1, x2, 0x20));
-						_mm256_storeu_si256((__m256i*)(p+16), _mm256_permute2x128_si256(x1, x2, 0x31));
-
-						w1 = _mm256_unpackhi_epi32(v1, v2);
-						w2 = _mm256_unpackhi_epi32(v3, v4);
-						x1 = _mm256_unpacklo_epi64(w1, w2);
-						x2 = _mm256_unpackhi_epi64(w1, w2);
-						_mm256_storeu_si256((__m256i*)(p+8), _mm256_permute2x128_si256(x1, x2, 0x20));
-						_mm256_storeu_si256((__m256i*)(p+24), _mm256_permute2x128_si256(x1, x2, 0x31));
-
-						p += 32;
-					} else if (sv32 != -1)  // at least one selected
-					{
-						// low 16 bits
-						int sv32_low = sv32 & 0xFFFF;
-						if (sv32_low == 0)  // all selected
-						{
-							WRITE_BIT2_ZERO_FILL(zero_len << 2)
-							WRITE_BIT2_DECODE_B4_INT32_RAW(vv)
-							p += 16;
-						} else if (sv32_low != 0xFFFF)  // at least one selected
-						{
-							WRITE_BIT2_ZERO_FILL(zero_len << 2)
-							C_UInt32 vvv = vv;
-							WRITE_BIT2_SEL_DECODE_B4_PACKED(vvv, sv32_low)
-						}
-						// high 16 bits
-						int sv32_high = C_UInt32(sv32) >> 16;
-						if (sv32_high == 0)  // all selected
-						{
-							WRITE_BIT2_ZERO_FILL(zero_len << 2)
-							WRITE_BIT2_DECODE_B4_INT32_RAW(vv >> 32)
-							p += 16;
-						} else if (sv32_high != 0xFFFF)  // at least one selected
-						{
-							WRITE_BIT2_ZERO_FILL(zero_len << 2)
-							C_UInt32 vvv = vv >> 32;
-							WRITE_BIT2_SEL_DECODE_B4_PACKED(vvv, sv32_high)
-						}
-					}
-				}
+				size_t m = dBit2Kernel.Decode2_Int32(s, n_byte, p, sel, zero_len);
+				s += m; n_byte -= m; sel += m << 2;
 			}
-		#endif
 			for (; n_byte >= 4; n_byte -= 4)
 			{
 				__m128i sv = _mm_loadu_si128((__m128i const*)sel);
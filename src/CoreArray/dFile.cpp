@@ -548,6 +548,8 @@ namespace CoreArray
 	static const char *VAR_PIPE_SIZE   = "PIPE_SIZE";
 	static const char *VAR_PIPE_LEVEL  = "PIPE_LEVEL";
 	static const char *VAR_PIPE_BKSIZE = "PIPE_BKSIZE";
+	static const char *VAR_PIPE_FILTER = "PIPE_FILTER";
+	static const char *VAR_PIPE_ZONEMAP = "PIPE_ZONEMAP";
 
 	static const CdRecodeStream::TLevel CompressionLevels[] =
 	{
@@ -567,6 +569,13 @@ namespace CoreArray
 		"4M", "8M", NULL
 	};
 
+	static const char *RA_Str_Filter[] =
+	{
+		"", "shuffle", "bitshuffle", "delta", "delta2", NULL
+	};
+
+	static const char *RA_Str_ZoneMap = "zonemap";
+
 	/// The pipe for writing data to a compressed stream
 	template<typename CLASS>
 		class COREARRAY_DLL_DEFAULT CdWritePipe: public CdStreamPipe
@@ -633,6 +642,81 @@ namespace CoreArray
 		}
 	};
 
+	/// The pipe for writing data to a compressed stream with random access,
+	/// the blocks are compressed on the helper threads of the GDS file
+	template<typename CLASS>
+		class COREARRAY_DLL_DEFAULT CdWritePipe_RA:
+		public CdWritePipe2<CLASS, CdRAAlgorithm::TBlockSize>
+	{
+	public:
+		CdWritePipe_RA(CdRecodeStream::TLevel vLevel,
+				CdRAAlgorithm::TBlockSize bs, TdCompressRemainder &vRemainder,
+				CdRAAlgorithm::TFilter vFilter=CdRAAlgorithm::rfNone,
+				int vFilterSize=0,
+				CdRAAlgorithm::TZoneMap vZoneMap=CdRAAlgorithm::rzNone,
+				int vZoneSize=0):
+			CdWritePipe2<CLASS, CdRAAlgorithm::TBlockSize>(vLevel, bs,
+				vRemainder)
+		{
+			fFilter = vFilter;
+			fFilterSize = vFilterSize;
+			fZoneMap = vZoneMap;
+			fZoneSize = vZoneSize;
+		}
+
+	protected:
+		CdRAAlgorithm::TFilter fFilter;
+		int fFilterSize;
+		CdRAAlgorithm::TZoneMap fZoneMap;
+		int fZoneSize;
+
+		virtual CdStream *InitPipe(CdBufStream *BufStream)
+		{
+			CLASS *s = static_cast<CLASS*>(
+				CdWritePipe2<CLASS, CdRAAlgorithm::TBlockSize>::InitPipe(
+				BufStream));
+			s->SetFilter(fFilter, fFilterSize);
+			s->SetZoneMap(fZoneMap, fZoneSize);
+			CdBlockStream *b = dynamic_cast<CdBlockStream*>(this->fStream);
+			if (b) s->SetNumThread(b->Collection().CompressThreads());
+			return s;
+		}
+	};
+
+	/// The pipe for reading data from a compressed stream with random access,
+	/// the blocks ahead are decompressed on the helper threads of the GDS file
+	template<typename CLASS>
+		class COREARRAY_DLL_DEFAULT CdReadPipe_RA: public CdStreamPipe
+	{
+	protected:
+		CdStream *fStream;
+		CLASS *fPStream;
+
+		virtual CdStream *InitPipe(CdBufStream *BufStream)
+		{
+			fStream = BufStream->Stream();
+			fPStream = new CLASS(*fStream);
+			CdBlockStream *b = dynamic_cast<CdBlockStream*>(fStream);
+			if (b) fPStream->SetNumThread(b->Collection().DecompressThreads());
+			return fPStream;
+		}
+		virtual CdStream *FreePipe()
+		{
+			if (fPStream) fPStream->Release();
+			return fStream;
+		}
+	};
+
+	/// continue the random-access stream Src with the encoder pushed on buf
+	template<typename CLASS>
+		static void RA_InitAppend(CdBufStream &buf, CdRA_Read &Src,
+		vector<C_UInt8> *Tail)
+	{
+		CLASS *s = dynamic_cast<CLASS*>(buf.Stream());
+		if (!s) throw ErrGDSObj("Invalid pipe for appending.");
+		s->InitAppendStream(Src, Tail);
+	}
+
 
 	/// The pipe system with a template
 	template<int MaxBVal, int DefBVal, typename BSIZE,
@@ -655,6 +739,8 @@ namespace CoreArray
 			CdPipe<MaxBVal, DefBVal, BSIZE, CLASS, TYPE> *rv = new TYPE();
 			rv->fCoderIndex = fCoderIndex;
 			rv->fParamIndex = fParamIndex;
+			rv->fFilterIndex = fFilterIndex;
+			rv->fZoneMap = fZoneMap;
 			rv->fLevel = fLevel;
 			rv->fBlockSize = fBlockSize;
 			return rv;
@@ -705,8 +791,10 @@ namespace CoreArray
 
 		virtual CdPipeMgrItem *Match(const char *Mode) const
 		{
-			int ic, ip;
-			ParseMode(Mode, ic, ip);
+			int ic, ip, ifl;
+			bool zm;
+			ParseMode(Mode, ic, ip, ifl, zm);
+			if (((ifl > 0) || zm) && !FilterAllowed()) return NULL;
 			if (ic >= 0)
 			{
 				CdPipe<MaxBVal, DefBVal, BSIZE, CLASS, TYPE> *rv = new TYPE();
@@ -715,6 +803,8 @@ namespace CoreArray
 				rv->fBlockSize = (BSIZE)ip;
 				rv->fCoderIndex = rv->fLevel;
 				rv->fParamIndex = ip;
+				rv->fFilterIndex = ifl;
+				rv->fZoneMap = zm;
 				return rv;
 			} else
 				return NULL;
@@ -774,6 +864,26 @@ namespace CoreArray
 					fBlockSize = (BSIZE)(-1);
 				fParamIndex = (int)fBlockSize;
 			}
+
+			// pipe filter
+			fFilterIndex = 0;
+			if (Reader.HaveProperty(VAR_PIPE_FILTER))
+			{
+				C_UInt8 I = 0;
+				Reader[VAR_PIPE_FILTER] >> I;
+				if (I > CdRAAlgorithm::rfLast)
+					throw ErrGDSObj("Invalid 'PIPE_FILTER %d'", I);
+				fFilterIndex = I;
+			}
+
+			// pipe zone map
+			fZoneMap = false;
+			if (Reader.HaveProperty(VAR_PIPE_ZONEMAP))
+			{
+				C_UInt8 I = 0;
+				Reader[VAR_PIPE_ZONEMAP] >> I;
+				fZoneMap = (I != 0);
+			}
 		}
 		virtual void SaveStream(CdWriter &Writer)
 		{
@@ -784,6 +894,10 @@ namespace CoreArray
 			Writer[VAR_PIPE_LEVEL] << C_UInt8(fLevel);
 			if (MaxBVal > 0)
 				Writer[VAR_PIPE_BKSIZE] << C_UInt8(fBlockSize);
+			if (fFilterIndex > 0)
+				Writer[VAR_PIPE_FILTER] << C_UInt8(fFilterIndex);
+			if (fZoneMap)
+				Writer[VAR_PIPE_ZONEMAP] << C_UInt8(1);
 		}
 	};
 }
@@ -826,8 +940,8 @@ namespace CoreArray
 	// ZRA: ZIP Pipe with the support of random access
 	// =====================================================================
 
-	typedef CdStreamPipe2<CdZDecoder_RA> CdZRAReadPipe;
-	typedef CdWritePipe2<CdZEncoder_RA, CdRAAlgorithm::TBlockSize> CdZRAWritePipe;
+	typedef CdReadPipe_RA<CdZDecoder_RA> CdZRAReadPipe;
+	typedef CdWritePipe_RA<CdZEncoder_RA> CdZRAWritePipe;
 
 	static const char *ZRA_Strings[] =
 	{
@@ -847,11 +961,17 @@ namespace CoreArray
 		virtual void PushReadPipe(CdBufStream &buf)
 			{ buf.PushPipe(new CdZRAReadPipe); }
 		virtual void PushWritePipe(CdBufStream &buf)
-			{ buf.PushPipe(new CdZRAWritePipe(fLevel, fBlockSize, fRemainder)); }
+			{ buf.PushPipe(new CdZRAWritePipe(fLevel, fBlockSize, fRemainder,
+				BlockFilter(), BlockFilterSize(), BlockZoneMap(),
+				BlockZoneSize())); }
+		virtual void PushAppendPipe(CdBufStream &buf, CdRA_Read &Src,
+			vector<C_UInt8> *Tail)
+			{ PushWritePipe(buf); RA_InitAppend<CdZEncoder_RA>(buf, Src, Tail); }
 
 	protected:
 		virtual const char **CoderList() const { return ZRA_Strings; }
 		virtual const char **ParamList() const { return RA_Str_BSize; }
+		virtual bool FilterAllowed() const { return true; }
 	};
 
 
@@ -901,8 +1021,8 @@ namespace CoreArray
 	// LZ4: LZ4 Pipe with random access
 	// =====================================================================
 
-	typedef CdStreamPipe2<CdLZ4Decoder_RA> CdLZ4RAReadPipe;
-	typedef CdWritePipe2<CdLZ4Encoder_RA, CdRAAlgorithm::TBlockSize> CdLZ4RAWritePipe;
+	typedef CdReadPipe_RA<CdLZ4Decoder_RA> CdLZ4RAReadPipe;
+	typedef CdWritePipe_RA<CdLZ4Encoder_RA> CdLZ4RAWritePipe;
 
 	static const char *LZ4RA_Strings[] =
 	{
@@ -928,11 +1048,17 @@ namespace CoreArray
 		virtual void PushReadPipe(CdBufStream &buf)
 			{ buf.PushPipe(new CdLZ4RAReadPipe); }
 		virtual void PushWritePipe(CdBufStream &buf)
-			{ buf.PushPipe(new CdLZ4RAWritePipe(fLevel, fBlockSize, fRemainder)); }
+			{ buf.PushPipe(new CdLZ4RAWritePipe(fLevel, fBlockSize, fRemainder,
+				BlockFilter(), BlockFilterSize(), BlockZoneMap(),
+				BlockZoneSize())); }
+		virtual void PushAppendPipe(CdBufStream &buf, CdRA_Read &Src,
+			vector<C_UInt8> *Tail)
+			{ PushWritePipe(buf); RA_InitAppend<CdLZ4Encoder_RA>(buf, Src, Tail); }
 
 	protected:
 		virtual const char **CoderList() const { return LZ4RA_Strings; }
 		virtual const char **ParamList() const { return RA_Str_BSize; }
+		virtual bool FilterAllowed() const { return true; }
 	};
 
 #endif
@@ -976,8 +1102,8 @@ namespace CoreArray
 	// XZ_RA: XZ Pipe with the support of random access
 	// =====================================================================
 
-	typedef CdStreamPipe2<CdXZDecoder_RA> CdXZReadPipe_RA;
-	typedef CdWritePipe2<CdXZEncoder_RA, CdRAAlgorithm::TBlockSize> CdXZWritePipe_RA;
+	typedef CdReadPipe_RA<CdXZDecoder_RA> CdXZReadPipe_RA;
+	typedef CdWritePipe_RA<CdXZEncoder_RA> CdXZWritePipe_RA;
 
 	static const char *XZ_RA_Strings[] =
 	{
@@ -997,11 +1123,92 @@ namespace CoreArray
 		virtual void PushReadPipe(CdBufStream &buf)
 			{ buf.PushPipe(new CdXZReadPipe_RA); }
 		virtual void PushWritePipe(CdBufStream &buf)
-			{ buf.PushPipe(new CdXZWritePipe_RA(fLevel, fBlockSize, fRemainder)); }
+			{ buf.PushPipe(new CdXZWritePipe_RA(fLevel, fBlockSize, fRemainder,
+				BlockFilter(), BlockFilterSize(), BlockZoneMap(),
+				BlockZoneSize())); }
+		virtual void PushAppendPipe(CdBufStream &buf, CdRA_Read &Src,
+			vector<C_UInt8> *Tail)
+			{ PushWritePipe(buf); RA_InitAppend<CdXZEncoder_RA>(buf, Src, Tail); }
 
 	protected:
 		virtual const char **CoderList() const { return XZ_RA_Strings; }
 		virtual const char **ParamList() const { return RA_Str_BSize; }
+		virtual bool FilterAllowed() const { return true; }
+	};
+
+#endif
+
+
+	// =====================================================================
+	// ZSTD: zstd stream
+	// =====================================================================
+
+#ifndef COREARRAY_NO_ZSTD
+
+	typedef CdStreamPipe2<CdZSTDDecoder> CdZSTDReadPipe;
+	typedef CdWritePipe<CdZSTDEncoder> CdZSTDWritePipe;
+
+	static const char *ZSTD_Strings[] =
+	{
+		"ZSTD.min", "ZSTD.fast", "ZSTD.def", "ZSTD.max",
+		"ZSTD.ultra", "ZSTD.ultra_max", "ZSTD", NULL
+	};
+
+	class COREARRAY_DLL_DEFAULT CdPipeZSTD:
+		public CdPipe<0, -1, int, CdZSTDEncoder, CdPipeZSTD>
+	{
+	public:
+		virtual const char *Coder() const
+			{ return "ZSTD"; }
+		virtual const char *Description() const
+			{ return "zstd_" ZSTD_VERSION_STRING; }
+		virtual void PushReadPipe(CdBufStream &buf)
+			{ buf.PushPipe(new CdZSTDReadPipe); }
+		virtual void PushWritePipe(CdBufStream &buf)
+			{ buf.PushPipe(new CdZSTDWritePipe(fLevel, fRemainder)); }
+
+	protected:
+		virtual const char **CoderList() const { return ZSTD_Strings; }
+		virtual const char **ParamList() const { return NULL; }
+	};
+
+
+	// =====================================================================
+	// ZSTD_RA: ZSTD Pipe with the support of random access
+	// =====================================================================
+
+	typedef CdReadPipe_RA<CdZSTDDecoder_RA> CdZSTDReadPipe_RA;
+	typedef CdWritePipe_RA<CdZSTDEncoder_RA> CdZSTDWritePipe_RA;
+
+	static const char *ZSTD_RA_Strings[] =
+	{
+		"ZSTD_RA.min", "ZSTD_RA.fast", "ZSTD_RA.def", "ZSTD_RA.max",
+		"ZSTD_RA.ultra", "ZSTD_RA.ultra_max", "ZSTD_RA", NULL
+	};
+
+	class COREARRAY_DLL_DEFAULT CdPipeZSTD_RA:
+		public CdPipe<CdRAAlgorithm::raLast, CdRAAlgorithm::raDefault,
+		CdRAAlgorithm::TBlockSize, CdZSTDEncoder_RA, CdPipeZSTD_RA>
+	{
+	public:
+		virtual const char *Coder() const
+			{ return "ZSTD_ra"; }
+		virtual const char *Description() const
+			{ return "zstd_" ZSTD_VERSION_STRING " (random access)"; }
+		virtual void PushReadPipe(CdBufStream &buf)
+			{ buf.PushPipe(new CdZSTDReadPipe_RA); }
+		virtual void PushWritePipe(CdBufStream &buf)
+			{ buf.PushPipe(new CdZSTDWritePipe_RA(fLevel, fBlockSize, fRemainder,
+				BlockFilter(), BlockFilterSize(), BlockZoneMap(),
+				BlockZoneSize())); }
+		virtual void PushAppendPipe(CdBufStream &buf, CdRA_Read &Src,
+			vector<C_UInt8> *Tail)
+			{ PushWritePipe(buf); RA_InitAppend<CdZSTDEncoder_RA>(buf, Src, Tail); }
+
+	protected:
+		virtual const char **CoderList() const { return ZSTD_RA_Strings; }
+		virtual const char **ParamList() const { return RA_Str_BSize; }
+		virtual bool FilterAllowed() const { return true; }
 	};
 
 #endif
@@ -1029,6 +1236,13 @@ void CdPipeMgrItem::UpdateStreamSize()
 		fOwner->GetPipeInfo();
 }
 
+void CdPipeMgrItem::PushAppendPipe(CdBufStream &buf, CdRA_Read &Src,
+	vector<C_UInt8> *Tail)
+{
+	throw ErrGDSObj("'%s' does not support appending to compressed data.",
+		Coder());
+}
+
 void CdPipeMgrItem::LoadStream(CdReader &Reader, TdVersion Version) { }
 
 void CdPipeMgrItem::SaveStream(CdWriter &Writer) { }
@@ -1049,6 +1263,8 @@ bool CdPipeMgrItem::EqualText(const char *s1, const char *s2)
 CdPipeMgrItem2::CdPipeMgrItem2(): CdPipeMgrItem()
 {
 	fCoderIndex = fParamIndex = -1;
+	fFilterIndex = 0;
+	fZoneMap = false;
 }
 
 string CdPipeMgrItem2::CoderOptString() const
@@ -1082,15 +1298,31 @@ string CdPipeMgrItem2::ExtOptString() const
 			}
 		}
 	}
+	if (FilterAllowed())
+	{
+		for (ss=RA_Str_Filter; *ss; ss++)
+		{
+			if (strlen(*ss) > 0)
+			{
+				if (!rv.empty()) rv.append(", ");
+				rv.append(":");
+				rv.append(*ss);
+			}
+		}
+		rv.append(", :");
+		rv.append(RA_Str_ZoneMap);
+	}
 	return rv;
 }
 
 bool CdPipeMgrItem2::Equal(const char *Mode) const
 {
-	int ic, ip;
-	ParseMode(Mode, ic, ip);
+	int ic, ip, ifl;
+	bool zm;
+	ParseMode(Mode, ic, ip, ifl, zm);
 	if (fCoderIndex >= 0)
-		return (fCoderIndex == ic) && (fParamIndex == ip);
+		return (fCoderIndex == ic) && (fParamIndex == ip) &&
+			(fFilterIndex == ifl) && (fZoneMap == zm);
 	else
 		return false;
 }
@@ -1105,16 +1337,115 @@ string CdPipeMgrItem2::CoderParam() const
 		ans.append(":");
 		ans.append(ParamList()[fParamIndex]);
 	}
+	if (fFilterIndex > 0)
+	{
+		ans.append(":");
+		ans.append(RA_Str_Filter[fFilterIndex]);
+	}
+	if (fZoneMap)
+	{
+		ans.append(":");
+		ans.append(RA_Str_ZoneMap);
+	}
 	return ans;
 }
 
+CdRAAlgorithm::TFilter CdPipeMgrItem2::BlockFilter() const
+{
+	if (fFilterIndex <= 0) return CdRAAlgorithm::rfNone;
+	if (fFilterIndex >= CdRAAlgorithm::rfDelta)
+		return (CdRAAlgorithm::TFilter)fFilterIndex;
+	// transpose the bytes of multi-byte elements, otherwise the bits
+	unsigned Bits = (fOwner && fOwner->IsPrimitive()) ? fOwner->BitOf() : 8;
+	if ((fFilterIndex == CdRAAlgorithm::rfShuffle) && (Bits > 8) &&
+			((Bits % 8) == 0))
+		return CdRAAlgorithm::rfShuffle;
+	else
+		return CdRAAlgorithm::rfBitShuffle;
+}
+
+int CdPipeMgrItem2::BlockFilterSize() const
+{
+	if (fFilterIndex <= 0) return 0;
+	// the elements not stored in place (e.g., sparse or variable-length)
+	//   are filtered as a byte stream
+	unsigned Bits = (fOwner && fOwner->IsPrimitive()) ? fOwner->BitOf() : 8;
+	// packed bits are transposed byte by byte
+	if (((Bits % 8) != 0) || (Bits == 0) || (Bits > 255*8))
+		return 1;
+	return Bits / 8;
+}
+
+CdRAAlgorithm::TZoneMap CdPipeMgrItem2::BlockZoneMap() const
+{
+	if (!fZoneMap) return CdRAAlgorithm::rzNone;
+	// the elements should be stored in place as native integers or real
+	//   numbers, not as the records of sparse or variable-length types
+	if (fOwner && !fOwner->IsPrimitive())
+		throw ErrGDSObj("The zone map requires a numeric data type.");
+	C_SVType sv = fOwner ? fOwner->SVType() : svCustom;
+	unsigned Bits = fOwner ? fOwner->BitOf() : 8;
+	if ((Bits >= 8) && (Bits <= 64) && ((Bits % 8) == 0))
+	{
+		if ((svInt8 <= sv) && (sv <= svUInt64))
+		{
+			return COREARRAY_SV_SINT(sv) ? CdRAAlgorithm::rzInt :
+				CdRAAlgorithm::rzUInt;
+		} else if (((sv == svFloat32) && (Bits == 32)) ||
+			((sv == svFloat64) && (Bits == 64)))
+		{
+			return CdRAAlgorithm::rzFloat;
+		}
+	}
+	throw ErrGDSObj("The zone map requires a numeric data type.");
+}
+
+int CdPipeMgrItem2::BlockZoneSize() const
+{
+	if (!fZoneMap) return 0;
+	return fOwner ? fOwner->BitOf() / 8 : 1;
+}
+
+bool CdPipeMgrItem2::FilterAllowed() const
+{
+	return false;
+}
+
 void CdPipeMgrItem2::ParseMode(const char *Mode, int &IdxCoder,
-	int &IdxParam) const
+	int &IdxParam, int &IdxFilter, bool &ZoneMap) const
 {
 	IdxCoder = IdxParam = -1;
+	IdxFilter = 0;
+	ZoneMap = false;
+
+	// the filter and zone map following the last colons in any order
+	string m = Mode;
+	size_t pos;
+	while ((pos = m.rfind(':')) != string::npos)
+	{
+		const char *opt = m.c_str() + pos + 1;
+		if (!ZoneMap && EqualText(opt, RA_Str_ZoneMap))
+		{
+			ZoneMap = true;
+		} else {
+			int flt = 0;
+			if (IdxFilter == 0)
+			{
+				for (int i=1; RA_Str_Filter[i] != NULL; i++)
+				{
+					if (EqualText(opt, RA_Str_Filter[i]))
+						{ flt = i; break; }
+				}
+			}
+			if (flt == 0) break;
+			IdxFilter = flt;
+		}
+		m.resize(pos);
+	}
+	Mode = m.c_str();
 
 	string s = Mode;
-	size_t pos = s.find(':');
+	pos = s.find(':');
 	if (pos != string::npos)
 	{
 		s.resize(pos);
@@ -1166,6 +1497,10 @@ CdStreamPipeMgr::CdStreamPipeMgr(): CdAbstractManager()
 	Register(new CdPipeXZ);
 	Register(new CdPipeXZ_RA);
 #endif
+#ifndef COREARRAY_NO_ZSTD
+	Register(new CdPipeZSTD);
+	Register(new CdPipeZSTD_RA);
+#endif
 }
 
 CdStreamPipeMgr::~CdStreamPipeMgr()
@@ -1219,6 +1554,21 @@ CdGDSObjPipe::~CdGDSObjPipe()
 	}
 }
 
+unsigned CdGDSObjPipe::BitOf()
+{
+	return 8;
+}
+
+C_SVType CdGDSObjPipe::SVType()
+{
+	return svCustom;
+}
+
+bool CdGDSObjPipe::IsPrimitive()
+{
+	return true;
+}
+
 CdGDSObjPipe *CdGDSObjPipe::AssignPipe(CdGDSObjPipe &Source)
 {
 	if (fPipeInfo)
@@ -2693,6 +3043,13 @@ void CdGDSFile::LoadFileFork(const char *fn, bool ReadOnly)
 	fFileName = UTF8Text(fn);
 }
 
+void CdGDSFile::LoadFileMmap(const char *fn)
+{
+	TdAutoRef<CdStream> F(new CdMmapFileStream(fn));
+	LoadStream(F.get(), true);
+	fFileName = UTF8Text(fn);
+}
+
 void CdGDSFile::SyncFile()
 {
 	if (fStream == NULL)
@@ -2772,6 +3129,12 @@ void CdGDSFile::CloseFile()
 			fRoot.fGDSStream->Release();
 			fRoot.fGDSStream = NULL;
 		}
+		if (!fReadOnly)
+		{
+			if (GrowthRatio() > 0)
+				CdBlockCollection::ReleaseReserved();
+			CdBlockCollection::WriteTOC();
+		}
 		CdBlockCollection::Clear();
     }
 }
@@ -2790,6 +3153,16 @@ void CdGDSFile::TidyUp(bool deep)
 	LoadFile(fn, TempReadOnly);
 }
 
+bool CdGDSFile::Compact(double TimeLimit)
+{
+	if (fReadOnly)
+		throw ErrGDSFile("The GDS file is read-only.");
+	SyncFile();
+	bool rv = CdBlockCollection::Compact(TimeLimit);
+	CdBlockCollection::WriteTOC();
+	return rv;
+}
+
 bool CdGDSFile::_HaveModify(CdGDSFolder *folder)
 {
 	if (folder->fChanged) return true;
@@ -2827,7 +3200,11 @@ int CdGDSFile::GetNumOfFragment()
 
 bool CdGDSFile::IfSupportForking()
 {
-	return (dynamic_cast<CdForkFileStream*>(fStream) != NULL);
+	if (dynamic_cast<CdForkFileStream*>(fStream) != NULL)
+		return true;
+	// a mapped view does not share the file offset with the parent process
+	CdMmapFileStream *s = dynamic_cast<CdMmapFileStream*>(fStream);
+	return (s != NULL) && (s->Memory() != NULL);
 }
 
 TProcessID CdGDSFile::GetProcessID()
@@ -239,6 +239,11 @@ namespace CoreArray
 		virtual void PopPipe(CdBufStream &buf) = 0;
 		virtual bool WriteMode(CdBufStream &buf) const = 0;
 		virtual void ClosePipe(CdBufStream &buf) = 0;
+		/// push the writing pipe on buf continuing the random-access stream
+		/// Src with its modified blocks, and Tail is the data of the last
+		/// block to be written again, or NULL to keep all blocks
+		virtual void PushAppendPipe(CdBufStream &buf, CdRA_Read &Src,
+			vector<C_UInt8> *Tail);
 
 		virtual bool GetStreamInfo(CdBufStream *BufStream) = 0;
 
@@ -278,13 +283,29 @@ namespace CoreArray
 		/// get the coder information with parameters
 		virtual string CoderParam() const;
 
+		/// the filter of blocks according to the element type of the owner
+		CdRAAlgorithm::TFilter BlockFilter() const;
+		/// the element size in bytes used by the filter of blocks
+		int BlockFilterSize() const;
+		/// the zone map of blocks according to the element type of the owner
+		CdRAAlgorithm::TZoneMap BlockZoneMap() const;
+		/// the element size in bytes used by the zone map of blocks
+		int BlockZoneSize() const;
+
 	protected:
 		int fCoderIndex;
 		int fParamIndex;
+		/// the filter option, 0 for none, "shuffle" or "bitshuffle"
+		int fFilterIndex;
+		/// whether to save the zone map of blocks, the "zonemap" option
+		bool fZoneMap;
 
-		void ParseMode(const char *Mode, int &IdxCoder, int &IdxParam) const;
+		void ParseMode(const char *Mode, int &IdxCoder, int &IdxParam,
+			int &IdxFilter, bool &ZoneMap) const;
 		virtual const char **CoderList() const = 0;
 		virtual const char **ParamList() const = 0;
+		/// whether the raw data of blocks can be filtered
+		virtual bool FilterAllowed() const;
 	};
 
 
@@ -326,6 +347,12 @@ namespace CoreArray
 
 		/// Set the mode of data storage (e.g, packed mode or compression)
 		virtual void SetPackedMode(const char *Mode) = 0;
+		/// Return number of bits for the element type, 8 for a byte stream
+		virtual unsigned BitOf();
+		/// Return C_SVType of the element type, svCustom for a byte stream
+		virtual C_SVType SVType();
+		/// Return whether the elements are stored in place with BitOf() bits
+		virtual bool IsPrimitive();
 
 	protected:
 		CdPipeMgrItem *fPipeInfo;
@@ -696,6 +723,8 @@ namespace CoreArray
 		void LoadFile(const UTF8String &fn, bool ReadOnly=true);
 		void LoadFile(const char *fn, bool ReadOnly=true);
 		void LoadFileFork(const char *fn, bool ReadOnly=true);
+		/// load a file in read-only mode using a memory-mapped view
+		void LoadFileMmap(const char *fn);
 
 		void SaveAsFile(const UTF8String &fn);
 		void SaveAsFile(const char *fn);
@@ -708,6 +737,8 @@ namespace CoreArray
 
 		/// Clean up all fragments
 		void TidyUp(bool deep);
+		/// Clean up fragments in place, see CdBlockCollection::Compact
+		bool Compact(double TimeLimit=0);
 
 		bool Modified();
 
@@ -724,6 +755,27 @@ namespace CoreArray
 		COREARRAY_INLINE UTF8String &FileName() { return fFileName; }
 		COREARRAY_INLINE CdGDSFolder &Root() { return fRoot; }
 		COREARRAY_INLINE bool ReadOnly() const { return fReadOnly; }
+		/// whether read-only arrays prefetch data in background when scanned
+		COREARRAY_INLINE bool ReadAhead() const { return fReadAhead; }
+		COREARRAY_INLINE void SetReadAhead(bool Value) { fReadAhead = Value; }
+		/// whether arrays write their buffers to the file in background
+		COREARRAY_INLINE bool WriteBehind() const { return fWriteBehind; }
+		COREARRAY_INLINE void SetWriteBehind(bool Value) { fWriteBehind = Value; }
+		/// the number of helper threads compressing the blocks of *_RA
+		COREARRAY_INLINE int CompressThreads() const { return fCompressThreads; }
+		COREARRAY_INLINE void SetCompressThreads(int Value)
+			{ CdBlockCollection::SetCompressThreads(Value); }
+		/// the number of helper threads decompressing the blocks of *_RA
+		COREARRAY_INLINE int DecompressThreads() const
+			{ return fDecompressThreads; }
+		COREARRAY_INLINE void SetDecompressThreads(int Value)
+			{ CdBlockCollection::SetDecompressThreads(Value); }
+		/// the ratio of reservation when a stream grows, 0 for exact growth
+		COREARRAY_INLINE double GrowthRatio() const { return fGrowthRatio; }
+		/// set the growth policy of streams, see CdBlockCollection
+		COREARRAY_INLINE void SetGrowthPolicy(double Ratio,
+			SIZE64 MaxSize=0x4000000, bool Prealloc=true)
+			{ CdBlockCollection::SetGrowthPolicy(Ratio, MaxSize, Prealloc); }
 		COREARRAY_INLINE CdLogRecord &Log() { return *fLog; }
 		COREARRAY_INLINE TdVersion Version() const { return fVersion; }
 
@@ -44,12 +44,19 @@
 #   include <process.h>
 #endif
 
+#if (defined(__GNUC__) || defined(__clang__)) && \
+	(defined(__i386__) || defined(__x86_64__))
+#   include <cpuid.h>
+#   define COREARRAY_HAVE_CPUID
+#endif
+
 #ifdef COREARRAY_PLATFORM_UNIX
 
 	#include <cerrno>
 	#include <fcntl.h>
 	#include <unistd.h>
 	#include <sys/types.h>
+	#include <sys/mman.h>
 
 	#if defined(COREARRAY_PLATFORM_BSD) || defined(COREARRAY_PLATFORM_MACOS)
 	#  include <sys/sysctl.h>
@@ -1091,6 +1098,22 @@ string CoreArray::NowDateToStr()
 	return rv;
 }
 
+double CoreArray::MonotonicSeconds()
+{
+	#if defined(COREARRAY_PLATFORM_WINDOWS)
+		LARGE_INTEGER freq, cnt;
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&cnt);
+		return (double)cnt.QuadPart / (double)freq.QuadPart;
+	#elif defined(CLOCK_MONOTONIC)
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec + ts.tv_nsec * 1e-9;
+	#else
+		return (double)time(NULL);
+	#endif
+}
+
 
 // =========================================================================
 // File Functions
@@ -1192,6 +1215,52 @@ size_t CoreArray::SysHandleWrite(TSysHandle Handle, const void* Buffer,
 	#endif
 }
 
+size_t CoreArray::SysHandleReadAt(TSysHandle Handle, C_Int64 Pos,
+	void *Buffer, size_t Count)
+{
+	#if defined(COREARRAY_PLATFORM_WINDOWS)
+		OVERLAPPED ov;
+		memset(&ov, 0, sizeof(ov));
+		ov.Offset = (DWORD)Pos;
+		ov.OffsetHigh = (DWORD)(Pos >> 32);
+		unsigned long rv;
+		if (ReadFile(Handle, Buffer, Count, &rv, &ov))
+			return rv;
+		else
+			return 0;
+	#else
+		#if defined(COREARRAY_CYGWIN) || defined(COREARRAY_PLATFORM_MACOS) || defined(COREARRAY_PLATFORM_BSD)
+			ssize_t rv = pread(Handle, Buffer, Count, Pos);
+		#else
+			ssize_t rv = pread64(Handle, Buffer, Count, Pos);
+		#endif
+		return (rv >= 0) ? rv : 0;
+	#endif
+}
+
+size_t CoreArray::SysHandleWriteAt(TSysHandle Handle, C_Int64 Pos,
+	const void* Buffer, size_t Count)
+{
+	#if defined(COREARRAY_PLATFORM_WINDOWS)
+		OVERLAPPED ov;
+		memset(&ov, 0, sizeof(ov));
+		ov.Offset = (DWORD)Pos;
+		ov.OffsetHigh = (DWORD)(Pos >> 32);
+		unsigned long rv;
+		if (WriteFile(Handle, Buffer, Count, &rv, &ov))
+			return rv;
+		else
+			return 0;
+	#else
+		#if defined(COREARRAY_CYGWIN) || defined(COREARRAY_PLATFORM_MACOS) || defined(COREARRAY_PLATFORM_BSD)
+			ssize_t rv = pwrite(Handle, Buffer, Count, Pos);
+		#else
+			ssize_t rv = pwrite64(Handle, Buffer, Count, Pos);
+		#endif
+		return (rv >= 0) ? rv : 0;
+	#endif
+}
+
 C_Int64 CoreArray::SysHandleSeek(TSysHandle Handle, C_Int64 Offset,
 	enum TdSysSeekOrg sk)
 {
@@ -1230,6 +1299,65 @@ bool CoreArray::SysHandleSetSize(TSysHandle Handle, C_Int64 NewSize)
 	#endif
 }
 
+bool CoreArray::SysHandlePreallocate(TSysHandle Handle, C_Int64 Pos,
+	C_Int64 Count)
+{
+	#if defined(COREARRAY_PLATFORM_LINUX) && defined(FALLOC_FL_KEEP_SIZE)
+		// fallocate() fails instead of writing zeros if not supported
+		return fallocate(Handle, FALLOC_FL_KEEP_SIZE, Pos, Count) == 0;
+	#else
+		return false;
+	#endif
+}
+
+bool CoreArray::SysHandleSync(TSysHandle Handle)
+{
+	#if defined(COREARRAY_PLATFORM_WINDOWS)
+		return FlushFileBuffers(Handle) != 0;
+	#elif defined(COREARRAY_PLATFORM_LINUX)
+		return fdatasync(Handle) == 0;
+	#else
+		return fsync(Handle) == 0;
+	#endif
+}
+
+void *CoreArray::SysMapFile(TSysHandle Handle, C_Int64 Size,
+	TSysHandle &MapHandle)
+{
+	MapHandle = NullSysHandle;
+	if ((Size <= 0) ||
+			((C_UInt64)Size > (C_UInt64)numeric_limits<size_t>::max()))
+		return NULL;
+
+	#if defined(COREARRAY_PLATFORM_WINDOWS)
+		HANDLE H = CreateFileMapping(Handle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (H == NULL) return NULL;
+		void *p = MapViewOfFile(H, FILE_MAP_READ, 0, 0, (SIZE_T)Size);
+		if (p == NULL)
+		{
+			CloseHandle(H);
+			return NULL;
+		}
+		MapHandle = H;
+		return p;
+	#else
+		void *p = mmap(NULL, (size_t)Size, PROT_READ, MAP_SHARED, Handle, 0);
+		return (p != MAP_FAILED) ? p : NULL;
+	#endif
+}
+
+bool CoreArray::SysUnmapFile(void *Ptr, C_Int64 Size, TSysHandle MapHandle)
+{
+	#if defined(COREARRAY_PLATFORM_WINDOWS)
+		bool rv = UnmapViewOfFile(Ptr);
+		if (MapHandle != NullSysHandle)
+			rv = CloseHandle(MapHandle) && rv;
+		return rv;
+	#else
+		return munmap(Ptr, (size_t)Size) == 0;
+	#endif
+}
+
 string CoreArray::TempFileName(const char *prefix, const char *tempdir)
 {
 #if defined(COREARRAY_USING_R)
@@ -1531,6 +1659,81 @@ C_UInt64 CoreArray::Mach::GetCPU_LevelCache(int level)
 #endif
 }
 
+C_UInt32 CoreArray::Mach::GetCPU_Features()
+{
+	C_UInt32 rv = 0;
+
+#if defined(COREARRAY_HAVE_CPUID)
+
+	unsigned int a, b, c, d;
+	if (!__get_cpuid(1, &a, &b, &c, &d)) return 0;
+	if (d & (1u << 26)) rv |= cpuSSE2;
+	if (c & (1u << 9))  rv |= cpuSSSE3;
+	if (c & (1u << 20)) rv |= cpuSSE4_2;
+	if (c & (1u << 23)) rv |= cpuPOPCNT;
+
+	// AVX requires the OS saving the YMM registers (OSXSAVE and XCR0)
+	if ((c & (1u << 27)) && (c & (1u << 28)))
+	{
+		unsigned int xa, xd;
+		__asm__ __volatile__ ("xgetbv" : "=a"(xa), "=d"(xd) : "c"(0));
+		if ((xa & 0x06) == 0x06)
+		{
+			rv |= cpuAVX;
+			if (__get_cpuid_max(0, NULL) >= 7)
+			{
+				__cpuid_count(7, 0, a, b, c, d);
+				if (b & (1u << 5)) rv |= cpuAVX2;
+				// also the opmask and ZMM registers
+				if ((xa & 0xE6) == 0xE6)
+				{
+					if (b & (1u << 16)) rv |= cpuAVX512F;
+					if ((b & (1u << 16)) && (b & (1u << 30)))
+						rv |= cpuAVX512BW;
+				}
+			}
+		}
+	}
+
+#endif
+
+	return rv;
+}
+
+
+/// the SIMD kernels selected at run time, and their instruction sets
+static vector< pair<string, string> > &SIMD_Kernel_List()
+{
+	static vector< pair<string, string> > List;
+	return List;
+}
+
+void CoreArray::Mach::SetSIMD_Kernel(const char *Name, const char *ISA)
+{
+	vector< pair<string, string> > &List = SIMD_Kernel_List();
+	for (size_t i=0; i < List.size(); i++)
+	{
+		if (List[i].first == Name)
+		{
+			List[i].second = ISA;
+			return;
+		}
+	}
+	List.push_back(pair<string, string>(Name, ISA));
+}
+
+void CoreArray::Mach::GetSIMD_Kernel(vector<string> &Name, vector<string> &ISA)
+{
+	vector< pair<string, string> > &List = SIMD_Kernel_List();
+	Name.resize(List.size());
+	ISA.resize(List.size());
+	for (size_t i=0; i < List.size(); i++)
+	{
+		Name[i] = List[i].first;
+		ISA[i] = List[i].second;
+	}
+}
+
 
 TProcessID CoreArray::GetCurrentProcessID()
 {
@@ -1566,6 +1769,27 @@ CdThreadMutex::CdThreadMutex()
 #endif
 }
 
+CdThreadMutex::CdThreadMutex(bool Recursive)
+{
+#if defined(COREARRAY_POSIX_THREAD)
+
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	if (Recursive)
+		pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+   	int v = pthread_mutex_init(&mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+   	if (v != 0)
+   		throw ErrOSError(ERR_PTHREAD, "pthread_mutex_init", v);
+
+#elif defined(COREARRAY_PLATFORM_WINDOWS)
+
+	// a critical section is always recursive
+	InitializeCriticalSection(&mutex);
+
+#endif
+}
+
 CdThreadMutex::~CdThreadMutex()
 {
 #if defined(COREARRAY_POSIX_THREAD)
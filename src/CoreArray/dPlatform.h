@@ -272,6 +272,9 @@ namespace CoreArray
 	/// convert the date and time information to a string
 	COREARRAY_DLL_DEFAULT string NowDateToStr();
 
+	/// the seconds of a monotonic high-resolution clock, for elapsed time
+	COREARRAY_DLL_DEFAULT double MonotonicSeconds();
+
 
 
 	// =====================================================================
@@ -311,10 +314,29 @@ namespace CoreArray
 		size_t Count);
 	COREARRAY_DLL_DEFAULT size_t SysHandleWrite(TSysHandle Handle,
 		const void* Buffer, size_t Count);
+	/// read at the absolute position, the file offset is not changed on
+	/// POSIX systems, but it is moved to the end of the read on Windows
+	COREARRAY_DLL_DEFAULT size_t SysHandleReadAt(TSysHandle Handle,
+		C_Int64 Pos, void *Buffer, size_t Count);
+	/// write at the absolute position, the file offset is not changed on
+	/// POSIX systems, but it is moved to the end of the write on Windows
+	COREARRAY_DLL_DEFAULT size_t SysHandleWriteAt(TSysHandle Handle,
+		C_Int64 Pos, const void* Buffer, size_t Count);
 	COREARRAY_DLL_DEFAULT C_Int64 SysHandleSeek(TSysHandle Handle,
 		C_Int64 Offset, enum TdSysSeekOrg sk);
 	COREARRAY_DLL_DEFAULT bool SysHandleSetSize(TSysHandle Handle,
 		C_Int64 NewSize);
+	/// allocate disk space for [Pos, Pos+Count) if supported, no zero filling
+	COREARRAY_DLL_DEFAULT bool SysHandlePreallocate(TSysHandle Handle,
+		C_Int64 Pos, C_Int64 Count);
+	/// flush the written data of the file to the storage device
+	COREARRAY_DLL_DEFAULT bool SysHandleSync(TSysHandle Handle);
+	/// map a read-only view of the whole file, return NULL if failed
+	COREARRAY_DLL_DEFAULT void *SysMapFile(TSysHandle Handle, C_Int64 Size,
+		TSysHandle &MapHandle);
+	/// unmap the view returned by SysMapFile
+	COREARRAY_DLL_DEFAULT bool SysUnmapFile(void *Ptr, C_Int64 Size,
+		TSysHandle MapHandle);
 
 	/// get a temporary file name
 	COREARRAY_DLL_DEFAULT string TempFileName(const char *prefix,
@@ -371,6 +393,30 @@ namespace CoreArray
 		 *  \return cache size, or 0 if unable to determine.
 		**/
 		COREARRAY_DLL_DEFAULT C_UInt64 GetCPU_LevelCache(int level);
+
+		/// The instruction sets detected at run time
+		enum TCPUFeature
+		{
+			cpuSSE2     = 0x01,  //< SSE2
+			cpuSSE4_2   = 0x02,  //< SSE4.2
+			cpuPOPCNT   = 0x04,  //< POPCNT
+			cpuAVX      = 0x08,  //< AVX, with the OS support
+			cpuAVX2     = 0x10,  //< AVX2, with the OS support
+			cpuAVX512F  = 0x20,  //< AVX-512 Foundation, with the OS support
+			cpuAVX512BW = 0x40,  //< AVX-512 Byte and Word, with the OS support
+			cpuSSSE3    = 0x80   //< SSSE3
+		};
+
+		/// Return the instruction sets (TCPUFeature) supported by the CPU and OS
+		/** return 0, if unable to determine. **/
+		COREARRAY_DLL_DEFAULT C_UInt32 GetCPU_Features();
+
+		/// Record the instruction set of a SIMD kernel selected at run time
+		COREARRAY_DLL_DEFAULT void SetSIMD_Kernel(const char *Name,
+			const char *ISA);
+		/// Return the SIMD kernels selected at run time and their instruction sets
+		COREARRAY_DLL_DEFAULT void GetSIMD_Kernel(vector<string> &Name,
+			vector<string> &ISA);
 	}
 
 
@@ -399,6 +445,8 @@ namespace CoreArray
 
 		/// constructor
 		CdThreadMutex();
+		/// constructor, the owner thread can lock it again if Recursive
+		CdThreadMutex(bool Recursive);
 		/// destructor
 		~CdThreadMutex();
 
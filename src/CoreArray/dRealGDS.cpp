@@ -35,6 +35,446 @@
 
 #include "dRealGDS.h"
 
+#ifdef COREARRAY_SIMD_SSE2
+#   include <emmintrin.h>
+#endif
+#if defined(COREARRAY_SIMD_AVX2) || defined(COREARRAY_TARGET_DISPATCH)
+#   include <immintrin.h>
+#endif
+
+
+using namespace CoreArray;
+
+
+// =====================================================================
+// Vectorized kernels of packed real numbers
+// =====================================================================
+
+static inline C_Float64 PR_Val(C_UInt16 v, bool Sign)
+	{ return Sign ? C_Float64(C_Int16(v)) : C_Float64(v); }
+static inline C_Float64 PR_Val(C_UInt32 v, bool Sign)
+	{ return Sign ? C_Float64(C_Int32(v)) : C_Float64(v); }
+
+/// the missing value in 32-bit lanes after sign or zero extension
+static inline C_Int32 PR_Wide(C_UInt16 v, bool Sign)
+	{ return Sign ? C_Int32(C_Int16(v)) : C_Int32(v); }
+static inline C_Int32 PR_Wide(C_UInt32 v, bool)
+	{ return C_Int32(v); }
+
+template<typename OUT, typename IN>
+	static void PR_Decode(OUT *p, const IN *s, size_t n, bool Sign,
+	IN Missing, C_Float64 Scale, C_Float64 Offset)
+{
+	for (; n > 0; n--, s++)
+	{
+		*p++ = VAL_CONV_FROM_F64(OUT,
+			(*s != Missing) ? (PR_Val(*s, Sign) * Scale + Offset) : NaN);
+	}
+}
+
+template<typename OUT>
+	static void PR_Decode24(OUT *p, const C_UInt8 *s, size_t n, bool Sign,
+	C_Float64 Scale, C_Float64 Offset)
+{
+	const C_UInt32 Missing = Sign ? 0x800000 : 0xFFFFFF;
+	for (; n > 0; n--, s+=3)
+	{
+		C_UInt32 v = s[0] | (C_UInt32(s[1]) << 8) | (C_UInt32(s[2]) << 16);
+		C_Float64 x = NaN;
+		if (v != Missing)
+		{
+			x = (Sign ? C_Float64(C_Int32(v << 8) >> 8) : C_Float64(v)) *
+				Scale + Offset;
+		}
+		*p++ = VAL_CONV_FROM_F64(OUT, x);
+	}
+}
+
+template<typename OUT>
+	static void PR_Encode(OUT *p, const C_Float64 *s, size_t n, C_Float64 Lo,
+	C_Float64 Hi, OUT Missing, C_Float64 Offset, C_Float64 InvScale)
+{
+	for (; n > 0; n--)
+	{
+		double v = round((*s++ - Offset) * InvScale);
+		*p++ = (IsFinite(v) && (Lo < v) && (v <= Hi)) ? OUT(C_Int64(v)) :
+			Missing;
+	}
+}
+
+
+#ifdef COREARRAY_SIMD_SSE2
+
+/// 0.5 - 2^-54, rounding half away from zero is trunc(x + copysign(c, x))
+static const double PR_HALF = 0.49999999999999994;
+
+/// load 4 values to 32-bit lanes
+static inline __m128i PR_Load4(const C_UInt16 *s, bool Sign)
+{
+	__m128i v = _mm_loadl_epi64((__m128i const*)s);
+	return Sign ? _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16) :
+		_mm_unpacklo_epi16(v, _mm_setzero_si128());
+}
+static inline __m128i PR_Load4(const C_UInt32 *s, bool)
+{
+	return _mm_loadu_si128((__m128i const*)s);
+}
+
+/// 32-bit lanes to 2x2 float64, U32 for unsigned 32-bit integers
+static inline void PR_ToF64(__m128i v, bool U32, const __m128d &Scale,
+	const __m128d &Offset, __m128d &y0, __m128d &y1)
+{
+	y0 = _mm_cvtepi32_pd(v);
+	y1 = _mm_cvtepi32_pd(_mm_shuffle_epi32(v, 0xEE));
+	if (U32)
+	{
+		const __m128d zero = _mm_setzero_pd(), b32 = _mm_set1_pd(4294967296.0);
+		y0 = _mm_add_pd(y0, _mm_and_pd(_mm_cmplt_pd(y0, zero), b32));
+		y1 = _mm_add_pd(y1, _mm_and_pd(_mm_cmplt_pd(y1, zero), b32));
+	}
+	y0 = _mm_add_pd(_mm_mul_pd(y0, Scale), Offset);
+	y1 = _mm_add_pd(_mm_mul_pd(y1, Scale), Offset);
+}
+
+/// round half away from zero and truncate to 32-bit integers
+static inline __m128i PR_Round4(__m128d y0, __m128d y1)
+{
+	const __m128d half = _mm_set1_pd(PR_HALF), sign = _mm_set1_pd(-0.0);
+	y0 = _mm_add_pd(y0, _mm_or_pd(half, _mm_and_pd(y0, sign)));
+	y1 = _mm_add_pd(y1, _mm_or_pd(half, _mm_and_pd(y1, sign)));
+	return _mm_unpacklo_epi64(_mm_cvttpd_epi32(y0), _mm_cvttpd_epi32(y1));
+}
+
+static inline void PR_Store4(C_Float64 *p, __m128d y0, __m128d y1, __m128i m)
+{
+	const __m128d nan = _mm_set1_pd(NaN);
+	__m128d m0 = _mm_castsi128_pd(_mm_unpacklo_epi32(m, m));
+	__m128d m1 = _mm_castsi128_pd(_mm_unpackhi_epi32(m, m));
+	_mm_storeu_pd(p, _mm_or_pd(_mm_andnot_pd(m0, y0), _mm_and_pd(m0, nan)));
+	_mm_storeu_pd(p+2, _mm_or_pd(_mm_andnot_pd(m1, y1), _mm_and_pd(m1, nan)));
+}
+static inline void PR_Store4(C_Float32 *p, __m128d y0, __m128d y1, __m128i m)
+{
+	__m128 v = _mm_movelh_ps(_mm_cvtpd_ps(y0), _mm_cvtpd_ps(y1));
+	__m128 mm = _mm_castsi128_ps(m);
+	v = _mm_or_ps(_mm_andnot_ps(mm, v), _mm_and_ps(mm, _mm_set1_ps(NaN)));
+	_mm_storeu_ps(p, v);
+}
+static inline void PR_Store4(C_Int32 *p, __m128d y0, __m128d y1, __m128i m)
+{
+	__m128i v = PR_Round4(y0, y1);
+	v = _mm_or_si128(_mm_andnot_si128(m, v),
+		_mm_and_si128(m, _mm_set1_epi32(0x80000000)));
+	_mm_storeu_si128((__m128i*)p, v);
+}
+
+template<typename OUT, typename IN>
+	static void PR_Decode_SSE2(OUT *p, const IN *s, size_t n, bool Sign,
+	IN Missing, C_Float64 Scale, C_Float64 Offset)
+{
+	const __m128d sc = _mm_set1_pd(Scale), off = _mm_set1_pd(Offset);
+	const __m128i miss = _mm_set1_epi32(PR_Wide(Missing, Sign));
+	const bool U32 = (sizeof(IN) == 4) && !Sign;
+	for (; n >= 4; n-=4, s+=4, p+=4)
+	{
+		__m128i v = PR_Load4(s, Sign);
+		__m128d y0, y1;
+		PR_ToF64(v, U32, sc, off, y0, y1);
+		PR_Store4(p, y0, y1, _mm_cmpeq_epi32(v, miss));
+	}
+	PR_Decode(p, s, n, Sign, Missing, Scale, Offset);
+}
+
+/// encode 4 float64 to 32-bit lanes
+static inline __m128i PR_Encode4(const C_Float64 *s, const __m128d &Lo,
+	const __m128d &Hi, const __m128i &Missing, const __m128d &Offset,
+	const __m128d &InvScale)
+{
+	__m128d t0 = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(s), Offset), InvScale);
+	__m128d t1 = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(s+2), Offset), InvScale);
+	__m128d v0 = _mm_and_pd(_mm_cmpgt_pd(t0, Lo), _mm_cmplt_pd(t0, Hi));
+	__m128d v1 = _mm_and_pd(_mm_cmpgt_pd(t1, Lo), _mm_cmplt_pd(t1, Hi));
+	__m128i m = _mm_castps_si128(_mm_shuffle_ps(_mm_castpd_ps(v0),
+		_mm_castpd_ps(v1), _MM_SHUFFLE(2,0,2,0)));
+	__m128i r = PR_Round4(t0, t1);
+	return _mm_or_si128(_mm_and_si128(m, r), _mm_andnot_si128(m, Missing));
+}
+
+static void PR_E16_SSE2(C_UInt16 *p, const C_Float64 *s, size_t n,
+	C_Float64 Lo, C_Float64 Hi, C_UInt16 Missing, C_Float64 Offset,
+	C_Float64 InvScale)
+{
+	const __m128d lo = _mm_set1_pd(Lo), hi = _mm_set1_pd(Hi);
+	const __m128d off = _mm_set1_pd(Offset), inv = _mm_set1_pd(InvScale);
+	const __m128i miss = _mm_set1_epi32(Missing);
+	for (; n >= 8; n-=8, s+=8, p+=8)
+	{
+		__m128i a = PR_Encode4(s, lo, hi, miss, off, inv);
+		__m128i b = PR_Encode4(s+4, lo, hi, miss, off, inv);
+		// keep the lower 16 bits
+		a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		_mm_storeu_si128((__m128i*)p, _mm_packs_epi32(a, b));
+	}
+	PR_Encode(p, s, n, Lo, Hi, Missing, Offset, InvScale);
+}
+
+static void PR_E32_SSE2(C_UInt32 *p, const C_Float64 *s, size_t n,
+	C_Float64 Lo, C_Float64 Hi, C_UInt32 Missing, C_Float64 Offset,
+	C_Float64 InvScale)
+{
+	const __m128d lo = _mm_set1_pd(Lo), hi = _mm_set1_pd(Hi);
+	const __m128d off = _mm_set1_pd(Offset), inv = _mm_set1_pd(InvScale);
+	const __m128i miss = _mm_set1_epi32(Missing);
+	for (; n >= 4; n-=4, s+=4, p+=4)
+	{
+		_mm_storeu_si128((__m128i*)p,
+			PR_Encode4(s, lo, hi, miss, off, inv));
+	}
+	PR_Encode(p, s, n, Lo, Hi, Missing, Offset, InvScale);
+}
+
+#endif
+
+
+#if defined(COREARRAY_SIMD_AVX2) || defined(COREARRAY_TARGET_DISPATCH)
+
+/// load 8 values to 32-bit lanes
+COREARRAY_TARGET("avx2")
+static inline __m256i PR_Load8(const C_UInt16 *s, bool Sign)
+{
+	__m128i v = _mm_loadu_si128((__m128i const*)s);
+	return Sign ? _mm256_cvtepi16_epi32(v) : _mm256_cvtepu16_epi32(v);
+}
+COREARRAY_TARGET("avx2")
+static inline __m256i PR_Load8(const C_UInt32 *s, bool)
+{
+	return _mm256_loadu_si256((__m256i const*)s);
+}
+
+COREARRAY_TARGET("avx2")
+static inline void PR_ToF64(__m256i v, bool U32, const __m256d &Scale,
+	const __m256d &Offset, __m256d &y0, __m256d &y1)
+{
+	y0 = _mm256_cvtepi32_pd(_mm256_castsi256_si128(v));
+	y1 = _mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1));
+	if (U32)
+	{
+		const __m256d zero = _mm256_setzero_pd();
+		const __m256d b32 = _mm256_set1_pd(4294967296.0);
+		y0 = _mm256_add_pd(y0,
+			_mm256_and_pd(_mm256_cmp_pd(y0, zero, _CMP_LT_OQ), b32));
+		y1 = _mm256_add_pd(y1,
+			_mm256_and_pd(_mm256_cmp_pd(y1, zero, _CMP_LT_OQ), b32));
+	}
+	y0 = _mm256_add_pd(_mm256_mul_pd(y0, Scale), Offset);
+	y1 = _mm256_add_pd(_mm256_mul_pd(y1, Scale), Offset);
+}
+
+COREARRAY_TARGET("avx2")
+static inline __m128i PR_Round4(__m256d y)
+{
+	const __m256d half = _mm256_set1_pd(PR_HALF);
+	const __m256d sign = _mm256_set1_pd(-0.0);
+	y = _mm256_add_pd(y, _mm256_or_pd(half, _mm256_and_pd(y, sign)));
+	return _mm256_cvttpd_epi32(y);
+}
+
+COREARRAY_TARGET("avx2")
+static inline void PR_Store8(C_Float64 *p, __m256d y0, __m256d y1, __m256i m)
+{
+	const __m256d nan = _mm256_set1_pd(NaN);
+	__m256d m0 = _mm256_castsi256_pd(
+		_mm256_cvtepi32_epi64(_mm256_castsi256_si128(m)));
+	__m256d m1 = _mm256_castsi256_pd(
+		_mm256_cvtepi32_epi64(_mm256_extracti128_si256(m, 1)));
+	_mm256_storeu_pd(p, _mm256_blendv_pd(y0, nan, m0));
+	_mm256_storeu_pd(p+4, _mm256_blendv_pd(y1, nan, m1));
+}
+COREARRAY_TARGET("avx2")
+static inline void PR_Store8(C_Float32 *p, __m256d y0, __m256d y1, __m256i m)
+{
+	__m256 v = _mm256_insertf128_ps(
+		_mm256_castps128_ps256(_mm256_cvtpd_ps(y0)), _mm256_cvtpd_ps(y1), 1);
+	v = _mm256_blendv_ps(v, _mm256_set1_ps(NaN), _mm256_castsi256_ps(m));
+	_mm256_storeu_ps(p, v);
+}
+COREARRAY_TARGET("avx2")
+static inline void PR_Store8(C_Int32 *p, __m256d y0, __m256d y1, __m256i m)
+{
+	__m256i v = _mm256_inserti128_si256(
+		_mm256_castsi128_si256(PR_Round4(y0)), PR_Round4(y1), 1);
+	v = _mm256_blendv_epi8(v, _mm256_set1_epi32(0x80000000), m);
+	_mm256_storeu_si256((__m256i*)p, v);
+}
+
+template<typename OUT, typename IN>
+	COREARRAY_TARGET("avx2")
+	static void PR_Decode_AVX2(OUT *p, const IN *s, size_t n, bool Sign,
+	IN Missing, C_Float64 Scale, C_Float64 Offset)
+{
+	const __m256d sc = _mm256_set1_pd(Scale), off = _mm256_set1_pd(Offset);
+	const __m256i miss = _mm256_set1_epi32(PR_Wide(Missing, Sign));
+	const bool U32 = (sizeof(IN) == 4) && !Sign;
+	for (; n >= 8; n-=8, s+=8, p+=8)
+	{
+		__m256i v = PR_Load8(s, Sign);
+		__m256d y0, y1;
+		PR_ToF64(v, U32, sc, off, y0, y1);
+		PR_Store8(p, y0, y1, _mm256_cmpeq_epi32(v, miss));
+	}
+	PR_Decode(p, s, n, Sign, Missing, Scale, Offset);
+}
+
+/// load 8 24-bit integers to 32-bit lanes, 30 bytes are accessible
+COREARRAY_TARGET("avx2")
+static inline __m256i PR_Load8_24(const C_UInt8 *s, bool Sign)
+{
+	// to the upper 24 bits of each lane
+	const __m256i shuf = _mm256_setr_epi8(
+		-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+		-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+	__m256i v = _mm256_inserti128_si256(
+		_mm256_castsi128_si256(_mm_loadu_si128((__m128i const*)s)),
+		_mm_loadu_si128((__m128i const*)(s + 12)), 1);
+	v = _mm256_shuffle_epi8(v, shuf);
+	return Sign ? _mm256_srai_epi32(v, 8) : _mm256_srli_epi32(v, 8);
+}
+
+template<typename OUT>
+	COREARRAY_TARGET("avx2")
+	static void PR_Decode24_AVX2(OUT *p, const C_UInt8 *s, size_t n,
+	bool Sign, C_Float64 Scale, C_Float64 Offset)
+{
+	const __m256d sc = _mm256_set1_pd(Scale), off = _mm256_set1_pd(Offset);
+	const __m256i miss = _mm256_set1_epi32(Sign ? 0xFF800000 : 0xFFFFFF);
+	for (; n >= 10; n-=8, s+=24, p+=8)
+	{
+		__m256i v = PR_Load8_24(s, Sign);
+		__m256d y0, y1;
+		PR_ToF64(v, false, sc, off, y0, y1);
+		PR_Store8(p, y0, y1, _mm256_cmpeq_epi32(v, miss));
+	}
+	PR_Decode24(p, s, n, Sign, Scale, Offset);
+}
+
+/// encode 4 float64 to 32-bit lanes
+COREARRAY_TARGET("avx2")
+static inline __m128i PR_Encode4(const C_Float64 *s, const __m256d &Lo,
+	const __m256d &Hi, const __m128i &Missing, const __m256d &Offset,
+	const __m256d &InvScale)
+{
+	const __m256i idx = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+	__m256d t = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(s), Offset),
+		InvScale);
+	__m256d v = _mm256_and_pd(_mm256_cmp_pd(t, Lo, _CMP_GT_OQ),
+		_mm256_cmp_pd(t, Hi, _CMP_LT_OQ));
+	__m128i m = _mm256_castsi256_si128(
+		_mm256_permutevar8x32_epi32(_mm256_castpd_si256(v), idx));
+	return _mm_blendv_epi8(Missing, PR_Round4(t), m);
+}
+
+COREARRAY_TARGET("avx2")
+static void PR_E16_AVX2(C_UInt16 *p, const C_Float64 *s, size_t n,
+	C_Float64 Lo, C_Float64 Hi, C_UInt16 Missing, C_Float64 Offset,
+	C_Float64 InvScale)
+{
+	const __m256d lo = _mm256_set1_pd(Lo), hi = _mm256_set1_pd(Hi);
+	const __m256d off = _mm256_set1_pd(Offset);
+	const __m256d inv = _mm256_set1_pd(InvScale);
+	const __m128i miss = _mm_set1_epi32(Missing);
+	for (; n >= 8; n-=8, s+=8, p+=8)
+	{
+		__m128i a = PR_Encode4(s, lo, hi, miss, off, inv);
+		__m128i b = PR_Encode4(s+4, lo, hi, miss, off, inv);
+		// keep the lower 16 bits
+		a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		_mm_storeu_si128((__m128i*)p, _mm_packs_epi32(a, b));
+	}
+	PR_Encode(p, s, n, Lo, Hi, Missing, Offset, InvScale);
+}
+
+COREARRAY_TARGET("avx2")
+static void PR_E32_AVX2(C_UInt32 *p, const C_Float64 *s, size_t n,
+	C_Float64 Lo, C_Float64 Hi, C_UInt32 Missing, C_Float64 Offset,
+	C_Float64 InvScale)
+{
+	const __m256d lo = _mm256_set1_pd(Lo), hi = _mm256_set1_pd(Hi);
+	const __m256d off = _mm256_set1_pd(Offset);
+	const __m256d inv = _mm256_set1_pd(InvScale);
+	const __m128i miss = _mm_set1_epi32(Missing);
+	for (; n >= 4; n-=4, s+=4, p+=4)
+	{
+		_mm_storeu_si128((__m128i*)p,
+			PR_Encode4(s, lo, hi, miss, off, inv));
+	}
+	PR_Encode(p, s, n, Lo, Hi, Missing, Offset, InvScale);
+}
+
+#endif
+
+
+/// select the kernels by the CPU features
+static TdPackedRealKernel PR_SelectKernel()
+{
+	TdPackedRealKernel K;
+	const char *ISA = "none";
+
+	K.D16_F64 = PR_Decode<C_Float64, C_UInt16>;
+	K.D16_F32 = PR_Decode<C_Float32, C_UInt16>;
+	K.D16_I32 = PR_Decode<C_Int32, C_UInt16>;
+	K.D32_F64 = PR_Decode<C_Float64, C_UInt32>;
+	K.D32_F32 = PR_Decode<C_Float32, C_UInt32>;
+	K.D32_I32 = PR_Decode<C_Int32, C_UInt32>;
+	K.D24_F64 = PR_Decode24<C_Float64>;
+	K.D24_F32 = PR_Decode24<C_Float32>;
+	K.D24_I32 = PR_Decode24<C_Int32>;
+	K.E16 = PR_Encode<C_UInt16>;
+	K.E32 = PR_Encode<C_UInt32>;
+
+#ifdef COREARRAY_SIMD_SSE2
+	K.D16_F64 = PR_Decode_SSE2<C_Float64, C_UInt16>;
+	K.D16_F32 = PR_Decode_SSE2<C_Float32, C_UInt16>;
+	K.D16_I32 = PR_Decode_SSE2<C_Int32, C_UInt16>;
+	K.D32_F64 = PR_Decode_SSE2<C_Float64, C_UInt32>;
+	K.D32_F32 = PR_Decode_SSE2<C_Float32, C_UInt32>;
+	K.D32_I32 = PR_Decode_SSE2<C_Int32, C_UInt32>;
+	// no byte shuffle in SSE2, so the scalar decoder for 24-bit integers
+	K.E16 = PR_E16_SSE2;
+	K.E32 = PR_E32_SSE2;
+	ISA = "SSE2";
+#endif
+
+#if defined(COREARRAY_SIMD_AVX2) || defined(COREARRAY_TARGET_DISPATCH)
+	C_UInt32 Flag = Mach::GetCPU_Features();
+#   ifdef COREARRAY_SIMD_AVX2
+	Flag |= Mach::cpuAVX2;
+#   endif
+	if (Flag & Mach::cpuAVX2)
+	{
+		K.D16_F64 = PR_Decode_AVX2<C_Float64, C_UInt16>;
+		K.D16_F32 = PR_Decode_AVX2<C_Float32, C_UInt16>;
+		K.D16_I32 = PR_Decode_AVX2<C_Int32, C_UInt16>;
+		K.D32_F64 = PR_Decode_AVX2<C_Float64, C_UInt32>;
+		K.D32_F32 = PR_Decode_AVX2<C_Float32, C_UInt32>;
+		K.D32_I32 = PR_Decode_AVX2<C_Int32, C_UInt32>;
+		K.D24_F64 = PR_Decode24_AVX2<C_Float64>;
+		K.D24_F32 = PR_Decode24_AVX2<C_Float32>;
+		K.D24_I32 = PR_Decode24_AVX2<C_Int32>;
+		K.E16 = PR_E16_AVX2;
+		K.E32 = PR_E32_AVX2;
+		ISA = "AVX2";
+	}
+#endif
+
+	Mach::SetSIMD_Kernel("packedreal", ISA);
+	return K;
+}
+
+TdPackedRealKernel CoreArray::dPackedRealKernel = PR_SelectKernel();
+
+
 
 namespace CoreArray
 {
@@ -414,6 +414,130 @@ namespace CoreArray
 
 
 
+	// =====================================================================
+	// Vectorized kernels of packed real numbers
+	// =====================================================================
+
+	/// the kernels of packed real numbers, selected by the CPU features
+	/** Decoding: (Sign ? signed : unsigned) integer * Scale + Offset, or
+	 *  NaN (NA_INTEGER for int32) if it is the missing value;
+	 *  encoding: (val - Offset) * InvScale rounded half away from zero, or
+	 *  the missing value if it is not in (Lo, Hi)
+	**/
+	struct COREARRAY_DLL_DEFAULT TdPackedRealKernel
+	{
+		void (*D16_F64)(C_Float64 *p, const C_UInt16 *s, size_t n, bool Sign,
+			C_UInt16 Missing, C_Float64 Scale, C_Float64 Offset);
+		void (*D16_F32)(C_Float32 *p, const C_UInt16 *s, size_t n, bool Sign,
+			C_UInt16 Missing, C_Float64 Scale, C_Float64 Offset);
+		void (*D16_I32)(C_Int32 *p, const C_UInt16 *s, size_t n, bool Sign,
+			C_UInt16 Missing, C_Float64 Scale, C_Float64 Offset);
+		void (*D32_F64)(C_Float64 *p, const C_UInt32 *s, size_t n, bool Sign,
+			C_UInt32 Missing, C_Float64 Scale, C_Float64 Offset);
+		void (*D32_F32)(C_Float32 *p, const C_UInt32 *s, size_t n, bool Sign,
+			C_UInt32 Missing, C_Float64 Scale, C_Float64 Offset);
+		void (*D32_I32)(C_Int32 *p, const C_UInt32 *s, size_t n, bool Sign,
+			C_UInt32 Missing, C_Float64 Scale, C_Float64 Offset);
+		/// 24-bit little-endian integers, the missing value is 0x800000
+		/// (signed) or 0xFFFFFF (unsigned)
+		void (*D24_F64)(C_Float64 *p, const C_UInt8 *s, size_t n, bool Sign,
+			C_Float64 Scale, C_Float64 Offset);
+		void (*D24_F32)(C_Float32 *p, const C_UInt8 *s, size_t n, bool Sign,
+			C_Float64 Scale, C_Float64 Offset);
+		void (*D24_I32)(C_Int32 *p, const C_UInt8 *s, size_t n, bool Sign,
+			C_Float64 Scale, C_Float64 Offset);
+		/// Lo >= -2147483648 and Hi <= 2147483648 are required
+		void (*E16)(C_UInt16 *p, const C_Float64 *s, size_t n, C_Float64 Lo,
+			C_Float64 Hi, C_UInt16 Missing, C_Float64 Offset, C_Float64 InvScale);
+		void (*E32)(C_UInt32 *p, const C_Float64 *s, size_t n, C_Float64 Lo,
+			C_Float64 Hi, C_UInt32 Missing, C_Float64 Offset, C_Float64 InvScale);
+	};
+
+	extern TdPackedRealKernel dPackedRealKernel;
+
+
+	/// Kernels of packed real numbers for MEM_TYPE (float64, float32, int32)
+	template<typename MEM_TYPE> struct COREARRAY_DLL_DEFAULT PACKED_REAL_VEC
+	{
+		static const bool Decode = false;
+		static const bool Encode = false;
+		static void D16(MEM_TYPE *, const C_UInt16 *, size_t, bool, C_UInt16,
+			C_Float64, C_Float64) { }
+		static void D32(MEM_TYPE *, const C_UInt32 *, size_t, bool, C_UInt32,
+			C_Float64, C_Float64) { }
+		static void D24(MEM_TYPE *, const C_UInt8 *, size_t, bool, C_Float64,
+			C_Float64) { }
+		static void E16(C_UInt16 *, const MEM_TYPE *, size_t, C_Float64,
+			C_Float64, C_UInt16, C_Float64, C_Float64) { }
+		static void E32(C_UInt32 *, const MEM_TYPE *, size_t, C_Float64,
+			C_Float64, C_UInt32, C_Float64, C_Float64) { }
+	};
+
+#ifdef COREARRAY_SIMD_SSE2
+
+	template<> struct COREARRAY_DLL_DEFAULT PACKED_REAL_VEC<C_Float64>
+	{
+		static const bool Decode = true;
+		static const bool Encode = true;
+		static void D16(C_Float64 *p, const C_UInt16 *s, size_t n, bool Sign,
+			C_UInt16 Missing, C_Float64 Scale, C_Float64 Offset)
+			{ dPackedRealKernel.D16_F64(p, s, n, Sign, Missing, Scale, Offset); }
+		static void D32(C_Float64 *p, const C_UInt32 *s, size_t n, bool Sign,
+			C_UInt32 Missing, C_Float64 Scale, C_Float64 Offset)
+			{ dPackedRealKernel.D32_F64(p, s, n, Sign, Missing, Scale, Offset); }
+		static void D24(C_Float64 *p, const C_UInt8 *s, size_t n, bool Sign,
+			C_Float64 Scale, C_Float64 Offset)
+			{ dPackedRealKernel.D24_F64(p, s, n, Sign, Scale, Offset); }
+		static void E16(C_UInt16 *p, const C_Float64 *s, size_t n, C_Float64 Lo,
+			C_Float64 Hi, C_UInt16 Missing, C_Float64 Offset, C_Float64 InvScale)
+			{ dPackedRealKernel.E16(p, s, n, Lo, Hi, Missing, Offset, InvScale); }
+		static void E32(C_UInt32 *p, const C_Float64 *s, size_t n, C_Float64 Lo,
+			C_Float64 Hi, C_UInt32 Missing, C_Float64 Offset, C_Float64 InvScale)
+			{ dPackedRealKernel.E32(p, s, n, Lo, Hi, Missing, Offset, InvScale); }
+	};
+
+	template<> struct COREARRAY_DLL_DEFAULT PACKED_REAL_VEC<C_Float32>
+	{
+		static const bool Decode = true;
+		static const bool Encode = false;
+		static void D16(C_Float32 *p, const C_UInt16 *s, size_t n, bool Sign,
+			C_UInt16 Missing, C_Float64 Scale, C_Float64 Offset)
+			{ dPackedRealKernel.D16_F32(p, s, n, Sign, Missing, Scale, Offset); }
+		static void D32(C_Float32 *p, const C_UInt32 *s, size_t n, bool Sign,
+			C_UInt32 Missing, C_Float64 Scale, C_Float64 Offset)
+			{ dPackedRealKernel.D32_F32(p, s, n, Sign, Missing, Scale, Offset); }
+		static void D24(C_Float32 *p, const C_UInt8 *s, size_t n, bool Sign,
+			C_Float64 Scale, C_Float64 Offset)
+			{ dPackedRealKernel.D24_F32(p, s, n, Sign, Scale, Offset); }
+		static void E16(C_UInt16 *, const C_Float32 *, size_t, C_Float64,
+			C_Float64, C_UInt16, C_Float64, C_Float64) { }
+		static void E32(C_UInt32 *, const C_Float32 *, size_t, C_Float64,
+			C_Float64, C_UInt32, C_Float64, C_Float64) { }
+	};
+
+	template<> struct COREARRAY_DLL_DEFAULT PACKED_REAL_VEC<C_Int32>
+	{
+		static const bool Decode = true;
+		static const bool Encode = false;
+		static void D16(C_Int32 *p, const C_UInt16 *s, size_t n, bool Sign,
+			C_UInt16 Missing, C_Float64 Scale, C_Float64 Offset)
+			{ dPackedRealKernel.D16_I32(p, s, n, Sign, Missing, Scale, Offset); }
+		static void D32(C_Int32 *p, const C_UInt32 *s, size_t n, bool Sign,
+			C_UInt32 Missing, C_Float64 Scale, C_Float64 Offset)
+			{ dPackedRealKernel.D32_I32(p, s, n, Sign, Missing, Scale, Offset); }
+		static void D24(C_Int32 *p, const C_UInt8 *s, size_t n, bool Sign,
+			C_Float64 Scale, C_Float64 Offset)
+			{ dPackedRealKernel.D24_I32(p, s, n, Sign, Scale, Offset); }
+		static void E16(C_UInt16 *, const C_Int32 *, size_t, C_Float64,
+			C_Float64, C_UInt16, C_Float64, C_Float64) { }
+		static void E32(C_UInt32 *, const C_Int32 *, size_t, C_Float64,
+			C_Float64, C_UInt32, C_Float64, C_Float64) { }
+	};
+
+#endif
+
+
+
 	// =====================================================================
 	// Template for Allocator
 	// =====================================================================
@@ -478,13 +602,26 @@ namespace CoreArray
 			{
 				ssize_t Cnt = (n >= NBUF) ? NBUF : n;
 				C_Int8 *s = Buf;
-				for (ssize_t m=Cnt; m > 0; m--)
+				if (PACKED_REAL_VEC<MEM_TYPE>::Encode)
 				{
-					double v = round((VAL_CONV_TO_F64(MEM_TYPE, *p++) - offset) * scale);
-					C_Int8 I = 0x80;
-					if (IsFinite(v) && (-127.5 < v) && (v <= 127.5))
-						I = (int)v;
-					*s++ = I;
+					C_UInt16 W[1024];
+					for (ssize_t m=Cnt; m > 0; )
+					{
+						ssize_t k = (m >= 1024) ? 1024 : m;
+						PACKED_REAL_VEC<MEM_TYPE>::E16(W, p, k, -127.5, 127.5, 0x80,
+							offset, scale);
+						for (ssize_t i=0; i < k; i++) *s++ = W[i];
+						p += k; m -= k;
+					}
+				} else {
+					for (ssize_t m=Cnt; m > 0; m--)
+					{
+						double v = round((VAL_CONV_TO_F64(MEM_TYPE, *p++) - offset) * scale);
+						C_Int8 I = 0x80;
+						if (IsFinite(v) && (-127.5 < v) && (v <= 127.5))
+							I = (int)v;
+						*s++ = I;
+					}
 				}
 				I.Allocator->WriteData(Buf, Cnt);
 				n -= Cnt;
@@ -556,13 +693,26 @@ namespace CoreArray
 			{
 				ssize_t Cnt = (n >= NBUF) ? NBUF : n;
 				C_UInt8 *s = Buf;
-				for (ssize_t m=Cnt; m > 0; m--)
+				if (PACKED_REAL_VEC<MEM_TYPE>::Encode)
 				{
-					double v = round((VAL_CONV_TO_F64(MEM_TYPE, *p++) - offset) * scale);
-					C_UInt8 I = 0xFF;
-					if (IsFinite(v) && (-0.5 < v) && (v <= 254.5))
-						I = (unsigned)v;
-					*s++ = I;
+					C_UInt16 W[1024];
+					for (ssize_t m=Cnt; m > 0; )
+					{
+						ssize_t k = (m >= 1024) ? 1024 : m;
+						PACKED_REAL_VEC<MEM_TYPE>::E16(W, p, k, -0.5, 254.5, 0xFF,
+							offset, scale);
+						for (ssize_t i=0; i < k; i++) *s++ = W[i];
+						p += k; m -= k;
+					}
+				} else {
+					for (ssize_t m=Cnt; m > 0; m--)
+					{
+						double v = round((VAL_CONV_TO_F64(MEM_TYPE, *p++) - offset) * scale);
+						C_UInt8 I = 0xFF;
+						if (IsFinite(v) && (-0.5 < v) && (v <= 254.5))
+							I = (unsigned)v;
+						*s++ = I;
+					}
 				}
 				I.Allocator->WriteData(Buf, Cnt);
 				n -= Cnt;
@@ -595,6 +745,13 @@ namespace CoreArray
 				ssize_t Cnt = (n >= NBUF) ? NBUF : n;
 				ss.R(Buf, Cnt);
 				n -= Cnt;
+				if (PACKED_REAL_VEC<MEM_TYPE>::Decode)
+				{
+					PACKED_REAL_VEC<MEM_TYPE>::D16(p, (const C_UInt16*)Buf, Cnt,
+						true, 0x8000, scale, offset);
+					p += Cnt;
+					continue;
+				}
 				for (C_Int16 *s=Buf; Cnt > 0; Cnt--, s++)
 				{
 					*p++ = VAL_CONV_FROM_F64(MEM_TYPE,
@@ -645,14 +802,21 @@ namespace CoreArray
 			while (n > 0)
 			{
 				ssize_t Cnt = (n >= NBUF) ? NBUF : n;
-				C_Int16 *s = Buf;
-				for (ssize_t m=Cnt; m > 0; m--)
+				if (PACKED_REAL_VEC<MEM_TYPE>::Encode)
 				{
-					double v = round((VAL_CONV_TO_F64(MEM_TYPE, *p++) - offset) * scale);
-					C_Int16 I = 0x8000;
-					if (IsFinite(v) && (-32767.5 < v) && (v <= 32767.5))
-						I = (C_Int16)v;
-					*s++ = I;
+					PACKED_REAL_VEC<MEM_TYPE>::E16((C_UInt16*)Buf, p, Cnt,
+						-32767.5, 32767.5, 0x8000, offset, scale);
+					p += Cnt;
+				} else {
+					C_Int16 *s = Buf;
+					for (ssize_t m=Cnt; m > 0; m--)
+					{
+						double v = round((VAL_CONV_TO_F64(MEM_TYPE, *p++) - offset) * scale);
+						C_Int16 I = 0x8000;
+						if (IsFinite(v) && (-32767.5 < v) && (v <= 32767.5))
+							I = (C_Int16)v;
+						*s++ = I;
+					}
 				}
 				COREARRAY_ENDIAN_NT_TO_LE_ARRAY(Buf, Cnt);
 				I.Allocator->WriteData(Buf, Cnt << 1);
@@ -686,6 +850,13 @@ namespace CoreArray
 				ssize_t Cnt = (n >= NBUF) ? NBUF : n;
 				ss.R(Buf, Cnt);
 				n -= Cnt;
+				if (PACKED_REAL_VEC<MEM_TYPE>::Decode)
+				{
+					PACKED_REAL_VEC<MEM_TYPE>::D16(p, (const C_UInt16*)Buf, Cnt,
+						false, 0xFFFF, scale, offset);
+					p += Cnt;
+					continue;
+				}
 				for (C_UInt16 *s=Buf; Cnt > 0; Cnt--, s++)
 				{
 					*p++ = VAL_CONV_FROM_F64(MEM_TYPE,
@@ -736,14 +907,21 @@ namespace CoreArray
 			while (n > 0)
 			{
 				ssize_t Cnt = (n >= NBUF) ? NBUF : n;
-				C_UInt16 *s = Buf;
-				for (ssize_t m=Cnt; m > 0; m--)
+				if (PACKED_REAL_VEC<MEM_TYPE>::Encode)
 				{
-					double v = round((VAL_CONV_TO_F64(MEM_TYPE, *p++) - offset) * scale);
-					C_UInt16 I = 0xFFFF;
-					if (IsFinite(v) && (-0.5 < v) && (v <= 65534.5))
-						I = (C_UInt16)v;
-					*s++ = I;
+					PACKED_REAL_VEC<MEM_TYPE>::E16((C_UInt16*)Buf, p, Cnt,
+						-0.5, 65534.5, 0xFFFF, offset, scale);
+					p += Cnt;
+				} else {
+					C_UInt16 *s = Buf;
+					for (ssize_t m=Cnt; m > 0; m--)
+					{
+						double v = round((VAL_CONV_TO_F64(MEM_TYPE, *p++) - offset) * scale);
+						C_UInt16 I = 0xFFFF;
+						if (IsFinite(v) && (-0.5 < v) && (v <= 65534.5))
+							I = (C_UInt16)v;
+						*s++ = I;
+					}
 				}
 				COREARRAY_ENDIAN_NT_TO_LE_ARRAY(Buf, Cnt);
 				I.Allocator->WriteData(Buf, Cnt << 1);
@@ -776,6 +954,13 @@ namespace CoreArray
 				ssize_t Cnt = (n >= NBUF) ? NBUF : n;
 				I.Allocator->ReadData(Buf, Cnt*3);
 				n -= Cnt;
+				if (PACKED_REAL_VEC<MEM_TYPE>::Decode)
+				{
+					PACKED_REAL_VEC<MEM_TYPE>::D24(p, Buf[0], Cnt, true, scale,
+						offset);
+					p += Cnt;
+					continue;
+				}
 				for (C_UInt8 *s=Buf[0]; Cnt > 0; Cnt--, s+=3)
 				{
 					C_Int32 val = s[0] | (C_Int32(s[1]) << 8) | (C_Int32(s[2]) << 16);
@@ -836,16 +1021,34 @@ namespace CoreArray
 			{
 				ssize_t Cnt = (n >= NBUF) ? NBUF : n;
 				C_UInt8 *s = Buf[0];
-				for (ssize_t m=Cnt; m > 0; m--)
+				if (PACKED_REAL_VEC<MEM_TYPE>::Encode)
 				{
-					double v = round((VAL_CONV_TO_F64(MEM_TYPE, *p++) - offset) * scale);
-					C_Int32 I = 0x800000;
-					if (IsFinite(v) && (-8388607.5 < v) && (v <= 8388607.5))
-						I = (C_Int32)v;
-					s[0] = C_UInt8(I);
-					s[1] = C_UInt8(I >> 8);
-					s[2] = C_UInt8(I >> 16);
-					s += 3;
+					C_UInt32 W[1024];
+					for (ssize_t m=Cnt; m > 0; )
+					{
+						ssize_t k = (m >= 1024) ? 1024 : m;
+						PACKED_REAL_VEC<MEM_TYPE>::E32(W, p, k, -8388607.5, 8388607.5, 0x800000,
+							offset, scale);
+						for (ssize_t i=0; i < k; i++, s+=3)
+						{
+							s[0] = C_UInt8(W[i]);
+							s[1] = C_UInt8(W[i] >> 8);
+							s[2] = C_UInt8(W[i] >> 16);
+						}
+						p += k; m -= k;
+					}
+				} else {
+					for (ssize_t m=Cnt; m > 0; m--)
+					{
+						double v = round((VAL_CONV_TO_F64(MEM_TYPE, *p++) - offset) * scale);
+						C_Int32 I = 0x800000;
+						if (IsFinite(v) && (-8388607.5 < v) && (v <= 8388607.5))
+							I = (C_Int32)v;
+						s[0] = C_UInt8(I);
+						s[1] = C_UInt8(I >> 8);
+						s[2] = C_UInt8(I >> 16);
+						s += 3;
+					}
 				}
 				I.Allocator->WriteData(Buf, Cnt*3);
 				n -= Cnt;
@@ -877,6 +1080,13 @@ namespace CoreArray
 				ssize_t Cnt = (n >= NBUF) ? NBUF : n;
 				I.Allocator->ReadData(Buf, Cnt*3);
 				n -= Cnt;
+				if (PACKED_REAL_VEC<MEM_TYPE>::Decode)
+				{
+					PACKED_REAL_VEC<MEM_TYPE>::D24(p, Buf[0], Cnt, false, scale,
+						offset);
+					p += Cnt;
+					continue;
+				}
 				for (C_UInt8 *s=Buf[0]; Cnt > 0; Cnt--, s+=3)
 				{
 					C_UInt32 val = s[0] | (C_UInt32(s[1]) << 8) | (C_UInt32(s[2]) << 16);
@@ -933,16 +1143,34 @@ namespace CoreArray
 			{
 				ssize_t Cnt = (n >= NBUF) ? NBUF : n;
 				C_UInt8 *s = Buf[0];
-				for (ssize_t m=Cnt; m > 0; m--)
+				if (PACKED_REAL_VEC<MEM_TYPE>::Encode)
 				{
-					double v = round((VAL_CONV_TO_F64(MEM_TYPE, *p++) - offset) * scale);
-					C_UInt32 I = 0xFFFFFF;
-					if (IsFinite(v) && (-0.5 < v) && (v <= 16777214.5))
-						I = (C_UInt32)v;
-					s[0] = C_UInt8(I);
-					s[1] = C_UInt8(I >> 8);
-					s[2] = C_UInt8(I >> 16);
-					s += 3;
+					C_UInt32 W[1024];
+					for (ssize_t m=Cnt; m > 0; )
+					{
+						ssize_t k = (m >= 1024) ? 1024 : m;
+						PACKED_REAL_VEC<MEM_TYPE>::E32(W, p, k, -0.5, 16777214.5, 0xFFFFFF,
+							offset, scale);
+						for (ssize_t i=0; i < k; i++, s+=3)
+						{
+							s[0] = C_UInt8(W[i]);
+							s[1] = C_UInt8(W[i] >> 8);
+							s[2] = C_UInt8(W[i] >> 16);
+						}
+						p += k; m -= k;
+					}
+				} else {
+					for (ssize_t m=Cnt; m > 0; m--)
+					{
+						double v = round((VAL_CONV_TO_F64(MEM_TYPE, *p++) - offset) * scale);
+						C_UInt32 I = 0xFFFFFF;
+						if (IsFinite(v) && (-0.5 < v) && (v <= 16777214.5))
+							I = (C_UInt32)v;
+						s[0] = C_UInt8(I);
+						s[1] = C_UInt8(I >> 8);
+						s[2] = C_UInt8(I >> 16);
+						s += 3;
+					}
 				}
 				I.Allocator->WriteData(Buf, Cnt*3);
 				n -= Cnt;
@@ -975,6 +1203,13 @@ namespace CoreArray
 				ssize_t Cnt = (n >= NBUF) ? NBUF : n;
 				ss.R(Buf, Cnt);
 				n -= Cnt;
+				if (PACKED_REAL_VEC<MEM_TYPE>::Decode)
+				{
+					PACKED_REAL_VEC<MEM_TYPE>::D32(p, (const C_UInt32*)Buf, Cnt,
+						true, 0x80000000, scale, offset);
+					p += Cnt;
+					continue;
+				}
 				for (C_Int32 *s=Buf; Cnt > 0; Cnt--, s++)
 				{
 					*p++ = VAL_CONV_FROM_F64(MEM_TYPE,
@@ -1025,14 +1260,21 @@ namespace CoreArray
 			while (n > 0)
 			{
 				ssize_t Cnt = (n >= NBUF) ? NBUF : n;
-				C_Int32 *s = Buf;
-				for (ssize_t m=Cnt; m > 0; m--)
+				if (PACKED_REAL_VEC<MEM_TYPE>::Encode)
 				{
-					double v = round((VAL_CONV_TO_F64(MEM_TYPE, *p++) - offset) * scale);
-					C_Int32 I = 0x80000000;
-					if (IsFinite(v) && (-2147483647.5 < v) && (v <= 2147483647.5))
-						I = (C_Int32)v;
-					*s++ = I;
+					PACKED_REAL_VEC<MEM_TYPE>::E32((C_UInt32*)Buf, p, Cnt,
+						-2147483647.5, 2147483647.5, 0x80000000, offset, scale);
+					p += Cnt;
+				} else {
+					C_Int32 *s = Buf;
+					for (ssize_t m=Cnt; m > 0; m--)
+					{
+						double v = round((VAL_CONV_TO_F64(MEM_TYPE, *p++) - offset) * scale);
+						C_Int32 I = 0x80000000;
+						if (IsFinite(v) && (-2147483647.5 < v) && (v <= 2147483647.5))
+							I = (C_Int32)v;
+						*s++ = I;
+					}
 				}
 				COREARRAY_ENDIAN_NT_TO_LE_ARRAY(Buf, Cnt);
 				I.Allocator->WriteData(Buf, Cnt << 2);
@@ -1066,6 +1308,13 @@ namespace CoreArray
 				ssize_t Cnt = (n >= NBUF) ? NBUF : n;
 				ss.R(Buf, Cnt);
 				n -= Cnt;
+				if (PACKED_REAL_VEC<MEM_TYPE>::Decode)
+				{
+					PACKED_REAL_VEC<MEM_TYPE>::D32(p, (const C_UInt32*)Buf, Cnt,
+						false, 0xFFFFFFFF, scale, offset);
+					p += Cnt;
+					continue;
+				}
 				for (C_UInt32 *s=Buf; Cnt > 0; Cnt--, s++)
 				{
 					*p++ = VAL_CONV_FROM_F64(MEM_TYPE,
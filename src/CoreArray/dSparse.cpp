@@ -0,0 +1,183 @@
+// ===========================================================
+//     _/_/_/   _/_/_/  _/_/_/_/    _/_/_/_/  _/_/_/   _/_/_/
+//      _/    _/       _/             _/    _/    _/   _/   _/
+//     _/    _/       _/_/_/_/       _/    _/    _/   _/_/_/
+//    _/    _/       _/             _/    _/    _/   _/
+// _/_/_/   _/_/_/  _/_/_/_/_/     _/     _/_/_/   _/_/
+// ===========================================================
+//
+// dSparse.cpp: Sparse array-oriented containers in GDS
+//
+// Copyright (C) 2019    Xiuwen Zheng
+//
+// This file is part of CoreArray.
+//
+// CoreArray is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License Version 3 as
+// published by the Free Software Foundation.
+//
+// CoreArray is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with CoreArray.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef COREARRAY_NO_COMPILER_OPTIM_O3
+#if defined(__clang__)
+#pragma clang optimize on
+#elif defined(__GNUC__) && ((__GNUC__>4) || (__GNUC__==4 && __GNUC_MINOR__>=4))
+#pragma GCC optimize("O3")
+#endif
+#endif
+
+#include "dSparse.h"
+
+
+using namespace std;
+using namespace CoreArray;
+
+static const char *ERR_INV_DIM_CNT = "%s: Invalid number of dimensions (%d).";
+static const char *ERR_INV_DIMLEN  = "%s: Invalid length of the %d dimension (%d).";
+
+
+// =====================================================================
+
+const ssize_t CdSpStruct::BatchSize;
+
+CdSpStruct::CdSpStruct(ssize_t ValSize)
+{
+	fIndexingStream = NULL;
+	fEntrySize = sizeof(C_UInt32) + ValSize;
+	fNumEntry = fNumColumn = 0;
+	fCurIndex = -1;
+	fCurEntry = fCurEnd = 0;
+}
+
+CdSpStruct::~CdSpStruct()
+{ }
+
+C_Int64 CdSpStruct::SpCheckDim(const C_Int32 DimLen[], int DCnt,
+	C_Int64 &TotalCount)
+{
+	if ((DCnt <= 0) || (DCnt > (int)CdAbstractArray::MAX_ARRAY_DIM))
+		throw ErrArray(ERR_INV_DIM_CNT, "CdSpArray::ResetDim", DCnt);
+	TotalCount = 1;
+	for (int i=0; i < DCnt; i++)
+	{
+		if (DimLen[i] < 0)
+			throw ErrArray(ERR_INV_DIMLEN, "CdSpArray::ResetDim", i, DimLen[i]);
+		TotalCount *= DimLen[i];
+	}
+	// a one-dimensional array is a single column
+	if (DCnt <= 1) return C_Int64(1) << 32;
+	C_Int64 ColSize = 1;
+	for (int i=1; i < DCnt; i++) ColSize *= DimLen[i];
+	if (ColSize > C_Int64(0xFFFFFFFF))
+		throw ErrArray("CdSpArray::ResetDim: the column is too long.");
+	return ColSize;
+}
+
+void CdSpStruct::SpColumnRange(C_Int64 Col, C_Int64 &St, C_Int64 &Ed)
+{
+	if (Col >= fNumColumn)
+	{
+		St = Ed = fNumEntry;
+	} else {
+		C_Int64 Ptr[2];
+		ssize_t n = (Col + 1 < fNumColumn) ? 2 : 1;
+		fIndexingStream->SetPosition(Col * sizeof(C_Int64));
+		fIndexingStream->ReadData(Ptr, n * sizeof(C_Int64));
+		COREARRAY_ENDIAN_LE_TO_NT_ARRAY(Ptr, n);
+		St = Ptr[0];
+		Ed = (n > 1) ? Ptr[1] : fNumEntry;
+	}
+}
+
+C_Int64 CdSpStruct::SpLowerBound(CdAllocator &A, C_Int64 St, C_Int64 Ed,
+	C_UInt32 Row)
+{
+	// binary search on the row indices of entries
+	while (St < Ed)
+	{
+		C_Int64 Mid = St + (Ed - St) / 2;
+		A.SetPosition(Mid * fEntrySize);
+		C_UInt8 s[sizeof(C_UInt32)];
+		A.ReadData(s, sizeof(s));
+		C_UInt32 r = s[0] | (C_UInt32(s[1]) << 8) | (C_UInt32(s[2]) << 16) |
+			(C_UInt32(s[3]) << 24);
+		if (r < Row)
+			St = Mid + 1;
+		else
+			Ed = Mid;
+	}
+	return St;
+}
+
+void CdSpStruct::SpSeek(CdAllocator &A, C_Int64 Idx, C_Int64 Col,
+	C_UInt32 Row, C_Int64 &St, C_Int64 &Ed)
+{
+	if ((Idx == fCurIndex) && (Row > 0))
+	{
+		// continue from the cursor in the same column
+		St = fCurEntry; Ed = fCurEnd;
+	} else {
+		SpColumnRange(Col, St, Ed);
+		if ((Row > 0) && (St < Ed))
+			St = SpLowerBound(A, St, Ed, Row);
+	}
+}
+
+void CdSpStruct::SpAddColumn(C_Int64 Col, C_Int64 NumEntry)
+{
+	if (!fIndexingStream)
+		throw ErrArray("CdSpArray: no indexing stream.");
+	C_Int64 Buf[1024];
+	fIndexingStream->SetPosition(fNumColumn * sizeof(C_Int64));
+	while (fNumColumn <= Col)
+	{
+		ssize_t n = 0;
+		for (; (n < 1024) && (fNumColumn <= Col); n++, fNumColumn++)
+			Buf[n] = COREARRAY_ENDIAN_NT_TO_LE(NumEntry);
+		fIndexingStream->WriteData(Buf, n * sizeof(C_Int64));
+	}
+}
+
+void CdSpStruct::SpClear(CdAllocator &A)
+{
+	if ((fNumEntry > 0) || (fNumColumn > 0))
+	{
+		A.SetSize(0);
+		if (fIndexingStream) fIndexingStream->SetSize(0);
+		fNumEntry = fNumColumn = 0;
+	}
+	fCurIndex = -1;
+}
+
+
+namespace CoreArray
+{
+	template<typename TClass> static CdObjRef *OnObjCreate()
+	{
+		return new TClass();
+	}
+
+	COREARRAY_DLL_LOCAL void RegisterClass_Sparse()
+	{
+		#define REG_CLASS(T, CLASS, CType, Desp)	\
+			dObjManager().AddClass(TdTraits< T >::StreamName(), \
+				OnObjCreate< CLASS >, CdObjClassMgr::CType, Desp)
+
+		// sparse arrays
+		REG_CLASS(TSpInt8, CdSpArray<C_Int8>, ctArray, "sparse signed integer of 8 bits");
+		REG_CLASS(TSpInt16, CdSpArray<C_Int16>, ctArray, "sparse signed integer of 16 bits");
+		REG_CLASS(TSpInt32, CdSpArray<C_Int32>, ctArray, "sparse signed integer of 32 bits");
+		REG_CLASS(TSpInt64, CdSpArray<C_Int64>, ctArray, "sparse signed integer of 64 bits");
+		REG_CLASS(TSpReal32, CdSpArray<C_Float32>, ctArray, "sparse floating-point number (32 bits)");
+		REG_CLASS(TSpReal64, CdSpArray<C_Float64>, ctArray, "sparse floating-point number (64 bits)");
+
+		#undef REG_CLASS
+	}
+}
@@ -0,0 +1,572 @@
+// ===========================================================
+//     _/_/_/   _/_/_/  _/_/_/_/    _/_/_/_/  _/_/_/   _/_/_/
+//      _/    _/       _/             _/    _/    _/   _/   _/
+//     _/    _/       _/_/_/_/       _/    _/    _/   _/_/_/
+//    _/    _/       _/             _/    _/    _/   _/
+// _/_/_/   _/_/_/  _/_/_/_/_/     _/     _/_/_/   _/_/
+// ===========================================================
+//
+// dSparse.h: Sparse array-oriented containers in GDS
+//
+// Copyright (C) 2019    Xiuwen Zheng
+//
+// This file is part of CoreArray.
+//
+// CoreArray is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License Version 3 as
+// published by the Free Software Foundation.
+//
+// CoreArray is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with CoreArray.
+// If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ *	\file     dSparse.h
+ *	\author   Xiuwen Zheng [zhengxwen@gmail.com]
+ *	\version  1.0
+ *	\date     2019
+ *	\brief    Sparse array-oriented containers in GDS
+ *	\details
+**/
+
+#ifndef _HEADER_COREARRAY_SPARSE_
+#define _HEADER_COREARRAY_SPARSE_
+
+#include "dStruct.h"
+
+
+namespace CoreArray
+{
+	using namespace std;
+
+	/// define sparse element
+	template<typename TYPE> struct COREARRAY_DLL_DEFAULT TSpVal
+	{
+		typedef TYPE TType;
+		TYPE Val;
+	};
+
+	typedef TSpVal<C_Int8>     TSpInt8;
+	typedef TSpVal<C_Int16>    TSpInt16;
+	typedef TSpVal<C_Int32>    TSpInt32;
+	typedef TSpVal<C_Int64>    TSpInt64;
+	typedef TSpVal<C_Float32>  TSpReal32;
+	typedef TSpVal<C_Float64>  TSpReal64;
+
+
+	/// Traits of sparse element
+	template<typename TYPE> struct COREARRAY_DLL_DEFAULT TdTraits< TSpVal<TYPE> >
+	{
+		typedef TYPE ElmType;
+
+		static const int trVal = TdTraits<TYPE>::trVal;
+		static const unsigned BitOf = TdTraits<TYPE>::BitOf;
+		static const bool IsPrimitive = false;
+		static const C_SVType SVType = TdTraits<TYPE>::SVType;
+
+		static const char *StreamName()
+		{
+			switch (SVType)
+			{
+				case svInt8:    return "dSparseInt8";
+				case svInt16:   return "dSparseInt16";
+				case svInt32:   return "dSparseInt32";
+				case svInt64:   return "dSparseInt64";
+				case svFloat32: return "dSparseReal32";
+				case svFloat64: return "dSparseReal64";
+				default:        return "dSparse";
+			}
+		}
+		static const char *TraitName() { return StreamName()+1; }
+
+		COREARRAY_INLINE static TYPE Min() { return TdTraits<TYPE>::Min(); }
+		COREARRAY_INLINE static TYPE Max() { return TdTraits<TYPE>::Max(); }
+	};
+
+
+
+	// =====================================================================
+	// Sparse array
+	// =====================================================================
+
+	/// Compressed-column storage of sparse arrays
+	/** The array is split into columns by the slowest dimension (the last
+	 *  dimension in R), and a one-dimensional array is a single column. Only
+	 *  the nonzero entries are saved in the allocator of the array, column by
+	 *  column, and each entry is the row index in the column (4 bytes) and
+	 *  the value. The indexing stream has the number of entries before each
+	 *  column (8 bytes per column), so that reading a column costs time
+	 *  proportional to its nonzero count. The columns after the last nonzero
+	 *  entry have no record in the indexing stream.
+	**/
+	class COREARRAY_DLL_DEFAULT CdSpStruct
+	{
+	public:
+		/// the number of entries in a batch of reading or writing
+		static const ssize_t BatchSize = 4096;
+
+		/// constructor
+		CdSpStruct(ssize_t ValSize);
+		virtual ~CdSpStruct();
+
+		/// read the nonzero entries in a rectangle with selection
+		/** \param Start       the starting positions (from ZERO), it could be NULL
+		 *  \param Length      the lengths of each dimension, it could be NULL
+		 *  \param Selection   the array of selection, it could be NULL
+		 *  \param Row         output the row indices (from ZERO) in the result,
+		 *                     where the dimensions except the last one in R
+		 *                     are flattened
+		 *  \param Col         output the column indices (from ZERO)
+		 *  \param Val         output the values
+		**/
+		virtual void ReadSparse(const C_Int32 *Start, const C_Int32 *Length,
+			const C_BOOL *const Selection[], vector<C_Int32> &Row,
+			vector<C_Int32> &Col, vector<C_Int32> &Val) = 0;
+		/// read the nonzero entries in a rectangle with selection
+		virtual void ReadSparse(const C_Int32 *Start, const C_Int32 *Length,
+			const C_BOOL *const Selection[], vector<C_Int32> &Row,
+			vector<C_Int32> &Col, vector<C_Float64> &Val) = 0;
+
+		/// the number of nonzero entries
+		COREARRAY_INLINE C_Int64 NumNonZero() const { return fNumEntry; }
+
+	protected:
+		CdBlockStream *fIndexingStream; ///< the GDS stream for indexing
+		ssize_t fEntrySize;   ///< the size of an entry
+		C_Int64 fNumEntry;    ///< the number of nonzero entries
+		C_Int64 fNumColumn;   ///< the number of column records
+		C_Int64 fCurIndex;    ///< the array index of the cursor
+		C_Int64 fCurEntry;    ///< the entry at or after the cursor
+		C_Int64 fCurEnd;      ///< the end of entries in the column of cursor
+
+		/// check the dimension, return the column length and the total number
+		static C_Int64 SpCheckDim(const C_Int32 DimLen[], int DCnt,
+			C_Int64 &TotalCount);
+		/// get the entries [St, Ed) of the column
+		void SpColumnRange(C_Int64 Col, C_Int64 &St, C_Int64 &Ed);
+		/// the first entry in [St, Ed) whose row is not less than 'Row'
+		C_Int64 SpLowerBound(CdAllocator &A, C_Int64 St, C_Int64 Ed,
+			C_UInt32 Row);
+		/// locate the entries from the row 'Row' of the column 'Col'
+		void SpSeek(CdAllocator &A, C_Int64 Idx, C_Int64 Col, C_UInt32 Row,
+			C_Int64 &St, C_Int64 &Ed);
+		/// add the column records until the column 'Col'
+		void SpAddColumn(C_Int64 Col, C_Int64 NumEntry);
+		/// remove all entries
+		void SpClear(CdAllocator &A);
+	};
+
+
+	/// Container of sparse array
+	/** \tparam TYPE  the type of nonzero values, e.g. C_Int32, C_Float64 **/
+	template<typename TYPE>
+		class COREARRAY_DLL_DEFAULT CdSpArray:
+		public CdArray< TSpVal<TYPE> >, public CdSpStruct
+	{
+	public:
+		template<typename ALLOC_TYPE, typename MEM_TYPE> friend struct ALLOC_FUNC;
+		typedef TYPE ElmType;
+
+		/// the size of an entry: row index and value
+		static const ssize_t EntrySize = sizeof(C_UInt32) + sizeof(TYPE);
+
+		/// constructor
+		CdSpArray(): CdArray< TSpVal<TYPE> >(1), CdSpStruct(sizeof(TYPE))
+			{ }
+
+		virtual CdGDSObj *NewObject()
+		{
+			return (new CdSpArray<TYPE>)->AssignPipe(*this);
+		}
+
+		/// reset the array with new dimension, the nonzero entries are kept
+		/// if the length of column does not change
+		virtual void ResetDim(const C_Int32 DimLen[], int DCnt)
+		{
+			C_Int64 TotCnt;
+			C_Int64 ColSize = SpCheckDim(DimLen, DCnt, TotCnt);
+			if (TotCnt <= 0)
+			{
+				SpClear(this->fAllocator);
+			} else if ((fNumColumn > 0) && ((ColSize != SpColSize()) ||
+				(TotCnt < this->fTotalCount)))
+			{
+				throw ErrArray(
+					"CdSpArray::ResetDim: the nonzero entries of a sparse "
+					"array can not be moved.");
+			}
+			this->fTotalCount = TotCnt;
+			this->_ResetDim(DimLen, DCnt);
+			fCurIndex = -1;
+
+			this->fChanged = true;
+			if (this->fGDSStream) this->SaveToBlockStream();
+		}
+
+		/// set the new length of a dimension
+		virtual void SetDLen(int I, C_Int32 Value)
+		{
+			this->_CheckSetDLen(I, Value);
+			if (this->fDimension[I].DimLen != Value)
+			{
+				CdAbstractArray::TArrayDim D;
+				this->GetDim(D);
+				D[I] = Value;
+				ResetDim(D, this->DimCnt());
+			}
+		}
+
+		/// get a list of CdBlockStream owned by this object, except fGDSStream
+		virtual void GetOwnBlockStream(vector<const CdBlockStream*> &Out) const
+		{
+			CdArray< TSpVal<TYPE> >::GetOwnBlockStream(Out);
+			if (fIndexingStream) Out.push_back(fIndexingStream);
+		}
+		/// get a list of CdStream owned by this object, except fGDSStream
+		virtual void GetOwnBlockStream(vector<CdStream*> &Out)
+		{
+			CdArray< TSpVal<TYPE> >::GetOwnBlockStream(Out);
+			if (fIndexingStream) Out.push_back(fIndexingStream);
+		}
+
+		virtual void ReadSparse(const C_Int32 *Start, const C_Int32 *Length,
+			const C_BOOL *const Selection[], vector<C_Int32> &Row,
+			vector<C_Int32> &Col, vector<C_Int32> &Val)
+		{
+			_ReadSparse(Start, Length, Selection, Row, Col, Val);
+		}
+		virtual void ReadSparse(const C_Int32 *Start, const C_Int32 *Length,
+			const C_BOOL *const Selection[], vector<C_Int32> &Row,
+			vector<C_Int32> &Col, vector<C_Float64> &Val)
+		{
+			_ReadSparse(Start, Length, Selection, Row, Col, Val);
+		}
+
+	protected:
+
+		/// the number of elements in a column
+		COREARRAY_INLINE C_Int64 SpColSize() const
+		{
+			return (this->fDimension.size() > 1) ?
+				this->fDimension[0].DimElmCnt : (C_Int64(1) << 32);
+		}
+
+		/// visit the nonzero entries in [Idx, Idx+n) by Op(offset, value)
+		template<class OP> void SpScan(CdAllocator &A, C_Int64 Idx,
+			C_Int64 n, OP &Op)
+		{
+			const C_Int64 ColSize = SpColSize();
+			C_UInt8 Buf[BatchSize * EntrySize];
+			for (C_Int64 Off=0; n > 0; )
+			{
+				C_Int64 Col = Idx / ColSize;
+				C_UInt32 Row = Idx - Col*ColSize;
+				C_Int64 m = ColSize - Row;
+				if (m > n) m = n;
+				C_Int64 St, Ed;
+				SpSeek(A, Idx, Col, Row, St, Ed);
+				const C_Int64 RowEnd = Row + m;
+				A.SetPosition(St * EntrySize);
+				while (St < Ed)
+				{
+					ssize_t Cnt = (Ed - St < BatchSize) ? (Ed - St) : BatchSize;
+					A.ReadData(Buf, Cnt * EntrySize);
+					const C_UInt8 *s = Buf;
+					ssize_t i = 0;
+					for (; i < Cnt; i++, s+=EntrySize)
+					{
+						C_UInt32 r = s[0] | (C_UInt32(s[1]) << 8) |
+							(C_UInt32(s[2]) << 16) | (C_UInt32(s[3]) << 24);
+						if (r >= RowEnd) break;
+						TYPE v;
+						memcpy(&v, s + sizeof(C_UInt32), sizeof(TYPE));
+						Op(Off + (r - Row), COREARRAY_ENDIAN_LE_TO_NT(v));
+					}
+					St += i;
+					if (i < Cnt) break;
+				}
+				Idx += m; n -= m; Off += m;
+				fCurIndex = Idx; fCurEntry = St; fCurEnd = Ed;
+			}
+		}
+
+		/// append n elements, and only the nonzero values are saved
+		void SpAppend(CdAllocator &A, C_Int64 Idx, const TYPE *p, ssize_t n)
+		{
+			const C_Int64 ColSize = SpColSize();
+			if (ColSize <= 0)
+				throw ErrArray("CdSpArray: the column length is zero.");
+			A.SetPosition(fNumEntry * EntrySize);
+			C_UInt8 Buf[BatchSize * EntrySize];
+			C_UInt8 *s = Buf;
+			C_Int64 Col = Idx / ColSize;
+			C_Int64 Row = Idx - Col*ColSize;
+			for (; n > 0; n--, p++)
+			{
+				if (*p != 0)
+				{
+					if (Col >= fNumColumn)
+						SpAddColumn(Col, fNumEntry + (s - Buf) / EntrySize);
+					C_UInt32 r = Row;
+					s[0] = r; s[1] = r >> 8; s[2] = r >> 16; s[3] = r >> 24;
+					TYPE v = COREARRAY_ENDIAN_NT_TO_LE(*p);
+					memcpy(s + sizeof(C_UInt32), &v, sizeof(TYPE));
+					s += EntrySize;
+					if (s >= Buf + sizeof(Buf))
+					{
+						A.WriteData(Buf, s - Buf);
+						fNumEntry += (s - Buf) / EntrySize;
+						s = Buf;
+					}
+				}
+				if (++Row >= ColSize) { Row = 0; Col++; }
+			}
+			if (s > Buf)
+			{
+				A.WriteData(Buf, s - Buf);
+				fNumEntry += (s - Buf) / EntrySize;
+			}
+			fCurIndex = -1;
+		}
+
+		/// loading function for serialization
+		virtual void Loading(CdReader &Reader, TdVersion Version)
+		{
+			CdArray< TSpVal<TYPE> >::Loading(Reader, Version);
+			if (this->fGDSStream)
+			{
+				TdGDSBlockID ID;
+				Reader["INDEX"] >> ID;
+				fIndexingStream = this->fGDSStream->Collection()[ID];
+				// get the total size
+				SIZE64 Size = 0;
+				if (this->fPipeInfo)
+					Size = this->fPipeInfo->StreamTotalIn();
+				else if (this->fAllocator.BufStream())
+					Size = this->fAllocator.BufStream()->GetSize();
+				fNumEntry = Size / EntrySize;
+				fNumColumn = fIndexingStream->GetSize() / sizeof(C_Int64);
+			}
+		}
+
+		/// saving function for serialization
+		virtual void Saving(CdWriter &Writer)
+		{
+			CdArray< TSpVal<TYPE> >::Saving(Writer);
+			if (this->fGDSStream != NULL)
+			{
+				if (!fIndexingStream)
+				{
+					fIndexingStream =
+						this->fGDSStream->Collection().NewBlockStream();
+				}
+				TdGDSBlockID Entry = fIndexingStream->ID();
+				Writer["INDEX"] << Entry;
+			}
+		}
+
+	private:
+
+		/// the operator saving the entries to a dense buffer
+		template<typename MEM_TYPE> struct TDense
+		{
+			MEM_TYPE *p;
+			void operator()(C_Int64 k, TYPE v)
+				{ p[k] = VAL_CONVERT(MEM_TYPE, TYPE, v); }
+		};
+
+		/// the operator saving the selected entries to a dense buffer
+		template<typename MEM_TYPE> struct TDenseEx
+		{
+			MEM_TYPE *p;
+			const C_BOOL *Sel;
+			C_Int64 k0;
+			void operator()(C_Int64 k, TYPE v)
+			{
+				// the number of selected elements before k
+				for (; k0 < k; k0++) if (Sel[k0]) p++;
+				if (Sel[k]) *p = VAL_CONVERT(MEM_TYPE, TYPE, v);
+			}
+		};
+
+		/// the operator saving the selected entries to triplets
+		template<typename OUT_TYPE> struct TTriplet
+		{
+			vector<C_Int32> *Row, *Col;
+			vector<OUT_TYPE> *Val;
+			/// the dimensions and the positions of selection in a column
+			const vector<C_Int64> *DimCnt;
+			const vector< vector<C_Int32> > *Map;
+			C_Int64 Row0;
+			C_Int32 ColIdx;
+			void operator()(C_Int64 k, TYPE v)
+			{
+				C_Int64 r = Row0 + k, R = 0;
+				for (size_t i=0; i < DimCnt->size(); i++)
+				{
+					C_Int64 d = (*DimCnt)[i];
+					C_Int64 j = r / d;
+					r -= j * d;
+					C_Int32 pos = (*Map)[i][j];
+					if (pos < 0) return;
+					R = R * (*Map)[i].back() + pos;
+				}
+				Row->push_back(R);
+				Col->push_back(ColIdx);
+				Val->push_back(VAL_CONVERT(OUT_TYPE, TYPE, v));
+			}
+		};
+
+		template<typename OUT_TYPE>
+			void _ReadSparse(const C_Int32 *Start, const C_Int32 *Length,
+			const C_BOOL *const Selection[], vector<C_Int32> &Row,
+			vector<C_Int32> &Col, vector<OUT_TYPE> &Val)
+		{
+			CdAbstractArray::TArrayDim DStart, DLength;
+			if (!Start)
+			{
+				memset(DStart, 0, sizeof(DStart));
+				Start = DStart;
+			}
+			if (!Length)
+			{
+				this->GetDim(DLength);
+				Length = DLength;
+			}
+			this->_CheckRect(Start, Length);
+			Row.clear(); Col.clear(); Val.clear();
+
+			// the dimensions in a column, and the selected positions with
+			// the number of selection at the end
+			const int DCnt = this->DimCnt();
+			const int D0 = (DCnt > 1) ? 1 : 0;
+			vector<C_Int64> DimCnt;
+			vector< vector<C_Int32> > Map;
+			C_Int64 RowSt = 0, RowEd = 0;
+			for (int i=D0; i < DCnt; i++)
+			{
+				const C_Int32 L = this->fDimension[i].DimLen;
+				vector<C_Int32> M(L + 1, -1);
+				C_Int32 n = 0;
+				for (C_Int32 j=Start[i]; j < Start[i]+Length[i]; j++)
+				{
+					if (!Selection || Selection[i][j - Start[i]])
+						M[j] = n++;
+				}
+				M[L] = n;
+				const C_Int64 d = this->fDimension[i].DimElmCnt;
+				DimCnt.push_back(d);
+				Map.push_back(M);
+				RowSt += Start[i] * d;
+				RowEd += (Start[i] + Length[i] - 1) * d;
+				if (n <= 0) return;
+			}
+
+			TTriplet<OUT_TYPE> Op;
+			Op.Row = &Row; Op.Col = &Col; Op.Val = &Val;
+			Op.DimCnt = &DimCnt; Op.Map = &Map;
+			Op.Row0 = RowSt;
+			Op.ColIdx = 0;
+			if (D0 > 0)
+			{
+				const C_Int64 ColSize = SpColSize();
+				for (C_Int32 j=0; j < Length[0]; j++)
+				{
+					if (!Selection || Selection[0][j])
+					{
+						C_Int64 Idx = (Start[0] + j) * ColSize;
+						if (Start[0] + j < fNumColumn)
+						{
+							SpScan(this->fAllocator, Idx + RowSt,
+								RowEd - RowSt + 1, Op);
+						}
+						Op.ColIdx ++;
+					}
+				}
+			} else {
+				SpScan(this->fAllocator, RowSt, RowEd - RowSt + 1, Op);
+			}
+		}
+	};
+
+
+	template<typename TYPE> const ssize_t CdSpArray<TYPE>::EntrySize;
+
+
+	// =====================================================================
+	// Template for Allocator for sparse array
+	// =====================================================================
+
+	/// Template functions for allocator of sparse array
+	template<typename TYPE, typename MEM_TYPE>
+		struct COREARRAY_DLL_DEFAULT ALLOC_FUNC< TSpVal<TYPE>, MEM_TYPE >
+	{
+		/// read an array from CdAllocator
+		static MEM_TYPE *Read(CdIterator &I, MEM_TYPE *p, ssize_t n)
+		{
+			CdSpArray<TYPE> *IT = static_cast<CdSpArray<TYPE>*>(I.Handler);
+			const MEM_TYPE Zero = VAL_CONVERT(MEM_TYPE, TYPE, TYPE(0));
+			for (ssize_t i=0; i < n; i++) p[i] = Zero;
+			typename CdSpArray<TYPE>::template TDense<MEM_TYPE> Op;
+			Op.p = p;
+			IT->SpScan(*I.Allocator, I.Ptr, n, Op);
+			I.Ptr += n;
+			return p + n;
+		}
+
+		/// read an array from CdAllocator with selection
+		static MEM_TYPE *ReadEx(CdIterator &I, MEM_TYPE *p, ssize_t n,
+			const C_BOOL Sel[])
+		{
+			const SIZE64 End = I.Ptr + n;
+			// skip the unselected leading and trailing elements
+			for (; n>0 && !*Sel; n--, Sel++) I.Ptr++;
+			for (; n>0 && !Sel[n-1]; ) n--;
+			ssize_t m = 0;
+			for (ssize_t i=0; i < n; i++) if (Sel[i]) m++;
+			const MEM_TYPE Zero = VAL_CONVERT(MEM_TYPE, TYPE, TYPE(0));
+			for (ssize_t i=0; i < m; i++) p[i] = Zero;
+			if (n > 0)
+			{
+				CdSpArray<TYPE> *IT = static_cast<CdSpArray<TYPE>*>(I.Handler);
+				typename CdSpArray<TYPE>::template TDenseEx<MEM_TYPE> Op;
+				Op.p = p; Op.Sel = Sel; Op.k0 = 0;
+				IT->SpScan(*I.Allocator, I.Ptr, n, Op);
+			}
+			I.Ptr = End;
+			return p + m;
+		}
+
+		/// write an array to CdAllocator
+		static const MEM_TYPE *Write(CdIterator &I, const MEM_TYPE *p,
+			ssize_t n)
+		{
+			CdSpArray<TYPE> *IT = static_cast<CdSpArray<TYPE>*>(I.Handler);
+			if (I.Ptr < IT->fTotalCount)
+			{
+				throw ErrArray("Insert an element into a sparse array wrong.");
+			} else if (I.Ptr == IT->fTotalCount)
+			{
+				TYPE Buf[CdSpStruct::BatchSize];
+				while (n > 0)
+				{
+					ssize_t Cnt = (n >= CdSpStruct::BatchSize) ?
+						CdSpStruct::BatchSize : n;
+					for (ssize_t i=0; i < Cnt; i++)
+						Buf[i] = VAL_CONVERT(TYPE, MEM_TYPE, *p++);
+					IT->SpAppend(*I.Allocator, I.Ptr, Buf, Cnt);
+					I.Ptr += Cnt; n -= Cnt;
+				}
+			} else
+				throw ErrArray("Invalid position for writing data.");
+			return p;
+		}
+	};
+}
+
+#endif /* _HEADER_COREARRAY_SPARSE_ */
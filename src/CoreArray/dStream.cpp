@@ -27,12 +27,17 @@
 
 #include "dStream.h"
 #include <cctype>
+#include <cmath>
 #include <limits>
 
 #ifndef COREARRAY_NO_STD_IN_OUT
 #   include <iostream>
 #endif
 
+#ifdef COREARRAY_SIMD_SSE2
+#   include <emmintrin.h>
+#endif
+
 
 using namespace std;
 using namespace CoreArray;
@@ -44,32 +49,68 @@ using namespace CoreArray;
 CdHandleStream::CdHandleStream(): CdStream()
 {
 	fHandle = NullSysHandle;
+#ifdef COREARRAY_PLATFORM_WINDOWS
+	fPosition = 0;
+#endif
 }
 
 CdHandleStream::CdHandleStream(TSysHandle AHandle): CdStream()
 {
 	fHandle = AHandle;
+#ifdef COREARRAY_PLATFORM_WINDOWS
+	fPosition = SysHandleSeek(AHandle, 0, soCurrent);
+	if (fPosition < 0) fPosition = 0;
+#endif
 }
 
 ssize_t CdHandleStream::Read(void *Buffer, ssize_t Count)
 {
 	if (Count > 0)
+	{
+	#ifdef COREARRAY_PLATFORM_WINDOWS
+		// the file pointer may have been moved by ReadAt() or WriteAt()
+		ssize_t rv = SysHandleReadAt(fHandle, fPosition, Buffer, Count);
+		fPosition += rv;
+		return rv;
+	#else
 		return SysHandleRead(fHandle, Buffer, Count);
-	else
+	#endif
+	} else
 		return 0;
 }
 
 ssize_t CdHandleStream::Write(const void *Buffer, ssize_t Count)
 {
 	if (Count > 0)
+	{
+	#ifdef COREARRAY_PLATFORM_WINDOWS
+		ssize_t rv = SysHandleWriteAt(fHandle, fPosition, Buffer, Count);
+		fPosition += rv;
+		return rv;
+	#else
 		return SysHandleWrite(fHandle, Buffer, Count);
-	else
+	#endif
+	} else
 		return 0;
 }
 
 SIZE64 CdHandleStream::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
 {
+#ifdef COREARRAY_PLATFORM_WINDOWS
+	SIZE64 rv;
+	switch (Origin)
+	{
+		case soBeginning:
+			rv = Offset; break;
+		case soCurrent:
+			rv = fPosition + Offset; break;
+		default:
+			rv = SysHandleSeek(fHandle, Offset, Origin);
+	}
+	if (rv >= 0) fPosition = rv;
+#else
 	SIZE64 rv = SysHandleSeek(fHandle, Offset, Origin);
+#endif
 
 	if (rv < 0)
 	{
@@ -85,6 +126,35 @@ void CdHandleStream::SetSize(SIZE64 NewSize)
     	RaiseLastOSError<ErrOSError>();
 }
 
+ssize_t CdHandleStream::ReadAt(SIZE64 Pos, void *Buffer, ssize_t Count)
+{
+	if (Count > 0)
+		return SysHandleReadAt(fHandle, Pos, Buffer, Count);
+	else
+		return 0;
+}
+
+ssize_t CdHandleStream::WriteAt(SIZE64 Pos, const void *Buffer, ssize_t Count)
+{
+	if (Count > 0)
+		return SysHandleWriteAt(fHandle, Pos, Buffer, Count);
+	else
+		return 0;
+}
+
+bool CdHandleStream::Preallocate(SIZE64 Pos, SIZE64 Count)
+{
+	if (Count > 0)
+		return SysHandlePreallocate(fHandle, Pos, Count);
+	else
+		return false;
+}
+
+bool CdHandleStream::Sync()
+{
+	return SysHandleSync(fHandle);
+}
+
 
 // =====================================================================
 // CdFileStream
@@ -121,6 +191,9 @@ void CdFileStream::Init(const char * const AFileName, TdOpenMode mode)
 		if (fHandle == NullSysHandle)
 			throw ErrStream(ErrFileOpen, AFileName, LastSysErrMsg().c_str());
 	}
+#ifdef COREARRAY_PLATFORM_WINDOWS
+	fPosition = 0;
+#endif
 
 	fFileName = AFileName;
 	fMode = mode;
@@ -172,6 +245,19 @@ void CdForkFileStream::SetSize(SIZE64 NewSize)
 	CdFileStream::SetSize(NewSize);
 }
 
+ssize_t CdForkFileStream::ReadAt(SIZE64 Pos, void *Buffer, ssize_t Count)
+{
+	RedirectFile();
+	return CdFileStream::ReadAt(Pos, Buffer, Count);
+}
+
+ssize_t CdForkFileStream::WriteAt(SIZE64 Pos, const void *Buffer,
+	ssize_t Count)
+{
+	RedirectFile();
+	return CdFileStream::WriteAt(Pos, Buffer, Count);
+}
+
 COREARRAY_INLINE void CdForkFileStream::RedirectFile()
 {
 #ifdef COREARRAY_PLATFORM_UNIX
@@ -191,6 +277,99 @@ COREARRAY_INLINE void CdForkFileStream::RedirectFile()
 }
 
 
+// =====================================================================
+// Memory-mapped file stream
+
+static const char *ErrMmapReadOnly =
+	"The memory-mapped file stream is read-only.";
+
+CdMmapFileStream::CdMmapFileStream(const char * const AFileName):
+	CdFileStream()
+{
+	fMemory = NULL;
+	fMapSize = fPosition = 0;
+	fMapHandle = NullSysHandle;
+
+	Init(AFileName, fmOpenRead);
+	// falls back to the file handle if the view can not be mapped
+	SIZE64 size = CdFileStream::GetSize();
+	fMemory = (C_UInt8*)SysMapFile(fHandle, size, fMapHandle);
+	if (fMemory) fMapSize = size;
+}
+
+CdMmapFileStream::~CdMmapFileStream()
+{
+	if (fMemory)
+	{
+		SysUnmapFile(fMemory, fMapSize, fMapHandle);
+		fMemory = NULL;
+	}
+}
+
+ssize_t CdMmapFileStream::Read(void *Buffer, ssize_t Count)
+{
+	if (!fMemory)
+		return CdFileStream::Read(Buffer, Count);
+	if (Count > fMapSize - fPosition)
+		Count = fMapSize - fPosition;
+	if (Count > 0)
+	{
+		memcpy(Buffer, fMemory + fPosition, Count);
+		fPosition += Count;
+		return Count;
+	} else
+		return 0;
+}
+
+ssize_t CdMmapFileStream::Write(const void *Buffer, ssize_t Count)
+{
+	throw ErrStream(ErrMmapReadOnly);
+}
+
+SIZE64 CdMmapFileStream::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
+{
+	if (!fMemory)
+		return CdFileStream::Seek(Offset, Origin);
+	switch (Origin)
+	{
+		case soBeginning:
+			fPosition = Offset; break;
+		case soCurrent:
+			fPosition += Offset; break;
+		case soEnd:
+			fPosition = fMapSize + Offset; break;
+		default:
+			return -1;
+	}
+	if (fPosition < 0) fPosition = 0;
+	return fPosition;
+}
+
+SIZE64 CdMmapFileStream::GetSize()
+{
+	return fMemory ? fMapSize : CdFileStream::GetSize();
+}
+
+void CdMmapFileStream::SetSize(SIZE64 NewSize)
+{
+	throw ErrStream(ErrMmapReadOnly);
+}
+
+ssize_t CdMmapFileStream::ReadAt(SIZE64 Pos, void *Buffer, ssize_t Count)
+{
+	if (!fMemory)
+		return CdFileStream::ReadAt(Pos, Buffer, Count);
+	if (Count > fMapSize - Pos)
+		Count = fMapSize - Pos;
+	if ((Count > 0) && (Pos >= 0))
+	{
+		memcpy(Buffer, fMemory + Pos, Count);
+		return Count;
+	} else
+		return 0;
+}
+
+
 // =====================================================================
 // CdTempStream
 
@@ -437,526 +616,3043 @@ CdRAAlgorithm::CdRAAlgorithm(CdRecodeStream &owner):
 	fOwner(owner)
 {
 	fSizeType = raUnknown;
+	fFilter = rfNone;
+	fFilterSize = 0;
+	fZoneMap = rzNone;
+	fZoneSize = 0;
 }
 
 
-// CdRA_Read
-
-CdRA_Read::CdRA_Read(CdRecodeStream *owner):
-	CdRAAlgorithm(*owner)
-{
-	fVersion = 0;
-	fBlockNum = fBlockIdx = 0;
-	fCB_ZStart = fCB_ZSize = 0;
-	fCB_UZStart = fCB_UZSize = 0;
-	fBlockListStart = 0;
-	fIndexingStart = 0;
-	fIndex = NULL;
-	fIndexSize = 0;
-}
-
-CdRA_Read::~CdRA_Read()
-{
-	if (fIndex) delete []fIndex;
-}
+// the filters of blocks
 
-void CdRA_Read::InitReadStream()
+/// transpose the bytes of n/s elements of size s, byte j of element i is
+/// stored at Dst[j*(n/s) + i], and the remaining bytes are copied
+static void RA_ByteShuffle(C_UInt8 *Dst, const C_UInt8 *Src, ssize_t n,
+	ssize_t s)
 {
-	static const char ErrUnsupport[] =
-		"Unsupported stream version v%d.%d, you might need to upgrade the library";
-	static const char ErrBlkNum[] =
-		"the number of compression blocks should be defined.";
-
-	// get the base position
-	fOwner.fStreamBase = fOwner.fStream->Position();
-
-	// read and check the magic number
-	if (!ReadMagicNumber(*fOwner.fStream))
-		throw ErrRecodeStream("Invalid stream header with random access.");
-
-	// get the algorithm version
-	fVersion = fOwner.fStream->R8b();
-	if ((fVersion != 0x10) && (fVersion != 0x11))
+	const ssize_t m = (s > 0) ? n / s : 0;
+	ssize_t i = 0;
+	if (s <= 1)
 	{
-		throw ErrStream(ErrUnsupport, fVersion >> 4, fVersion & 0x0F);
+		memcpy(Dst, Src, n);
+		return;
 	}
-	// get size type
-	C_Int8 b = fOwner.fStream->R8b();
-	if ((b < raFirst) || (b > raLast)) b = raUnknown;
-	fSizeType = (TBlockSize)b;
-
-	// get the number of independent blocks
-	BYTE_LE<CdStream>(fOwner.fStream) >> fBlockNum;
-	fBlockListStart = fOwner.fStreamPos = fOwner.fStream->Position();
-	// avoid integer overflow
-	if ((fBlockNum >= 0) && (fBlockNum < 0x7FFFFFFF))
-	{
-		const size_t n = (size_t)fBlockNum + 1;
-		fIndex = new TIndex[n];
-		memset(fIndex, 0, sizeof(TIndex)*n);
-	} else
-		throw ErrStream(ErrBlkNum);
-
-	// initialize the first compressed block
-	fBlockIdx = 0;
-	fCB_UZStart = fIndex[0].RawStart = 0;
-	fIndexSize = 0;
-
-	if (fVersion == 0x10)
+#ifdef COREARRAY_SIMD_SSE2
+	if ((s == 2) || (s == 4) || (s == 8))
 	{
-		// there is no pre-defined block information
-		fCB_ZStart  = fIndex[0].CmpStart = fBlockListStart;
-		if (fBlockNum > 0)
+		// 16 elements in s registers, byte j of element i at j*16+i after
+		// interleaving the first and second halves 4 times
+		const int H = s / 2;
+		__m128i R[8], T[8];
+		for (; i+16 <= m; i += 16)
 		{
-			GetBlockHeader_v1_0();
-			fIndex[1].RawStart = fIndex[0].RawStart + fCB_UZSize;
-			fIndex[1].CmpStart = fIndex[0].CmpStart + fCB_ZSize;
-			fIndexSize = 1;
+			const C_UInt8 *p = Src + i*s;
+			for (int k=0; k < s; k++)
+				R[k] = _mm_loadu_si128((__m128i const*)(p + 16*k));
+			for (int r=0; r < 4; r++)
+			{
+				for (int k=0; k < H; k++)
+				{
+					T[2*k]   = _mm_unpacklo_epi8(R[k], R[k+H]);
+					T[2*k+1] = _mm_unpackhi_epi8(R[k], R[k+H]);
+				}
+				for (int k=0; k < s; k++) R[k] = T[k];
+			}
+			for (int k=0; k < s; k++)
+				_mm_storeu_si128((__m128i*)(Dst + k*m + i), R[k]);
 		}
-	} else if (fVersion == 0x11)
+	}
+#endif
+	for (; i < m; i++)
 	{
-		// pre-defined block information is stored after compressed data blocks
-		TdGDSPos Len;
-		BYTE_LE<CdStream>(fOwner.fStream) >> Len;
-		fOwner.fStreamPos += GDS_POS_SIZE;
-		fCB_ZStart = fIndex[0].CmpStart = fBlockListStart = fOwner.fStreamPos;
-		fIndexingStart = fBlockListStart + Len;
-		// read indexing information
-		LoadIndexing();
-		// set sizes
-		if (fBlockNum >= 1)
-		{
-			fCB_UZSize = fIndex[1].RawStart - fIndex[0].RawStart;
-			fCB_ZSize = fIndex[1].CmpStart - fIndex[0].CmpStart;
-		} else {
-			fCB_UZSize = fCB_ZSize = 0;
-		}
-	} else
-		throw ErrStream(ErrUnsupport, fVersion >> 4, fVersion & 0x0F);
+		const C_UInt8 *p = Src + i*s;
+		for (ssize_t j=0; j < s; j++) Dst[j*m + i] = p[j];
+	}
+	memcpy(Dst + m*s, Src + m*s, n - m*s);
 }
 
-bool CdRA_Read::SeekStream(SIZE64 Position)
+/// the inverse of RA_ByteShuffle()
+static void RA_ByteUnshuffle(C_UInt8 *Dst, const C_UInt8 *Src, ssize_t n,
+	ssize_t s)
 {
-	if (Position < 0)
+	const ssize_t m = (s > 0) ? n / s : 0;
+	ssize_t i = 0;
+	if (s <= 1)
 	{
-		throw ErrStream(
-			"'Seek' out of the range: position (%lld) should be >= 0.",
-			Position);
+		memcpy(Dst, Src, n);
+		return;
 	}
-
-	if (Position < fCB_UZStart)
+#ifdef COREARRAY_SIMD_SSE2
+	if ((s == 2) || (s == 4) || (s == 8))
 	{
-		BinSearch(Position, 0, fBlockIdx-1);
-		return true;
-
-	} else if (Position >= (fCB_UZStart + fCB_UZSize))
-	{
-		if (Position >= fIndex[fIndexSize].RawStart)
+		// interleaving log2(s) times restores the order of 16 elements
+		const int H = s / 2;
+		const int NR = (s == 2) ? 1 : ((s == 4) ? 2 : 3);
+		__m128i R[8], T[8];
+		for (; i+16 <= m; i += 16)
 		{
-			if (fVersion == 0x10)
+			for (int k=0; k < s; k++)
+				R[k] = _mm_loadu_si128((__m128i const*)(Src + k*m + i));
+			for (int r=0; r < NR; r++)
 			{
-				// no target, go to the last
-				fBlockIdx = fIndexSize - 1;
-				TIndex *p = fIndex + fBlockIdx;
-				fCB_UZStart = p[0].RawStart;
-				fCB_UZSize  = p[1].RawStart - p[0].RawStart;
-				fCB_ZStart  = p[0].CmpStart;
-				fCB_ZSize   = p[1].CmpStart - p[0].CmpStart;
-
-				while (Position >= (fCB_UZStart + fCB_UZSize))
+				for (int k=0; k < H; k++)
 				{
-					// go to the next block
-					if (!NextBlock())
-					{
-						if (Position > fCB_UZStart)
-						{
-							throw ErrStream(
-								"'Seek' out of the range with position (%lld).",
-								Position);
-						}
-					}
+					T[2*k]   = _mm_unpacklo_epi8(R[k], R[k+H]);
+					T[2*k+1] = _mm_unpackhi_epi8(R[k], R[k+H]);
 				}
-			} else {
-				throw ErrStream(
-					"'Seek' out of the range with position (%lld).",
-					Position);
+				for (int k=0; k < s; k++) R[k] = T[k];
 			}
-		} else {
-			BinSearch(Position, fBlockIdx+1, fIndexSize-1);
+			C_UInt8 *p = Dst + i*s;
+			for (int k=0; k < s; k++)
+				_mm_storeu_si128((__m128i*)(p + 16*k), R[k]);
 		}
-		return true;
 	}
+#endif
+	for (; i < m; i++)
+	{
+		C_UInt8 *p = Dst + i*s;
+		for (ssize_t j=0; j < s; j++) p[j] = Src[j*m + i];
+	}
+	memcpy(Dst + m*s, Src + m*s, n - m*s);
+}
 
-	return false;
+/// transpose an 8x8 bit matrix, bit j of byte i <-> bit i of byte j
+COREARRAY_INLINE static C_UInt64 RA_BitTranspose(C_UInt64 x)
+{
+	C_UInt64 t;
+	t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+	x = x ^ t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+	x = x ^ t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+	x = x ^ t ^ (t << 28);
+	return x;
 }
 
-void CdRA_Read::GetUpdated()
+/// transpose the bits of n bytes in groups of 8 bytes, bit b of Src[8*g+i]
+/// is stored in bit i of Dst[b*(n/8) + g], and the remaining bytes are copied
+static void RA_BitTransposeBlock(C_UInt8 *Dst, const C_UInt8 *Src,
+	ssize_t n, bool Inverse)
 {
-	if (fIndexSize < fBlockNum)
+	const ssize_t G = n / 8;
+	for (ssize_t g=0; g < G; g++)
 	{
-		while (NextBlock());
+		C_UInt64 x = 0;
+		if (!Inverse)
+		{
+			const C_UInt8 *p = Src + 8*g;
+			for (int i=0; i < 8; i++) x |= C_UInt64(p[i]) << (8*i);
+		} else {
+			for (int b=0; b < 8; b++) x |= C_UInt64(Src[b*G + g]) << (8*b);
+		}
+		x = RA_BitTranspose(x);
+		if (!Inverse)
+		{
+			for (int b=0; b < 8; b++) Dst[b*G + g] = C_UInt8(x >> (8*b));
+		} else {
+			C_UInt8 *p = Dst + 8*g;
+			for (int i=0; i < 8; i++) p[i] = C_UInt8(x >> (8*i));
+		}
 	}
+	memcpy(Dst + 8*G, Src + 8*G, n - 8*G);
 }
 
-void CdRA_Read::GetBlockInfo(vector<SIZE64> &RawSize, vector<SIZE64> &CmpSize)
+/// replace the elements of size s from index Start by the difference to the
+/// previous one, as little-endian integers modulo 2^(8*s)
+template<typename TYPE>
+	static void RA_DeltaElm(C_UInt8 *Buf, ssize_t m, ssize_t Start)
 {
-	GetUpdated();
-	RawSize.resize(fIndexSize);
-	CmpSize.resize(fIndexSize);
-	for (ssize_t i=0; i < fIndexSize; i++)
+	TYPE prev, v;
+	if (Start >= m) return;
+	memcpy(&prev, Buf + (Start-1)*sizeof(TYPE), sizeof(TYPE));
+	for (ssize_t i=Start; i < m; i++)
 	{
-		RawSize[i] = fIndex[i+1].RawStart - fIndex[i].RawStart;
-		CmpSize[i] = fIndex[i+1].CmpStart - fIndex[i].CmpStart;
+		C_UInt8 *p = Buf + i*sizeof(TYPE);
+		memcpy(&v, p, sizeof(TYPE));
+		TYPE d = v - prev;
+		memcpy(p, &d, sizeof(TYPE));
+		prev = v;
 	}
 }
 
-bool CdRA_Read::NextBlock()
+/// the inverse of RA_DeltaElm(), the running sums from index Start
+template<typename TYPE>
+	static void RA_UndeltaElm(C_UInt8 *Buf, ssize_t m, ssize_t Start)
 {
-	fCB_ZStart += fCB_ZSize;
-	fCB_UZStart += fCB_UZSize;
-	fBlockIdx ++;
-	if (fBlockIdx < fBlockNum)
+	TYPE sum, v;
+	if (Start >= m) return;
+	memcpy(&sum, Buf + (Start-1)*sizeof(TYPE), sizeof(TYPE));
+	for (ssize_t i=Start; i < m; i++)
 	{
-		if (fBlockIdx < fIndexSize)
+		C_UInt8 *p = Buf + i*sizeof(TYPE);
+		memcpy(&v, p, sizeof(TYPE));
+		sum += v;
+		memcpy(p, &sum, sizeof(TYPE));
+	}
+}
+
+/// in-place delta coding of the n/s elements in Buf from index Start (>= 1),
+/// or the inverse if Inverse = true
+static void RA_DeltaBlock(C_UInt8 *Buf, ssize_t n, ssize_t s, ssize_t Start,
+	bool Inverse)
+{
+	const ssize_t m = n / s;
+	if (Start >= m) return;
+#ifdef COREARRAY_ENDIAN_LITTLE
+	switch (s)
+	{
+	case 1:
+		if (Inverse) RA_UndeltaElm<C_UInt8>(Buf, m, Start);
+			else RA_DeltaElm<C_UInt8>(Buf, m, Start);
+		return;
+	case 2:
+		if (Inverse) RA_UndeltaElm<C_UInt16>(Buf, m, Start);
+			else RA_DeltaElm<C_UInt16>(Buf, m, Start);
+		return;
+	case 4:
+		if (Inverse) RA_UndeltaElm<C_UInt32>(Buf, m, Start);
+			else RA_DeltaElm<C_UInt32>(Buf, m, Start);
+		return;
+	case 8:
+		if (Inverse) RA_UndeltaElm<C_UInt64>(Buf, m, Start);
+			else RA_DeltaElm<C_UInt64>(Buf, m, Start);
+		return;
+	}
+#endif
+	// any element size, byte by byte with carry or borrow
+	vector<C_UInt8> Prev(Buf + (Start-1)*s, Buf + Start*s);
+	for (ssize_t i=Start; i < m; i++)
+	{
+		C_UInt8 *p = Buf + i*s;
+		unsigned c = 0;
+		for (ssize_t j=0; j < s; j++)
 		{
-			fOwner.fStreamPos = fCB_ZStart;
-			if (fVersion == 0x10)
-				 fOwner.fStreamPos += SIZE_RA_BLOCK_HEADER;
-			TIndex *p = fIndex + fBlockIdx;
-			fCB_ZSize = p[1].CmpStart - p[0].CmpStart;
-			fCB_UZSize = p[1].RawStart - p[0].RawStart;
-		} else {
-			GetBlockHeader_v1_0();
-			fIndexSize = fBlockIdx + 1;
-			TIndex *p = fIndex + fIndexSize;
-			p->RawStart = fCB_UZStart + fCB_UZSize;
-			p->CmpStart = fCB_ZStart + fCB_ZSize;
+			unsigned v = p[j];
+			if (Inverse)
+			{
+				c += v + Prev[j];
+				p[j] = Prev[j] = C_UInt8(c);
+				c >>= 8;
+			} else {
+				unsigned d = v - Prev[j] - c;
+				c = (v < Prev[j] + c) ? 1 : 0;
+				p[j] = C_UInt8(d);
+				Prev[j] = C_UInt8(v);
+			}
 		}
-		return true;
-	} else {
-		fCB_ZSize = fCB_UZSize = 1; // avoid ZERO
-		return false;
 	}
 }
 
-void CdRA_Read::BinSearch(SIZE64 Position, ssize_t low, ssize_t high)
+void CdRAAlgorithm::FilterData(C_UInt8 *Dst, const C_UInt8 *Src, ssize_t n)
 {
-	TIndex *p = fIndex;
-	while (low < high)
+	const ssize_t s = fFilterSize;
+	if (n <= 0) return;
+	switch (fFilter)
 	{
-		ssize_t mid = low + ((high - low) >> 1);
-		if (Position >= p[mid].RawStart)
+	case rfShuffle:
+		RA_ByteShuffle(Dst, Src, n, s);
+		break;
+	case rfBitShuffle:
 		{
-			if (Position >= p[mid+1].RawStart)
-				low = mid + 1;
-			else
-				high = low = mid;
-		} else {
-			high = mid - 1;
+			// the byte planes of the elements in groups of 8, and then
+			// the bit planes of each byte plane
+			const ssize_t m8 = (n / s) & ~ssize_t(7);
+			const ssize_t L = m8 * s;
+			vector<C_UInt8> Buf(L);
+			if (L > 0)
+			{
+				RA_ByteShuffle(&Buf[0], Src, L, s);
+				for (ssize_t j=0; j < s; j++)
+					RA_BitTransposeBlock(Dst + j*m8, &Buf[j*m8], m8, false);
+			}
+			memcpy(Dst + L, Src + L, n - L);
+		}
+		break;
+	case rfDelta: case rfDelta2:
+		{
+			// the first element of a block is kept, and the second one is
+			// kept as a difference for the second order; the small
+			// differences are then byte-shuffled to group the zero bytes
+			vector<C_UInt8> Buf(Src, Src + n);
+			RA_DeltaBlock(&Buf[0], n, s, 1, false);
+			if (fFilter == rfDelta2)
+				RA_DeltaBlock(&Buf[0], n, s, 2, false);
+			RA_ByteShuffle(Dst, &Buf[0], n, s);
 		}
+		break;
+	default:
+		memcpy(Dst, Src, n);
 	}
+}
 
-	// find the target
-	fBlockIdx = low;
-	p = fIndex + low;
-	fCB_UZStart = p[0].RawStart;
-	fCB_UZSize  = p[1].RawStart - p[0].RawStart;
-	fCB_ZStart  = p[0].CmpStart;
-	fCB_ZSize   = p[1].CmpStart - p[0].CmpStart;
+void CdRAAlgorithm::UnfilterData(C_UInt8 *Dst, const C_UInt8 *Src, ssize_t n)
+{
+	const ssize_t s = fFilterSize;
+	if (n <= 0) return;
+	switch (fFilter)
+	{
+	case rfShuffle:
+		RA_ByteUnshuffle(Dst, Src, n, s);
+		break;
+	case rfBitShuffle:
+		{
+			const ssize_t m8 = (n / s) & ~ssize_t(7);
+			const ssize_t L = m8 * s;
+			vector<C_UInt8> Buf(L);
+			if (L > 0)
+			{
+				for (ssize_t j=0; j < s; j++)
+					RA_BitTransposeBlock(&Buf[j*m8], Src + j*m8, m8, true);
+				RA_ByteUnshuffle(Dst, &Buf[0], L, s);
+			}
+			memcpy(Dst + L, Src + L, n - L);
+		}
+		break;
+	case rfDelta: case rfDelta2:
+		RA_ByteUnshuffle(Dst, Src, n, s);
+		if (fFilter == rfDelta2)
+			RA_DeltaBlock(Dst, n, s, 2, true);
+		RA_DeltaBlock(Dst, n, s, 1, true);
+		break;
+	default:
+		memcpy(Dst, Src, n);
+	}
 }
 
-void CdRA_Read::GetBlockHeader_v1_0()
+
+// the zone map of blocks
+
+/// get the little-endian integer of s bytes at p, sign-extended if Signed
+COREARRAY_INLINE static C_UInt64 RA_ZoneInt(const C_UInt8 *p, int s,
+	bool Signed)
 {
-	C_UInt8 BSZ[SIZE_RA_BLOCK_HEADER];
-	fOwner.fStream->SetPosition(fCB_ZStart);
-	fOwner.fStream->ReadData(BSZ, SIZE_RA_BLOCK_HEADER);
-	fOwner.fStreamPos = fCB_ZStart + SIZE_RA_BLOCK_HEADER;
+	C_UInt64 v = 0;
+	for (int i=s-1; i >= 0; i--) v = (v << 8) | p[i];
+	if (Signed && (s < 8) && (p[s-1] & 0x80))
+		v |= ~C_UInt64(0) << (8*s);
+	return v;
+}
 
-	fCB_ZSize = BSZ[0] | (C_UInt32(BSZ[1]) << 8) |
-		(C_UInt32(BSZ[2]) << 16);
-	fCB_UZSize = BSZ[3] | (C_UInt32(BSZ[4]) << 8) |
-		(C_UInt32(BSZ[5]) << 16) | (C_UInt32(BSZ[6]) << 24);
+void CdRAAlgorithm::ZoneStat(const C_UInt8 *Raw, ssize_t n,
+	TZoneStat &Out) const
+{
+	const int s = fZoneSize;
+	const ssize_t m = (s > 0) ? n / s : 0;
+	Out.Min = Out.Max = 0;
+	Out.NumNA = 0;
+	bool Empty = true;
+
+	switch (fZoneMap)
+	{
+	case rzInt:
+		{
+			// NA_INTEGER in R for 32-bit integers
+			C_Int64 MinV=0, MaxV=0;
+			for (ssize_t i=0; i < m; i++, Raw += s)
+			{
+				C_Int64 v = (C_Int64)RA_ZoneInt(Raw, s, true);
+				if ((s == 4) && (v == C_Int64(C_Int32(0x80000000u))))
+					{ Out.NumNA ++; continue; }
+				if (Empty)
+					{ MinV = MaxV = v; Empty = false; }
+				else if (v < MinV) MinV = v;
+				else if (v > MaxV) MaxV = v;
+			}
+			Out.Min = (C_UInt64)MinV; Out.Max = (C_UInt64)MaxV;
+		}
+		break;
+	case rzUInt:
+		for (ssize_t i=0; i < m; i++, Raw += s)
+		{
+			C_UInt64 v = RA_ZoneInt(Raw, s, false);
+			if (Empty)
+				{ Out.Min = Out.Max = v; Empty = false; }
+			else if (v < Out.Min) Out.Min = v;
+			else if (v > Out.Max) Out.Max = v;
+		}
+		break;
+	case rzFloat:
+		{
+			C_Float64 MinV=0, MaxV=0;
+			for (ssize_t i=0; i < m; i++, Raw += s)
+			{
+				C_Float64 v;
+				if (s == 4)
+				{
+					C_UInt32 u = (C_UInt32)RA_ZoneInt(Raw, 4, false);
+					C_Float32 f;
+					memcpy(&f, &u, sizeof(f));
+					v = f;
+				} else {
+					C_UInt64 u = RA_ZoneInt(Raw, 8, false);
+					memcpy(&v, &u, sizeof(v));
+				}
+				if (IsNaN(v))
+					{ Out.NumNA ++; continue; }
+				if (Empty)
+					{ MinV = MaxV = v; Empty = false; }
+				else if (v < MinV) MinV = v;
+				else if (v > MaxV) MaxV = v;
+			}
+			memcpy(&Out.Min, &MinV, sizeof(MinV));
+			memcpy(&Out.Max, &MaxV, sizeof(MaxV));
+		}
+		break;
+	default:
+		break;
+	}
 }
 
-void CdRA_Read::LoadIndexing()
+double CdRAAlgorithm::ZoneValue(C_UInt64 Val, bool Upper) const
 {
-	if (fIndexSize <= 0)
+	// a double has 53 significant bits, so the bounds are widened to the
+	//   adjacent double if rounding moves them inward
+	switch (fZoneMap)
 	{
-		fOwner.fStream->SetPosition(fIndexingStart);
-		C_UInt8 BSZ[SIZE_RA_BLOCK_HEADER];
-		TIndex *p = fIndex;
-		for (ssize_t i=0; i < fBlockNum; i++)
+	case rzInt:
 		{
-			fOwner.fStream->ReadData(BSZ, SIZE_RA_BLOCK_HEADER);
-			C_UInt32 CmpLen = BSZ[0] | (C_UInt32(BSZ[1]) << 8) |
-				(C_UInt32(BSZ[2]) << 16);
-			C_UInt32 RawLen = BSZ[3] | (C_UInt32(BSZ[4]) << 8) |
-				(C_UInt32(BSZ[5]) << 16) | (C_UInt32(BSZ[6]) << 24);
-			TIndex *n = p + 1;
-			n->RawStart = p->RawStart + RawLen;
-			n->CmpStart = p->CmpStart + CmpLen;
-			p ++;
+			const C_Int64 v = (C_Int64)Val;
+			double d = (double)v;
+			// 2^63 is out of the range of C_Int64
+			const bool big = (d >= 9223372036854775808.0);
+			if (Upper)
+			{
+				if (!big && ((C_Int64)d < v)) d = nextafter(d, Infinity);
+			} else {
+				if (big || ((C_Int64)d > v)) d = nextafter(d, NegInfinity);
+			}
+			return d;
 		}
-		fIndexSize = fBlockNum;
-		fOwner.fStream->SetPosition(fOwner.fStreamPos);
+	case rzUInt:
+		{
+			double d = (double)Val;
+			// 2^64 is out of the range of C_UInt64
+			const bool big = (d >= 18446744073709551616.0);
+			if (Upper)
+			{
+				if (!big && ((C_UInt64)d < Val)) d = nextafter(d, Infinity);
+			} else {
+				if (big || ((C_UInt64)d > Val)) d = nextafter(d, NegInfinity);
+			}
+			return d;
+		}
+	case rzFloat:
+		{
+			C_Float64 v;
+			memcpy(&v, &Val, sizeof(v));
+			return v;
+		}
+	default:
+		return NaN;
 	}
 }
 
+bool CdRAAlgorithm::SameBlockFormat(const CdRAAlgorithm &Src) const
+{
+	return (Src.fFilter == fFilter) && (Src.fFilterSize == fFilterSize) &&
+		(Src.fZoneMap == fZoneMap) && (Src.fZoneSize == fZoneSize);
+}
 
-// CdRA_Write
 
-CdRA_Write::CdRA_Write(CdRecodeStream *owner, TBlockSize bs):
-	CdRAAlgorithm(*owner)
+// CdRABlockCache
+
+namespace CoreArray
 {
-	if ((bs < raFirst) || (bs > raLast))
-		throw EZLibError("%s: invalid block size.", __func__);
-	fVersion = 0x11;  // by default
-	fBlockNum = 0;
-	fCB_ZStart = fCB_UZStart = 0;
-	fBlockListStart = 0;
-	fHasInitWriteBlock = false;
+	struct CdRABlockCache::TBlock
+	{
+		const void *File;  ///< the file, i.e., the block collection
+		C_UInt32 ID;       ///< the stream ID
+		C_Int32 Idx;       ///< the block index
+		vector<C_UInt8> Data;  ///< the decompressed data
+		int RefCnt;        ///< the number of references
+		bool Cached;       ///< whether it is in the cache
+		TBlock *Prev, *Next;  ///< the LRU list, the most recent first
+	};
+
+	/// the key of a cached block
+	struct COREARRAY_DLL_LOCAL TRABlockKey
+	{
+		const void *File;
+		C_UInt32 ID;
+		C_Int32 Idx;
+
+		TRABlockKey(const void *f, C_UInt32 id, C_Int32 i)
+			{ File = f; ID = id; Idx = i; }
+		bool operator< (const TRABlockKey &v) const
+		{
+			if (File != v.File) return File < v.File;
+			if (ID != v.ID) return ID < v.ID;
+			return Idx < v.Idx;
+		}
+	};
 }
 
-void CdRA_Write::InitWriteStream()
+typedef map<TRABlockKey, CdRABlockCache::TBlock*> TRABlockMap;
+
+static CdThreadMutex RACache_Mutex;
+static TRABlockMap RACache_Map;
+static CdRABlockCache::TBlock *RACache_Head = NULL, *RACache_Tail = NULL;
+static SIZE64 RACache_Budget = 0, RACache_Size = 0;
+static C_Int64 RACache_Hit = 0, RACache_Miss = 0, RACache_Evict = 0;
+
+static void RACache_Unlink(CdRABlockCache::TBlock *p)
 {
-	// get the base position
-	fOwner.fStreamBase = fOwner.fStream->Position();
+	if (p->Prev) p->Prev->Next = p->Next; else RACache_Head = p->Next;
+	if (p->Next) p->Next->Prev = p->Prev; else RACache_Tail = p->Prev;
+	p->Prev = p->Next = NULL;
+}
 
-	// write the magic number
-	WriteMagicNumber(*fOwner.fStream);
-	// write the version of this algorithm, v1.0
-	fOwner.fStream->W8b(fVersion);
-	// write the parameter of block size
-	fOwner.fStream->W8b(fSizeType);
-	// write the number of independent blocks, -1 for unknown
-	BYTE_LE<CdStream>(fOwner.fStream) << C_Int32(-1);
+static void RACache_LinkHead(CdRABlockCache::TBlock *p)
+{
+	p->Prev = NULL; p->Next = RACache_Head;
+	if (RACache_Head) RACache_Head->Prev = p; else RACache_Tail = p;
+	RACache_Head = p;
+}
 
-	// set values
-	fBlockListStart = fOwner.fStreamPos = fOwner.fStream->Position();
-	// version
-	if (fVersion == 0x11)
+// remove the block from the cache, it is freed if not referenced
+static void RACache_Remove(TRABlockMap::iterator it)
+{
+	CdRABlockCache::TBlock *p = it->second;
+	RACache_Map.erase(it);
+	RACache_Unlink(p);
+	RACache_Size -= p->Data.size();
+	p->Cached = false;
+	if (p->RefCnt <= 0) delete p;
+}
+
+// evict the least recently used blocks until the size fits the budget
+static void RACache_Shrink()
+{
+	while ((RACache_Size > RACache_Budget) && RACache_Tail)
 	{
-		BYTE_LE<CdStream>(fOwner.fStream) << TdGDSPos(0);
-		fOwner.fStreamPos += GDS_POS_SIZE;
-		fBlockListStart = fOwner.fStreamPos;
+		CdRABlockCache::TBlock *p = RACache_Tail;
+		RACache_Remove(RACache_Map.find(TRABlockKey(p->File, p->ID, p->Idx)));
+		RACache_Evict ++;
 	}
+}
 
-	fOwner.fTotalOut = (fOwner.fStreamPos - fOwner.fStreamBase);
-	fHasInitWriteBlock = false;
+void CdRABlockCache::SetBudget(SIZE64 Size)
+{
+	TdAutoMutex _m(&RACache_Mutex);
+	RACache_Budget = (Size > 0) ? Size : 0;
+	RACache_Shrink();
 }
 
-void CdRA_Write::DoneWriteStream()
+SIZE64 CdRABlockCache::Budget()
 {
-	DoneWriteBlock();
+	return RACache_Budget;
+}
 
-	if (fVersion == 0x10)
+void CdRABlockCache::GetStat(TStat &Stat)
+{
+	TdAutoMutex _m(&RACache_Mutex);
+	Stat.Budget = RACache_Budget;
+	Stat.Size = RACache_Size;
+	Stat.NumBlock = RACache_Map.size();
+	Stat.Hit = RACache_Hit;
+	Stat.Miss = RACache_Miss;
+	Stat.Evict = RACache_Evict;
+}
+
+void CdRABlockCache::Clear(bool ResetStat)
+{
+	TdAutoMutex _m(&RACache_Mutex);
+	while (!RACache_Map.empty())
+		RACache_Remove(RACache_Map.begin());
+	if (ResetStat)
+		RACache_Hit = RACache_Miss = RACache_Evict = 0;
+}
+
+void CdRABlockCache::Purge(const void *File, C_UInt32 ID)
+{
+	TdAutoMutex _m(&RACache_Mutex);
+	TRABlockMap::iterator it =
+		RACache_Map.lower_bound(TRABlockKey(File, ID, INT_MIN));
+	while ((it != RACache_Map.end()) && (it->first.File == File) &&
+		(it->first.ID == ID))
 	{
-		// write the ending code, zero filling
-		C_UInt64 Val = 0;
-		fOwner.fStream->WriteData(&Val, SIZE_RA_BLOCK_HEADER);
-		fOwner.fStreamPos += SIZE_RA_BLOCK_HEADER;
-		fOwner.fTotalOut = fOwner.fStreamPos - fOwner.fStreamBase;
+		RACache_Remove(it++);
 	}
+}
 
-	fHasInitWriteBlock = false;
-	// save position
-	SIZE64 OldPos = fOwner.fStreamPos;
+void CdRABlockCache::Purge(const void *File)
+{
+	TdAutoMutex _m(&RACache_Mutex);
+	TRABlockMap::iterator it =
+		RACache_Map.lower_bound(TRABlockKey(File, 0, INT_MIN));
+	while ((it != RACache_Map.end()) && (it->first.File == File))
+		RACache_Remove(it++);
+}
 
-	// write down the number of independent blocks
-	if (fVersion == 0x10)
+CdRABlockCache::TBlock *CdRABlockCache::Find(const void *File, C_UInt32 ID,
+	C_Int32 Idx, const C_UInt8 *&Data)
+{
+	TdAutoMutex _m(&RACache_Mutex);
+	TRABlockMap::iterator it = RACache_Map.find(TRABlockKey(File, ID, Idx));
+	if (it == RACache_Map.end())
 	{
-		fOwner.fStream->SetPosition(fBlockListStart - sizeof(C_Int32));
-		BYTE_LE<CdStream>(fOwner.fStream) << C_Int32(fBlockNum);
-	} else if (fVersion == 0x11)
+		RACache_Miss ++;
+		return NULL;
+	}
+	RACache_Hit ++;
+	TBlock *p = it->second;
+	RACache_Unlink(p);
+	RACache_LinkHead(p);
+	p->RefCnt ++;
+	Data = p->Data.empty() ? NULL : &p->Data[0];
+	return p;
+}
+
+CdRABlockCache::TBlock *CdRABlockCache::Add(const void *File, C_UInt32 ID,
+	C_Int32 Idx, vector<C_UInt8> &Data, const C_UInt8 *&Ptr)
+{
+	TBlock *p = new TBlock;
+	p->File = File; p->ID = ID; p->Idx = Idx;
+	p->Data.swap(Data);
+	p->RefCnt = 1;
+	p->Cached = false;
+	p->Prev = p->Next = NULL;
+	Ptr = p->Data.empty() ? NULL : &p->Data[0];
+
+	TdAutoMutex _m(&RACache_Mutex);
+	if ((SIZE64)p->Data.size() <= RACache_Budget)
 	{
-		fOwner.fStream->SetPosition(fBlockListStart - sizeof(C_Int32) -
-			GDS_POS_SIZE);
-		BYTE_LE<CdStream>(fOwner.fStream) << C_Int32(fBlockNum) <<
-			TdGDSPos(OldPos - fBlockListStart);
-		// store indexing information
-		fOwner.fStream->SetPosition(OldPos);
-		for (ssize_t i=0; i < fBlockNum; i++)
-		{
-			C_UInt64 u = fBlockInfoList[i];
-			C_UInt32 SC = u & 0xFFFFFFFF;
-			C_UInt32 SU = u >> 32;
-			C_UInt8 SZ[SIZE_RA_BLOCK_HEADER] =
-			{
-				C_UInt8(SC & 0xFF),
-				C_UInt8((SC >> 8) & 0xFF),
-				C_UInt8((SC >> 16) & 0xFF),
-				C_UInt8(SU & 0xFF),
-				C_UInt8((SU >> 8) & 0xFF),
-				C_UInt8((SU >> 16) & 0xFF),
-				C_UInt8((SU >> 24) & 0xFF)
-			};
-			fOwner.fStream->WriteData(SZ, SIZE_RA_BLOCK_HEADER);
-		}
+		TRABlockKey Key(File, ID, Idx);
+		TRABlockMap::iterator it = RACache_Map.find(Key);
+		if (it != RACache_Map.end()) RACache_Remove(it);
+		RACache_Map[Key] = p;
+		RACache_LinkHead(p);
+		RACache_Size += p->Data.size();
+		p->Cached = true;
+		RACache_Shrink();
 	}
+	return p;
+}
 
-	// reset stream position
-	fOwner.fStream->SetPosition(fOwner.fStreamPos=OldPos);
+void CdRABlockCache::Release(TBlock *Block)
+{
+	TdAutoMutex _m(&RACache_Mutex);
+	Block->RefCnt --;
+	if ((Block->RefCnt <= 0) && !Block->Cached)
+		delete Block;
 }
 
-void CdRA_Write::InitWriteBlock()
+
+// CdRA_Read
+
+CdRA_Read::CdRA_Read(CdRecodeStream *owner):
+	CdRAAlgorithm(*owner)
 {
-	if (!fHasInitWriteBlock)
-	{
-		fCB_ZStart = fOwner.fStreamPos;
-		fCB_UZStart = fOwner.fTotalIn;
-		if (fVersion == 0x10)
-		{
-			C_UInt64 Val = 0;
-			fOwner.fStream->WriteData(&Val, SIZE_RA_BLOCK_HEADER);
-			fOwner.fStreamPos += SIZE_RA_BLOCK_HEADER;
-		}
-		fHasInitWriteBlock = true;
-	}
+	fVersion = 0;
+	fBlockNum = fBlockIdx = 0;
+	fCB_ZStart = fCB_ZSize = 0;
+	fCB_UZStart = fCB_UZSize = 0;
+	fBlockListStart = 0;
+	fIndexingStart = 0;
+	fIndex = NULL;
+	fIndexSize = 0;
+	fNumThread = 0;
+	fPool = NULL;
+	fParIdx = -1;
+	fParBlock = NULL;
+	fCacheBlk = NULL;
+	fCacheData = NULL;
+	fTracing = false;
+	fPatchIdx = -1;
+}
+
+CdRA_Read::~CdRA_Read()
+{
+	CacheEnd();
+	ParallelEnd();
+	if (fIndex) delete []fIndex;
+}
+
+void CdRA_Read::InitReadStream()
+{
+	static const char ErrUnsupport[] =
+		"Unsupported stream version v%d.%d, you might need to upgrade the library";
+	static const char ErrBlkNum[] =
+		"the number of compression blocks should be defined.";
+	static const char ErrFilter[] =
+		"Invalid block filter (%d) with the element size (%d).";
+	static const char ErrZoneMap[] =
+		"Invalid zone map (%d) with the element size (%d).";
+
+	// get the base position
+	fOwner.fStreamBase = fOwner.fStream->Position();
+
+	// read and check the magic number
+	if (!ReadMagicNumber(*fOwner.fStream))
+		throw ErrRecodeStream("Invalid stream header with random access.");
+
+	// get the algorithm version
+	fVersion = fOwner.fStream->R8b();
+	if ((fVersion < 0x10) || (fVersion > 0x13))
+	{
+		throw ErrStream(ErrUnsupport, fVersion >> 4, fVersion & 0x0F);
+	}
+	// get size type
+	C_Int8 b = fOwner.fStream->R8b();
+	if ((b < raFirst) || (b > raLast)) b = raUnknown;
+	fSizeType = (TBlockSize)b;
+	// get the filter and its element size
+	if (fVersion >= 0x12)
+	{
+		C_UInt8 f = fOwner.fStream->R8b();
+		C_UInt8 sz = fOwner.fStream->R8b();
+		if ((f > rfLast) || ((f != rfNone) && (sz == 0)))
+			throw ErrStream(ErrFilter, f, sz);
+		fFilter = (TFilter)f;
+		fFilterSize = sz;
+	}
+	// get the zone map and its element size
+	if (fVersion >= 0x13)
+	{
+		C_UInt8 z = fOwner.fStream->R8b();
+		C_UInt8 sz = fOwner.fStream->R8b();
+		if ((z > rzLast) || (sz > 8) || ((z != rzNone) && (sz == 0)))
+			throw ErrStream(ErrZoneMap, z, sz);
+		fZoneMap = (TZoneMap)z;
+		fZoneSize = sz;
+	}
+
+	// get the number of independent blocks
+	BYTE_LE<CdStream>(fOwner.fStream) >> fBlockNum;
+	fBlockListStart = fOwner.fStreamPos = fOwner.fStream->Position();
+	// avoid integer overflow
+	if ((fBlockNum >= 0) && (fBlockNum < 0x7FFFFFFF))
+	{
+		const size_t n = (size_t)fBlockNum + 1;
+		fIndex = new TIndex[n];
+		memset(fIndex, 0, sizeof(TIndex)*n);
+	} else
+		throw ErrStream(ErrBlkNum);
+
+	// initialize the first compressed block
+	fBlockIdx = 0;
+	fCB_UZStart = fIndex[0].RawStart = 0;
+	fIndexSize = 0;
+
+	if (fVersion == 0x10)
+	{
+		// there is no pre-defined block information
+		fCB_ZStart  = fIndex[0].CmpStart = fBlockListStart;
+		if (fBlockNum > 0)
+		{
+			GetBlockHeader_v1_0();
+			fIndex[1].RawStart = fIndex[0].RawStart + fCB_UZSize;
+			fIndex[1].CmpStart = fIndex[0].CmpStart + fCB_ZSize;
+			fIndexSize = 1;
+		}
+	} else if (fVersion >= 0x11)
+	{
+		// pre-defined block information is stored after compressed data blocks
+		TdGDSPos Len;
+		BYTE_LE<CdStream>(fOwner.fStream) >> Len;
+		fOwner.fStreamPos += GDS_POS_SIZE;
+		fCB_ZStart = fIndex[0].CmpStart = fBlockListStart = fOwner.fStreamPos;
+		fIndexingStart = fBlockListStart + Len;
+		// read indexing information
+		LoadIndexing();
+		// set sizes
+		if (fBlockNum >= 1)
+		{
+			fCB_UZSize = fIndex[1].RawStart - fIndex[0].RawStart;
+			fCB_ZSize = fIndex[1].CmpStart - fIndex[0].CmpStart;
+		} else {
+			fCB_UZSize = fCB_ZSize = 0;
+		}
+	} else
+		throw ErrStream(ErrUnsupport, fVersion >> 4, fVersion & 0x0F);
+
+	// the filtered blocks are always decompressed as a whole
+	if (fFilter != rfNone) SetNumThread(0);
+}
+
+bool CdRA_Read::SeekStream(SIZE64 Position)
+{
+	if (Position < 0)
+	{
+		throw ErrStream(
+			"'Seek' out of the range: position (%lld) should be >= 0.",
+			Position);
+	}
+
+	if (Position < fCB_UZStart)
+	{
+		BinSearch(Position, 0, fBlockIdx-1);
+		return true;
+
+	} else if (Position >= (fCB_UZStart + fCB_UZSize))
+	{
+		if (Position >= fIndex[fIndexSize].RawStart)
+		{
+			if (fVersion == 0x10)
+			{
+				// no target, go to the last
+				fBlockIdx = fIndexSize - 1;
+				TIndex *p = fIndex + fBlockIdx;
+				fCB_UZStart = p[0].RawStart;
+				fCB_UZSize  = p[1].RawStart - p[0].RawStart;
+				fCB_ZStart  = p[0].CmpStart;
+				fCB_ZSize   = p[1].CmpStart - p[0].CmpStart;
+
+				while (Position >= (fCB_UZStart + fCB_UZSize))
+				{
+					// go to the next block
+					if (!NextBlock())
+					{
+						if (Position > fCB_UZStart)
+						{
+							throw ErrStream(
+								"'Seek' out of the range with position (%lld).",
+								Position);
+						}
+					}
+				}
+			} else {
+				throw ErrStream(
+					"'Seek' out of the range with position (%lld).",
+					Position);
+			}
+		} else {
+			BinSearch(Position, fBlockIdx+1, fIndexSize-1);
+		}
+		return true;
+	}
+
+	return false;
+}
+
+void CdRA_Read::GetUpdated()
+{
+	if (fIndexSize < fBlockNum)
+	{
+		while (NextBlock());
+	}
+}
+
+void CdRA_Read::GetBlockInfo(vector<SIZE64> &RawSize, vector<SIZE64> &CmpSize)
+{
+	GetUpdated();
+	RawSize.resize(fIndexSize);
+	CmpSize.resize(fIndexSize);
+	for (ssize_t i=0; i < fIndexSize; i++)
+	{
+		RawSize[i] = fIndex[i+1].RawStart - fIndex[i].RawStart;
+		CmpSize[i] = fIndex[i+1].CmpStart - fIndex[i].CmpStart;
+	}
+}
+
+bool CdRA_Read::GetZoneMap(vector<TZoneBlock> &Out)
+{
+	Out.clear();
+	if (fZoneMap == rzNone) return false;
+	GetUpdated();
+	LoadZoneMap();
+	Out.resize(fIndexSize);
+	for (ssize_t i=0; i < fIndexSize; i++)
+	{
+		TZoneBlock &b = Out[i];
+		const TZoneStat &st = fZoneList[i];
+		b.Start = fIndex[i].RawStart / fZoneSize;
+		b.Count = (fIndex[i+1].RawStart - fIndex[i].RawStart) / fZoneSize;
+		b.NumNA = st.NumNA;
+		if (b.Count > b.NumNA)
+		{
+			b.Min = ZoneValue(st.Min, false);
+			b.Max = ZoneValue(st.Max, true);
+		} else
+			b.Min = b.Max = NaN;
+	}
+	return true;
+}
+
+/// the maximum number of entries in the access trace
+static const size_t RA_TRACE_MAX_SIZE = 1024*1024;
+
+void CdRA_Read::SetTrace(bool Enable)
+{
+	if (Enable && !fTracing) fTrace.clear();
+	fTracing = Enable;
+}
+
+void CdRA_Read::TraceRead(SIZE64 Position, ssize_t Count)
+{
+	if (!fTrace.empty())
+	{
+		// merge the consecutive or overlapping reading
+		TAccess &a = fTrace.back();
+		if ((a.Start <= Position) && (Position <= a.Start + a.Length))
+		{
+			if (Position + Count > a.Start + a.Length)
+				a.Length = Position + Count - a.Start;
+			return;
+		}
+	}
+	if (fTrace.size() < RA_TRACE_MAX_SIZE)
+	{
+		TAccess a = { Position, Count };
+		fTrace.push_back(a);
+	}
+}
+
+bool CdRA_Read::SelectZone(double Lower, double Upper, vector<TZoneBlock> &Out)
+{
+	if (!GetZoneMap(Out)) return false;
+	// the blocks without any value never overlap
+	size_t n = 0;
+	for (size_t i=0; i < Out.size(); i++)
+	{
+		const TZoneBlock &b = Out[i];
+		if ((b.Count > b.NumNA) && (b.Max >= Lower) && (b.Min <= Upper))
+			Out[n++] = b;
+	}
+	Out.resize(n);
+	return true;
+}
+
+bool CdRA_Read::NextBlock()
+{
+	fCB_ZStart += fCB_ZSize;
+	fCB_UZStart += fCB_UZSize;
+	fBlockIdx ++;
+	if (fBlockIdx < fBlockNum)
+	{
+		if (fBlockIdx < fIndexSize)
+		{
+			fOwner.fStreamPos = fCB_ZStart;
+			if (fVersion == 0x10)
+				 fOwner.fStreamPos += SIZE_RA_BLOCK_HEADER;
+			TIndex *p = fIndex + fBlockIdx;
+			fCB_ZSize = p[1].CmpStart - p[0].CmpStart;
+			fCB_UZSize = p[1].RawStart - p[0].RawStart;
+		} else {
+			GetBlockHeader_v1_0();
+			fIndexSize = fBlockIdx + 1;
+			TIndex *p = fIndex + fIndexSize;
+			p->RawStart = fCB_UZStart + fCB_UZSize;
+			p->CmpStart = fCB_ZStart + fCB_ZSize;
+		}
+		return true;
+	} else {
+		fCB_ZSize = fCB_UZSize = 1; // avoid ZERO
+		return false;
+	}
+}
+
+void CdRA_Read::BinSearch(SIZE64 Position, ssize_t low, ssize_t high)
+{
+	TIndex *p = fIndex;
+	while (low < high)
+	{
+		ssize_t mid = low + ((high - low) >> 1);
+		if (Position >= p[mid].RawStart)
+		{
+			if (Position >= p[mid+1].RawStart)
+				low = mid + 1;
+			else
+				high = low = mid;
+		} else {
+			high = mid - 1;
+		}
+	}
+
+	// find the target
+	fBlockIdx = low;
+	p = fIndex + low;
+	fCB_UZStart = p[0].RawStart;
+	fCB_UZSize  = p[1].RawStart - p[0].RawStart;
+	fCB_ZStart  = p[0].CmpStart;
+	fCB_ZSize   = p[1].CmpStart - p[0].CmpStart;
+}
+
+void CdRA_Read::GetBlockHeader_v1_0()
+{
+	C_UInt8 BSZ[SIZE_RA_BLOCK_HEADER];
+	fOwner.fStream->SetPosition(fCB_ZStart);
+	fOwner.fStream->ReadData(BSZ, SIZE_RA_BLOCK_HEADER);
+	fOwner.fStreamPos = fCB_ZStart + SIZE_RA_BLOCK_HEADER;
+
+	fCB_ZSize = BSZ[0] | (C_UInt32(BSZ[1]) << 8) |
+		(C_UInt32(BSZ[2]) << 16);
+	fCB_UZSize = BSZ[3] | (C_UInt32(BSZ[4]) << 8) |
+		(C_UInt32(BSZ[5]) << 16) | (C_UInt32(BSZ[6]) << 24);
+}
+
+void CdRA_Read::LoadIndexing()
+{
+	if (fIndexSize <= 0)
+	{
+		fOwner.fStream->SetPosition(fIndexingStart);
+		C_UInt8 BSZ[SIZE_RA_BLOCK_HEADER];
+		TIndex *p = fIndex;
+		for (ssize_t i=0; i < fBlockNum; i++)
+		{
+			fOwner.fStream->ReadData(BSZ, SIZE_RA_BLOCK_HEADER);
+			C_UInt32 CmpLen = BSZ[0] | (C_UInt32(BSZ[1]) << 8) |
+				(C_UInt32(BSZ[2]) << 16);
+			C_UInt32 RawLen = BSZ[3] | (C_UInt32(BSZ[4]) << 8) |
+				(C_UInt32(BSZ[5]) << 16) | (C_UInt32(BSZ[6]) << 24);
+			TIndex *n = p + 1;
+			n->RawStart = p->RawStart + RawLen;
+			n->CmpStart = p->CmpStart + CmpLen;
+			p ++;
+		}
+		fIndexSize = fBlockNum;
+		fOwner.fStream->SetPosition(fOwner.fStreamPos);
+	}
+}
+
+void CdRA_Read::LoadZoneMap()
+{
+	static const ssize_t SIZE = 2*sizeof(C_UInt64) + sizeof(C_UInt32);
+	if ((fVersion >= 0x13) && ((ssize_t)fZoneList.size() < fBlockNum))
+	{
+		fOwner.fStream->SetPosition(fIndexingStart +
+			(SIZE64)fBlockNum * SIZE_RA_BLOCK_HEADER);
+		fZoneList.resize(fBlockNum);
+		for (ssize_t i=0; i < fBlockNum; i++)
+		{
+			C_UInt8 B[SIZE];
+			fOwner.fStream->ReadData(B, SIZE);
+			TZoneStat &st = fZoneList[i];
+			st.Min = st.Max = 0;
+			for (int j=7; j >= 0; j--)
+			{
+				st.Min = (st.Min << 8) | B[j];
+				st.Max = (st.Max << 8) | B[8 + j];
+			}
+			st.NumNA = B[16] | (C_UInt32(B[17]) << 8) |
+				(C_UInt32(B[18]) << 16) | (C_UInt32(B[19]) << 24);
+		}
+		fOwner.fStream->SetPosition(fOwner.fStreamPos);
+	}
+}
+
+namespace CoreArray
+{
+	/// The maximum size of raw data in a block decompressed on helper threads
+	static const SIZE64 RA_PARALLEL_MAX_BLOCK_SIZE = 64*1024*1024;
+
+	/// The helper threads and the blocks decompressed ahead for CdRA_Read
+	class COREARRAY_DLL_LOCAL CdRA_ReadPool
+	{
+	public:
+		CdRA_ReadPool(CdRA_Read *Owner, int NumThread)
+		{
+			fOwner = Owner;
+			fAhead = 2 * NumThread;
+			// the blocks ahead, the blocks being decompressed and the current
+			fNumItem = fAhead + NumThread + 1;
+			fItem = new TItem[fNumItem];
+			for (int i=0; i < fNumItem; i++)
+				_InitItem(fItem[i]);
+			_InitItem(fLocal);
+			fStop = false;
+			fPID = GetCurrentProcessID();
+			fMutex = new CdThreadMutex;
+			fCond = new CdThreadCondition;
+			for (int i=0; i < NumThread; i++)
+			{
+				CdThread *th = new CdThread;
+				try {
+					th->BeginThread(_Proc, this);
+				} catch (...) {
+					delete th;
+					_Stop(); _Free();
+					throw;
+				}
+				fThread.push_back(th);
+			}
+		}
+		~CdRA_ReadPool()
+		{
+			_Stop(); _Free();
+		}
+
+		/// return the decompressed data of block Idx, and decompress the
+		/// following blocks on the helper threads if Ahead
+		const C_UInt8 *Block(C_Int32 Idx, bool Ahead)
+		{
+			// forked, the helper threads do not exist in the child
+			if (fPID != GetCurrentProcessID())
+				return _LocalBlock(Idx);
+
+			TItem *I;
+			bool Own = false;
+			{
+				TdAutoMutex _m(fMutex);
+				I = _Find(Idx);
+				if (I)
+				{
+					if (I->State == stQueue)
+					{
+						// not picked up yet, decompress it here
+						I->State = stWork; Own = true;
+					} else {
+						while (I->State == stWork)
+							fCond->Wait(*fMutex);
+					}
+				} else {
+					I = _Reuse(Idx);
+					if (!I) return _LocalBlock(Idx);
+					I->Idx = Idx; I->State = stLoad;
+					Own = true;
+				}
+			}
+
+			if (Own)
+			{
+				try {
+					if (I->State == stLoad) _Load(*I, Idx);
+					_Decompress(*I);
+				} catch (...) {
+					TdAutoMutex _m(fMutex);
+					I->Idx = -1; I->State = stIdle;
+					throw;
+				}
+				TdAutoMutex _m(fMutex);
+				I->State = stDone;
+			} else if (I->State == stFail)
+			{
+				string Msg = I->ErrMsg;
+				TdAutoMutex _m(fMutex);
+				I->Idx = -1; I->State = stIdle;
+				throw ErrRecodeStream(Msg);
+			}
+
+			if (Ahead) _Prefetch(Idx);
+			return I->Raw;
+		}
+
+	private:
+		enum TState { stIdle, stLoad, stQueue, stWork, stDone, stFail };
+
+		struct TItem
+		{
+			C_Int32 Idx;       ///< the block index, -1 for none
+			TState State;
+			vector<C_UInt8> Cmp;  ///< the compressed data
+			C_UInt8 *Raw;      ///< the decompressed data
+			ssize_t RawSize;   ///< the allocated size of Raw
+			ssize_t RawLen;    ///< the size of raw data in the block
+			string ErrMsg;     ///< the error message of decompressing
+		};
+
+		CdRA_Read *fOwner;
+		TItem *fItem;      ///< the blocks
+		int fNumItem;      ///< the number of blocks
+		int fAhead;        ///< the number of blocks decompressed ahead
+		TItem fLocal;      ///< the block used in a forked process
+		vector<CdThread*> fThread;
+		bool fStop;
+		TProcessID fPID;
+		CdThreadMutex *fMutex;
+		CdThreadCondition *fCond;
+
+		static void _InitItem(TItem &I)
+		{
+			I.Idx = -1; I.State = stIdle;
+			I.Raw = NULL;
+			I.RawSize = I.RawLen = 0;
+		}
+
+		void _Stop()
+		{
+			if (fPID == GetCurrentProcessID())
+			{
+				fMutex->Lock();
+				fStop = true;
+				fCond->Broadcast();
+				fMutex->Unlock();
+				for (size_t i=0; i < fThread.size(); i++)
+				{
+					try {
+						fThread[i]->EndThread();
+					} catch (...) { }
+					delete fThread[i];
+				}
+				delete fCond;
+				delete fMutex;
+			} else {
+				// forked, the mutex might be left locked
+				for (size_t i=0; i < fThread.size(); i++)
+					delete fThread[i];
+			}
+			fThread.clear();
+			fCond = NULL; fMutex = NULL;
+		}
+		void _Free()
+		{
+			for (int i=0; i < fNumItem; i++)
+				if (fItem[i].Raw) free((void*)fItem[i].Raw);
+			if (fLocal.Raw) free((void*)fLocal.Raw);
+			delete []fItem;
+			fItem = NULL;
+		}
+
+		/// decompress block Idx on the calling thread without the helpers
+		const C_UInt8 *_LocalBlock(C_Int32 Idx)
+		{
+			if (fLocal.Idx != Idx)
+			{
+				fLocal.Idx = -1;
+				_Load(fLocal, Idx);
+				_Decompress(fLocal);
+				fLocal.Idx = Idx;
+			}
+			return fLocal.Raw;
+		}
+
+		/// the block Idx, or NULL
+		TItem *_Find(C_Int32 Idx)
+		{
+			for (int i=0; i < fNumItem; i++)
+				if (fItem[i].Idx == Idx) return &fItem[i];
+			return NULL;
+		}
+
+		/// a free block except the blocks from Idx to Idx+fAhead, or NULL
+		TItem *_Reuse(C_Int32 Idx)
+		{
+			TItem *rv = NULL;
+			for (int i=0; i < fNumItem; i++)
+			{
+				TItem &I = fItem[i];
+				if ((I.Idx >= Idx) && (I.Idx <= Idx+fAhead)) continue;
+				if (I.State == stIdle) return &I;
+				if ((I.State == stDone) || (I.State == stFail))
+					rv = &I;
+				else if ((I.State == stQueue) && !rv)
+					rv = &I;  // cancel a block not needed any more
+			}
+			return rv;
+		}
+
+		/// read the compressed data of block Idx, on the calling thread
+		void _Load(TItem &I, C_Int32 Idx)
+		{
+			fOwner->LoadBlock(Idx, I.Cmp);
+			CdRA_Read::TIndex *p = fOwner->fIndex + Idx;
+			ssize_t RawLen = p[1].RawStart - p[0].RawStart;
+			if (I.RawSize < RawLen)
+			{
+				C_UInt8 *tmp = (C_UInt8*)realloc((void*)I.Raw, RawLen);
+				COREARRAY_ALLOCCHECK(tmp);
+				I.Raw = tmp; I.RawSize = RawLen;
+			}
+			I.RawLen = RawLen;
+		}
+
+		void _Decompress(TItem &I)
+		{
+			if (I.RawLen > 0)
+			{
+				fOwner->DecodeBlock(I.Cmp.empty() ? NULL : &I.Cmp[0],
+					I.Cmp.size(), I.Raw, I.RawLen);
+			}
+		}
+
+		/// queue the blocks after Idx for the helper threads
+		void _Prefetch(C_Int32 Idx)
+		{
+			C_Int32 End = Idx + fAhead;
+			if (End >= fOwner->fBlockNum) End = fOwner->fBlockNum - 1;
+			for (C_Int32 j=Idx+1; j <= End; j++)
+			{
+				TItem *I;
+				{
+					TdAutoMutex _m(fMutex);
+					if (_Find(j)) continue;
+					I = _Reuse(Idx);
+					if (!I) break;
+					I->Idx = j; I->State = stLoad;
+				}
+				bool Failed = false;
+				try {
+					_Load(*I, j);
+				} catch (...) {
+					Failed = true;
+				}
+				TdAutoMutex _m(fMutex);
+				if (Failed)
+				{
+					// reported when the block is needed
+					I->Idx = -1; I->State = stIdle;
+					break;
+				}
+				I->State = stQueue;
+				fCond->Broadcast();
+			}
+		}
+
+		static int _Proc(CdThread *Thread, CdRA_ReadPool *Obj)
+		{
+			TdAutoMutex _m(Obj->fMutex);
+			while (!Obj->fStop)
+			{
+				// the queued block nearest to the reading position
+				TItem *I = NULL;
+				for (int i=0; i < Obj->fNumItem; i++)
+				{
+					TItem &T = Obj->fItem[i];
+					if ((T.State == stQueue) && (!I || (T.Idx < I->Idx)))
+						I = &T;
+				}
+				if (!I)
+				{
+					Obj->fCond->Wait(*Obj->fMutex);
+					continue;
+				}
+				I->State = stWork;
+				Obj->fMutex->Unlock();
+				string Msg;
+				bool Failed = false;
+				try {
+					Obj->_Decompress(*I);
+				} catch (exception &E) {
+					Msg = E.what(); Failed = true;
+				} catch (...) {
+					Msg = "block decompression error"; Failed = true;
+				}
+				Obj->fMutex->Lock();
+				I->ErrMsg = Msg;
+				I->State = Failed ? stFail : stDone;
+				Obj->fCond->Broadcast();
+			}
+			return 0;
+		}
+	};
+}
+
+void CdRA_Read::SetNumThread(int Num)
+{
+	if (Num < 0) Num = 0;
+	if ((Num == fNumThread) && (fPool || (fFilter == rfNone))) return;
+	ParallelEnd();
+	fNumThread = 0;
+	// the block list is required, and the filtered blocks are decompressed
+	// by the pool without any helper thread if Num = 0
+	if (((Num > 0) || (fFilter != rfNone)) && (fVersion >= 0x11) &&
+		(fBlockNum > 0))
+	{
+		for (ssize_t i=0; i < fBlockNum; i++)
+		{
+			if (fIndex[i+1].RawStart - fIndex[i].RawStart >
+					RA_PARALLEL_MAX_BLOCK_SIZE)
+			{
+				if (fFilter != rfNone)
+					throw ErrStream("The filtered block is too large.");
+				return;
+			}
+		}
+		try {
+			fPool = new CdRA_ReadPool(this, Num);
+			fNumThread = Num;
+		} catch (...) {
+			// decompress on the calling thread
+			fPool = NULL;
+			if (fFilter != rfNone) throw;
+		}
+	}
+}
+
+ssize_t CdRA_Read::ParallelRead(void *Buffer, ssize_t Count,
+	SIZE64 &Position)
+{
+	C_UInt8 *p = (C_UInt8*)Buffer;
+	const SIZE64 TotalSize = fIndex[fBlockNum].RawStart;
+	ssize_t OldCount = Count;
+
+	while ((Count > 0) && (Position < TotalSize))
+	{
+		if ((fParIdx < 0) || (Position < fIndex[fParIdx].RawStart) ||
+			(Position >= fIndex[fParIdx+1].RawStart))
+		{
+			C_Int32 Prev = fParIdx;
+			fParIdx = -1;
+			ParallelSeek(Position);
+			// decompress the blocks ahead when reading sequentially
+			fParBlock = fPool->Block(fBlockIdx, fBlockIdx == Prev+1);
+			fParIdx = fBlockIdx;
+		}
+		TIndex *I = fIndex + fParIdx;
+		ssize_t Off = Position - I[0].RawStart;
+		ssize_t L = (I[1].RawStart - I[0].RawStart) - Off;
+		if (L > Count) L = Count;
+		memcpy(p, fParBlock + Off, L);
+		p += L; Count -= L;
+		Position += L;
+	}
+
+	if (Position > fOwner.fTotalOut)
+		fOwner.fTotalOut = Position;
+	return OldCount - Count;
+}
+
+void CdRA_Read::LoadBlock(C_Int32 Idx, vector<C_UInt8> &Cmp)
+{
+	TIndex *p = fIndex + Idx;
+	SIZE64 Start = p[0].CmpStart;
+	// the block header in version 0x10
+	if (fVersion == 0x10) Start += SIZE_RA_BLOCK_HEADER;
+	Cmp.resize(p[1].CmpStart - Start);
+	if (!Cmp.empty())
+	{
+		fOwner.fStream->SetPosition(Start);
+		fOwner.fStream->ReadData(&Cmp[0], Cmp.size());
+	}
+}
+
+bool CdRA_Read::CacheSeek()
+{
+	CacheEnd();
+	if ((fBlockIdx >= fIndexSize) ||
+			(fCB_UZSize > CdRABlockCache::Budget()))
+		return false;
+	CdBlockStream *s = dynamic_cast<CdBlockStream*>(fOwner.fStream);
+	if (!s) return false;
+
+	const void *File = &s->Collection();
+	C_UInt32 ID = s->ID().Get();
+	fCacheBlk = CdRABlockCache::Find(File, ID, fBlockIdx, fCacheData);
+	if (!fCacheBlk)
+	{
+		vector<C_UInt8> Cmp, Raw(fCB_UZSize);
+		LoadBlock(fBlockIdx, Cmp);
+		if (!Raw.empty())
+		{
+			DecodeBlock(Cmp.empty() ? NULL : &Cmp[0], Cmp.size(),
+				&Raw[0], Raw.size());
+		}
+		fCacheBlk = CdRABlockCache::Add(File, ID, fBlockIdx, Raw, fCacheData);
+	}
+	return true;
+}
+
+ssize_t CdRA_Read::CacheRead(void *Buffer, ssize_t Count, SIZE64 &Position)
+{
+	ssize_t Off = Position - fCB_UZStart;
+	ssize_t L = fCB_UZSize - Off;
+	if (L > Count) L = Count;
+	if (L > 0)
+	{
+		memcpy(Buffer, fCacheData + Off, L);
+		Position += L;
+	} else
+		L = 0;
+	if (Position >= fCB_UZStart + fCB_UZSize)
+	{
+		// continue decompressing from the next block
+		CacheEnd();
+		if (NextBlock()) Reset();
+	}
+	if (Position > fOwner.fTotalOut)
+		fOwner.fTotalOut = Position;
+	return L;
+}
+
+void CdRA_Read::CacheEnd()
+{
+	if (fCacheBlk)
+	{
+		CdRABlockCache::Release(fCacheBlk);
+		fCacheBlk = NULL;
+		fCacheData = NULL;
+	}
+}
+
+void CdRA_Read::ParallelSeek(SIZE64 Position)
+{
+	if (Position < 0)
+	{
+		throw ErrStream(
+			"'Seek' out of the range: position (%lld) should be >= 0.",
+			Position);
+	}
+	if (Position < fIndex[fBlockNum].RawStart)
+	{
+		if ((Position < fCB_UZStart) || (Position >= fCB_UZStart+fCB_UZSize) ||
+				(fBlockIdx >= fBlockNum))
+			BinSearch(Position, 0, fBlockNum-1);
+	} else if (Position > fIndex[fBlockNum].RawStart)
+	{
+		throw ErrStream(
+			"'Seek' out of the range with position (%lld).", Position);
+	}
+}
+
+void CdRA_Read::DecodeBlock(const C_UInt8 *Cmp, ssize_t CmpLen,
+	C_UInt8 *Raw, ssize_t RawLen)
+{
+	if (fFilter != rfNone)
+	{
+		vector<C_UInt8> Buf(RawLen);
+		DecompressBlock(Cmp, CmpLen, &Buf[0], RawLen);
+		UnfilterData(Raw, &Buf[0], RawLen);
+	} else
+		DecompressBlock(Cmp, CmpLen, Raw, RawLen);
+}
+
+C_UInt8 *CdRA_Read::PatchBlock(C_Int32 Idx, bool Modify)
+{
+	map<C_Int32, vector<C_UInt8> >::iterator it = fPatch.find(Idx);
+	if (it != fPatch.end())
+		return it->second.empty() ? NULL : &(it->second[0]);
+
+	if (fPatchIdx != Idx)
+	{
+		vector<C_UInt8> Cmp;
+		LoadBlock(Idx, Cmp);
+		fPatchIdx = -1;
+		fPatchBlk.resize(fIndex[Idx+1].RawStart - fIndex[Idx].RawStart);
+		if (!fPatchBlk.empty())
+		{
+			DecodeBlock(Cmp.empty() ? NULL : &Cmp[0], Cmp.size(),
+				&fPatchBlk[0], fPatchBlk.size());
+		}
+		fPatchIdx = Idx;
+	}
+	if (Modify)
+	{
+		vector<C_UInt8> &Blk = fPatch[Idx];
+		Blk.swap(fPatchBlk);
+		fPatchIdx = -1;
+		return Blk.empty() ? NULL : &Blk[0];
+	}
+	return fPatchBlk.empty() ? NULL : &fPatchBlk[0];
+}
+
+ssize_t CdRA_Read::PatchRead(void *Buffer, ssize_t Count, SIZE64 &Position)
+{
+	C_UInt8 *p = (C_UInt8*)Buffer;
+	ssize_t OldCount = Count;
+	while ((Count > 0) && (Position < fIndex[fIndexSize].RawStart))
+	{
+		BinSearch(Position, 0, fIndexSize-1);
+		const C_UInt8 *Raw = PatchBlock(fBlockIdx, false);
+		ssize_t L = fCB_UZStart + fCB_UZSize - Position;
+		if (L > Count) L = Count;
+		memcpy(p, Raw + (Position - fCB_UZStart), L);
+		p += L; Count -= L;
+		Position += L;
+	}
+	if (Position > fOwner.fTotalOut)
+		fOwner.fTotalOut = Position;
+	return OldCount - Count;
+}
+
+ssize_t CdRA_Read::PatchWrite(const void *Buffer, ssize_t Count,
+	SIZE64 &Position)
+{
+	if (Count <= 0) return 0;
+	if (fVersion < 0x11)
+	{
+		throw ErrRecodeStream(
+			"Writing requires the block list of compressed data (v1.1 or later).");
+	}
+	GetUpdated();
+	if ((Position < 0) || (Position + Count > fIndex[fIndexSize].RawStart))
+	{
+		throw ErrRecodeStream(
+			"Writing out of the range of compressed data (position: %lld).",
+			(C_Int64)(Position + Count));
+	}
+
+	// the sequential or parallel reading is not used any more
+	CacheEnd();
+	ParallelEnd();
+
+	const C_UInt8 *p = (const C_UInt8*)Buffer;
+	ssize_t OldCount = Count;
+	while (Count > 0)
+	{
+		BinSearch(Position, 0, fIndexSize-1);
+		C_UInt8 *Raw = PatchBlock(fBlockIdx, true);
+		ssize_t L = fCB_UZStart + fCB_UZSize - Position;
+		if (L > Count) L = Count;
+		memcpy(Raw + (Position - fCB_UZStart), p, L);
+		p += L; Count -= L;
+		Position += L;
+	}
+	return OldCount;
+}
+
+void CdRA_Read::ParallelEnd()
+{
+	if (fPool)
+	{
+		delete fPool;
+		fPool = NULL;
+	}
+	fParIdx = -1;
+	fParBlock = NULL;
+}
+
+
+// CdRA_Write
+
+namespace CoreArray
+{
+	/// The maximum size of raw data in a block compressed on helper threads,
+	/// the compressed size should be less than 16M in the block list
+	static const ssize_t RA_PARALLEL_MAX_RAW_SIZE = 14*1024*1024;
+
+	/// The helper threads and the queue of blocks compressed for CdRA_Write
+	class COREARRAY_DLL_LOCAL CdRA_WritePool
+	{
+	public:
+		struct TItem
+		{
+			C_UInt8 *Raw;      ///< the raw data
+			ssize_t RawSize;   ///< the allocated size of Raw
+			ssize_t RawLen;    ///< the size of raw data in Raw
+			ssize_t Target;    ///< the size of raw data in a full block
+			vector<C_UInt8> Cmp;  ///< the compressed data
+			bool Done, Failed;
+			string ErrMsg;     ///< the error message of compressing
+		};
+
+		TItem *Item;       ///< a ring of blocks
+		int NumItem;       ///< the number of blocks in the ring
+		/// the numbers of blocks queued, compressed and written
+		C_Int64 NumSubmit, NumPick, NumRetire;
+		bool Filling;      ///< whether Item[NumSubmit] is being filled
+
+		CdRA_WritePool(CdRA_Write *Owner, int NumThread)
+		{
+			fOwner = Owner;
+			NumItem = (NumThread > 0) ? 2 * NumThread : 1;
+			Item = new TItem[NumItem];
+			for (int i=0; i < NumItem; i++)
+			{
+				TItem &I = Item[i];
+				I.Raw = NULL;
+				I.RawSize = I.RawLen = I.Target = 0;
+				I.Done = I.Failed = false;
+			}
+			NumSubmit = NumPick = NumRetire = 0;
+			Filling = fStop = false;
+			for (int i=0; i < NumThread; i++)
+			{
+				CdThread *th = new CdThread;
+				try {
+					th->BeginThread(_Proc, this);
+				} catch (...) {
+					delete th;
+					_Stop(); _Free();
+					throw;
+				}
+				fThread.push_back(th);
+			}
+		}
+		~CdRA_WritePool()
+		{
+			_Stop(); _Free();
+		}
+
+		/// the block being filled
+		COREARRAY_INLINE TItem &Current()
+			{ return Item[NumSubmit % NumItem]; }
+		/// whether all blocks in the ring are queued or being compressed
+		COREARRAY_INLINE bool Full() const
+			{ return NumSubmit - NumRetire >= NumItem; }
+
+		/// queue the current block for the helper threads
+		void Submit()
+		{
+			if (fThread.empty())
+			{
+				// no helper thread, compress it on the calling thread
+				TItem &I = Current();
+				fOwner->EncodeBlock(I.Raw, I.RawLen, I.Cmp);
+				I.Failed = false; I.Done = true;
+				NumSubmit ++; NumPick ++;
+				Filling = false;
+				return;
+			}
+			TdAutoMutex _m(&fMutex);
+			Current().Done = Current().Failed = false;
+			NumSubmit ++;
+			Filling = false;
+			fCond.Broadcast();
+		}
+		/// wait for the oldest queued block, and remove it from the queue
+		TItem &Pop()
+		{
+			TdAutoMutex _m(&fMutex);
+			TItem &I = Item[NumRetire % NumItem];
+			while (!I.Done)
+				fCond.Wait(fMutex);
+			NumRetire ++;
+			I.Target = 0;
+			return I;
+		}
+
+	private:
+		CdRA_Write *fOwner;
+		vector<CdThread*> fThread;
+		bool fStop;
+		CdThreadMutex fMutex;
+		CdThreadCondition fCond;
+
+		void _Stop()
+		{
+			fMutex.Lock();
+			fStop = true;
+			fCond.Broadcast();
+			fMutex.Unlock();
+			for (size_t i=0; i < fThread.size(); i++)
+			{
+				try {
+					fThread[i]->EndThread();
+				} catch (...) { }
+				delete fThread[i];
+			}
+			fThread.clear();
+		}
+		void _Free()
+		{
+			for (int i=0; i < NumItem; i++)
+				if (Item[i].Raw) free((void*)Item[i].Raw);
+			delete []Item;
+			Item = NULL;
+		}
+
+		static int _Proc(CdThread *Thread, CdRA_WritePool *Obj)
+		{
+			TdAutoMutex _m(&Obj->fMutex);
+			while (!Obj->fStop)
+			{
+				if (Obj->NumPick >= Obj->NumSubmit)
+				{
+					Obj->fCond.Wait(Obj->fMutex);
+					continue;
+				}
+				// the block is not reused by the main thread until done
+				TItem &I = Obj->Item[Obj->NumPick % Obj->NumItem];
+				Obj->NumPick ++;
+				Obj->fMutex.Unlock();
+				string Msg;
+				bool Failed = false;
+				try {
+					Obj->fOwner->EncodeBlock(I.Raw, I.RawLen, I.Cmp);
+				} catch (exception &E) {
+					Msg = E.what(); Failed = true;
+				} catch (...) {
+					Msg = "block compression error"; Failed = true;
+				}
+				Obj->fMutex.Lock();
+				I.ErrMsg = Msg;
+				I.Failed = Failed;
+				I.Done = true;
+				Obj->fCond.Broadcast();
+			}
+			return 0;
+		}
+	};
+}
+
+CdRA_Write::CdRA_Write(CdRecodeStream *owner, TBlockSize bs):
+	CdRAAlgorithm(*owner)
+{
+	if ((bs < raFirst) || (bs > raLast))
+		throw EZLibError("%s: invalid block size.", __func__);
+	fVersion = 0x11;  // by default
+	fBlockNum = 0;
+	fCB_ZStart = fCB_UZStart = 0;
+	fBlockListStart = 0;
+	fHasInitWriteBlock = false;
+	fNumThread = 0;
+	fPool = NULL;
+	fParBlockSize = RA_BLOCK_SIZE_LIST[bs];
+	fParRawTotal = fParCmpTotal = 0;
+}
+
+CdRA_Write::~CdRA_Write()
+{
+	ParallelEnd();
+}
+
+void CdRA_Write::InitWriteStream()
+{
+	// the cached blocks of the stream are out of date
+	CdBlockStream *s = dynamic_cast<CdBlockStream*>(fOwner.fStream);
+	if (s) CdRABlockCache::Purge(&s->Collection(), s->ID().Get());
+
+	// get the base position
+	fOwner.fStreamBase = fOwner.fStream->Position();
+
+	// write the magic number
+	WriteMagicNumber(*fOwner.fStream);
+	// write the version of this algorithm, v1.0
+	fOwner.fStream->W8b(fVersion);
+	// write the parameter of block size
+	fOwner.fStream->W8b(fSizeType);
+	// write the filter and its element size
+	if (fVersion >= 0x12)
+	{
+		fOwner.fStream->W8b(fFilter);
+		fOwner.fStream->W8b(fFilterSize);
+	}
+	// write the zone map and its element size
+	if (fVersion >= 0x13)
+	{
+		fOwner.fStream->W8b(fZoneMap);
+		fOwner.fStream->W8b(fZoneSize);
+	}
+	// write the number of independent blocks, -1 for unknown
+	BYTE_LE<CdStream>(fOwner.fStream) << C_Int32(-1);
+
+	// set values
+	fBlockListStart = fOwner.fStreamPos = fOwner.fStream->Position();
+	// version
+	if (fVersion >= 0x11)
+	{
+		BYTE_LE<CdStream>(fOwner.fStream) << TdGDSPos(0);
+		fOwner.fStreamPos += GDS_POS_SIZE;
+		fBlockListStart = fOwner.fStreamPos;
+	}
+
+	fOwner.fTotalOut = (fOwner.fStreamPos - fOwner.fStreamBase);
+	fHasInitWriteBlock = false;
+}
+
+void CdRA_Write::DoneWriteStream()
+{
+	DoneWriteBlock();
+
+	if (fVersion == 0x10)
+	{
+		// write the ending code, zero filling
+		C_UInt64 Val = 0;
+		fOwner.fStream->WriteData(&Val, SIZE_RA_BLOCK_HEADER);
+		fOwner.fStreamPos += SIZE_RA_BLOCK_HEADER;
+		fOwner.fTotalOut = fOwner.fStreamPos - fOwner.fStreamBase;
+	}
+
+	fHasInitWriteBlock = false;
+	// save position
+	SIZE64 OldPos = fOwner.fStreamPos;
+
+	// write down the number of independent blocks
+	if (fVersion == 0x10)
+	{
+		fOwner.fStream->SetPosition(fBlockListStart - sizeof(C_Int32));
+		BYTE_LE<CdStream>(fOwner.fStream) << C_Int32(fBlockNum);
+	} else if (fVersion >= 0x11)
+	{
+		fOwner.fStream->SetPosition(fBlockListStart - sizeof(C_Int32) -
+			GDS_POS_SIZE);
+		BYTE_LE<CdStream>(fOwner.fStream) << C_Int32(fBlockNum) <<
+			TdGDSPos(OldPos - fBlockListStart);
+		// store indexing information
+		fOwner.fStream->SetPosition(OldPos);
+		for (ssize_t i=0; i < fBlockNum; i++)
+		{
+			C_UInt64 u = fBlockInfoList[i];
+			C_UInt32 SC = u & 0xFFFFFFFF;
+			C_UInt32 SU = u >> 32;
+			C_UInt8 SZ[SIZE_RA_BLOCK_HEADER] =
+			{
+				C_UInt8(SC & 0xFF),
+				C_UInt8((SC >> 8) & 0xFF),
+				C_UInt8((SC >> 16) & 0xFF),
+				C_UInt8(SU & 0xFF),
+				C_UInt8((SU >> 8) & 0xFF),
+				C_UInt8((SU >> 16) & 0xFF),
+				C_UInt8((SU >> 24) & 0xFF)
+			};
+			fOwner.fStream->WriteData(SZ, SIZE_RA_BLOCK_HEADER);
+		}
+		// store the zone map after indexing information
+		if (fVersion >= 0x13)
+		{
+			for (ssize_t i=0; i < fBlockNum; i++)
+			{
+				const TZoneStat &st = fZoneList[i];
+				C_UInt8 B[2*sizeof(C_UInt64) + sizeof(C_UInt32)];
+				for (int j=0; j < 8; j++)
+				{
+					B[j] = C_UInt8(st.Min >> (8*j));
+					B[8 + j] = C_UInt8(st.Max >> (8*j));
+				}
+				for (int j=0; j < 4; j++)
+					B[16 + j] = C_UInt8(st.NumNA >> (8*j));
+				fOwner.fStream->WriteData(B, sizeof(B));
+			}
+		}
+	}
+
+	// reset stream position
+	fOwner.fStream->SetPosition(fOwner.fStreamPos=OldPos);
+}
+
+void CdRA_Write::InitWriteBlock()
+{
+	if (!fHasInitWriteBlock)
+	{
+		fCB_ZStart = fOwner.fStreamPos;
+		fCB_UZStart = fOwner.fTotalIn;
+		if (fVersion == 0x10)
+		{
+			C_UInt64 Val = 0;
+			fOwner.fStream->WriteData(&Val, SIZE_RA_BLOCK_HEADER);
+			fOwner.fStreamPos += SIZE_RA_BLOCK_HEADER;
+		}
+		fHasInitWriteBlock = true;
+	}
+}
+
+void CdRA_Write::DoneWriteBlock()
+{
+	if (fHasInitWriteBlock)
+	{
+		C_UInt32 SC = fOwner.fStreamPos - fCB_ZStart;
+		C_UInt32 SU = fOwner.fTotalIn - fCB_UZStart;
+
+		if (fVersion == 0x10)
+		{
+			// store indexing info together with the compression block
+			C_UInt8 SZ[SIZE_RA_BLOCK_HEADER] =
+			{
+				C_UInt8(SC & 0xFF),
+				C_UInt8((SC >> 8) & 0xFF),
+				C_UInt8((SC >> 16) & 0xFF),
+				C_UInt8(SU & 0xFF),
+				C_UInt8((SU >> 8) & 0xFF),
+				C_UInt8((SU >> 16) & 0xFF),
+				C_UInt8((SU >> 24) & 0xFF)
+			};
+			fOwner.fStream->SetPosition(fCB_ZStart);
+			fOwner.fStream->WriteData(SZ, SIZE_RA_BLOCK_HEADER);
+			fOwner.fStream->SetPosition(fOwner.fStreamPos);
+			fBlockNum ++;
+		} else if (fVersion >= 0x11)
+		{
+			// add indexing info to fBlockInfoList
+			AddBlockInfo(SC, SU);
+		}
+
+		fHasInitWriteBlock = false;
+	}
+}
+
+void CdRA_Write::AddBlockInfo(C_UInt32 CmpLen, C_UInt32 RawLen)
+{
+	if (fVersion >= 0x11)
+		fBlockInfoList.push_back(CmpLen | (C_UInt64(RawLen) << 32));
+	fBlockNum ++;
+}
+
+void CdRA_Write::CopyBlockInfo(CdRA_Read &Src)
+{
+	AddBlockInfo(Src.fCB_ZSize, Src.fCB_UZSize);
+	if (fZoneMap != rzNone)
+	{
+		Src.LoadZoneMap();
+		fZoneList.push_back(Src.fZoneList[Src.fBlockIdx]);
+	}
+}
+
+void CdRA_Write::SetNumThread(int Num)
+{
+	if (Num < 0) Num = 0;
+	if ((Num == fNumThread) || (fOwner.fTotalIn > 0)) return;
+	ParallelEnd();
+	fNumThread = 0;
+	if (Num > 0)
+	{
+		try {
+			fPool = new CdRA_WritePool(this, Num);
+			fNumThread = Num;
+		} catch (...) {
+			// compress on the calling thread
+			fPool = NULL;
+		}
+	}
+	// the filtered blocks or the blocks with a zone map are buffered without
+	// any helper thread
+	if (!fPool && ((fFilter != rfNone) || (fZoneMap != rzNone)))
+		fPool = new CdRA_WritePool(this, 0);
+}
+
+void CdRA_Write::SetFilter(TFilter Filter, int ElmSize)
+{
+	if (Filter == rfNone) ElmSize = 0;
+	if ((Filter == fFilter) && (ElmSize == fFilterSize)) return;
+	if ((Filter < rfNone) || (Filter > rfLast) ||
+			((Filter != rfNone) && ((ElmSize < 1) || (ElmSize > 255))))
+		throw ErrRecodeStream("Invalid block filter (%d) with the element size (%d).",
+			(int)Filter, ElmSize);
+	if ((fOwner.fTotalIn > 0) || fHasInitWriteBlock || (fBlockNum > 0))
+		throw ErrRecodeStream("The block filter should be set before writing data.");
+
+	fFilter = Filter;
+	fFilterSize = ElmSize;
+	ResetVersion();
+}
+
+void CdRA_Write::SetZoneMap(TZoneMap Map, int ElmSize)
+{
+	if (Map == rzNone) ElmSize = 0;
+	if ((Map == fZoneMap) && (ElmSize == fZoneSize)) return;
+	if ((Map < rzNone) || (Map > rzLast) ||
+			((Map != rzNone) && ((ElmSize < 1) || (ElmSize > 8))) ||
+			((Map == rzFloat) && (ElmSize != 4) && (ElmSize != 8)))
+		throw ErrRecodeStream("Invalid zone map (%d) with the element size (%d).",
+			(int)Map, ElmSize);
+	if ((fOwner.fTotalIn > 0) || fHasInitWriteBlock || (fBlockNum > 0))
+		throw ErrRecodeStream("The zone map should be set before writing data.");
+
+	fZoneMap = Map;
+	fZoneSize = ElmSize;
+	ResetVersion();
+}
+
+void CdRA_Write::InitAppendStream(CdRA_Read &Src, vector<C_UInt8> *Tail)
+{
+	if ((fOwner.fTotalIn > 0) || fHasInitWriteBlock || (fBlockNum > 0))
+		throw ErrRecodeStream("Appending should be initialized before writing data.");
+	// the same stream header is required
+	if ((Src.fVersion < 0x11) || (Src.fVersion != fVersion) ||
+			(Src.fSizeType != fSizeType) || !SameBlockFormat(Src) ||
+			(Src.fBlockListStart != fBlockListStart))
+		throw ErrRecodeStream("The stream is not compatible with appending.");
+	// the blocks are copied to a new stream, or kept in place if unmodified
+	const bool Copy = (fOwner.fStream != Src.fOwner.fStream);
+	if (!Copy && Src.Patched())
+		throw ErrRecodeStream("The modified blocks should be written to a new stream.");
+
+	Src.GetUpdated();
+	Src.LoadZoneMap();
+	const C_Int32 N = Src.fIndexSize;
+	const CdRA_Read::TIndex *Idx = Src.fIndex;
+	if (fZoneMap != rzNone)
+		fZoneList = Src.fZoneList;
+
+	// the number of blocks kept
+	C_Int32 K = (Tail && (N > 0)) ? (N - 1) : N;
+	map<C_Int32, vector<C_UInt8> >::iterator it;
+
+	// decompress the last block, which is compressed again with the new data
+	if (Tail)
+	{
+		Tail->clear();
+		if (K < N)
+		{
+			it = Src.fPatch.find(K);
+			if (it == Src.fPatch.end())
+			{
+				vector<C_UInt8> Cmp;
+				Src.LoadBlock(K, Cmp);
+				Tail->resize(Idx[K+1].RawStart - Idx[K].RawStart);
+				if (!Tail->empty())
+				{
+					Src.DecodeBlock(Cmp.empty() ? NULL : &Cmp[0], Cmp.size(),
+						&(*Tail)[0], Tail->size());
+				}
+			} else
+				*Tail = it->second;
+		}
+	}
+
+	// keep the blocks, and the modified blocks are compressed again
+	vector<C_UInt8> Cmp;
+	SIZE64 Pos = Idx[0].CmpStart;
+	for (C_Int32 i=0; i < K; i++)
+	{
+		const C_UInt32 RawLen = Idx[i+1].RawStart - Idx[i].RawStart;
+		if (Copy)
+		{
+			it = Src.fPatch.find(i);
+			if (it != Src.fPatch.end())
+			{
+				vector<C_UInt8> &Raw = it->second;
+				EncodeBlock(Raw.empty() ? NULL : &Raw[0], Raw.size(), Cmp);
+				if (fZoneMap != rzNone)
+					ZoneStat(Raw.empty() ? NULL : &Raw[0], Raw.size(), fZoneList[i]);
+			} else
+				Src.LoadBlock(i, Cmp);
+			if (!Cmp.empty())
+			{
+				fOwner.fStream->SetPosition(Pos);
+				fOwner.fStream->WriteData(&Cmp[0], Cmp.size());
+			}
+			AddBlockInfo(Cmp.size(), RawLen);
+			Pos += Cmp.size();
+		} else {
+			AddBlockInfo(Idx[i+1].CmpStart - Idx[i].CmpStart, RawLen);
+			Pos = Idx[i+1].CmpStart;
+		}
+	}
+	if (fZoneMap != rzNone)
+		fZoneList.resize(K);
+	fOwner.fStreamPos = Pos;
+	fOwner.fTotalIn = Idx[K].RawStart;
+	fOwner.fTotalOut = fOwner.fStreamPos - fOwner.fStreamBase;
+	fParRawTotal = fOwner.fTotalIn;
+	fParCmpTotal = fOwner.fStreamPos - fBlockListStart;
+
+	// the block list is rewritten when the stream is closed
+	fOwner.fStream->SetSize(fOwner.fStreamPos);
+	fOwner.fStream->SetPosition(fOwner.fStreamPos);
+}
+
+void CdRA_Write::ResetVersion()
+{
+	if (fZoneMap != rzNone)
+		fVersion = 0x13;
+	else if (fFilter != rfNone)
+		fVersion = 0x12;
+	else
+		fVersion = 0x11;
+	// rewrite the stream header
+	fOwner.fStream->SetPosition(fOwner.fStreamBase);
+	InitWriteStream();
+
+	if ((fFilter != rfNone) || (fZoneMap != rzNone))
+	{
+		if (!fPool) fPool = new CdRA_WritePool(this, 0);
+	} else if (fPool && (fNumThread <= 0))
+		ParallelEnd();
+}
+
+void CdRA_Write::EncodeBlock(const C_UInt8 *Raw, ssize_t Len,
+	vector<C_UInt8> &Out)
+{
+	if (fFilter != rfNone)
+	{
+		vector<C_UInt8> Buf(Len);
+		if (Len > 0) FilterData(&Buf[0], Raw, Len);
+		CompressBlock(Len > 0 ? &Buf[0] : Raw, Len, Out);
+	} else
+		CompressBlock(Raw, Len, Out);
+}
+
+void CdRA_Write::ParallelWrite(const void *Buffer, ssize_t Count)
+{
+	const C_UInt8 *p = (const C_UInt8*)Buffer;
+	while (Count > 0)
+	{
+		if (!fPool->Filling)
+		{
+			if (fPool->Full()) ParallelRetire();
+			// the raw size is estimated from the blocks written, so the
+			// compressed size is close to the block size
+			CdRA_WritePool::TItem &I = fPool->Current();
+			SIZE64 n = fParBlockSize;
+			if (fParCmpTotal > 0)
+				n = (SIZE64)((double)fParBlockSize * fParRawTotal / fParCmpTotal);
+			if (n < fParBlockSize) n = fParBlockSize;
+			if (n > RA_PARALLEL_MAX_RAW_SIZE) n = RA_PARALLEL_MAX_RAW_SIZE;
+			// whole groups of 8 elements in a filtered block, and whole
+			// elements in the zone map
+			ssize_t unit = (fFilter != rfNone) ? 8 * fFilterSize : 1;
+			if ((fZoneMap != rzNone) && (unit % fZoneSize != 0))
+				unit *= fZoneSize;
+			n -= n % unit;
+			if (I.RawSize < n)
+			{
+				C_UInt8 *tmp = (C_UInt8*)realloc((void*)I.Raw, n);
+				COREARRAY_ALLOCCHECK(tmp);
+				I.Raw = tmp; I.RawSize = n;
+			}
+			I.Target = n;
+			I.RawLen = 0;
+			fPool->Filling = true;
+		}
+
+		CdRA_WritePool::TItem &I = fPool->Current();
+		ssize_t L = I.Target - I.RawLen;
+		if (L > Count) L = Count;
+		memcpy(I.Raw + I.RawLen, p, L);
+		I.RawLen += L;
+		p += L; Count -= L;
+		fOwner.fTotalIn += L;
+		if (I.RawLen >= I.Target) fPool->Submit();
+	}
+}
+
+void CdRA_Write::ParallelRetire()
+{
+	CdRA_WritePool::TItem &I = fPool->Pop();
+	if (I.Failed)
+		throw ErrRecodeStream(I.ErrMsg);
+
+	ssize_t n = I.Cmp.size();
+	fOwner.UpdateStreamPosition();
+	fOwner.fStream->WriteData(&I.Cmp[0], n);
+	fOwner.fStreamPos += n;
+	fOwner.fTotalOut = fOwner.fStreamPos - fOwner.fStreamBase;
+	AddBlockInfo(n, I.RawLen);
+	if (fZoneMap != rzNone)
+	{
+		TZoneStat st;
+		ZoneStat(I.Raw, I.RawLen, st);
+		fZoneList.push_back(st);
+	}
+	fParRawTotal += I.RawLen;
+	fParCmpTotal += n;
+}
+
+void CdRA_Write::ParallelFlush()
+{
+	if (fPool)
+	{
+		if (fPool->Filling) fPool->Submit();
+		while (fPool->NumRetire < fPool->NumSubmit)
+			ParallelRetire();
+	}
+}
+
+void CdRA_Write::ParallelEnd()
+{
+	if (fPool)
+	{
+		delete fPool;
+		fPool = NULL;
+	}
+}
+
+
+// =====================================================================
+// The classes of ZLIB stream
+
+static const char *ErrZDeflateInvalid =
+	"Invalid ZIP deflate stream operation '%s'!";
+static const char *ErrZInflateInvalid =
+	"Invalid ZIP inflate stream operation '%s'!";
+static const char *ErrZDeflateClosed =
+	"ZIP deflate stream has been closed.";
+
+static short ZLevels[4] =
+{
+	Z_BEST_SPEED,           // clMin
+	3,                      // clFast
+	Z_DEFAULT_COMPRESSION,  // clDefault
+	Z_BEST_COMPRESSION      // clMax
+};
+
+COREARRAY_INLINE static int ZCheck(int Code)
+{
+	if ((Code < 0) && (Code != Z_BUF_ERROR))
+		throw EZLibError(Code);
+	return Code;
+}
+
+
+// CdBaseZStream
+
+CdBaseZStream::CdBaseZStream(CdStream &vStream): CdRecodeStream(vStream)
+{
+	memset((void*)&fZStream, 0, sizeof(z_stream));
+}
+
+// CdZEncoder
+
+CdZEncoder::CdZEncoder(CdStream &Dest, TLevel Level):
+	CdBaseZStream(Dest), CdRecodeLevel(Level)
+{
+	PtrExtRec = NULL;
+	fZStream.next_out = fBuffer;
+	fZStream.avail_out = sizeof(fBuffer);
+	fHaveClosed = false;
+	ZCheck( deflateInit_(&fZStream, ZLevels[Level],
+		ZLIB_VERSION, sizeof(fZStream)) );
+}
+
+CdZEncoder::CdZEncoder(CdStream &Dest, TLevel Level, int windowBits,
+	int memLevel, int Strategy): CdBaseZStream(Dest), CdRecodeLevel(Level)
+{
+	PtrExtRec = NULL;
+	fZStream.next_out = fBuffer;
+	fZStream.avail_out = sizeof(fBuffer);
+	fHaveClosed = false;
+
+	#define Z_DEFLATED 8
+	ZCheck( deflateInit2_(&fZStream, ZLevels[Level],
+		Z_DEFLATED, windowBits, memLevel, Strategy,
+		ZLIB_VERSION, sizeof(fZStream)) );
+	#undef Z_DEFLATED
+}
+
+CdZEncoder::~CdZEncoder()
+{
+	Close();
+	deflateEnd(&fZStream);
+}
+
+ssize_t CdZEncoder::Read(void *Buffer, ssize_t Count)
+{
+	throw EZLibError(ErrZDeflateInvalid, "Read");
+}
+
+ssize_t CdZEncoder::Write(const void *Buffer, ssize_t Count)
+{
+	if (fHaveClosed)
+		throw EZLibError(ErrZDeflateClosed);
+
+	fZStream.next_in = (Bytef*)Buffer;
+	fZStream.avail_in = Count;
+	ssize_t L = fZStream.avail_in;
+
+	while (fZStream.avail_in > 0)
+	{
+		ZCheck(deflate(&fZStream, Z_NO_FLUSH));
+		fTotalIn += L - fZStream.avail_in;
+		L = fZStream.avail_in;
+		if (fZStream.avail_out <= 0)
+		{
+			UpdateStreamPosition();
+			fStream->WriteData(fBuffer, sizeof(fBuffer));
+			fStreamPos += sizeof(fBuffer);
+			fTotalOut += sizeof(fBuffer);
+			fZStream.next_out = fBuffer;
+			fZStream.avail_out = sizeof(fBuffer);
+		}
+	}
+
+	return Count;
+}
+
+SIZE64 CdZEncoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
+{
+	switch (Origin)
+	{
+		case soBeginning:
+			if (Offset == fTotalIn) return fTotalIn;
+			break;
+		case soCurrent:
+			if (Offset == 0) return fTotalIn;
+			break;
+		case soEnd:
+			if (Offset == 0) return fTotalIn;
+			break;
+	}
+	throw EZLibError(ErrZDeflateInvalid, "Seek");
+}
+
+void CdZEncoder::SetSize(SIZE64 NewSize)
+{
+	if (NewSize != fTotalIn)
+		throw EZLibError(ErrZDeflateInvalid, "SetSize");
+}
+
+void CdZEncoder::Close()
+{
+	if (!fHaveClosed)
+	{
+		if (PtrExtRec)
+		{
+			if (PtrExtRec->Size > 0)
+				WriteData((void*)PtrExtRec->Buf, PtrExtRec->Size);
+			PtrExtRec = NULL;
+		}
+		SyncFinish();
+		fHaveClosed = true;
+	}
+}
+
+ssize_t CdZEncoder::Pending()
+{
+	return sizeof(fBuffer) - fZStream.avail_out;
+}
+
+void CdZEncoder::SyncFinish()
+{
+	fZStream.next_in = NULL;
+	fZStream.avail_in = 0;
+	UpdateStreamPosition();
+
+	while (ZCheck(deflate(&fZStream, Z_FINISH)) != Z_STREAM_END)
+	{
+		ssize_t L = sizeof(fBuffer) - fZStream.avail_out;
+		fStream->WriteData(fBuffer, L);
+		fStreamPos += L;
+		fZStream.next_out = fBuffer;
+		fZStream.avail_out = sizeof(fBuffer);
+	}
+
+	if (fZStream.avail_out < sizeof(fBuffer))
+	{
+		ssize_t L = sizeof(fBuffer) - fZStream.avail_out;
+		fStream->WriteData(fBuffer, L);
+		fStreamPos += L;
+	}
+
+	fTotalOut = fStreamPos - fStreamBase;
+}
+
+
+// CdZDecoder
+
+CdZDecoder::CdZDecoder(CdStream &Source):
+	CdBaseZStream(Source)
+{
+	fZStream.next_in = fBuffer;
+	fZStream.avail_in = 0;
+	fCurPosition = 0;
+	ZCheck(inflateInit_(&fZStream, ZLIB_VERSION, sizeof(fZStream)));
+}
+
+CdZDecoder::CdZDecoder(CdStream &Source, int windowBits):
+	CdBaseZStream(Source)
+{
+	fZStream.next_in = fBuffer;
+	fZStream.avail_in = 0;
+	fCurPosition = 0;
+	ZCheck(inflateInit2_(&fZStream, windowBits, ZLIB_VERSION, sizeof(fZStream)));
+}
+
+CdZDecoder::~CdZDecoder()
+{
+	inflateEnd(&fZStream);
+}
+
+ssize_t CdZDecoder::Read(void *Buffer, ssize_t Count)
+{
+	fZStream.next_out = (Bytef*)Buffer;
+	const ssize_t OriCount = Count;
+	int ZResult = Z_OK;
+
+	while ((Count>0) && (ZResult!=Z_STREAM_END))
+	{
+		if (fZStream.avail_in <= 0)
+		{
+			UpdateStreamPosition();
+			fZStream.avail_in = fStream->Read(fBuffer, sizeof(fBuffer));
+			fStreamPos += fZStream.avail_in;
+			if (fZStream.avail_in <= 0)
+				return OriCount - Count;
+			fZStream.next_in = fBuffer;
+		}
+
+		fZStream.avail_out = Count;
+		ZResult = ZCheck(inflate(&fZStream, Z_NO_FLUSH));
+
+		ssize_t L = Count - fZStream.avail_out;
+		fCurPosition += L;
+		Count -= L;
+	}
+
+	if ((ZResult==Z_STREAM_END) && (fZStream.avail_in>0))
+	{
+		fStreamPos -= fZStream.avail_in;
+		fStream->SetPosition(fStreamPos);
+		fZStream.avail_in = 0;
+	}
+
+	SIZE64 tmp = fStreamPos - fStreamBase;
+	if (tmp > fTotalIn) fTotalIn = tmp;
+	if (fCurPosition > fTotalOut) fTotalOut = fCurPosition;
+
+	return OriCount - Count;
+}
+
+ssize_t CdZDecoder::Write(const void *Buffer, ssize_t Count)
+{
+	throw EZLibError(ErrZInflateInvalid, "Write");
+}
+
+SIZE64 CdZDecoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
+{
+	if ((Offset==0) && (Origin==soBeginning))
+	{
+		if (fCurPosition == 0) return 0;
+		ZCheck(inflateReset(&fZStream));
+		fZStream.next_in = fBuffer;
+		fZStream.avail_in = 0;
+		fStream->SetPosition(fStreamPos = fStreamBase);
+		return (fCurPosition = 0);
+	} else if (Origin != soEnd)
+	{
+		if ((Offset==0) && (Origin==soCurrent))
+			return fCurPosition;
+
+		if (Origin == soCurrent) Offset += fCurPosition;
+		if (Offset < fCurPosition)
+			Seek(0, soBeginning);
+		else
+			Offset -= fCurPosition;
+
+		C_UInt8 buffer[4096];
+		SIZE64 DivI = Offset / sizeof(buffer);
+		for (; DivI > 0; DivI--)
+			ReadData(buffer, sizeof(buffer));
+		ReadData(buffer, Offset % sizeof(buffer));
+	} else
+		throw EZLibError(ErrZInflateInvalid, "Seek");
+
+	return fCurPosition;
+}
+
+SIZE64 CdZDecoder::GetSize()
+{
+	return -1;
+}
+
+void CdZDecoder::SetSize(SIZE64 NewSize)
+{
+	throw EZLibError(ErrZInflateInvalid, "SetSize");
+}
+
+
+// =====================================================================
+// Input stream for zlib with the support of random access
+// =====================================================================
+
+#define ZRA_MAGIC_HEADER_SIZE     4
+static const C_UInt8 ZRA_MAGIC_HEADER[ZRA_MAGIC_HEADER_SIZE] =
+	{ 'Z', 'R', 'A', 0x10 };
+
+// windowBits<0, indicating generating raw deflate data without zlib header
+//               or trailer
+#define ZRA_WINDOW_BITS_16K    -11
+#define ZRA_WINDOW_BITS_32K    -12
+#define ZRA_WINDOW_BITS_64K    -13
+#define ZRA_WINDOW_BITS_128K   -14
+#define ZRA_WINDOW_BITS        -15
+
+// See: http://www.zlib.net/ChangeLog.txt
+#ifdef ZLIB_VERNUM
+#   if (ZLIB_VERNUM > 0x1250)
+#       define ZLIB_DEFLATE_PENDING    deflatePending
+#   else
+#       define ZLIB_DEFLATE_PENDING(z, p, b)    0
+#   endif
+#else
+#   define ZLIB_DEFLATE_PENDING(z, p, b)    0
+#endif
+
+
+#define ZRA_WINDOW_BITS_BK(BK)    ( \
+	 BK==CdRAAlgorithm::ra16KB  ? ZRA_WINDOW_BITS_16K : \
+	(BK==CdRAAlgorithm::ra32KB  ? ZRA_WINDOW_BITS_32K : \
+	(BK==CdRAAlgorithm::ra64KB  ? ZRA_WINDOW_BITS_64K : \
+	(BK==CdRAAlgorithm::ra128KB ? ZRA_WINDOW_BITS_128K : ZRA_WINDOW_BITS))) )
+
+CdZEncoder_RA::CdZEncoder_RA(CdStream &Dest, TLevel Level,
+	TBlockSize BK): CdRA_Write(this, BK),
+	CdZEncoder(Dest, Level, ZRA_WINDOW_BITS_BK(BK))
+{
+	fBlockZIPSize = fCurBlockZIPSize = RA_BLOCK_SIZE_LIST[BK];
+	fWindowBits = ZRA_WINDOW_BITS_BK(BK);
+	InitWriteStream();
+}
+
+CdZEncoder_RA::~CdZEncoder_RA()
+{
+	// the helper threads call CompressBlock()
+	ParallelEnd();
+}
+
+ssize_t CdZEncoder_RA::Write(const void *Buffer, ssize_t Count)
+{
+	if (fHaveClosed)
+		throw EZLibError(ErrZDeflateClosed);
+	if (Count <= 0) return 0;
+	if (fPool)
+	{
+		ParallelWrite(Buffer, Count);
+		return Count;
+	}
+
+	ssize_t OldCount = Count;
+	C_UInt8 *pBuf = (C_UInt8*)Buffer;
+
+	while (Count > 0)
+	{
+		InitWriteBlock();
+
+		fZStream.next_in = (Bytef*)pBuf;
+		fZStream.avail_in = Count;
+
+		while (fZStream.avail_in > 0)
+		{
+			ZCheck(deflate(&fZStream, Z_NO_FLUSH));
+			ssize_t L = Count - fZStream.avail_in;
+			fTotalIn += L; pBuf += L;
+			Count = fZStream.avail_in;
+
+			// whether it is the end of specified block
+			if (fZStream.avail_out <= 0)
+			{
+				UpdateStreamPosition();
+				fStream->WriteData(fBuffer, sizeof(fBuffer));
+				fStreamPos += sizeof(fBuffer);
+				fZStream.next_out = fBuffer;
+				fZStream.avail_out = sizeof(fBuffer);
+				fCurBlockZIPSize -= sizeof(fBuffer);
+
+				unsigned pending = 0;
+				int bits = 0;
+				ZCheck(ZLIB_DEFLATE_PENDING(&fZStream, &pending, &bits));
+				if (bits > 0) pending ++;
+
+				if ((fCurBlockZIPSize - (int)pending <= 0) ||
+					(fTotalIn - fCB_UZStart >= 0xF8000000))
+				{
+					// finish this block
+					// 'fZStream.avail_in = 0' in SyncFinishBlock()
+					SyncFinishBlock();
+				}
+			}
+		}
+	}
+
+	fTotalOut = fStreamPos - fStreamBase;
+	return OldCount - Count;
+}
+
+void CdZEncoder_RA::Close()
+{
+	if (!fHaveClosed)
+	{
+		if (PtrExtRec)
+		{
+			if (PtrExtRec->Size > 0)
+				WriteData((void*)PtrExtRec->Buf, PtrExtRec->Size);
+			PtrExtRec = NULL;
+		}
+		SyncFinishBlock();
+		DoneWriteStream();
+		fHaveClosed = true;
+	}
+}
+
+void CdZEncoder_RA::WriteMagicNumber(CdStream &Stream)
+{
+	Stream.WriteData(ZRA_MAGIC_HEADER, ZRA_MAGIC_HEADER_SIZE);
+}
+
+void CdZEncoder_RA::SyncFinishBlock()
+{
+	if (fPool)
+	{
+		ParallelFlush();
+	} else if (fHasInitWriteBlock)
+	{
+		SyncFinish();
+		DoneWriteBlock();
+		fCurBlockZIPSize = fBlockZIPSize;
+		fZStream.next_out = fBuffer;
+		fZStream.avail_out = sizeof(fBuffer);
+		ZCheck(deflateReset(&fZStream));
+	}
+}
+
+void CdZEncoder_RA::CompressBlock(const C_UInt8 *Raw, ssize_t Len,
+	vector<C_UInt8> &Out)
+{
+	// a raw deflate stream with the same parameters as fZStream
+	z_stream z;
+	memset((void*)&z, 0, sizeof(z));
+	#define Z_DEFLATED 8
+	ZCheck( deflateInit2_(&z, ZLevels[fLevel], Z_DEFLATED, fWindowBits,
+		Z_DEFAULT_MEMORY, Z_DEFAULT_STRATEGY, ZLIB_VERSION, sizeof(z)) );
+	#undef Z_DEFLATED
+
+	Out.resize(deflateBound(&z, Len));
+	z.next_in = (Bytef*)Raw;
+	z.avail_in = Len;
+	z.next_out = &Out[0];
+	z.avail_out = Out.size();
+	int rv = deflate(&z, Z_FINISH);
+	Out.resize(z.total_out);
+	deflateEnd(&z);
+	if (rv != Z_STREAM_END)
+		throw EZLibError((rv < 0) ? rv : Z_BUF_ERROR);
+}
+
+void CdZEncoder_RA::CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count)
+{
+	if (dynamic_cast<CdZDecoder_RA*>(&Source))
+	{
+		CdZDecoder_RA *Src = static_cast<CdZDecoder_RA*>(&Source);
+		if ((Src->SizeType() == SizeType()) && (Src->fVersion == fVersion) &&
+			SameBlockFormat(*Src))
+		{
+			Src->SetPosition(Pos);
+			if (Count < 0)
+				Count = Src->GetSize() - Pos;
+
+			C_UInt8 Buffer[COREARRAY_STREAM_BUFFER];
+			const ssize_t SIZE = sizeof(Buffer);
+
+			// header
+			if (Pos > Src->fCB_UZStart)
+			{
+				SIZE64 L = Src->fCB_UZStart + Src->fCB_UZSize - Pos;
+				if (L > Count) L = Count;
+				for (; L > 0; )
+				{
+					ssize_t N = (L <= SIZE) ? L : SIZE;
+					Src->ReadData(Buffer, N);
+					WriteData((void*)Buffer, N);
+					Count -= N; Pos += N;
+					L -= N;
+				}
+			}
+
+			// body
+			if (Count > 0)
+			{
+				Src->SeekStream(Pos);
+				if ((Src->fCB_UZStart + Src->fCB_UZSize) <= (Pos + Count))
+				{
+					SyncFinishBlock();
+					// determine start and size
+					SIZE64 Start = Src->fCB_ZStart;
+					SIZE64 ZSize = 0, USize = 0;
+					while ((Src->fCB_UZStart + Src->fCB_UZSize) <= (Pos + Count))
+					{
+						ZSize += Src->fCB_ZSize;
+						USize += Src->fCB_UZSize;
+						CopyBlockInfo(*Src);
+						Count -= Src->fCB_UZSize;
+						Pos += Src->fCB_UZSize;
+						Src->NextBlock();
+					}
+					Src->Reset();
+					// copying
+					fStream->CopyFrom(*Src->fStream, Start, ZSize);
+					fTotalIn += USize;
+					fStreamPos += ZSize;
+					fTotalOut = fStreamPos - fStreamBase;
+				}
+			}
+
+			// tail
+			if (Count > 0) Src->SetPosition(Pos);
+			for (; Count > 0; )
+			{
+				ssize_t N = (Count <= SIZE) ? Count : SIZE;
+				Src->ReadData(Buffer, N);
+				WriteData((void*)Buffer, N);
+				Count -= N;
+			}
+
+			return;
+		}
+	}
+
+	CdStream::CopyFrom(Source, Pos, Count);
+}
+
+
+// =====================================================================
+// Output stream for zlib with the support of random access
+// =====================================================================
+
+CdZDecoder_RA::CdZDecoder_RA(CdStream &Source):
+	CdRA_Read(this), CdZDecoder(Source, ZRA_WINDOW_BITS)
+{
+	InitReadStream();
+}
+
+CdZDecoder_RA::~CdZDecoder_RA()
+{
+	ParallelEnd();
+}
+
+ssize_t CdZDecoder_RA::Read(void *Buffer, ssize_t Count)
+{
+	if (Count <= 0) return 0;
+	if (fTracing) TraceRead(fCurPosition, Count);
+	if (!fPatch.empty()) return PatchRead(Buffer, Count, fCurPosition);
+	if (fPool) return ParallelRead(Buffer, Count, fCurPosition);
+	if (fCacheData)
+	{
+		ssize_t L = CacheRead(Buffer, Count, fCurPosition);
+		if (L >= Count) return L;
+		return L + Read((C_UInt8*)Buffer + L, Count - L);
+	}
+	if (fBlockIdx >= fBlockNum) return 0;
+
+	C_UInt8 *pBuf = (C_UInt8*)Buffer;
+	ssize_t OldCount = Count;
+
+	while (Count > 0)
+	{
+		fZStream.next_out = (Bytef*)pBuf;
+		int ZResult = Z_OK;
+
+		while ((Count>0) && (ZResult!=Z_STREAM_END))
+		{
+			if (fZStream.avail_in <= 0)
+			{
+				ssize_t s = fCB_ZStart + fCB_ZSize - fStreamPos;
+				if (s > (ssize_t)sizeof(fBuffer))
+					s = sizeof(fBuffer);
+				if (s > 0)
+				{
+					fStream->SetPosition(fStreamPos);
+					fZStream.avail_in = fStream->Read(fBuffer, s);
+					if (fZStream.avail_in <= 0)
+						return OldCount - Count;
+
+					fStreamPos += fZStream.avail_in;
+					fZStream.next_in = fBuffer;
+				}
+			}
+
+			fZStream.avail_out = Count;
+			ZResult = ZCheck(inflate(&fZStream, Z_NO_FLUSH));
+
+			ssize_t L = Count - fZStream.avail_out;
+			fCurPosition += L;
+			Count -= L;
+			pBuf += L;
+		}
+
+		if (ZResult == Z_STREAM_END)
+		{
+			if ((fCurPosition-fCB_UZStart) != fCB_UZSize)
+				throw EZLibError("Invalid ZIP block, inconsistent length.");
+
+			// go to the next block
+			if (NextBlock())
+			{
+				fZStream.next_in = fBuffer;
+				fZStream.avail_in = 0;
+				ZCheck(inflateReset(&fZStream));
+			} else
+				break;
+		}
+	}
+
+	SIZE64 tmp = fStreamPos - fStreamBase;
+	if (tmp > fTotalIn) fTotalIn = tmp;
+	if (fCurPosition > fTotalOut) fTotalOut = fCurPosition;
+
+	return OldCount - Count;
+}
+
+SIZE64 CdZDecoder_RA::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
+{
+	if (Origin == soCurrent)
+	{
+		Offset += fCurPosition;
+		if (Offset < 0)
+			throw EZLibError(ErrZInflateInvalid, "Seek");
+	} else if (Origin == soEnd)
+		throw EZLibError(ErrZInflateInvalid, "Seek");
+
+	if (!fPatch.empty())
+		return (fCurPosition = Offset);
+	if (fPool)
+	{
+		ParallelSeek(Offset);
+		return (fCurPosition = Offset);
+	}
+
+	bool flag = SeekStream(Offset);
+	if (fCacheData && !flag)
+		return (fCurPosition = Offset);
+	if (flag || (Offset < fCurPosition))
+	{
+		// use the decompressed block in the shared cache
+		if (CacheSeek())
+			return (fCurPosition = Offset);
+		Reset();
+	}
+
+	Offset -= fCurPosition;
+	if (Offset > 0)
+	{
+		// skipping is not a reading in the access trace
+		bool tracing = fTracing;
+		fTracing = false;
+		C_UInt8 buffer[4096];
+		SIZE64 DivI = Offset / sizeof(buffer);
+		for (; DivI > 0; DivI--)
+			ReadData(buffer, sizeof(buffer));
+		ReadData(buffer, Offset % sizeof(buffer));
+		fTracing = tracing;
+	} else if (Offset < 0)
+		throw EZLibError(ErrZInflateInvalid, "Seek");
+
+	return fCurPosition;
+}
+
+ssize_t CdZDecoder_RA::Write(const void *Buffer, ssize_t Count)
+{
+	return PatchWrite(Buffer, Count, fCurPosition);
+}
+
+bool CdZDecoder_RA::ReadMagicNumber(CdStream &Stream)
+{
+	C_UInt8 Header[ZRA_MAGIC_HEADER_SIZE];
+	Stream.SetPosition(fStreamBase);
+	Stream.ReadData(Header, sizeof(Header));
+	return (memcmp(Header, ZRA_MAGIC_HEADER, ZRA_MAGIC_HEADER_SIZE) == 0);
 }
 
-void CdRA_Write::DoneWriteBlock()
+void CdZDecoder_RA::Reset()
 {
-	if (fHasInitWriteBlock)
-	{
-		C_UInt32 SC = fOwner.fStreamPos - fCB_ZStart;
-		C_UInt32 SU = fOwner.fTotalIn - fCB_UZStart;
-
-		if (fVersion == 0x10)
-		{
-			// store indexing info together with the compression block
-			C_UInt8 SZ[SIZE_RA_BLOCK_HEADER] =
-			{
-				C_UInt8(SC & 0xFF),
-				C_UInt8((SC >> 8) & 0xFF),
-				C_UInt8((SC >> 16) & 0xFF),
-				C_UInt8(SU & 0xFF),
-				C_UInt8((SU >> 8) & 0xFF),
-				C_UInt8((SU >> 16) & 0xFF),
-				C_UInt8((SU >> 24) & 0xFF)
-			};
-			fOwner.fStream->SetPosition(fCB_ZStart);
-			fOwner.fStream->WriteData(SZ, SIZE_RA_BLOCK_HEADER);
-			fOwner.fStream->SetPosition(fOwner.fStreamPos);
-			fBlockNum ++;
-		} else if (fVersion == 0x11)
-		{
-			// add indexing info to fBlockInfoList
-			AddBlockInfo(SC, SU);
-		}
+	CacheEnd();
+	fZStream.next_in = fBuffer;
+	fZStream.avail_in = 0;
+	ZCheck(inflateReset(&fZStream));
+	fStreamPos = fCB_ZStart;
+	if (fVersion == 0x10)
+		fStreamPos += SIZE_RA_BLOCK_HEADER;
+	fCurPosition = fCB_UZStart;
+}
 
-		fHasInitWriteBlock = false;
-	}
+void CdZDecoder_RA::DecompressBlock(const C_UInt8 *Cmp, ssize_t CmpLen,
+	C_UInt8 *Raw, ssize_t RawLen)
+{
+	z_stream z;
+	memset((void*)&z, 0, sizeof(z));
+	ZCheck(inflateInit2_(&z, ZRA_WINDOW_BITS, ZLIB_VERSION, sizeof(z)));
+	z.next_in = (Bytef*)Cmp;
+	z.avail_in = CmpLen;
+	z.next_out = (Bytef*)Raw;
+	z.avail_out = RawLen;
+	int rv = inflate(&z, Z_FINISH);
+	ssize_t L = z.total_out;
+	inflateEnd(&z);
+	if (rv < 0)
+		throw EZLibError(rv);
+	if ((rv != Z_STREAM_END) || (L != RawLen))
+		throw EZLibError("Invalid ZIP block, inconsistent length.");
 }
 
-void CdRA_Write::AddBlockInfo(C_UInt32 CmpLen, C_UInt32 RawLen)
+// EZLibError
+
+EZLibError::EZLibError(int Code): ErrRecodeStream()
 {
-	if (fVersion == 0x11)
-		fBlockInfoList.push_back(CmpLen | (C_UInt64(RawLen) << 32));
-	fBlockNum ++;
+	fErrCode = Code;
+	fMessage = zError(Code);
 }
 
 
+
+// =====================================================================
+// The classes of LZ4 stream
 // =====================================================================
-// The classes of ZLIB stream
 
-static const char *ErrZDeflateInvalid =
-	"Invalid ZIP deflate stream operation '%s'!";
-static const char *ErrZInflateInvalid =
-	"Invalid ZIP inflate stream operation '%s'!";
-static const char *ErrZDeflateClosed =
-	"ZIP deflate stream has been closed.";
+#ifndef COREARRAY_NO_LZ4
 
-static short ZLevels[4] =
-{
-	Z_BEST_SPEED,           // clMin
-	3,                      // clFast
-	Z_DEFAULT_COMPRESSION,  // clDefault
-	Z_BEST_COMPRESSION      // clMax
-};
+//   64KB,    256KB,         1MB,         4MB
+static const ssize_t LZ4ChunkSize[4] =
+	{ 64*1024, 256*1024, 1*1024*1024, 4*1024*1024 };
+static const int LZ4DeflateLevel[4] =
+	{ 0, LZ4HC_CLEVEL_MIN, LZ4HC_CLEVEL_DEFAULT, LZ4HC_CLEVEL_MAX };
+static const LZ4F_blockSizeID_t LZ4FrameInfoBlockSize[4] =
+	{ LZ4F_max64KB, LZ4F_max256KB, LZ4F_max1MB, LZ4F_max4MB };
 
-COREARRAY_INLINE static int ZCheck(int Code)
-{
-	if ((Code < 0) && (Code != Z_BUF_ERROR))
-		throw EZLibError(Code);
-	return Code;
-}
+static const char *ErrLZ4DeflateInvalid =
+	"Invalid LZ4 Deflate Stream operation '%s'!";
+static const char *ErrLZ4InflateInvalid =
+	"Invalid LZ4 Inflate Stream operation '%s'!";
+static const char *ErrLZ4DeflateClosed =
+	"LZ4 deflate stream has been closed.";
 
+CdBaseLZ4Stream::CdBaseLZ4Stream(CdStream &vStream):
+	CdRecodeStream(vStream)
+{ }
 
-// CdBaseZStream
 
-CdBaseZStream::CdBaseZStream(CdStream &vStream): CdRecodeStream(vStream)
+// Compression of LZ4 algorithm
+
+CdLZ4Encoder::CdLZ4Encoder(CdStream &Dest, CdRecodeStream::TLevel level,
+	TLZ4Chunk chunk): CdBaseLZ4Stream(Dest), CdRecodeLevel(level)
 {
-	memset((void*)&fZStream, 0, sizeof(z_stream));
-}
+	if ((chunk < bsFirst) || (chunk > bsLast))
+		throw ELZ4Error("CdLZ4Encoder::CdLZ4Encoder, invalid chunk.");
+	fChunk = chunk;
 
-// CdZEncoder
+	memset((void*)&lz4_pref, 0, sizeof(lz4_pref));
+	lz4_pref.compressionLevel = LZ4DeflateLevel[level];
+	lz4_pref.frameInfo.blockSizeID = LZ4FrameInfoBlockSize[chunk];
+	lz4_pref.frameInfo.blockMode = LZ4F_blockLinked;
+	lz4_pref.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
 
-CdZEncoder::CdZEncoder(CdStream &Dest, TLevel Level):
-	CdBaseZStream(Dest), CdRecodeLevel(Level)
-{
-	PtrExtRec = NULL;
-	fZStream.next_out = fBuffer;
-	fZStream.avail_out = sizeof(fBuffer);
-	fHaveClosed = false;
-	ZCheck( deflateInit_(&fZStream, ZLevels[Level],
-		ZLIB_VERSION, sizeof(fZStream)) );
-}
+	lz4_context = NULL;
+	LZ4F_errorCode_t err = LZ4F_createCompressionContext(&lz4_context, LZ4F_VERSION);
+	if (LZ4F_isError(err)) throw ELZ4Error(err);
 
-CdZEncoder::CdZEncoder(CdStream &Dest, TLevel Level, int windowBits,
-	int memLevel, int Strategy): CdBaseZStream(Dest), CdRecodeLevel(Level)
-{
-	PtrExtRec = NULL;
-	fZStream.next_out = fBuffer;
-	fZStream.avail_out = sizeof(fBuffer);
+	fChunkSize = LZ4ChunkSize[chunk];
+	fRawChunkSize = LZ4F_compressBound(fChunkSize, &lz4_pref);
+	fCompress = new C_UInt8[fRawChunkSize];
+	fChunkUsed = 0;
 	fHaveClosed = false;
 
-	#define Z_DEFLATED 8
-	ZCheck( deflateInit2_(&fZStream, ZLevels[Level],
-		Z_DEFLATED, windowBits, memLevel, Strategy,
-		ZLIB_VERSION, sizeof(fZStream)) );
-	#undef Z_DEFLATED
+	size_t s = LZ4F_compressBegin(lz4_context, fCompress, fRawChunkSize, &lz4_pref);
+	if (LZ4F_isError(s))
+	{
+		LZ4F_freeCompressionContext(lz4_context);
+		lz4_context = NULL;
+		throw ELZ4Error((LZ4F_errorCode_t)s);
+	}
+
+	// write the header
+	fStream->SetPosition(fStreamBase);
+	fStream->WriteData(fCompress, s);
+	fStreamPos = fStreamBase + (int)s;
+	fTotalOut = (fStreamPos - fStreamBase);
 }
 
-CdZEncoder::~CdZEncoder()
+CdLZ4Encoder::~CdLZ4Encoder()
 {
 	Close();
-	deflateEnd(&fZStream);
+	if (fCompress)
+	{
+		delete[] fCompress;
+		fCompress = NULL;
+	}
+	if (lz4_context)
+	{
+		// LZ4F_errorCode_t err = 
+		LZ4F_freeCompressionContext(lz4_context);
+		lz4_context = NULL;
+		// if (LZ4F_isError(err)) throw ELZ4Error(err);
+	}
 }
 
-ssize_t CdZEncoder::Read(void *Buffer, ssize_t Count)
+ssize_t CdLZ4Encoder::Read(void *Buffer, ssize_t Count)
 {
-	throw EZLibError(ErrZDeflateInvalid, "Read");
+	throw ELZ4Error(ErrLZ4DeflateInvalid, "Read");
 }
 
-ssize_t CdZEncoder::Write(const void *Buffer, ssize_t Count)
+ssize_t CdLZ4Encoder::Write(const void *Buffer, ssize_t Count)
 {
 	if (fHaveClosed)
-		throw EZLibError(ErrZDeflateClosed);
-
-	fZStream.next_in = (Bytef*)Buffer;
-	fZStream.avail_in = Count;
-	ssize_t L = fZStream.avail_in;
+		throw ELZ4Error(ErrLZ4DeflateClosed);
 
-	while (fZStream.avail_in > 0)
+	ssize_t OldCount = Count;
+	C_UInt8 *p = (C_UInt8*)Buffer;
+	while (Count > 0)
 	{
-		ZCheck(deflate(&fZStream, Z_NO_FLUSH));
-		fTotalIn += L - fZStream.avail_in;
-		L = fZStream.avail_in;
-		if (fZStream.avail_out <= 0)
+		ssize_t size = fChunkSize - fChunkUsed;
+		if (Count < size) size = Count;
+		Count -= size; fTotalIn += size;
+		fChunkUsed += size;
+
+		size_t s = LZ4F_compressUpdate(lz4_context, fCompress, fRawChunkSize,
+			p, size, NULL);
+		if (LZ4F_isError(s))
+			throw ELZ4Error((LZ4F_errorCode_t)s);
+		if (s > 0)
 		{
-			UpdateStreamPosition();
-			fStream->WriteData(fBuffer, sizeof(fBuffer));
-			fStreamPos += sizeof(fBuffer);
-			fTotalOut += sizeof(fBuffer);
-			fZStream.next_out = fBuffer;
-			fZStream.avail_out = sizeof(fBuffer);
+			fStream->WriteData(fCompress, s);
+			fStreamPos += s;
+			fChunkUsed = 0;
 		}
+
+		p += size;
 	}
 
-	return Count;
+	fTotalOut = (fStreamPos - fStreamBase);
+	return OldCount;
 }
 
-SIZE64 CdZEncoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
+SIZE64 CdLZ4Encoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
 {
 	switch (Origin)
 	{
@@ -970,16 +3666,16 @@ SIZE64 CdZEncoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
 			if (Offset == 0) return fTotalIn;
 			break;
 	}
-	throw EZLibError(ErrZDeflateInvalid, "Seek");
+	throw ELZ4Error(ErrLZ4DeflateInvalid, "Seek");
 }
 
-void CdZEncoder::SetSize(SIZE64 NewSize)
+void CdLZ4Encoder::SetSize(SIZE64 NewSize)
 {
 	if (NewSize != fTotalIn)
-		throw EZLibError(ErrZDeflateInvalid, "SetSize");
+		throw ELZ4Error(ErrLZ4DeflateInvalid, "SetSize");
 }
 
-void CdZEncoder::Close()
+void CdLZ4Encoder::Close()
 {
 	if (!fHaveClosed)
 	{
@@ -989,120 +3685,96 @@ void CdZEncoder::Close()
 				WriteData((void*)PtrExtRec->Buf, PtrExtRec->Size);
 			PtrExtRec = NULL;
 		}
-		SyncFinish();
-		fHaveClosed = true;
-	}
-}
 
-ssize_t CdZEncoder::Pending()
-{
-	return sizeof(fBuffer) - fZStream.avail_out;
-}
-
-void CdZEncoder::SyncFinish()
-{
-	fZStream.next_in = NULL;
-	fZStream.avail_in = 0;
-	UpdateStreamPosition();
-
-	while (ZCheck(deflate(&fZStream, Z_FINISH)) != Z_STREAM_END)
-	{
-		ssize_t L = sizeof(fBuffer) - fZStream.avail_out;
-		fStream->WriteData(fBuffer, L);
-		fStreamPos += L;
-		fZStream.next_out = fBuffer;
-		fZStream.avail_out = sizeof(fBuffer);
-	}
-
-	if (fZStream.avail_out < sizeof(fBuffer))
-	{
-		ssize_t L = sizeof(fBuffer) - fZStream.avail_out;
-		fStream->WriteData(fBuffer, L);
-		fStreamPos += L;
-	}
+		size_t s = LZ4F_compressEnd(lz4_context, fCompress, fRawChunkSize, NULL);
+		if (LZ4F_isError(s))
+			throw ELZ4Error((LZ4F_errorCode_t)s);
+		fStream->WriteData(fCompress, s);
+		fStreamPos += s;
+		fTotalOut = (fStreamPos - fStreamBase);
 
-	fTotalOut = fStreamPos - fStreamBase;
+		fHaveClosed = true;
+	}
 }
 
 
-// CdZDecoder
+// Decompression of LZ4 algorithm
 
-CdZDecoder::CdZDecoder(CdStream &Source):
-	CdBaseZStream(Source)
+CdLZ4Decoder::CdLZ4Decoder(CdStream &Source): CdBaseLZ4Stream(Source)
 {
-	fZStream.next_in = fBuffer;
-	fZStream.avail_in = 0;
+	lz4_context = NULL;
+	LZ4F_errorCode_t err =
+		LZ4F_createDecompressionContext(&lz4_context, LZ4F_VERSION);
+	if (LZ4F_isError(err)) throw ELZ4Error(err);
 	fCurPosition = 0;
-	ZCheck(inflateInit_(&fZStream, ZLIB_VERSION, sizeof(fZStream)));
+	fBufPtr = fBufEnd = fBuffer;
 }
 
-CdZDecoder::CdZDecoder(CdStream &Source, int windowBits):
-	CdBaseZStream(Source)
-{
-	fZStream.next_in = fBuffer;
-	fZStream.avail_in = 0;
-	fCurPosition = 0;
-	ZCheck(inflateInit2_(&fZStream, windowBits, ZLIB_VERSION, sizeof(fZStream)));
-}
 
-CdZDecoder::~CdZDecoder()
+CdLZ4Decoder::~CdLZ4Decoder()
 {
-	inflateEnd(&fZStream);
+	if (lz4_context)
+	{
+		// LZ4F_errorCode_t err =
+		LZ4F_freeDecompressionContext(lz4_context);
+		lz4_context = NULL;
+		// if (LZ4F_isError(err)) throw ELZ4Error(err);
+	}
 }
 
-ssize_t CdZDecoder::Read(void *Buffer, ssize_t Count)
+ssize_t CdLZ4Decoder::Read(void *Buffer, ssize_t Count)
 {
-	fZStream.next_out = (Bytef*)Buffer;
-	const ssize_t OriCount = Count;
-	int ZResult = Z_OK;
-
-	while ((Count>0) && (ZResult!=Z_STREAM_END))
+	ssize_t OldCount = Count;
+	C_UInt8 *p = (C_UInt8*)Buffer;
+	while (Count > 0)
 	{
-		if (fZStream.avail_in <= 0)
+		if (fBufPtr >= fBufEnd)
 		{
 			UpdateStreamPosition();
-			fZStream.avail_in = fStream->Read(fBuffer, sizeof(fBuffer));
-			fStreamPos += fZStream.avail_in;
-			if (fZStream.avail_in <= 0)
-				return OriCount - Count;
-			fZStream.next_in = fBuffer;
+			ssize_t Cnt = fStream->Read(fBuffer, sizeof(fBuffer));
+			fStreamPos += Cnt;
+			fBufPtr = fBuffer;
+			fBufEnd = fBufPtr + Cnt;
+			if (Cnt <= 0) break;
 		}
 
-		fZStream.avail_out = Count;
-		ZResult = ZCheck(inflate(&fZStream, Z_NO_FLUSH));
-
-		ssize_t L = Count - fZStream.avail_out;
-		fCurPosition += L;
-		Count -= L;
-	}
+		size_t DstCnt = Count;
+		size_t ScrCnt = fBufEnd - fBufPtr;
+		size_t s = LZ4F_decompress(lz4_context, p, &DstCnt,
+			fBufPtr, &ScrCnt, NULL);
+		if (LZ4F_isError(s))
+			break;
 
-	if ((ZResult==Z_STREAM_END) && (fZStream.avail_in>0))
-	{
-		fStreamPos -= fZStream.avail_in;
-		fStream->SetPosition(fStreamPos);
-		fZStream.avail_in = 0;
+		fBufPtr += ScrCnt;
+		fCurPosition += DstCnt;
+		p += DstCnt;
+		Count -= DstCnt;
 	}
 
 	SIZE64 tmp = fStreamPos - fStreamBase;
 	if (tmp > fTotalIn) fTotalIn = tmp;
 	if (fCurPosition > fTotalOut) fTotalOut = fCurPosition;
 
-	return OriCount - Count;
+	return (OldCount - Count);
 }
 
-ssize_t CdZDecoder::Write(const void *Buffer, ssize_t Count)
+ssize_t CdLZ4Decoder::Write(const void *Buffer, ssize_t Count)
 {
-	throw EZLibError(ErrZInflateInvalid, "Write");
+	throw ELZ4Error(ErrLZ4InflateInvalid, "Write");
 }
 
-SIZE64 CdZDecoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
+SIZE64 CdLZ4Decoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
 {
 	if ((Offset==0) && (Origin==soBeginning))
 	{
 		if (fCurPosition == 0) return 0;
-		ZCheck(inflateReset(&fZStream));
-		fZStream.next_in = fBuffer;
-		fZStream.avail_in = 0;
+		LZ4F_freeDecompressionContext(lz4_context);
+		lz4_context = NULL;
+		LZ4F_errorCode_t err =
+			LZ4F_createDecompressionContext(&lz4_context, LZ4F_VERSION);
+		if (LZ4F_isError(err))
+			throw ELZ4Error(err);
+		fBufPtr = fBufEnd = fBuffer;
 		fStream->SetPosition(fStreamPos = fStreamBase);
 		return (fCurPosition = 0);
 	} else if (Origin != soEnd)
@@ -1122,116 +3794,152 @@ SIZE64 CdZDecoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
 			ReadData(buffer, sizeof(buffer));
 		ReadData(buffer, Offset % sizeof(buffer));
 	} else
-		throw EZLibError(ErrZInflateInvalid, "Seek");
+		throw ELZ4Error(ErrLZ4InflateInvalid, "Seek");
 
 	return fCurPosition;
 }
 
-SIZE64 CdZDecoder::GetSize()
+SIZE64 CdLZ4Decoder::GetSize()
 {
 	return -1;
 }
 
-void CdZDecoder::SetSize(SIZE64 NewSize)
+void CdLZ4Decoder::SetSize(SIZE64 NewSize)
 {
-	throw EZLibError(ErrZInflateInvalid, "SetSize");
+	throw ELZ4Error(ErrLZ4InflateInvalid, "SetSize");
 }
 
 
-// =====================================================================
-// Input stream for zlib with the support of random access
-// =====================================================================
+// CdLZ4Encoder_RA
 
-#define ZRA_MAGIC_HEADER_SIZE     4
-static const C_UInt8 ZRA_MAGIC_HEADER[ZRA_MAGIC_HEADER_SIZE] =
-	{ 'Z', 'R', 'A', 0x10 };
+#define LZ4_MAGIC_HEADER_SIZE     7
+static const C_UInt8 LZ4_MAGIC_HEADER[LZ4_MAGIC_HEADER_SIZE] =
+	{ 'L', 'Z', '4', '_', 'R', 'A', 0x10 };
+static const char *ErrLZ4Compressing =
+	"Internal error in 'CdLZ4Encoder_RA::Compressing'.";
 
-// windowBits<0, indicating generating raw deflate data without zlib header
-//               or trailer
-#define ZRA_WINDOW_BITS_16K    -11
-#define ZRA_WINDOW_BITS_32K    -12
-#define ZRA_WINDOW_BITS_64K    -13
-#define ZRA_WINDOW_BITS_128K   -14
-#define ZRA_WINDOW_BITS        -15
+CdLZ4Encoder_RA::CdLZ4Encoder_RA(CdStream &Dest, TLevel Level, TBlockSize BK):
+	CdRA_Write(this, BK), CdBaseLZ4Stream(Dest), CdRecodeLevel(Level)
+{
+	switch (Level)
+	{
+	case clFast:
+		fLZ4Ptr = malloc(sizeof(LZ4_stream_t));
+		memset(fLZ4Ptr, 0, sizeof(LZ4_stream_t));
+		break;
+	case clDefault: case clMax:
+		fLZ4Ptr = LZ4_createStreamHC();
+		break;
+	default:
+		fLZ4Ptr = NULL;
+	}
 
-// See: http://www.zlib.net/ChangeLog.txt
-#ifdef ZLIB_VERNUM
-#   if (ZLIB_VERNUM > 0x1250)
-#       define ZLIB_DEFLATE_PENDING    deflatePending
-#   else
-#       define ZLIB_DEFLATE_PENDING(z, p, b)    0
-#   endif
-#else
-#   define ZLIB_DEFLATE_PENDING(z, p, b)    0
-#endif
+	PtrExtRec = NULL;
+	fHaveClosed = false;
+	fUnusedRawSize = LZ4RA_RAW_BUFFER_SIZE;
+	_IdxRaw = 0;
 
+	fBlockLZ4Size = fCurBlockLZ4Size = RA_BLOCK_SIZE_LIST[BK];
+	InitWriteStream();
+}
 
-CdZEncoder_RA::CdZEncoder_RA(CdStream &Dest, TLevel Level,
-	TBlockSize BK): CdRA_Write(this, BK),
-	CdZEncoder( Dest, Level,
-		 BK==ra16KB  ? ZRA_WINDOW_BITS_16K :
-		(BK==ra32KB  ? ZRA_WINDOW_BITS_32K :
-		(BK==ra64KB  ? ZRA_WINDOW_BITS_64K :
-		(BK==ra128KB ? ZRA_WINDOW_BITS_128K : ZRA_WINDOW_BITS))) )
+CdLZ4Encoder_RA::~CdLZ4Encoder_RA()
 {
-	fBlockZIPSize = fCurBlockZIPSize = RA_BLOCK_SIZE_LIST[BK];
-	InitWriteStream();
+	// the helper threads call CompressBlock()
+	ParallelEnd();
+	switch (fLevel)
+	{
+	case clFast:
+		free(fLZ4Ptr); break;
+	case clDefault: case clMax:
+		LZ4_freeStreamHC((LZ4_streamHC_t*)fLZ4Ptr); break;
+	default:
+		break;
+	}
+	fLZ4Ptr = NULL;
 }
 
-ssize_t CdZEncoder_RA::Write(const void *Buffer, ssize_t Count)
+ssize_t CdLZ4Encoder_RA::Read(void *Buffer, ssize_t Count)
+{
+	throw ELZ4Error(ErrLZ4InflateInvalid, "Read");
+}
+
+ssize_t CdLZ4Encoder_RA::Write(const void *Buffer, ssize_t Count)
 {
 	if (fHaveClosed)
-		throw EZLibError(ErrZDeflateClosed);
+		throw ELZ4Error(ErrLZ4DeflateClosed);
 	if (Count <= 0) return 0;
+	if (fPool)
+	{
+		ParallelWrite(Buffer, Count);
+		return Count;
+	}
 
 	ssize_t OldCount = Count;
 	C_UInt8 *pBuf = (C_UInt8*)Buffer;
+	char *pRaw = fRawBuffer[_IdxRaw];
 
 	while (Count > 0)
 	{
+		if (!fHasInitWriteBlock)
+		{
+			switch (fLevel)
+			{
+			case clFast:
+				memset(fLZ4Ptr, 0, sizeof(LZ4_stream_t)); break;
+			case clDefault:
+				LZ4_resetStreamHC((LZ4_streamHC_t*)fLZ4Ptr,
+					LZ4DeflateLevel[clDefault]); break;
+			case clMax:
+				LZ4_resetStreamHC((LZ4_streamHC_t*)fLZ4Ptr,
+					LZ4DeflateLevel[clMax]); break;
+			default:
+				break;
+			}
+		}
 		InitWriteBlock();
 
-		fZStream.next_in = (Bytef*)pBuf;
-		fZStream.avail_in = Count;
-
-		while (fZStream.avail_in > 0)
+		ssize_t L = Count;
+		if (L > fUnusedRawSize) L = fUnusedRawSize;
+		memcpy(&pRaw[LZ4RA_RAW_BUFFER_SIZE - fUnusedRawSize], pBuf, L);
+		pBuf += L;
+		Count -= L;
+		fTotalIn += L;
+		fUnusedRawSize -= L;
+		if (fUnusedRawSize <= 0)
 		{
-			ZCheck(deflate(&fZStream, Z_NO_FLUSH));
-			ssize_t L = Count - fZStream.avail_in;
-			fTotalIn += L; pBuf += L;
-			Count = fZStream.avail_in;
-
-			// whether it is the end of specified block
-			if (fZStream.avail_out <= 0)
-			{
-				UpdateStreamPosition();
-				fStream->WriteData(fBuffer, sizeof(fBuffer));
-				fStreamPos += sizeof(fBuffer);
-				fZStream.next_out = fBuffer;
-				fZStream.avail_out = sizeof(fBuffer);
-				fCurBlockZIPSize -= sizeof(fBuffer);
+			Compressing(LZ4RA_RAW_BUFFER_SIZE);
+			pRaw = fRawBuffer[_IdxRaw];
+		}
+	}
 
-				unsigned pending = 0;
-				int bits = 0;
-				ZCheck(ZLIB_DEFLATE_PENDING(&fZStream, &pending, &bits));
-				if (bits > 0) pending ++;
+	return OldCount - Count;
+}
 
-				if ((fCurBlockZIPSize - (int)pending <= 0) ||
-					(fTotalIn - fCB_UZStart >= 0xF8000000))
-				{
-					// finish this block
-					// 'fZStream.avail_in = 0' in SyncFinishBlock()
-					SyncFinishBlock();
-				}
-			}
-		}
+SIZE64 CdLZ4Encoder_RA::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
+{
+	switch (Origin)
+	{
+		case soBeginning:
+			if (Offset == fTotalIn) return fTotalIn;
+			break;
+		case soCurrent:
+			if (Offset == 0) return fTotalIn;
+			break;
+		case soEnd:
+			if (Offset == 0) return fTotalIn;
+			break;
 	}
+	throw ELZ4Error(ErrLZ4InflateInvalid, "Seek");
+}
 
-	fTotalOut = fStreamPos - fStreamBase;
-	return OldCount - Count;
+void CdLZ4Encoder_RA::SetSize(SIZE64 NewSize)
+{
+	if (NewSize != fTotalIn)
+		throw ELZ4Error(ErrLZ4InflateInvalid, "SetSize");
 }
 
-void CdZEncoder_RA::Close()
+void CdLZ4Encoder_RA::Close()
 {
 	if (!fHaveClosed)
 	{
@@ -1241,36 +3949,170 @@ void CdZEncoder_RA::Close()
 				WriteData((void*)PtrExtRec->Buf, PtrExtRec->Size);
 			PtrExtRec = NULL;
 		}
-		SyncFinishBlock();
+		if (fPool)
+		{
+			ParallelFlush();
+		} else {
+			fCurBlockLZ4Size = 0;
+			Compressing(LZ4RA_RAW_BUFFER_SIZE - fUnusedRawSize);
+		}
 		DoneWriteStream();
 		fHaveClosed = true;
 	}
 }
 
-void CdZEncoder_RA::WriteMagicNumber(CdStream &Stream)
+void CdLZ4Encoder_RA::WriteMagicNumber(CdStream &Stream)
 {
-	Stream.WriteData(ZRA_MAGIC_HEADER, ZRA_MAGIC_HEADER_SIZE);
+	Stream.WriteData(LZ4_MAGIC_HEADER, LZ4_MAGIC_HEADER_SIZE);
+	Stream.W8b(fLevel);
 }
 
-void CdZEncoder_RA::SyncFinishBlock()
+void CdLZ4Encoder_RA::Compressing(int bufsize)
 {
-	if (fHasInitWriteBlock)
+	if (bufsize <= 0) return;
+
+	// the buffer for compressed data
+	char LZ4Buffer[LZ4RA_LZ4_BUFFER_SIZE + 2];
+	int size, cmpBytes;
+
+	UpdateStreamPosition();
+
+	switch (fLevel)
 	{
-		SyncFinish();
+	case clMin:
+		BYTE_LE<CdStream>(fStream) << (C_UInt16)(bufsize);
+		fStream->WriteData(fRawBuffer[_IdxRaw], bufsize);
+		size = sizeof(C_UInt16) + bufsize;
+		break;
+
+	case clFast:
+		cmpBytes = LZ4_compress_fast_continue((LZ4_stream_t*)fLZ4Ptr,
+			fRawBuffer[_IdxRaw], LZ4Buffer+2, bufsize,
+			LZ4_compressBound(bufsize), 1);
+		if (cmpBytes <= 0)
+			throw ELZ4Error(ErrLZ4Compressing);
+		LZ4Buffer[0] = cmpBytes & 0xFF;
+		LZ4Buffer[1] = (cmpBytes >> 8) & 0xFF;
+		size = sizeof(C_UInt16) + cmpBytes;
+		fStream->WriteData(LZ4Buffer, size);
+		break;
+
+	case clDefault: case clMax:
+		cmpBytes = LZ4_compress_HC_continue((LZ4_streamHC_t*)fLZ4Ptr,
+			fRawBuffer[_IdxRaw], LZ4Buffer+2, bufsize,
+			LZ4_compressBound(bufsize));
+		if (cmpBytes <= 0)
+			throw ELZ4Error(ErrLZ4Compressing);
+		LZ4Buffer[0] = cmpBytes & 0xFF;
+		LZ4Buffer[1] = (cmpBytes >> 8) & 0xFF;
+		size = sizeof(C_UInt16) + cmpBytes;
+		fStream->WriteData(LZ4Buffer, size);
+		break;
+
+	default:
+		throw ELZ4Error(ErrLZ4Compressing);
+	}
+
+	fStreamPos += size;
+	fTotalOut = fStreamPos - fStreamBase;
+
+	_IdxRaw = 1 - _IdxRaw;
+	fUnusedRawSize = LZ4RA_RAW_BUFFER_SIZE;
+	fCurBlockLZ4Size -= size;
+	if (fCurBlockLZ4Size < 0)
+	{
+		fCurBlockLZ4Size = fBlockLZ4Size;
 		DoneWriteBlock();
-		fCurBlockZIPSize = fBlockZIPSize;
-		fZStream.next_out = fBuffer;
-		fZStream.avail_out = sizeof(fBuffer);
-		ZCheck(deflateReset(&fZStream));
 	}
 }
 
-void CdZEncoder_RA::CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count)
+void CdLZ4Encoder_RA::CompressBlock(const C_UInt8 *Raw, ssize_t Len,
+	vector<C_UInt8> &Out)
 {
-	if (dynamic_cast<CdZDecoder_RA*>(&Source))
+	// the same chunks as Compressing(), and the raw data are copied to a
+	// double buffer since a chunk only refers to the previous one
+	const ssize_t nChunk =
+		(Len + LZ4RA_RAW_BUFFER_SIZE - 1) / LZ4RA_RAW_BUFFER_SIZE;
+	Out.resize(nChunk * (sizeof(C_UInt16) + LZ4RA_LZ4_BUFFER_SIZE));
+	C_UInt8 *p = &Out[0];
+
+	void *lz4 = NULL;
+	switch (fLevel)
 	{
-		CdZDecoder_RA *Src = static_cast<CdZDecoder_RA*>(&Source);
-		if ((Src->SizeType() == SizeType()) && (Src->fVersion == fVersion))
+	case clMin:
+		break;
+	case clFast:
+		lz4 = malloc(sizeof(LZ4_stream_t));
+		COREARRAY_ALLOCCHECK(lz4);
+		memset(lz4, 0, sizeof(LZ4_stream_t));
+		break;
+	case clDefault: case clMax:
+		lz4 = LZ4_createStreamHC();
+		COREARRAY_ALLOCCHECK(lz4);
+		LZ4_resetStreamHC((LZ4_streamHC_t*)lz4, LZ4DeflateLevel[fLevel]);
+		break;
+	default:
+		throw ELZ4Error(ErrLZ4Compressing);
+	}
+	vector<char> RawBuf((fLevel != clMin) ? 2*LZ4RA_RAW_BUFFER_SIZE : 0);
+	int idx = 0;
+	bool failed = false;
+
+	while ((Len > 0) && !failed)
+	{
+		int size = (Len <= LZ4RA_RAW_BUFFER_SIZE) ? Len : LZ4RA_RAW_BUFFER_SIZE;
+		char *pRaw = (fLevel != clMin) ? &RawBuf[idx*LZ4RA_RAW_BUFFER_SIZE] : NULL;
+		int cmpBytes;
+		switch (fLevel)
+		{
+		case clMin:
+			memcpy(p + sizeof(C_UInt16), Raw, size);
+			cmpBytes = size;
+			break;
+		case clFast:
+			memcpy(pRaw, Raw, size);
+			cmpBytes = LZ4_compress_fast_continue((LZ4_stream_t*)lz4,
+				pRaw, (char*)p + sizeof(C_UInt16), size,
+				LZ4_compressBound(size), 1);
+			break;
+		default:
+			memcpy(pRaw, Raw, size);
+			cmpBytes = LZ4_compress_HC_continue((LZ4_streamHC_t*)lz4,
+				pRaw, (char*)p + sizeof(C_UInt16), size,
+				LZ4_compressBound(size));
+		}
+		if (cmpBytes > 0)
+		{
+			p[0] = cmpBytes & 0xFF;
+			p[1] = (cmpBytes >> 8) & 0xFF;
+			p += sizeof(C_UInt16) + cmpBytes;
+			Raw += size; Len -= size;
+			idx = 1 - idx;
+		} else
+			failed = true;
+	}
+
+	switch (fLevel)
+	{
+	case clFast:
+		free(lz4); break;
+	case clDefault: case clMax:
+		LZ4_freeStreamHC((LZ4_streamHC_t*)lz4); break;
+	default:
+		break;
+	}
+	if (failed)
+		throw ELZ4Error(ErrLZ4Compressing);
+	Out.resize(p - &Out[0]);
+}
+
+void CdLZ4Encoder_RA::CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count)
+{
+	if (dynamic_cast<CdLZ4Decoder_RA*>(&Source))
+	{
+		CdLZ4Decoder_RA *Src = static_cast<CdLZ4Decoder_RA*>(&Source);
+		if ((Src->SizeType() == SizeType()) && (Src->fVersion == fVersion) &&
+			SameBlockFormat(*Src))
 		{
 			Src->SetPosition(Pos);
 			if (Count < 0)
@@ -1300,15 +4142,23 @@ void CdZEncoder_RA::CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count)
 				Src->SeekStream(Pos);
 				if ((Src->fCB_UZStart + Src->fCB_UZSize) <= (Pos + Count))
 				{
-					SyncFinishBlock();
+					if (fPool)
+					{
+						ParallelFlush();
+					} else if (fHasInitWriteBlock)
+					{
+						fCurBlockLZ4Size = 0;
+						Compressing(LZ4RA_RAW_BUFFER_SIZE - fUnusedRawSize);
+						fHasInitWriteBlock = false;
+					}
 					// determine start and size
 					SIZE64 Start = Src->fCB_ZStart;
 					SIZE64 ZSize = 0, USize = 0;
-					while ((Src->fCB_UZStart + Src->fCB_UZSize) <= (Pos + Count))
+					for (; (Src->fCB_UZStart + Src->fCB_UZSize) <= (Pos + Count); )
 					{
 						ZSize += Src->fCB_ZSize;
 						USize += Src->fCB_UZSize;
-						AddBlockInfo(Src->fCB_ZSize, Src->fCB_UZSize);
+						CopyBlockInfo(*Src);
 						Count -= Src->fCB_UZSize;
 						Pos += Src->fCB_UZSize;
 						Src->NextBlock();
@@ -1340,70 +4190,94 @@ void CdZEncoder_RA::CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count)
 }
 
 
-// =====================================================================
-// Output stream for zlib with the support of random access
-// =====================================================================
 
-CdZDecoder_RA::CdZDecoder_RA(CdStream &Source):
-	CdRA_Read(this), CdZDecoder(Source, ZRA_WINDOW_BITS)
+// CdLZ4Decoder_RA
+
+CdLZ4Decoder_RA::CdLZ4Decoder_RA(CdStream &Source):
+	CdRA_Read(this), CdBaseLZ4Stream(Source)
 {
+	fLevel = clUnknown;
 	InitReadStream();
+	_IdxRaw = 1;
+	fCurPosition = 0;
+	memset(&lz4_body, 0, sizeof(lz4_body));
+	iRaw = CntRaw = 0;
 }
 
-ssize_t CdZDecoder_RA::Read(void *Buffer, ssize_t Count)
+CdLZ4Decoder_RA::~CdLZ4Decoder_RA()
+{
+	ParallelEnd();
+}
+
+ssize_t CdLZ4Decoder_RA::Read(void *Buffer, ssize_t Count)
 {
 	if (Count <= 0) return 0;
+	if (fTracing) TraceRead(fCurPosition, Count);
+	if (!fPatch.empty()) return PatchRead(Buffer, Count, fCurPosition);
+	if (fPool) return ParallelRead(Buffer, Count, fCurPosition);
+	if (fCacheData)
+	{
+		ssize_t L = CacheRead(Buffer, Count, fCurPosition);
+		if (L >= Count) return L;
+		return L + Read((C_UInt8*)Buffer + L, Count - L);
+	}
 	if (fBlockIdx >= fBlockNum) return 0;
 
 	C_UInt8 *pBuf = (C_UInt8*)Buffer;
 	ssize_t OldCount = Count;
+	char *pRaw = fRawBuffer[_IdxRaw];
 
 	while (Count > 0)
 	{
-		fZStream.next_out = (Bytef*)pBuf;
-		int ZResult = Z_OK;
-
-		while ((Count>0) && (ZResult!=Z_STREAM_END))
+		if (CntRaw <= 0)
 		{
-			if (fZStream.avail_in <= 0)
-			{
-				ssize_t s = fCB_ZStart + fCB_ZSize - fStreamPos;
-				if (s > (ssize_t)sizeof(fBuffer))
-					s = sizeof(fBuffer);
-				if (s > 0)
-				{
-					fStream->SetPosition(fStreamPos);
-					fZStream.avail_in = fStream->Read(fBuffer, s);
-					if (fZStream.avail_in <= 0)
-						return OldCount - Count;
-
-					fStreamPos += fZStream.avail_in;
-					fZStream.next_in = fBuffer;
-				}
-			}
+			UpdateStreamPosition();
+			C_UInt16 Len;
+			BYTE_LE<CdStream>(fStream) >> Len;
 
-			fZStream.avail_out = Count;
-			ZResult = ZCheck(inflate(&fZStream, Z_NO_FLUSH));
+			if (fLevel != clMin)
+			{
+				char LZ4Buffer[65536];
+				fStream->ReadData(LZ4Buffer, Len);
+				fStreamPos += sizeof(Len) + Len;
 
-			ssize_t L = Count - fZStream.avail_out;
-			fCurPosition += L;
-			Count -= L;
-			pBuf += L;
+	            _IdxRaw = 1 - _IdxRaw;
+				int decBytes = LZ4_decompress_safe_continue(
+					&lz4_body, LZ4Buffer, fRawBuffer[_IdxRaw], Len,
+					LZ4RA_RAW_BUFFER_SIZE);
+	            if(decBytes <= 0)
+    	        	break;
+	            CntRaw = decBytes;
+	            pRaw = fRawBuffer[_IdxRaw];
+	        } else {
+				fStream->ReadData(fRawBuffer[_IdxRaw], Len);
+				fStreamPos += sizeof(Len) + Len;
+	            CntRaw = Len;
+	        }
+            iRaw = 0;
 		}
 
-		if (ZResult == Z_STREAM_END)
-		{
-			if ((fCurPosition-fCB_UZStart) != fCB_UZSize)
-				throw EZLibError("Invalid ZIP block, inconsistent length.");
+		ssize_t L = Count;
+		if (L > (CntRaw - iRaw)) L = CntRaw - iRaw;
+		memcpy(pBuf, &pRaw[iRaw], L);
+		fCurPosition += L;
+		Count -= L;
+		pBuf += L;
 
-			// go to the next block
-			if (NextBlock())
+		iRaw += L;
+		if (iRaw >= CntRaw)
+		{
+			CntRaw = 0;
+			SIZE64 b = fCurPosition - fCB_UZStart;
+			if (b == fCB_UZSize)
 			{
-				fZStream.next_in = fBuffer;
-				fZStream.avail_in = 0;
-				ZCheck(inflateReset(&fZStream));
-			} else
-				break;
+				// go to the next block
+				if (NextBlock())
+					memset(&lz4_body, 0, sizeof(lz4_body));
+				else
+					break;
+			} else if (b > fCB_UZSize)
+				throw ELZ4Error("Invalid LZ4 block for random access");
 		}
 	}
 
@@ -1414,184 +4288,291 @@ ssize_t CdZDecoder_RA::Read(void *Buffer, ssize_t Count)
 	return OldCount - Count;
 }
 
-SIZE64 CdZDecoder_RA::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
+SIZE64 CdLZ4Decoder_RA::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
 {
 	if (Origin == soCurrent)
 	{
 		Offset += fCurPosition;
 		if (Offset < 0)
-			throw EZLibError(ErrZInflateInvalid, "Seek");
+			throw ELZ4Error(ErrLZ4InflateInvalid, "Seek");
 	} else if (Origin == soEnd)
-		throw EZLibError(ErrZInflateInvalid, "Seek");
+		throw ELZ4Error(ErrLZ4InflateInvalid, "Seek");
+
+	if (!fPatch.empty())
+		return (fCurPosition = Offset);
+	if (fPool)
+	{
+		ParallelSeek(Offset);
+		return (fCurPosition = Offset);
+	}
 
 	bool flag = SeekStream(Offset);
+	if (fCacheData && !flag)
+		return (fCurPosition = Offset);
 	if (flag || (Offset < fCurPosition))
+	{
+		// use the decompressed block in the shared cache
+		if (CacheSeek())
+			return (fCurPosition = Offset);
 		Reset();
+	}
 
 	Offset -= fCurPosition;
 	if (Offset > 0)
 	{
+		// skipping is not a reading in the access trace
+		bool tracing = fTracing;
+		fTracing = false;
 		C_UInt8 buffer[4096];
 		SIZE64 DivI = Offset / sizeof(buffer);
 		for (; DivI > 0; DivI--)
 			ReadData(buffer, sizeof(buffer));
 		ReadData(buffer, Offset % sizeof(buffer));
+		fTracing = tracing;
 	} else if (Offset < 0)
-		throw EZLibError(ErrZInflateInvalid, "Seek");
+		throw ELZ4Error(ErrLZ4InflateInvalid, "Seek");
 
 	return fCurPosition;
 }
 
-bool CdZDecoder_RA::ReadMagicNumber(CdStream &Stream)
+ssize_t CdLZ4Decoder_RA::Write(const void *Buffer, ssize_t Count)
+{
+	return PatchWrite(Buffer, Count, fCurPosition);
+}
+
+SIZE64 CdLZ4Decoder_RA::GetSize()
+{
+	return -1;
+}
+
+void CdLZ4Decoder_RA::SetSize(SIZE64 NewSize)
+{
+	throw ELZ4Error(ErrLZ4InflateInvalid, "SetSize");
+}
+
+bool CdLZ4Decoder_RA::ReadMagicNumber(CdStream &Stream)
 {
-	C_UInt8 Header[ZRA_MAGIC_HEADER_SIZE];
+	C_UInt8 Header[LZ4_MAGIC_HEADER_SIZE];
 	Stream.SetPosition(fStreamBase);
 	Stream.ReadData(Header, sizeof(Header));
-	return (memcmp(Header, ZRA_MAGIC_HEADER, ZRA_MAGIC_HEADER_SIZE) == 0);
+	if (memcmp(Header, LZ4_MAGIC_HEADER, LZ4_MAGIC_HEADER_SIZE) == 0)
+	{
+		fLevel = (CdRecodeStream::TLevel)((C_Int8)Stream.R8b());
+		return true;
+	} else
+		return false;
 }
 
-void CdZDecoder_RA::Reset()
+void CdLZ4Decoder_RA::Reset()
 {
-	fZStream.next_in = fBuffer;
-	fZStream.avail_in = 0;
-	ZCheck(inflateReset(&fZStream));
+	CacheEnd();
+	memset(&lz4_body, 0, sizeof(lz4_body));
+	iRaw = CntRaw = 0;
 	fStreamPos = fCB_ZStart;
 	if (fVersion == 0x10)
 		fStreamPos += SIZE_RA_BLOCK_HEADER;
 	fCurPosition = fCB_UZStart;
 }
 
-// EZLibError
-
-EZLibError::EZLibError(int Code): ErrRecodeStream()
+void CdLZ4Decoder_RA::DecompressBlock(const C_UInt8 *Cmp, ssize_t CmpLen,
+	C_UInt8 *Raw, ssize_t RawLen)
 {
-	fErrCode = Code;
-	fMessage = zError(Code);
+	// the chunks are decompressed in place, since each chunk only refers
+	// to the previous one
+	LZ4_streamDecode_t lz4;
+	memset((void*)&lz4, 0, sizeof(lz4));
+	const C_UInt8 *pEnd = Cmp + CmpLen;
+	while (RawLen > 0)
+	{
+		if (pEnd - Cmp < (ssize_t)sizeof(C_UInt16))
+			throw ELZ4Error("Invalid LZ4 block for random access");
+		ssize_t Len = Cmp[0] | (ssize_t(Cmp[1]) << 8);
+		Cmp += sizeof(C_UInt16);
+		if (pEnd - Cmp < Len)
+			throw ELZ4Error("Invalid LZ4 block for random access");
+
+		ssize_t L;
+		if (fLevel != clMin)
+		{
+			int Size = (RawLen < LZ4RA_RAW_BUFFER_SIZE) ? RawLen :
+				LZ4RA_RAW_BUFFER_SIZE;
+			L = LZ4_decompress_safe_continue(&lz4, (const char*)Cmp,
+				(char*)Raw, Len, Size);
+			if (L <= 0)
+				throw ELZ4Error("Invalid LZ4 block for random access");
+		} else {
+			if ((Len <= 0) || (Len > RawLen))
+				throw ELZ4Error("Invalid LZ4 block for random access");
+			memcpy(Raw, Cmp, Len);
+			L = Len;
+		}
+		Cmp += Len;
+		Raw += L; RawLen -= L;
+	}
 }
 
+#endif
+
 
 
 // =====================================================================
-// The classes of LZ4 stream
-// =====================================================================
+// The classes of xz/lzma stream
 
-#ifndef COREARRAY_NO_LZ4
+#ifndef COREARRAY_NO_LZMA
 
-//   64KB,    256KB,         1MB,         4MB
-static const ssize_t LZ4ChunkSize[4] =
-	{ 64*1024, 256*1024, 1*1024*1024, 4*1024*1024 };
-static const int LZ4DeflateLevel[4] =
-	{ 0, LZ4HC_CLEVEL_MIN, LZ4HC_CLEVEL_DEFAULT, LZ4HC_CLEVEL_MAX };
-static const LZ4F_blockSizeID_t LZ4FrameInfoBlockSize[4] =
-	{ LZ4F_max64KB, LZ4F_max256KB, LZ4F_max1MB, LZ4F_max4MB };
+static const char *ErrXZDeflateInvalid =
+	"Invalid xz deflate Stream operation '%s'!";
+static const char *ErrXZInflateInvalid =
+	"Invalid xz inflate Stream operation '%s'!";
+static const char *ErrXZDeflateClosed =
+	"xz deflate stream has been closed.";
 
-static const char *ErrLZ4DeflateInvalid =
-	"Invalid LZ4 Deflate Stream operation '%s'!";
-static const char *ErrLZ4InflateInvalid =
-	"Invalid LZ4 Inflate Stream operation '%s'!";
-static const char *ErrLZ4DeflateClosed =
-	"LZ4 deflate stream has been closed.";
+static uint32_t XZLevels[4] =
+{
+	0,  // clMin
+	2,  // clFast
+	6,  // clDefault
+	9 | LZMA_PRESET_EXTREME  // clMax
+};
 
-CdBaseLZ4Stream::CdBaseLZ4Stream(CdStream &vStream):
-	CdRecodeStream(vStream)
-{ }
+COREARRAY_INLINE static void XZCheck(lzma_ret code)
+{
+	switch (code)
+	{
+		case LZMA_OK:
+		case LZMA_BUF_ERROR:
+		case LZMA_GET_CHECK:
+			break;
+		case LZMA_UNSUPPORTED_CHECK:
+			throw EXZError("LZMA: cannot calculate the integrity check");
+		case LZMA_MEM_ERROR:
+			throw EXZError("LZMA: cannot allocate memory");
+		case LZMA_MEMLIMIT_ERROR:
+			throw EXZError("LZMA: memory usage limit was reached");
+		case LZMA_FORMAT_ERROR:
+			throw EXZError("LZMA: file format not recognized");
+		case LZMA_OPTIONS_ERROR:
+			throw EXZError("LZMA: invalid or unsupported options");
+		case LZMA_DATA_ERROR:
+			throw EXZError("LZMA: data is corrupt");
+		case LZMA_PROG_ERROR:
+			throw EXZError("LZMA: programming error");
+		default:
+			throw EXZError((int)code);
+	}
+}
 
 
-// Compression of LZ4 algorithm
+// CdBaseXZStream
 
-CdLZ4Encoder::CdLZ4Encoder(CdStream &Dest, CdRecodeStream::TLevel level,
-	TLZ4Chunk chunk): CdBaseLZ4Stream(Dest), CdRecodeLevel(level)
+CdBaseXZStream::CdBaseXZStream(CdStream &vStream): CdRecodeStream(vStream)
 {
-	if ((chunk < bsFirst) || (chunk > bsLast))
-		throw ELZ4Error("CdLZ4Encoder::CdLZ4Encoder, invalid chunk.");
-	fChunk = chunk;
+	memset((void*)&fXZStream, 0, sizeof(fXZStream));
+}
 
-	memset((void*)&lz4_pref, 0, sizeof(lz4_pref));
-	lz4_pref.compressionLevel = LZ4DeflateLevel[level];
-	lz4_pref.frameInfo.blockSizeID = LZ4FrameInfoBlockSize[chunk];
-	lz4_pref.frameInfo.blockMode = LZ4F_blockLinked;
-	lz4_pref.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
 
-	lz4_context = NULL;
-	LZ4F_errorCode_t err = LZ4F_createCompressionContext(&lz4_context, LZ4F_VERSION);
-	if (LZ4F_isError(err)) throw ELZ4Error(err);
+// CdXZEncoder
 
-	fChunkSize = LZ4ChunkSize[chunk];
-	fRawChunkSize = LZ4F_compressBound(fChunkSize, &lz4_pref);
-	fCompress = new C_UInt8[fRawChunkSize];
-	fChunkUsed = 0;
+CdXZEncoder::CdXZEncoder(CdStream &Dest, TLevel Level):
+	CdBaseXZStream(Dest), CdRecodeLevel(Level)
+{
+	PtrExtRec = NULL;
 	fHaveClosed = false;
+	InitXZStream();
+}
 
-	size_t s = LZ4F_compressBegin(lz4_context, fCompress, fRawChunkSize, &lz4_pref);
-	if (LZ4F_isError(s))
-	{
-		LZ4F_freeCompressionContext(lz4_context);
-		lz4_context = NULL;
-		throw ELZ4Error((LZ4F_errorCode_t)s);
-	}
+CdXZEncoder::CdXZEncoder(CdStream &Dest, int DictKB):
+	CdBaseXZStream(Dest), CdRecodeLevel(clCustom)
+{
+	PtrExtRec = NULL;
+	fHaveClosed = false;
+	if (DictKB < 128 || DictKB > 1572864)  // 128KiB min, 1536MiB max
+		throw EXZError("CdXZEncoder initialization error (DictKB: %d).", DictKB);
 
-	// write the header
-	fStream->SetPosition(fStreamBase);
-	fStream->WriteData(fCompress, s);
-	fStreamPos = fStreamBase + (int)s;
-	fTotalOut = (fStreamPos - fStreamBase);
+	lzma_options_lzma opt_lzma;
+	if (lzma_lzma_preset(&opt_lzma, 9 | LZMA_PRESET_EXTREME))
+		throw EXZError("CdXZEncoder initialization internal error.");
+	opt_lzma.dict_size = DictKB * 1024;
+
+	lzma_filter filters[2];
+	filters[0].id = LZMA_FILTER_LZMA2;
+	filters[0].options = &opt_lzma;
+	filters[1].id = LZMA_VLI_UNKNOWN;
+	XZCheck(lzma_stream_encoder(&fXZStream, filters, LZMA_CHECK_CRC32));
 }
 
-CdLZ4Encoder::~CdLZ4Encoder()
+CdXZEncoder::~CdXZEncoder()
 {
 	Close();
-	if (fCompress)
+	lzma_end(&fXZStream);
+}
+
+void CdXZEncoder::InitXZStream()
+{
+	InitXZStream(fXZStream, fLevel);
+}
+
+void CdXZEncoder::InitXZStream(lzma_stream &XZ, TLevel Level)
+{
+	if (clMin<=Level && Level<=clMax)
 	{
-		delete[] fCompress;
-		fCompress = NULL;
-	}
-	if (lz4_context)
+		XZCheck(lzma_easy_encoder(&XZ, XZLevels[Level],
+			LZMA_CHECK_CRC32));
+	} else if (Level==clUltra || Level==clUltraMax)
 	{
-		// LZ4F_errorCode_t err = 
-		LZ4F_freeCompressionContext(lz4_context);
-		lz4_context = NULL;
-		// if (LZ4F_isError(err)) throw ELZ4Error(err);
-	}
+		lzma_options_lzma opt_lzma;
+		if (lzma_lzma_preset(&opt_lzma, 9 | LZMA_PRESET_EXTREME))
+			throw EXZError("CdXZEncoder initialization internal error.");
+		opt_lzma.dict_size = (Level==clUltra) ? 512*1024*1024 : (1024+512)*1024*1024; // 512MiB : 1.5GB
+		opt_lzma.depth = (Level==clUltra) ?  512*8: 65536;  // -9e with 512
+		lzma_filter filters[2];
+		filters[0].id = LZMA_FILTER_LZMA2;
+		filters[0].options = &opt_lzma;
+		filters[1].id = LZMA_VLI_UNKNOWN;
+		XZCheck(lzma_stream_encoder(&XZ, filters, LZMA_CHECK_CRC32));
+	} else
+		throw EXZError("CdXZEncoder initialization level error.");
 }
 
-ssize_t CdLZ4Encoder::Read(void *Buffer, ssize_t Count)
+ssize_t CdXZEncoder::Read(void *Buffer, ssize_t Count)
 {
-	throw ELZ4Error(ErrLZ4DeflateInvalid, "Read");
+	throw EXZError(ErrXZInflateInvalid, "Read");
 }
 
-ssize_t CdLZ4Encoder::Write(const void *Buffer, ssize_t Count)
+ssize_t CdXZEncoder::Write(const void *Buffer, ssize_t Count)
 {
 	if (fHaveClosed)
-		throw ELZ4Error(ErrLZ4DeflateClosed);
+		throw EXZError(ErrXZDeflateClosed);
+	if (Count <= 0) return 0;
 
-	ssize_t OldCount = Count;
-	C_UInt8 *p = (C_UInt8*)Buffer;
-	while (Count > 0)
+	C_UInt8 buf[65536];
+	fXZStream.next_in = (const C_UInt8 *)Buffer;
+	fXZStream.avail_in = Count;
+	ssize_t L = fXZStream.avail_in;
+
+	while (fXZStream.avail_in > 0)
 	{
-		ssize_t size = fChunkSize - fChunkUsed;
-		if (Count < size) size = Count;
-		Count -= size; fTotalIn += size;
-		fChunkUsed += size;
+		fXZStream.avail_out = sizeof(buf);
+		fXZStream.next_out = buf;
 
-		size_t s = LZ4F_compressUpdate(lz4_context, fCompress, fRawChunkSize,
-			p, size, NULL);
-		if (LZ4F_isError(s))
-			throw ELZ4Error((LZ4F_errorCode_t)s);
-		if (s > 0)
+		XZCheck(lzma_code(&fXZStream, LZMA_RUN));
+		fTotalIn += L - fXZStream.avail_in;
+		L = fXZStream.avail_in;
+
+		size_t nout = sizeof(buf) - fXZStream.avail_out;
+		if (nout > 0)
 		{
-			fStream->WriteData(fCompress, s);
-			fStreamPos += s;
-			fChunkUsed = 0;
+			UpdateStreamPosition();
+			fStream->WriteData(buf, nout);
+			fStreamPos += nout;
+			fTotalOut += nout;
 		}
+    }
 
-		p += size;
-	}
-
-	fTotalOut = (fStreamPos - fStreamBase);
-	return OldCount;
+	return Count;
 }
 
-SIZE64 CdLZ4Encoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
+SIZE64 CdXZEncoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
 {
 	switch (Origin)
 	{
@@ -1605,16 +4586,16 @@ SIZE64 CdLZ4Encoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
 			if (Offset == 0) return fTotalIn;
 			break;
 	}
-	throw ELZ4Error(ErrLZ4DeflateInvalid, "Seek");
+	throw EXZError(ErrXZInflateInvalid, "Seek");
 }
 
-void CdLZ4Encoder::SetSize(SIZE64 NewSize)
+void CdXZEncoder::SetSize(SIZE64 NewSize)
 {
 	if (NewSize != fTotalIn)
-		throw ELZ4Error(ErrLZ4DeflateInvalid, "SetSize");
+		throw EXZError(ErrXZDeflateInvalid, "SetSize");
 }
 
-void CdLZ4Encoder::Close()
+void CdXZEncoder::Close()
 {
 	if (!fHaveClosed)
 	{
@@ -1624,96 +4605,114 @@ void CdLZ4Encoder::Close()
 				WriteData((void*)PtrExtRec->Buf, PtrExtRec->Size);
 			PtrExtRec = NULL;
 		}
+		SyncFinish();
+		fHaveClosed = true;
+	}
+}
 
-		size_t s = LZ4F_compressEnd(lz4_context, fCompress, fRawChunkSize, NULL);
-		if (LZ4F_isError(s))
-			throw ELZ4Error((LZ4F_errorCode_t)s);
-		fStream->WriteData(fCompress, s);
-		fStreamPos += s;
-		fTotalOut = (fStreamPos - fStreamBase);
+void CdXZEncoder::SyncFinish()
+{
+	C_UInt8 buffer[65536];
+	lzma_ret ret = LZMA_OK;
+
+	while (ret != LZMA_STREAM_END)
+	{
+		fXZStream.avail_out = sizeof(buffer);
+		fXZStream.next_out = buffer;
 
-		fHaveClosed = true;
+		ret = lzma_code(&fXZStream, LZMA_FINISH);
+		if (ret != LZMA_STREAM_END) XZCheck(ret);
+
+		size_t nout = sizeof(buffer) - fXZStream.avail_out;
+		if (nout > 0)
+		{
+			UpdateStreamPosition();
+			fStream->WriteData(buffer, nout);
+			fStreamPos += nout;
+			fTotalOut += nout;
+		}
 	}
 }
 
+ssize_t CdXZEncoder::Pending()
+{
+	return 0;
+}
+
 
-// Decompression of LZ4 algorithm
+// CdXZDecoder
 
-CdLZ4Decoder::CdLZ4Decoder(CdStream &Source): CdBaseLZ4Stream(Source)
+#define XZ_DECODER_FLAG    LZMA_TELL_UNSUPPORTED_CHECK
+
+CdXZDecoder::CdXZDecoder(CdStream &Source): CdBaseXZStream(Source)
 {
-	lz4_context = NULL;
-	LZ4F_errorCode_t err =
-		LZ4F_createDecompressionContext(&lz4_context, LZ4F_VERSION);
-	if (LZ4F_isError(err)) throw ELZ4Error(err);
+	fXZStream.avail_in = 0;
 	fCurPosition = 0;
-	fBufPtr = fBufEnd = fBuffer;
+	XZCheck(lzma_stream_decoder(&fXZStream, UINT64_MAX, XZ_DECODER_FLAG));
 }
 
-
-CdLZ4Decoder::~CdLZ4Decoder()
+CdXZDecoder::~CdXZDecoder()
 {
-	if (lz4_context)
-	{
-		// LZ4F_errorCode_t err =
-		LZ4F_freeDecompressionContext(lz4_context);
-		lz4_context = NULL;
-		// if (LZ4F_isError(err)) throw ELZ4Error(err);
-	}
+	lzma_end(&fXZStream);
 }
 
-ssize_t CdLZ4Decoder::Read(void *Buffer, ssize_t Count)
+ssize_t CdXZDecoder::Read(void *Buffer, ssize_t Count)
 {
-	ssize_t OldCount = Count;
-	C_UInt8 *p = (C_UInt8*)Buffer;
-	while (Count > 0)
+	ssize_t OriCount = Count;
+	C_UInt8 *pBuffer = (C_UInt8 *)Buffer;
+	lzma_ret ret = LZMA_OK;
+
+	while ((Count > 0) && (ret != LZMA_STREAM_END))
 	{
-		if (fBufPtr >= fBufEnd)
+		if (fXZStream.avail_in <= 0)
 		{
 			UpdateStreamPosition();
-			ssize_t Cnt = fStream->Read(fBuffer, sizeof(fBuffer));
-			fStreamPos += Cnt;
-			fBufPtr = fBuffer;
-			fBufEnd = fBufPtr + Cnt;
-			if (Cnt <= 0) break;
+			fXZStream.avail_in = fStream->Read(fBuffer, sizeof(fBuffer));
+			if (fXZStream.avail_in <= 0)
+				return OriCount - Count;
+			fStreamPos += fXZStream.avail_in;
+			fXZStream.next_in = fBuffer;
 		}
 
-		size_t DstCnt = Count;
-		size_t ScrCnt = fBufEnd - fBufPtr;
-		size_t s = LZ4F_decompress(lz4_context, p, &DstCnt,
-			fBufPtr, &ScrCnt, NULL);
-		if (LZ4F_isError(s))
-			break;
+		fXZStream.avail_out = Count;
+		fXZStream.next_out = pBuffer;
+		ret = lzma_code(&fXZStream, LZMA_RUN);
+		if (ret != LZMA_STREAM_END)
+			XZCheck(ret);
 
-		fBufPtr += ScrCnt;
-		fCurPosition += DstCnt;
-		p += DstCnt;
-		Count -= DstCnt;
+		ssize_t n = Count - fXZStream.avail_out;
+		fCurPosition += n;
+		pBuffer += n;
+		Count -= n;
+	}
+
+	if ((ret==LZMA_STREAM_END) && (fXZStream.avail_in>0))
+	{
+		fStreamPos -= fXZStream.avail_in;
+		fStream->SetPosition(fStreamPos);
+		fXZStream.avail_in = 0;
 	}
 
 	SIZE64 tmp = fStreamPos - fStreamBase;
 	if (tmp > fTotalIn) fTotalIn = tmp;
 	if (fCurPosition > fTotalOut) fTotalOut = fCurPosition;
 
-	return (OldCount - Count);
+	return OriCount - Count;
 }
 
-ssize_t CdLZ4Decoder::Write(const void *Buffer, ssize_t Count)
+ssize_t CdXZDecoder::Write(const void *Buffer, ssize_t Count)
 {
-	throw ELZ4Error(ErrLZ4InflateInvalid, "Write");
+	throw EXZError(ErrXZInflateInvalid, "Write");
 }
 
-SIZE64 CdLZ4Decoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
+SIZE64 CdXZDecoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
 {
 	if ((Offset==0) && (Origin==soBeginning))
 	{
 		if (fCurPosition == 0) return 0;
-		LZ4F_freeDecompressionContext(lz4_context);
-		lz4_context = NULL;
-		LZ4F_errorCode_t err =
-			LZ4F_createDecompressionContext(&lz4_context, LZ4F_VERSION);
-		if (LZ4F_isError(err))
-			throw ELZ4Error(err);
-		fBufPtr = fBufEnd = fBuffer;
+		lzma_end(&fXZStream);
+		XZCheck(lzma_stream_decoder(&fXZStream, UINT64_MAX, XZ_DECODER_FLAG));
+		fXZStream.avail_in = 0;
 		fStream->SetPosition(fStreamPos = fStreamBase);
 		return (fCurPosition = 0);
 	} else if (Origin != soEnd)
@@ -1733,145 +4732,103 @@ SIZE64 CdLZ4Decoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
 			ReadData(buffer, sizeof(buffer));
 		ReadData(buffer, Offset % sizeof(buffer));
 	} else
-		throw ELZ4Error(ErrLZ4InflateInvalid, "Seek");
+		throw EXZError(ErrXZInflateInvalid, "Seek");
 
 	return fCurPosition;
 }
 
-SIZE64 CdLZ4Decoder::GetSize()
+SIZE64 CdXZDecoder::GetSize()
 {
 	return -1;
 }
 
-void CdLZ4Decoder::SetSize(SIZE64 NewSize)
+void CdXZDecoder::SetSize(SIZE64 NewSize)
 {
-	throw ELZ4Error(ErrLZ4InflateInvalid, "SetSize");
+	throw EXZError(ErrXZInflateInvalid, "SetSize");
 }
 
 
-// CdLZ4Encoder_RA
-
-#define LZ4_MAGIC_HEADER_SIZE     7
-static const C_UInt8 LZ4_MAGIC_HEADER[LZ4_MAGIC_HEADER_SIZE] =
-	{ 'L', 'Z', '4', '_', 'R', 'A', 0x10 };
-static const char *ErrLZ4Compressing =
-	"Internal error in 'CdLZ4Encoder_RA::Compressing'.";
 
-CdLZ4Encoder_RA::CdLZ4Encoder_RA(CdStream &Dest, TLevel Level, TBlockSize BK):
-	CdRA_Write(this, BK), CdBaseLZ4Stream(Dest), CdRecodeLevel(Level)
-{
-	switch (Level)
-	{
-	case clFast:
-		fLZ4Ptr = malloc(sizeof(LZ4_stream_t));
-		memset(fLZ4Ptr, 0, sizeof(LZ4_stream_t));
-		break;
-	case clDefault: case clMax:
-		fLZ4Ptr = LZ4_createStreamHC();
-		break;
-	default:
-		fLZ4Ptr = NULL;
-	}
+// =====================================================================
+// Input stream for xz/lzma with the support of random access
 
-	PtrExtRec = NULL;
-	fHaveClosed = false;
-	fUnusedRawSize = LZ4RA_RAW_BUFFER_SIZE;
-	_IdxRaw = 0;
+#define XZ_RA_MAGIC_HEADER_SIZE     6
+static const C_UInt8 XZ_RA_MAGIC_HEADER[XZ_RA_MAGIC_HEADER_SIZE] =
+	{ 'X', 'Z', '_', 'R', 'A', 0x10 };
 
-	fBlockLZ4Size = fCurBlockLZ4Size = RA_BLOCK_SIZE_LIST[BK];
-	InitWriteStream();
-}
 
-CdLZ4Encoder_RA::~CdLZ4Encoder_RA()
+CdXZEncoder_RA::CdXZEncoder_RA(CdStream &Dest, TLevel Level,
+	TBlockSize B): CdRA_Write(this, B), CdXZEncoder(Dest, Level)
 {
-	switch (fLevel)
-	{
-	case clFast:
-		free(fLZ4Ptr); break;
-	case clDefault: case clMax:
-		LZ4_freeStreamHC((LZ4_streamHC_t*)fLZ4Ptr); break;
-	default:
-		break;
-	}
-	fLZ4Ptr = NULL;
+	fBlockZIPSize = fCurBlockZIPSize = RA_BLOCK_SIZE_LIST[B];
+	InitWriteStream();
 }
 
-ssize_t CdLZ4Encoder_RA::Read(void *Buffer, ssize_t Count)
+CdXZEncoder_RA::~CdXZEncoder_RA()
 {
-	throw ELZ4Error(ErrLZ4InflateInvalid, "Read");
+	// the helper threads call CompressBlock()
+	ParallelEnd();
 }
 
-ssize_t CdLZ4Encoder_RA::Write(const void *Buffer, ssize_t Count)
+ssize_t CdXZEncoder_RA::Write(const void *Buffer, ssize_t Count)
 {
 	if (fHaveClosed)
-		throw ELZ4Error(ErrLZ4DeflateClosed);
+		throw EXZError(ErrZDeflateClosed);
 	if (Count <= 0) return 0;
+	if (fPool)
+	{
+		ParallelWrite(Buffer, Count);
+		return Count;
+	}
 
+	C_UInt8 buf[8192];
 	ssize_t OldCount = Count;
 	C_UInt8 *pBuf = (C_UInt8*)Buffer;
-	char *pRaw = fRawBuffer[_IdxRaw];
 
 	while (Count > 0)
 	{
-		if (!fHasInitWriteBlock)
-		{
-			switch (fLevel)
-			{
-			case clFast:
-				memset(fLZ4Ptr, 0, sizeof(LZ4_stream_t)); break;
-			case clDefault:
-				LZ4_resetStreamHC((LZ4_streamHC_t*)fLZ4Ptr,
-					LZ4DeflateLevel[clDefault]); break;
-			case clMax:
-				LZ4_resetStreamHC((LZ4_streamHC_t*)fLZ4Ptr,
-					LZ4DeflateLevel[clMax]); break;
-			default:
-				break;
-			}
-		}
 		InitWriteBlock();
 
-		ssize_t L = Count;
-		if (L > fUnusedRawSize) L = fUnusedRawSize;
-		memcpy(&pRaw[LZ4RA_RAW_BUFFER_SIZE - fUnusedRawSize], pBuf, L);
-		pBuf += L;
-		Count -= L;
-		fTotalIn += L;
-		fUnusedRawSize -= L;
-		if (fUnusedRawSize <= 0)
+		fXZStream.next_in = pBuf;
+		fXZStream.avail_in = Count;
+		fXZStream.next_out = buf;
+		fXZStream.avail_out = sizeof(buf);
+
+		while (fXZStream.avail_in > 0)
 		{
-			Compressing(LZ4RA_RAW_BUFFER_SIZE);
-			pRaw = fRawBuffer[_IdxRaw];
-		}
-	}
+			XZCheck(lzma_code(&fXZStream, LZMA_RUN));
+			ssize_t L = Count - fXZStream.avail_in;
+			fTotalIn += L;
+			pBuf += L;
+			Count = fXZStream.avail_in;
 
-	return OldCount - Count;
-}
+			// have something output
+			ssize_t n  = sizeof(buf) - fXZStream.avail_out;
+			if (n > 0)
+			{
+				UpdateStreamPosition();
+				fStream->WriteData(buf, n);
+				fStreamPos += n;
+				fXZStream.next_out = buf;
+				fXZStream.avail_out = sizeof(buf);
+				fCurBlockZIPSize -= n;
 
-SIZE64 CdLZ4Encoder_RA::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
-{
-	switch (Origin)
-	{
-		case soBeginning:
-			if (Offset == fTotalIn) return fTotalIn;
-			break;
-		case soCurrent:
-			if (Offset == 0) return fTotalIn;
-			break;
-		case soEnd:
-			if (Offset == 0) return fTotalIn;
-			break;
+				if ((fCurBlockZIPSize - Pending() <= 0) ||
+					(fTotalIn - fCB_UZStart >= 0xF8000000))
+				{
+					// finish this block
+					// 'fZStream.avail_in = 0' in SyncFinishBlock()
+					SyncFinishBlock();
+				}
+			}
+		}
 	}
-	throw ELZ4Error(ErrLZ4InflateInvalid, "Seek");
-}
 
-void CdLZ4Encoder_RA::SetSize(SIZE64 NewSize)
-{
-	if (NewSize != fTotalIn)
-		throw ELZ4Error(ErrLZ4InflateInvalid, "SetSize");
+	fTotalOut = fStreamPos - fStreamBase;
+	return OldCount - Count;
 }
 
-void CdLZ4Encoder_RA::Close()
+void CdXZEncoder_RA::Close()
 {
 	if (!fHaveClosed)
 	{
@@ -1881,84 +4838,64 @@ void CdLZ4Encoder_RA::Close()
 				WriteData((void*)PtrExtRec->Buf, PtrExtRec->Size);
 			PtrExtRec = NULL;
 		}
-		fCurBlockLZ4Size = 0;
-		Compressing(LZ4RA_RAW_BUFFER_SIZE - fUnusedRawSize);
+		SyncFinishBlock();
 		DoneWriteStream();
 		fHaveClosed = true;
 	}
 }
 
-void CdLZ4Encoder_RA::WriteMagicNumber(CdStream &Stream)
+void CdXZEncoder_RA::WriteMagicNumber(CdStream &Stream)
 {
-	Stream.WriteData(LZ4_MAGIC_HEADER, LZ4_MAGIC_HEADER_SIZE);
-	Stream.W8b(fLevel);
+	Stream.WriteData(XZ_RA_MAGIC_HEADER, XZ_RA_MAGIC_HEADER_SIZE);
 }
 
-void CdLZ4Encoder_RA::Compressing(int bufsize)
+void CdXZEncoder_RA::SyncFinishBlock()
 {
-	if (bufsize <= 0) return;
-
-	// the buffer for compressed data
-	char LZ4Buffer[LZ4RA_LZ4_BUFFER_SIZE + 2];
-	int size, cmpBytes;
-
-	UpdateStreamPosition();
-
-	switch (fLevel)
+	if (fPool)
 	{
-	case clMin:
-		BYTE_LE<CdStream>(fStream) << (C_UInt16)(bufsize);
-		fStream->WriteData(fRawBuffer[_IdxRaw], bufsize);
-		size = sizeof(C_UInt16) + bufsize;
-		break;
-
-	case clFast:
-		cmpBytes = LZ4_compress_fast_continue((LZ4_stream_t*)fLZ4Ptr,
-			fRawBuffer[_IdxRaw], LZ4Buffer+2, bufsize,
-			LZ4_compressBound(bufsize), 1);
-		if (cmpBytes <= 0)
-			throw ELZ4Error(ErrLZ4Compressing);
-		LZ4Buffer[0] = cmpBytes & 0xFF;
-		LZ4Buffer[1] = (cmpBytes >> 8) & 0xFF;
-		size = sizeof(C_UInt16) + cmpBytes;
-		fStream->WriteData(LZ4Buffer, size);
-		break;
-
-	case clDefault: case clMax:
-		cmpBytes = LZ4_compress_HC_continue((LZ4_streamHC_t*)fLZ4Ptr,
-			fRawBuffer[_IdxRaw], LZ4Buffer+2, bufsize,
-			LZ4_compressBound(bufsize));
-		if (cmpBytes <= 0)
-			throw ELZ4Error(ErrLZ4Compressing);
-		LZ4Buffer[0] = cmpBytes & 0xFF;
-		LZ4Buffer[1] = (cmpBytes >> 8) & 0xFF;
-		size = sizeof(C_UInt16) + cmpBytes;
-		fStream->WriteData(LZ4Buffer, size);
-		break;
-
-	default:
-		throw ELZ4Error(ErrLZ4Compressing);
+		ParallelFlush();
+	} else if (fHasInitWriteBlock)
+	{
+		fXZStream.avail_in = 0;
+		SyncFinish();
+		DoneWriteBlock();
+		fCurBlockZIPSize = fBlockZIPSize;
+		lzma_end(&fXZStream);
+		InitXZStream();
 	}
+}
 
-	fStreamPos += size;
-	fTotalOut = fStreamPos - fStreamBase;
+void CdXZEncoder_RA::CompressBlock(const C_UInt8 *Raw, ssize_t Len,
+	vector<C_UInt8> &Out)
+{
+	// an xz stream with the same preset as fXZStream
+	lzma_stream xz = LZMA_STREAM_INIT;
+	InitXZStream(xz, fLevel);
 
-	_IdxRaw = 1 - _IdxRaw;
-	fUnusedRawSize = LZ4RA_RAW_BUFFER_SIZE;
-	fCurBlockLZ4Size -= size;
-	if (fCurBlockLZ4Size < 0)
+	Out.resize(lzma_stream_buffer_bound(Len));
+	xz.next_in = Raw;
+	xz.avail_in = Len;
+	xz.next_out = &Out[0];
+	xz.avail_out = Out.size();
+	lzma_ret ret = LZMA_OK;
+	while (ret == LZMA_OK)
+		ret = lzma_code(&xz, LZMA_FINISH);
+	Out.resize(Out.size() - xz.avail_out);
+	lzma_end(&xz);
+	if (ret != LZMA_STREAM_END)
 	{
-		fCurBlockLZ4Size = fBlockLZ4Size;
-		DoneWriteBlock();
+		XZCheck(ret);
+		throw EXZError("LZMA: insufficient buffer for a block");
 	}
 }
 
-void CdLZ4Encoder_RA::CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count)
+void CdXZEncoder_RA::CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count)
 {
-	if (dynamic_cast<CdLZ4Decoder_RA*>(&Source))
+	if (dynamic_cast<CdXZDecoder_RA*>(&Source))
 	{
-		CdLZ4Decoder_RA *Src = static_cast<CdLZ4Decoder_RA*>(&Source);
-		if ((Src->SizeType() == SizeType()) && (Src->fVersion == fVersion))
+		CdXZDecoder_RA *Src = static_cast<CdXZDecoder_RA*>(&Source);
+		if ((Src->SizeType() == SizeType()) && (Src->fVersion == fVersion) &&
+			SameBlockFormat(*Src))
 		{
 			Src->SetPosition(Pos);
 			if (Count < 0)
@@ -1988,12 +4925,7 @@ void CdLZ4Encoder_RA::CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count)
 				Src->SeekStream(Pos);
 				if ((Src->fCB_UZStart + Src->fCB_UZSize) <= (Pos + Count))
 				{
-					if (fHasInitWriteBlock)
-					{
-						fCurBlockLZ4Size = 0;
-						Compressing(LZ4RA_RAW_BUFFER_SIZE - fUnusedRawSize);
-						fHasInitWriteBlock = false;
-					}
+					SyncFinishBlock();
 					// determine start and size
 					SIZE64 Start = Src->fCB_ZStart;
 					SIZE64 ZSize = 0, USize = 0;
@@ -2001,7 +4933,7 @@ void CdLZ4Encoder_RA::CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count)
 					{
 						ZSize += Src->fCB_ZSize;
 						USize += Src->fCB_UZSize;
-						AddBlockInfo(Src->fCB_ZSize, Src->fCB_UZSize);
+						CopyBlockInfo(*Src);
 						Count -= Src->fCB_UZSize;
 						Pos += Src->fCB_UZSize;
 						Src->NextBlock();
@@ -2033,80 +4965,80 @@ void CdLZ4Encoder_RA::CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count)
 }
 
 
+// =====================================================================
 
-// CdLZ4Decoder_RA
-
-CdLZ4Decoder_RA::CdLZ4Decoder_RA(CdStream &Source):
-	CdRA_Read(this), CdBaseLZ4Stream(Source)
+CdXZDecoder_RA::CdXZDecoder_RA(CdStream &Source): CdRA_Read(this),
+	CdXZDecoder(Source)
 {
-	fLevel = clUnknown;
 	InitReadStream();
-	_IdxRaw = 1;
-	fCurPosition = 0;
-	memset(&lz4_body, 0, sizeof(lz4_body));
-	iRaw = CntRaw = 0;
 }
 
-ssize_t CdLZ4Decoder_RA::Read(void *Buffer, ssize_t Count)
+CdXZDecoder_RA::~CdXZDecoder_RA()
+{
+	ParallelEnd();
+}
+
+ssize_t CdXZDecoder_RA::Read(void *Buffer, ssize_t Count)
 {
 	if (Count <= 0) return 0;
+	if (fTracing) TraceRead(fCurPosition, Count);
+	if (!fPatch.empty()) return PatchRead(Buffer, Count, fCurPosition);
+	if (fPool) return ParallelRead(Buffer, Count, fCurPosition);
+	if (fCacheData)
+	{
+		ssize_t L = CacheRead(Buffer, Count, fCurPosition);
+		if (L >= Count) return L;
+		return L + Read((C_UInt8*)Buffer + L, Count - L);
+	}
 	if (fBlockIdx >= fBlockNum) return 0;
 
-	C_UInt8 *pBuf = (C_UInt8*)Buffer;
-	ssize_t OldCount = Count;
-	char *pRaw = fRawBuffer[_IdxRaw];
+	ssize_t OriCount = Count;
+	C_UInt8 *pBuffer = (C_UInt8 *)Buffer;
 
 	while (Count > 0)
 	{
-		if (CntRaw <= 0)
-		{
-			UpdateStreamPosition();
-			C_UInt16 Len;
-			BYTE_LE<CdStream>(fStream) >> Len;
+		lzma_ret ret = LZMA_OK;
 
-			if (fLevel != clMin)
+		while ((Count > 0) && (ret != LZMA_STREAM_END))
+		{
+			if (fXZStream.avail_in <= 0)
 			{
-				char LZ4Buffer[65536];
-				fStream->ReadData(LZ4Buffer, Len);
-				fStreamPos += sizeof(Len) + Len;
+				UpdateStreamPosition();
+				ssize_t n = fCB_ZSize - (fStreamPos - fCB_ZStart);
+				if (n > (ssize_t)sizeof(fBuffer)) n = sizeof(fBuffer);
+				if (n < 0) n = 0;
+				fXZStream.avail_in = fStream->Read(fBuffer, n);
+				if (fXZStream.avail_in <= 0)
+					return OriCount - Count;
+				fStreamPos += fXZStream.avail_in;
+				fXZStream.next_in = fBuffer;
+			}
 
-	            _IdxRaw = 1 - _IdxRaw;
-				int decBytes = LZ4_decompress_safe_continue(
-					&lz4_body, LZ4Buffer, fRawBuffer[_IdxRaw], Len,
-					LZ4RA_RAW_BUFFER_SIZE);
-	            if(decBytes <= 0)
-    	        	break;
-	            CntRaw = decBytes;
-	            pRaw = fRawBuffer[_IdxRaw];
-	        } else {
-				fStream->ReadData(fRawBuffer[_IdxRaw], Len);
-				fStreamPos += sizeof(Len) + Len;
-	            CntRaw = Len;
-	        }
-            iRaw = 0;
-		}
+			fXZStream.avail_out = Count;
+			fXZStream.next_out = pBuffer;
+			ret = lzma_code(&fXZStream, LZMA_RUN);
+			if (ret != LZMA_STREAM_END)
+				XZCheck(ret);
 
-		ssize_t L = Count;
-		if (L > (CntRaw - iRaw)) L = CntRaw - iRaw;
-		memcpy(pBuf, &pRaw[iRaw], L);
-		fCurPosition += L;
-		Count -= L;
-		pBuf += L;
+			ssize_t n = Count - fXZStream.avail_out;
+			fCurPosition += n;
+			pBuffer += n;
+			Count -= n;
+		}
 
-		iRaw += L;
-		if (iRaw >= CntRaw)
+		if (ret == LZMA_STREAM_END)
 		{
-			CntRaw = 0;
-			SIZE64 b = fCurPosition - fCB_UZStart;
-			if (b == fCB_UZSize)
+			if ((fCurPosition-fCB_UZStart) != fCB_UZSize)
+				throw EXZError("Invalid XZ block, inconsistent length.");
+
+			// go to the next block
+			if (NextBlock())
 			{
-				// go to the next block
-				if (NextBlock())
-					memset(&lz4_body, 0, sizeof(lz4_body));
-				else
-					break;
-			} else if (b > fCB_UZSize)
-				throw ELZ4Error("Invalid LZ4 block for random access");
+				lzma_end(&fXZStream);
+				XZCheck(lzma_stream_decoder(&fXZStream, UINT64_MAX, XZ_DECODER_FLAG));
+				fXZStream.avail_in = 0;
+			} else
+				break;
 		}
 	}
 
@@ -2114,232 +5046,203 @@ ssize_t CdLZ4Decoder_RA::Read(void *Buffer, ssize_t Count)
 	if (tmp > fTotalIn) fTotalIn = tmp;
 	if (fCurPosition > fTotalOut) fTotalOut = fCurPosition;
 
-	return OldCount - Count;
-}
-
-ssize_t CdLZ4Decoder_RA::Write(const void *Buffer, ssize_t Count)
-{
-	throw ELZ4Error(ErrLZ4InflateInvalid, "Write");
+	return OriCount - Count;
 }
 
-SIZE64 CdLZ4Decoder_RA::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
+SIZE64 CdXZDecoder_RA::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
 {
 	if (Origin == soCurrent)
 	{
 		Offset += fCurPosition;
 		if (Offset < 0)
-			throw ELZ4Error(ErrLZ4InflateInvalid, "Seek");
+			throw EXZError(ErrXZInflateInvalid, "Seek");
 	} else if (Origin == soEnd)
-		throw ELZ4Error(ErrLZ4InflateInvalid, "Seek");
+		throw EXZError(ErrXZInflateInvalid, "Seek");
+
+	if (!fPatch.empty())
+		return (fCurPosition = Offset);
+	if (fPool)
+	{
+		ParallelSeek(Offset);
+		return (fCurPosition = Offset);
+	}
 
 	bool flag = SeekStream(Offset);
+	if (fCacheData && !flag)
+		return (fCurPosition = Offset);
 	if (flag || (Offset < fCurPosition))
+	{
+		// use the decompressed block in the shared cache
+		if (CacheSeek())
+			return (fCurPosition = Offset);
 		Reset();
+	}
 
 	Offset -= fCurPosition;
 	if (Offset > 0)
 	{
+		// skipping is not a reading in the access trace
+		bool tracing = fTracing;
+		fTracing = false;
 		C_UInt8 buffer[4096];
 		SIZE64 DivI = Offset / sizeof(buffer);
 		for (; DivI > 0; DivI--)
 			ReadData(buffer, sizeof(buffer));
 		ReadData(buffer, Offset % sizeof(buffer));
+		fTracing = tracing;
 	} else if (Offset < 0)
-		throw ELZ4Error(ErrLZ4InflateInvalid, "Seek");
+		throw EXZError(ErrXZInflateInvalid, "Seek");
 
 	return fCurPosition;
 }
 
-SIZE64 CdLZ4Decoder_RA::GetSize()
-{
-	return -1;
-}
-
-void CdLZ4Decoder_RA::SetSize(SIZE64 NewSize)
+ssize_t CdXZDecoder_RA::Write(const void *Buffer, ssize_t Count)
 {
-	throw ELZ4Error(ErrLZ4InflateInvalid, "SetSize");
+	return PatchWrite(Buffer, Count, fCurPosition);
 }
 
-bool CdLZ4Decoder_RA::ReadMagicNumber(CdStream &Stream)
+bool CdXZDecoder_RA::ReadMagicNumber(CdStream &Stream)
 {
-	C_UInt8 Header[LZ4_MAGIC_HEADER_SIZE];
+	C_UInt8 Header[XZ_RA_MAGIC_HEADER_SIZE];
 	Stream.SetPosition(fStreamBase);
 	Stream.ReadData(Header, sizeof(Header));
-	if (memcmp(Header, LZ4_MAGIC_HEADER, LZ4_MAGIC_HEADER_SIZE) == 0)
-	{
-		fLevel = (CdRecodeStream::TLevel)((C_Int8)Stream.R8b());
-		return true;
-	} else
-		return false;
-}
-
-void CdLZ4Decoder_RA::Reset()
-{
-	memset(&lz4_body, 0, sizeof(lz4_body));
-	iRaw = CntRaw = 0;
-	fStreamPos = fCB_ZStart;
-	if (fVersion == 0x10)
-		fStreamPos += SIZE_RA_BLOCK_HEADER;
-	fCurPosition = fCB_UZStart;
+	return (memcmp(Header, XZ_RA_MAGIC_HEADER, XZ_RA_MAGIC_HEADER_SIZE) == 0);
 }
 
-#endif
-
-
-
-// =====================================================================
-// The classes of xz/lzma stream
-
-#ifndef COREARRAY_NO_LZMA
-
-static const char *ErrXZDeflateInvalid =
-	"Invalid xz deflate Stream operation '%s'!";
-static const char *ErrXZInflateInvalid =
-	"Invalid xz inflate Stream operation '%s'!";
-static const char *ErrXZDeflateClosed =
-	"xz deflate stream has been closed.";
-
-static uint32_t XZLevels[4] =
+void CdXZDecoder_RA::Reset()
 {
-	0,  // clMin
-	2,  // clFast
-	6,  // clDefault
-	9 | LZMA_PRESET_EXTREME  // clMax
-};
+	CacheEnd();
+	lzma_end(&fXZStream);
+	XZCheck(lzma_stream_decoder(&fXZStream, UINT64_MAX, XZ_DECODER_FLAG));
+	fXZStream.avail_in = 0;
+	fStreamPos = fCB_ZStart;
+	if (fVersion == 0x10)
+		fStreamPos += SIZE_RA_BLOCK_HEADER;
+	fCurPosition = fCB_UZStart;
+}
 
-COREARRAY_INLINE static void XZCheck(lzma_ret code)
+void CdXZDecoder_RA::DecompressBlock(const C_UInt8 *Cmp, ssize_t CmpLen,
+	C_UInt8 *Raw, ssize_t RawLen)
 {
-	switch (code)
+	uint64_t MemLimit = UINT64_MAX;
+	size_t InPos = 0, OutPos = 0;
+	lzma_ret ret = lzma_stream_buffer_decode(&MemLimit, 0, NULL,
+		Cmp, &InPos, CmpLen, Raw, &OutPos, RawLen);
+	if (ret != LZMA_OK)
 	{
-		case LZMA_OK:
-		case LZMA_BUF_ERROR:
-		case LZMA_GET_CHECK:
-			break;
-		case LZMA_UNSUPPORTED_CHECK:
-			throw EXZError("LZMA: cannot calculate the integrity check");
-		case LZMA_MEM_ERROR:
-			throw EXZError("LZMA: cannot allocate memory");
-		case LZMA_MEMLIMIT_ERROR:
-			throw EXZError("LZMA: memory usage limit was reached");
-		case LZMA_FORMAT_ERROR:
-			throw EXZError("LZMA: file format not recognized");
-		case LZMA_OPTIONS_ERROR:
-			throw EXZError("LZMA: invalid or unsupported options");
-		case LZMA_DATA_ERROR:
-			throw EXZError("LZMA: data is corrupt");
-		case LZMA_PROG_ERROR:
-			throw EXZError("LZMA: programming error");
-		default:
-			throw EXZError((int)code);
+		XZCheck(ret);
+		throw EXZError("Invalid XZ block, inconsistent length.");
 	}
+	if ((ssize_t)OutPos != RawLen)
+		throw EXZError("Invalid XZ block, inconsistent length.");
 }
 
+#endif
 
-// CdBaseXZStream
 
-CdBaseXZStream::CdBaseXZStream(CdStream &vStream): CdRecodeStream(vStream)
-{
-	memset((void*)&fXZStream, 0, sizeof(fXZStream));
-}
 
+// =====================================================================
+// The classes of zstd stream
+// =====================================================================
+
+#ifndef COREARRAY_NO_ZSTD
 
-// CdXZEncoder
+static const char *ErrZSTDDeflateInvalid =
+	"Invalid zstd deflate Stream operation '%s'!";
+static const char *ErrZSTDInflateInvalid =
+	"Invalid zstd inflate Stream operation '%s'!";
+static const char *ErrZSTDDeflateClosed =
+	"zstd deflate stream has been closed.";
 
-CdXZEncoder::CdXZEncoder(CdStream &Dest, TLevel Level):
-	CdBaseXZStream(Dest), CdRecodeLevel(Level)
+static int ZSTDLevels[6] =
 {
-	PtrExtRec = NULL;
-	fHaveClosed = false;
-	InitXZStream();
+	1,   // clMin
+	3,   // clFast
+	9,   // clDefault
+	19,  // clMax
+	22,  // clUltra
+	22   // clUltraMax, with a 1GB window and long distance matching
+};
+
+/// the maximum window size in the decoder, 2^30
+#define ZSTD_WINDOW_LOG_MAX    30
+
+COREARRAY_INLINE static size_t ZSTDCheck(size_t code)
+{
+	if (ZSTD_isError(code))
+		throw EZSTDError("ZSTD: %s", ZSTD_getErrorName(code));
+	return code;
 }
 
-CdXZEncoder::CdXZEncoder(CdStream &Dest, int DictKB):
-	CdBaseXZStream(Dest), CdRecodeLevel(clCustom)
+
+// CdZSTDEncoder
+
+CdZSTDEncoder::CdZSTDEncoder(CdStream &Dest, TLevel Level):
+	CdRecodeStream(Dest), CdRecodeLevel(Level)
 {
 	PtrExtRec = NULL;
 	fHaveClosed = false;
-	if (DictKB < 128 || DictKB > 1572864)  // 128KiB min, 1536MiB max
-		throw EXZError("CdXZEncoder initialization error (DictKB: %d).", DictKB);
-
-	lzma_options_lzma opt_lzma;
-	if (lzma_lzma_preset(&opt_lzma, 9 | LZMA_PRESET_EXTREME))
-		throw EXZError("CdXZEncoder initialization internal error.");
-	opt_lzma.dict_size = DictKB * 1024;
-
-	lzma_filter filters[2];
-	filters[0].id = LZMA_FILTER_LZMA2;
-	filters[0].options = &opt_lzma;
-	filters[1].id = LZMA_VLI_UNKNOWN;
-	XZCheck(lzma_stream_encoder(&fXZStream, filters, LZMA_CHECK_CRC32));
+	fZStream = ZSTD_createCCtx();
+	if (!fZStream)
+		throw EZSTDError("ZSTD: cannot allocate memory");
+	InitZSTDStream(fZStream, fLevel);
 }
 
-CdXZEncoder::~CdXZEncoder()
+CdZSTDEncoder::~CdZSTDEncoder()
 {
 	Close();
-	lzma_end(&fXZStream);
+	ZSTD_freeCCtx(fZStream);
 }
 
-void CdXZEncoder::InitXZStream()
+void CdZSTDEncoder::InitZSTDStream(ZSTD_CCtx *ZS, TLevel Level)
 {
-	if (clMin<=fLevel && fLevel<=clMax)
-	{
-		XZCheck(lzma_easy_encoder(&fXZStream, XZLevels[fLevel],
-			LZMA_CHECK_CRC32));
-	} else if (fLevel==clUltra || fLevel==clUltraMax)
+	if (Level<clMin || Level>clUltraMax)
+		throw EZSTDError("CdZSTDEncoder initialization level error.");
+	ZSTDCheck(ZSTD_CCtx_setParameter(ZS, ZSTD_c_compressionLevel,
+		ZSTDLevels[Level]));
+	if (Level == clUltraMax)
 	{
-		lzma_options_lzma opt_lzma;
-		if (lzma_lzma_preset(&opt_lzma, 9 | LZMA_PRESET_EXTREME))
-			throw EXZError("CdXZEncoder initialization internal error.");
-		opt_lzma.dict_size = (fLevel==clUltra) ? 512*1024*1024 : (1024+512)*1024*1024; // 512MiB : 1.5GB
-		opt_lzma.depth = (fLevel==clUltra) ?  512*8: 65536;  // -9e with 512
-		lzma_filter filters[2];
-		filters[0].id = LZMA_FILTER_LZMA2;
-		filters[0].options = &opt_lzma;
-		filters[1].id = LZMA_VLI_UNKNOWN;
-		XZCheck(lzma_stream_encoder(&fXZStream, filters, LZMA_CHECK_CRC32));
-	} else
-		throw EXZError("CdXZEncoder initialization level error.");
+		ZSTDCheck(ZSTD_CCtx_setParameter(ZS, ZSTD_c_windowLog,
+			ZSTD_WINDOW_LOG_MAX));
+		ZSTDCheck(ZSTD_CCtx_setParameter(ZS,
+			ZSTD_c_enableLongDistanceMatching, 1));
+	}
 }
 
-ssize_t CdXZEncoder::Read(void *Buffer, ssize_t Count)
+ssize_t CdZSTDEncoder::Read(void *Buffer, ssize_t Count)
 {
-	throw EXZError(ErrXZInflateInvalid, "Read");
+	throw EZSTDError(ErrZSTDInflateInvalid, "Read");
 }
 
-ssize_t CdXZEncoder::Write(const void *Buffer, ssize_t Count)
+ssize_t CdZSTDEncoder::Write(const void *Buffer, ssize_t Count)
 {
 	if (fHaveClosed)
-		throw EXZError(ErrXZDeflateClosed);
+		throw EZSTDError(ErrZSTDDeflateClosed);
 	if (Count <= 0) return 0;
 
 	C_UInt8 buf[65536];
-	fXZStream.next_in = (const C_UInt8 *)Buffer;
-	fXZStream.avail_in = Count;
-	ssize_t L = fXZStream.avail_in;
+	ZSTD_inBuffer in = { Buffer, (size_t)Count, 0 };
 
-	while (fXZStream.avail_in > 0)
+	while (in.pos < in.size)
 	{
-		fXZStream.avail_out = sizeof(buf);
-		fXZStream.next_out = buf;
-
-		XZCheck(lzma_code(&fXZStream, LZMA_RUN));
-		fTotalIn += L - fXZStream.avail_in;
-		L = fXZStream.avail_in;
+		ZSTD_outBuffer out = { buf, sizeof(buf), 0 };
+		size_t L = in.pos;
+		ZSTDCheck(ZSTD_compressStream2(fZStream, &out, &in, ZSTD_e_continue));
+		fTotalIn += in.pos - L;
 
-		size_t nout = sizeof(buf) - fXZStream.avail_out;
-		if (nout > 0)
+		if (out.pos > 0)
 		{
 			UpdateStreamPosition();
-			fStream->WriteData(buf, nout);
-			fStreamPos += nout;
-			fTotalOut += nout;
+			fStream->WriteData(buf, out.pos);
+			fStreamPos += out.pos;
+			fTotalOut += out.pos;
 		}
-    }
+	}
 
 	return Count;
 }
 
-SIZE64 CdXZEncoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
+SIZE64 CdZSTDEncoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
 {
 	switch (Origin)
 	{
@@ -2353,16 +5256,16 @@ SIZE64 CdXZEncoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
 			if (Offset == 0) return fTotalIn;
 			break;
 	}
-	throw EXZError(ErrXZInflateInvalid, "Seek");
+	throw EZSTDError(ErrZSTDInflateInvalid, "Seek");
 }
 
-void CdXZEncoder::SetSize(SIZE64 NewSize)
+void CdZSTDEncoder::SetSize(SIZE64 NewSize)
 {
 	if (NewSize != fTotalIn)
-		throw EXZError(ErrXZDeflateInvalid, "SetSize");
+		throw EZSTDError(ErrZSTDDeflateInvalid, "SetSize");
 }
 
-void CdXZEncoder::Close()
+void CdZSTDEncoder::Close()
 {
 	if (!fHaveClosed)
 	{
@@ -2377,87 +5280,94 @@ void CdXZEncoder::Close()
 	}
 }
 
-void CdXZEncoder::SyncFinish()
+void CdZSTDEncoder::SyncFinish()
 {
 	C_UInt8 buffer[65536];
-	lzma_ret ret = LZMA_OK;
+	ZSTD_inBuffer in = { NULL, 0, 0 };
+	size_t remaining = 1;
 
-	while (ret != LZMA_STREAM_END)
+	while (remaining > 0)
 	{
-		fXZStream.avail_out = sizeof(buffer);
-		fXZStream.next_out = buffer;
-
-		ret = lzma_code(&fXZStream, LZMA_FINISH);
-		if (ret != LZMA_STREAM_END) XZCheck(ret);
-
-		size_t nout = sizeof(buffer) - fXZStream.avail_out;
-		if (nout > 0)
+		ZSTD_outBuffer out = { buffer, sizeof(buffer), 0 };
+		remaining = ZSTDCheck(ZSTD_compressStream2(fZStream, &out, &in,
+			ZSTD_e_end));
+		if (out.pos > 0)
 		{
 			UpdateStreamPosition();
-			fStream->WriteData(buffer, nout);
-			fStreamPos += nout;
-			fTotalOut += nout;
+			fStream->WriteData(buffer, out.pos);
+			fStreamPos += out.pos;
+			fTotalOut += out.pos;
 		}
 	}
 }
 
-ssize_t CdXZEncoder::Pending()
+ssize_t CdZSTDEncoder::Pending()
 {
 	return 0;
 }
 
 
-// CdXZDecoder
-
-#define XZ_DECODER_FLAG    LZMA_TELL_UNSUPPORTED_CHECK
+// CdZSTDDecoder
 
-CdXZDecoder::CdXZDecoder(CdStream &Source): CdBaseXZStream(Source)
+CdZSTDDecoder::CdZSTDDecoder(CdStream &Source): CdRecodeStream(Source)
 {
-	fXZStream.avail_in = 0;
+	fZStream = ZSTD_createDCtx();
+	if (!fZStream)
+		throw EZSTDError("ZSTD: cannot allocate memory");
+	InitZSTDStream(fZStream);
+	fInput.src = fBuffer;
+	fInput.size = fInput.pos = 0;
 	fCurPosition = 0;
-	XZCheck(lzma_stream_decoder(&fXZStream, UINT64_MAX, XZ_DECODER_FLAG));
 }
 
-CdXZDecoder::~CdXZDecoder()
+CdZSTDDecoder::~CdZSTDDecoder()
 {
-	lzma_end(&fXZStream);
+	ZSTD_freeDCtx(fZStream);
 }
 
-ssize_t CdXZDecoder::Read(void *Buffer, ssize_t Count)
+void CdZSTDDecoder::InitZSTDStream(ZSTD_DCtx *ZS)
+{
+	ZSTDCheck(ZSTD_DCtx_setParameter(ZS, ZSTD_d_windowLogMax,
+		ZSTD_WINDOW_LOG_MAX));
+}
+
+void CdZSTDDecoder::ResetZSTDStream()
+{
+	ZSTDCheck(ZSTD_DCtx_reset(fZStream, ZSTD_reset_session_only));
+	fInput.size = fInput.pos = 0;
+}
+
+ssize_t CdZSTDDecoder::Read(void *Buffer, ssize_t Count)
 {
 	ssize_t OriCount = Count;
 	C_UInt8 *pBuffer = (C_UInt8 *)Buffer;
-	lzma_ret ret = LZMA_OK;
+	size_t ret = 1;
 
-	while ((Count > 0) && (ret != LZMA_STREAM_END))
+	while ((Count > 0) && (ret != 0))
 	{
-		if (fXZStream.avail_in <= 0)
+		if (fInput.pos >= fInput.size)
 		{
 			UpdateStreamPosition();
-			fXZStream.avail_in = fStream->Read(fBuffer, sizeof(fBuffer));
-			if (fXZStream.avail_in <= 0)
+			ssize_t n = fStream->Read(fBuffer, sizeof(fBuffer));
+			if (n <= 0)
 				return OriCount - Count;
-			fStreamPos += fXZStream.avail_in;
-			fXZStream.next_in = fBuffer;
+			fStreamPos += n;
+			fInput.size = n; fInput.pos = 0;
 		}
 
-		fXZStream.avail_out = Count;
-		fXZStream.next_out = pBuffer;
-		ret = lzma_code(&fXZStream, LZMA_RUN);
-		if (ret != LZMA_STREAM_END)
-			XZCheck(ret);
+		ZSTD_outBuffer out = { pBuffer, (size_t)Count, 0 };
+		ret = ZSTDCheck(ZSTD_decompressStream(fZStream, &out, &fInput));
 
-		ssize_t n = Count - fXZStream.avail_out;
-		fCurPosition += n;
-		pBuffer += n;
-		Count -= n;
+		fCurPosition += out.pos;
+		pBuffer += out.pos;
+		Count -= out.pos;
 	}
 
-	if ((ret==LZMA_STREAM_END) && (fXZStream.avail_in>0))
+	if ((ret == 0) && (fInput.pos < fInput.size))
 	{
-		fStreamPos -= fXZStream.avail_in;
+		fStreamPos -= fInput.size - fInput.pos;
 		fStream->SetPosition(fStreamPos);
-		fXZStream.avail_in = 0;
+		fInput.size = fInput.pos = 0;
 	}
 
 	SIZE64 tmp = fStreamPos - fStreamBase;
@@ -2467,19 +5377,17 @@ ssize_t CdXZDecoder::Read(void *Buffer, ssize_t Count)
 	return OriCount - Count;
 }
 
-ssize_t CdXZDecoder::Write(const void *Buffer, ssize_t Count)
+ssize_t CdZSTDDecoder::Write(const void *Buffer, ssize_t Count)
 {
-	throw EXZError(ErrXZInflateInvalid, "Write");
+	throw EZSTDError(ErrZSTDInflateInvalid, "Write");
 }
 
-SIZE64 CdXZDecoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
+SIZE64 CdZSTDDecoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
 {
 	if ((Offset==0) && (Origin==soBeginning))
 	{
 		if (fCurPosition == 0) return 0;
-		lzma_end(&fXZStream);
-		XZCheck(lzma_stream_decoder(&fXZStream, UINT64_MAX, XZ_DECODER_FLAG));
-		fXZStream.avail_in = 0;
+		ResetZSTDStream();
 		fStream->SetPosition(fStreamPos = fStreamBase);
 		return (fCurPosition = 0);
 	} else if (Origin != soEnd)
@@ -2499,43 +5407,54 @@ SIZE64 CdXZDecoder::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
 			ReadData(buffer, sizeof(buffer));
 		ReadData(buffer, Offset % sizeof(buffer));
 	} else
-		throw EXZError(ErrXZInflateInvalid, "Seek");
+		throw EZSTDError(ErrZSTDInflateInvalid, "Seek");
 
 	return fCurPosition;
 }
 
-SIZE64 CdXZDecoder::GetSize()
+SIZE64 CdZSTDDecoder::GetSize()
 {
 	return -1;
 }
 
-void CdXZDecoder::SetSize(SIZE64 NewSize)
+void CdZSTDDecoder::SetSize(SIZE64 NewSize)
 {
-	throw EXZError(ErrXZInflateInvalid, "SetSize");
+	throw EZSTDError(ErrZSTDInflateInvalid, "SetSize");
 }
 
 
 
 // =====================================================================
-// Input stream for xz/lzma with the support of random access
+// Input stream for zstd with the support of random access
 
-#define XZ_RA_MAGIC_HEADER_SIZE     6
-static const C_UInt8 XZ_RA_MAGIC_HEADER[XZ_RA_MAGIC_HEADER_SIZE] =
-	{ 'X', 'Z', '_', 'R', 'A', 0x10 };
+#define ZSTD_RA_MAGIC_HEADER_SIZE     6
+static const C_UInt8 ZSTD_RA_MAGIC_HEADER[ZSTD_RA_MAGIC_HEADER_SIZE] =
+	{ 'Z', 'S', '_', 'R', 'A', 0x10 };
 
 
-CdXZEncoder_RA::CdXZEncoder_RA(CdStream &Dest, TLevel Level,
-	TBlockSize B): CdRA_Write(this, B), CdXZEncoder(Dest, Level)
+CdZSTDEncoder_RA::CdZSTDEncoder_RA(CdStream &Dest, TLevel Level,
+	TBlockSize B): CdRA_Write(this, B), CdZSTDEncoder(Dest, Level)
 {
 	fBlockZIPSize = fCurBlockZIPSize = RA_BLOCK_SIZE_LIST[B];
 	InitWriteStream();
 }
 
-ssize_t CdXZEncoder_RA::Write(const void *Buffer, ssize_t Count)
+CdZSTDEncoder_RA::~CdZSTDEncoder_RA()
+{
+	// the helper threads call CompressBlock()
+	ParallelEnd();
+}
+
+ssize_t CdZSTDEncoder_RA::Write(const void *Buffer, ssize_t Count)
 {
 	if (fHaveClosed)
-		throw EXZError(ErrZDeflateClosed);
+		throw EZSTDError(ErrZSTDDeflateClosed);
 	if (Count <= 0) return 0;
+	if (fPool)
+	{
+		ParallelWrite(Buffer, Count);
+		return Count;
+	}
 
 	C_UInt8 buf[8192];
 	ssize_t OldCount = Count;
@@ -2545,36 +5464,32 @@ ssize_t CdXZEncoder_RA::Write(const void *Buffer, ssize_t Count)
 	{
 		InitWriteBlock();
 
-		fXZStream.next_in = pBuf;
-		fXZStream.avail_in = Count;
-		fXZStream.next_out = buf;
-		fXZStream.avail_out = sizeof(buf);
-
-		while (fXZStream.avail_in > 0)
+		ZSTD_inBuffer in = { pBuf, (size_t)Count, 0 };
+		while (in.pos < in.size)
 		{
-			XZCheck(lzma_code(&fXZStream, LZMA_RUN));
-			ssize_t L = Count - fXZStream.avail_in;
+			ZSTD_outBuffer out = { buf, sizeof(buf), 0 };
+			size_t L0 = in.pos;
+			ZSTDCheck(ZSTD_compressStream2(fZStream, &out, &in,
+				ZSTD_e_continue));
+			ssize_t L = in.pos - L0;
 			fTotalIn += L;
 			pBuf += L;
-			Count = fXZStream.avail_in;
+			Count -= L;
 
 			// have something output
-			ssize_t n  = sizeof(buf) - fXZStream.avail_out;
-			if (n > 0)
+			if (out.pos > 0)
 			{
 				UpdateStreamPosition();
-				fStream->WriteData(buf, n);
-				fStreamPos += n;
-				fXZStream.next_out = buf;
-				fXZStream.avail_out = sizeof(buf);
-				fCurBlockZIPSize -= n;
+				fStream->WriteData(buf, out.pos);
+				fStreamPos += out.pos;
+				fCurBlockZIPSize -= out.pos;
 
-				if ((fCurBlockZIPSize - Pending() <= 0) ||
+				if ((fCurBlockZIPSize <= 0) ||
 					(fTotalIn - fCB_UZStart >= 0xF8000000))
 				{
-					// finish this block
-					// 'fZStream.avail_in = 0' in SyncFinishBlock()
+					// finish this frame, and start a new block
 					SyncFinishBlock();
+					break;
 				}
 			}
 		}
@@ -2584,7 +5499,7 @@ ssize_t CdXZEncoder_RA::Write(const void *Buffer, ssize_t Count)
 	return OldCount - Count;
 }
 
-void CdXZEncoder_RA::Close()
+void CdZSTDEncoder_RA::Close()
 {
 	if (!fHaveClosed)
 	{
@@ -2600,30 +5515,53 @@ void CdXZEncoder_RA::Close()
 	}
 }
 
-void CdXZEncoder_RA::WriteMagicNumber(CdStream &Stream)
+void CdZSTDEncoder_RA::WriteMagicNumber(CdStream &Stream)
 {
-	Stream.WriteData(XZ_RA_MAGIC_HEADER, XZ_RA_MAGIC_HEADER_SIZE);
+	Stream.WriteData(ZSTD_RA_MAGIC_HEADER, ZSTD_RA_MAGIC_HEADER_SIZE);
 }
 
-void CdXZEncoder_RA::SyncFinishBlock()
+void CdZSTDEncoder_RA::SyncFinishBlock()
 {
-	if (fHasInitWriteBlock)
+	if (fPool)
 	{
-		fXZStream.avail_in = 0;
+		ParallelFlush();
+	} else if (fHasInitWriteBlock)
+	{
+		// the context is ready for a new frame after ZSTD_e_end
 		SyncFinish();
 		DoneWriteBlock();
 		fCurBlockZIPSize = fBlockZIPSize;
-		lzma_end(&fXZStream);
-		InitXZStream();
 	}
 }
 
-void CdXZEncoder_RA::CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count)
+void CdZSTDEncoder_RA::CompressBlock(const C_UInt8 *Raw, ssize_t Len,
+	vector<C_UInt8> &Out)
 {
-	if (dynamic_cast<CdXZDecoder_RA*>(&Source))
+	// a zstd context with the same parameters as fZStream
+	ZSTD_CCtx *ZS = ZSTD_createCCtx();
+	if (!ZS)
+		throw EZSTDError("ZSTD: cannot allocate memory");
+	size_t ret;
+	try {
+		InitZSTDStream(ZS, fLevel);
+		Out.resize(ZSTD_compressBound(Len));
+		ret = ZSTD_compress2(ZS, &Out[0], Out.size(), Raw, Len);
+	}
+	catch (...) {
+		ZSTD_freeCCtx(ZS);
+		throw;
+	}
+	ZSTD_freeCCtx(ZS);
+	Out.resize(ZSTDCheck(ret));
+}
+
+void CdZSTDEncoder_RA::CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count)
+{
+	if (dynamic_cast<CdZSTDDecoder_RA*>(&Source))
 	{
-		CdXZDecoder_RA *Src = static_cast<CdXZDecoder_RA*>(&Source);
-		if ((Src->SizeType() == SizeType()) && (Src->fVersion == fVersion))
+		CdZSTDDecoder_RA *Src = static_cast<CdZSTDDecoder_RA*>(&Source);
+		if ((Src->SizeType() == SizeType()) && (Src->fVersion == fVersion) &&
+			SameBlockFormat(*Src))
 		{
 			Src->SetPosition(Pos);
 			if (Count < 0)
@@ -2661,7 +5599,7 @@ void CdXZEncoder_RA::CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count)
 					{
 						ZSize += Src->fCB_ZSize;
 						USize += Src->fCB_UZSize;
-						AddBlockInfo(Src->fCB_ZSize, Src->fCB_UZSize);
+						CopyBlockInfo(*Src);
 						Count -= Src->fCB_UZSize;
 						Pos += Src->fCB_UZSize;
 						Src->NextBlock();
@@ -2695,15 +5633,29 @@ void CdXZEncoder_RA::CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count)
 
 // =====================================================================
 
-CdXZDecoder_RA::CdXZDecoder_RA(CdStream &Source): CdRA_Read(this),
-	CdXZDecoder(Source)
+CdZSTDDecoder_RA::CdZSTDDecoder_RA(CdStream &Source): CdRA_Read(this),
+	CdZSTDDecoder(Source)
 {
 	InitReadStream();
 }
 
-ssize_t CdXZDecoder_RA::Read(void *Buffer, ssize_t Count)
+CdZSTDDecoder_RA::~CdZSTDDecoder_RA()
+{
+	ParallelEnd();
+}
+
+ssize_t CdZSTDDecoder_RA::Read(void *Buffer, ssize_t Count)
 {
 	if (Count <= 0) return 0;
+	if (fTracing) TraceRead(fCurPosition, Count);
+	if (!fPatch.empty()) return PatchRead(Buffer, Count, fCurPosition);
+	if (fPool) return ParallelRead(Buffer, Count, fCurPosition);
+	if (fCacheData)
+	{
+		ssize_t L = CacheRead(Buffer, Count, fCurPosition);
+		if (L >= Count) return L;
+		return L + Read((C_UInt8*)Buffer + L, Count - L);
+	}
 	if (fBlockIdx >= fBlockNum) return 0;
 
 	ssize_t OriCount = Count;
@@ -2711,47 +5663,45 @@ ssize_t CdXZDecoder_RA::Read(void *Buffer, ssize_t Count)
 
 	while (Count > 0)
 	{
-		lzma_ret ret = LZMA_OK;
+		size_t ret = 1;
 
-		while ((Count > 0) && (ret != LZMA_STREAM_END))
+		while ((Count > 0) && (ret != 0))
 		{
-			if (fXZStream.avail_in <= 0)
+			if (fInput.pos >= fInput.size)
 			{
 				UpdateStreamPosition();
 				ssize_t n = fCB_ZSize - (fStreamPos - fCB_ZStart);
 				if (n > (ssize_t)sizeof(fBuffer)) n = sizeof(fBuffer);
-				if (n < 0) n = 0;
-				fXZStream.avail_in = fStream->Read(fBuffer, n);
-				if (fXZStream.avail_in <= 0)
-					return OriCount - Count;
-				fStreamPos += fXZStream.avail_in;
-				fXZStream.next_in = fBuffer;
+				if (n > 0)
+				{
+					n = fStream->Read(fBuffer, n);
+					if (n <= 0)
+						return OriCount - Count;
+					fStreamPos += n;
+				} else
+					n = 0;  // let the decoder end the frame
+				fInput.size = n; fInput.pos = 0;
 			}
 
-			fXZStream.avail_out = Count;
-			fXZStream.next_out = pBuffer;
-			ret = lzma_code(&fXZStream, LZMA_RUN);
-			if (ret != LZMA_STREAM_END)
-				XZCheck(ret);
+			ZSTD_outBuffer out = { pBuffer, (size_t)Count, 0 };
+			ret = ZSTDCheck(ZSTD_decompressStream(fZStream, &out, &fInput));
+			if ((ret != 0) && (out.pos == 0) && (fInput.size == 0))
+				throw EZSTDError("Invalid ZSTD block, inconsistent length.");
 
-			ssize_t n = Count - fXZStream.avail_out;
-			fCurPosition += n;
-			pBuffer += n;
-			Count -= n;
+			fCurPosition += out.pos;
+			pBuffer += out.pos;
+			Count -= out.pos;
 		}
 
-		if (ret == LZMA_STREAM_END)
+		if (ret == 0)
 		{
 			if ((fCurPosition-fCB_UZStart) != fCB_UZSize)
-				throw EXZError("Invalid XZ block, inconsistent length.");
+				throw EZSTDError("Invalid ZSTD block, inconsistent length.");
 
 			// go to the next block
 			if (NextBlock())
-			{
-				lzma_end(&fXZStream);
-				XZCheck(lzma_stream_decoder(&fXZStream, UINT64_MAX, XZ_DECODER_FLAG));
-				fXZStream.avail_in = 0;
-			} else
+				ResetZSTDStream();
+			else
 				break;
 		}
 	}
@@ -2763,53 +5713,91 @@ ssize_t CdXZDecoder_RA::Read(void *Buffer, ssize_t Count)
 	return OriCount - Count;
 }
 
-SIZE64 CdXZDecoder_RA::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
+SIZE64 CdZSTDDecoder_RA::Seek(SIZE64 Offset, TdSysSeekOrg Origin)
 {
 	if (Origin == soCurrent)
 	{
 		Offset += fCurPosition;
 		if (Offset < 0)
-			throw EXZError(ErrXZInflateInvalid, "Seek");
+			throw EZSTDError(ErrZSTDInflateInvalid, "Seek");
 	} else if (Origin == soEnd)
-		throw EXZError(ErrXZInflateInvalid, "Seek");
+		throw EZSTDError(ErrZSTDInflateInvalid, "Seek");
+
+	if (!fPatch.empty())
+		return (fCurPosition = Offset);
+	if (fPool)
+	{
+		ParallelSeek(Offset);
+		return (fCurPosition = Offset);
+	}
 
 	bool flag = SeekStream(Offset);
+	if (fCacheData && !flag)
+		return (fCurPosition = Offset);
 	if (flag || (Offset < fCurPosition))
+	{
+		// use the decompressed block in the shared cache
+		if (CacheSeek())
+			return (fCurPosition = Offset);
 		Reset();
+	}
 
 	Offset -= fCurPosition;
 	if (Offset > 0)
 	{
+		// skipping is not a reading in the access trace
+		bool tracing = fTracing;
+		fTracing = false;
 		C_UInt8 buffer[4096];
 		SIZE64 DivI = Offset / sizeof(buffer);
 		for (; DivI > 0; DivI--)
 			ReadData(buffer, sizeof(buffer));
 		ReadData(buffer, Offset % sizeof(buffer));
+		fTracing = tracing;
 	} else if (Offset < 0)
-		throw EXZError(ErrXZInflateInvalid, "Seek");
+		throw EZSTDError(ErrZSTDInflateInvalid, "Seek");
 
 	return fCurPosition;
 }
 
-bool CdXZDecoder_RA::ReadMagicNumber(CdStream &Stream)
+ssize_t CdZSTDDecoder_RA::Write(const void *Buffer, ssize_t Count)
 {
-	C_UInt8 Header[XZ_RA_MAGIC_HEADER_SIZE];
+	return PatchWrite(Buffer, Count, fCurPosition);
+}
+
+bool CdZSTDDecoder_RA::ReadMagicNumber(CdStream &Stream)
+{
+	C_UInt8 Header[ZSTD_RA_MAGIC_HEADER_SIZE];
 	Stream.SetPosition(fStreamBase);
 	Stream.ReadData(Header, sizeof(Header));
-	return (memcmp(Header, XZ_RA_MAGIC_HEADER, XZ_RA_MAGIC_HEADER_SIZE) == 0);
+	return (memcmp(Header, ZSTD_RA_MAGIC_HEADER, ZSTD_RA_MAGIC_HEADER_SIZE) == 0);
 }
 
-void CdXZDecoder_RA::Reset()
+void CdZSTDDecoder_RA::Reset()
 {
-	lzma_end(&fXZStream);
-	XZCheck(lzma_stream_decoder(&fXZStream, UINT64_MAX, XZ_DECODER_FLAG));
-	fXZStream.avail_in = 0;
+	CacheEnd();
+	ResetZSTDStream();
 	fStreamPos = fCB_ZStart;
 	if (fVersion == 0x10)
 		fStreamPos += SIZE_RA_BLOCK_HEADER;
 	fCurPosition = fCB_UZStart;
 }
 
+void CdZSTDDecoder_RA::DecompressBlock(const C_UInt8 *Cmp, ssize_t CmpLen,
+	C_UInt8 *Raw, ssize_t RawLen)
+{
+	ZSTD_DCtx *ZS = ZSTD_createDCtx();
+	if (!ZS)
+		throw EZSTDError("ZSTD: cannot allocate memory");
+	size_t ret = ZSTD_DCtx_setParameter(ZS, ZSTD_d_windowLogMax,
+		ZSTD_WINDOW_LOG_MAX);
+	if (!ZSTD_isError(ret))
+		ret = ZSTD_decompressDCtx(ZS, Raw, RawLen, Cmp, CmpLen);
+	ZSTD_freeDCtx(ZS);
+	if (ZSTDCheck(ret) != (size_t)RawLen)
+		throw EZSTDError("Invalid ZSTD block, inconsistent length.");
+}
+
 #endif
 
 
@@ -2821,6 +5809,8 @@ static const char *ErrBlockInvalidPos =
 	"Invalid Position: %lld in CdBlockStream (current blocksize: %lld).";
 static const char *ErrInvalidBlockLength =
 	"Invalid block length in CdBlockCollection!";
+static const char *ErrMoveBlock =
+	"Fail to move the block stream (id: %x) in compaction.";
 
 // CoreArray GDS Stream position mask
 const C_Int64 CoreArray::GDS_STREAM_POS_MASK = 0x7FFFFFFFFFFFLL;
@@ -2917,6 +5907,10 @@ ssize_t CdBlockStream::Read(void *Buffer, ssize_t Count)
 		CdStream *vStream = fCollection.Stream();
 		if (!vStream) return 0;
 
+		// the memory-mapped view of the file, or NULL
+		const C_UInt8 *base = fCollection.fMapMemory;
+		const SIZE64 base_size = fCollection.fMapSize;
+
 		char *p = (char*)Buffer;
 		SIZE64 I, L;
 		ssize_t RL;
@@ -2925,15 +5919,25 @@ ssize_t CdBlockStream::Read(void *Buffer, ssize_t Count)
 			L = fCurrent->BlockSize - I;
 			if (Count < L)
 			{
-				vStream->SetPosition(fCurrent->StreamStart + I);
-				RL = vStream->Read((void*)p, Count);
+				SIZE64 st = fCurrent->StreamStart + I;
+				if (base && (st + Count <= base_size))
+				{
+					memcpy(p, base + st, Count);
+					RL = Count;
+				} else
+					RL = vStream->ReadAt(st, (void*)p, Count);
 				fPosition += RL;
 				break;
 			} else {
 				if (L > 0)
 				{
-					vStream->SetPosition(fCurrent->StreamStart + I);
-					RL = vStream->Read((void*)p, L);
+					SIZE64 st = fCurrent->StreamStart + I;
+					if (base && (st + L <= base_size))
+					{
+						memcpy(p, base + st, L);
+						RL = L;
+					} else
+						RL = vStream->ReadAt(st, (void*)p, L);
 					Count -= RL; fPosition += RL; p += RL;
 					if (RL != L) break;
                 }
@@ -2949,6 +5953,7 @@ ssize_t CdBlockStream::Read(void *Buffer, ssize_t Count)
 
 ssize_t CdBlockStream::Write(const void *Buffer, ssize_t Count)
 {
+	TdAutoMutex _m(fCollection._WriteMutex());
 	SIZE64 LastPos = fPosition;
 
 	if (Count > 0)
@@ -2967,14 +5972,13 @@ ssize_t CdBlockStream::Write(const void *Buffer, ssize_t Count)
 			L = fCurrent->BlockSize - I;
 			if (Count < L)
 			{
-				vStream->SetPosition(fCurrent->StreamStart + I);
-				fPosition += vStream->Write(p, Count);
+				fPosition += vStream->WriteAt(fCurrent->StreamStart + I,
+					p, Count);
 				break;
 			} else {
 				if (L > 0)
 				{
-					vStream->SetPosition(fCurrent->StreamStart + I);
-					RL = vStream->Write(p, L);
+					RL = vStream->WriteAt(fCurrent->StreamStart + I, p, L);
 					Count -= RL; fPosition += RL; p += RL;
 					if (RL != L) break;
 				}
@@ -3038,6 +6042,7 @@ SIZE64 CdBlockStream::GetSize() const
 
 void CdBlockStream::SetSize(SIZE64 NewSize)
 {
+	TdAutoMutex _m(fCollection._WriteMutex());
 	if ((0<=NewSize) && (NewSize!=fBlockSize))
 	{
 		if (NewSize > fBlockCapacity)
@@ -3057,6 +6062,7 @@ void CdBlockStream::SetSize(SIZE64 NewSize)
 
 void CdBlockStream::SetSizeOnly(SIZE64 NewSize)
 {
+	TdAutoMutex _m(fCollection._WriteMutex());
 	if ((0<=NewSize) && (NewSize!=fBlockSize))
 	{
 		if (NewSize > fBlockCapacity)
@@ -3082,225 +6088,849 @@ bool CdBlockStream::ReadOnly() const
 
 int CdBlockStream::ListCount() const
 {
-	int rv = 0;
-	TBlockInfo *p = fList;
-	while (p != NULL) { p = p->Next; rv++; }
+	return fExtent.size();
+}
+
+void CdBlockStream::SyncSizeInfo()
+{
+	if (fNeedSyncSize)
+	{
+		TdAutoMutex _m(fCollection._WriteMutex());
+		if (fList)
+		{
+			if (fCollection.fTocBlock)
+				fCollection._DropTOC();
+			CdStream *s = fCollection.Stream();
+			s->SetPosition(fList->StreamStart - GDS_POS_SIZE);
+			BYTE_LE<CdStream>(*s) << TdGDSPos(fBlockSize);
+        }
+    	fNeedSyncSize = false;
+	}
+}
+
+CdBlockStream::TBlockInfo *CdBlockStream::_FindCur(const SIZE64 Pos)
+{
+	if ((Pos < fBlockCapacity) && !fExtent.empty())
+	{
+		// the current block or the next one, for sequential access
+		TBlockInfo *p = fCurrent;
+		if (p && (p->BlockStart <= Pos))
+		{
+			if (Pos < p->BlockStart + p->BlockSize)
+				return p;
+			p = p->Next;
+			if (p && (Pos < p->BlockStart + p->BlockSize))
+				return p;
+		}
+
+		// binary search, the last block with BlockStart <= Pos
+		size_t lo = 0, hi = fExtent.size();
+		while (hi - lo > 1)
+		{
+			size_t mid = (lo + hi) >> 1;
+			if (fExtent[mid]->BlockStart <= Pos)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		return fExtent[lo];
+	} else
+		return NULL;
+}
+
+void CdBlockStream::_RebuildExtent()
+{
+	fExtent.clear();
+	for (TBlockInfo *p=fList; p != NULL; p = p->Next)
+		fExtent.push_back(p);
+}
+
+
+// =====================================================================
+// CdBlockCollection
+
+CdBlockCollection::CdBlockCollection(const SIZE64 vCodeStart):
+	CdAbstract(), fMutex(true)
+{
+	fStream = NULL;
+	fStreamSize = 0;
+	fUnuse = NULL;
+	vNextID = 1; // start from 1
+	fCodeStart = vCodeStart;
+	fClassMgr = &dObjManager();
+	fReadOnly = false;
+	fReadAhead = false;
+	fWriteBehind = false;
+	fCompressThreads = 0;
+	fDecompressThreads = 0;
+	fMapMemory = NULL;
+	fMapSize = 0;
+	fTocBlock = NULL;
+	fGrowthRatio = 0;
+	fGrowthMaxSize = 0;
+	fPreallocate = false;
+}
+
+CdBlockCollection::~CdBlockCollection()
+{
+	Clear();
+}
+
+// the remaining part of a reused block smaller than it is not split off
+static const SIZE64 FREE_SPLIT_MIN_SIZE = 2*GDS_POS_SIZE + 1024;
+// the buffer size for moving a stream in compaction
+static const ssize_t COMPACT_BUFFER_SIZE = 1024*1024;
+
+void CdBlockCollection::_IncStreamSize(CdBlockStream &Block,
+	const SIZE64 NewCapacity)
+{
+	// NewCapacity > fBlockCapacity
+	if (fTocBlock) _DropTOC();
+	if (Block.fList != NULL)
+	{
+		CdBlockStream::TBlockInfo *p = Block.fExtent.back();
+		SIZE64 L = p->BlockSize + p->StreamStart;
+
+		// to check if it is the last block
+		if (L == fStreamSize)
+		{
+			// immediately increase size of the original stream
+			SIZE64 Grow = _GrowSize(Block, NewCapacity - Block.fBlockCapacity);
+			_SetStreamSize(L + Grow);
+			// set size
+			p->SetSize(*fStream, p->BlockSize + Grow);
+			Block.fBlockCapacity += Grow;
+			// check Block.fCurrent
+			if (Block.fCurrent == NULL)
+				Block.fCurrent = p;
+		} else if (L < fStreamSize)
+		{
+			const SIZE64 Need = NewCapacity - Block.fBlockCapacity;
+			const SIZE64 Grow = _GrowSize(Block, Need);
+
+			// to check if it is followed by an unused block
+			map<SIZE64, PdBlockStream_BlockInfo>::iterator it =
+				fFreePos.find(L);
+			if (it != fFreePos.end())
+			{
+				CdBlockStream::TBlockInfo *u = it->second;
+				const SIZE64 Avail = 2*GDS_POS_SIZE + u->BlockSize;
+				if (Avail >= Need)
+				{
+					// extend the last block in place
+					_EraseFree(u);
+					delete u;
+					p->SetSize(*fStream, p->BlockSize + Avail);
+					if (Avail - Grow >= FREE_SPLIT_MIN_SIZE)
+						_SplitFree(p, p->BlockSize - Avail + Grow);
+					Block.fBlockCapacity = p->BlockStart + p->BlockSize;
+					if (Block.fCurrent == NULL)
+						Block.fCurrent = p;
+					return;
+				}
+			}
+
+			// Need a new block
+			CdBlockStream::TBlockInfo *n = _NeedBlock(Grow, false);
+
+			n->BlockStart = p->BlockStart + p->BlockSize;
+			p->Next = n; n->Next = NULL;
+			p->SetNext(*fStream, n->AbsStart());
+			Block.fExtent.push_back(n);
+
+			Block.fBlockCapacity = n->BlockStart + n->BlockSize;
+			if (Block.fCurrent == NULL)
+				Block.fCurrent = n;
+		} else
+			throw ErrStream(ErrInvalidBlockLength);
+
+	} else {
+		// Need a new block
+		CdBlockStream::TBlockInfo *n =
+			_NeedBlock(NewCapacity - Block.fBlockCapacity, true);
+
+		n->BlockStart = 0; n->Next = NULL;
+		Block.fBlockCapacity = n->BlockSize;
+		Block.fList = Block.fCurrent = n;
+		Block.fExtent.push_back(n);
+
+		fStream->SetPosition(n->StreamStart -
+			CdBlockStream::TBlockInfo::HEAD_SIZE);
+		BYTE_LE<CdStream>(fStream) << Block.fID << TdGDSPos(0);
+	}
+}
+
+void CdBlockCollection::_DecStreamSize(CdBlockStream &Block,
+	const SIZE64 NewSize)
+{
+	// NewSize < fBlockCapacity
+	if (fTocBlock) _DropTOC();
+	CdBlockStream::TBlockInfo *p, *q;
+
+	p = Block.fList; q = NULL;
+	while ((p!=NULL) && (p->BlockStart < NewSize))
+	{
+		q = p;
+		p = p->Next;
+	}
+
+	if (p != NULL)
+	{
+		if (p == Block.fList)
+		{
+			// skip the header
+			q = p;
+			p = p->Next;
+		}
+
+		// delete the link
+		q->Next = NULL;
+		q->SetNext(*fStream, 0);
+		Block._RebuildExtent();
+
+		// delete the unused parts
+		while (p != NULL)
+		{
+			Block.fBlockCapacity -= p->BlockSize;
+			q = p;
+			p = p->Next;
+			_AddFree(q);
+		}
+
+		// the current block might have been released
+		Block.fCurrent = NULL;
+		Block.fCurrent = Block._FindCur(Block.fPosition);
+	}
+}
+
+SIZE64 CdBlockCollection::_GrowSize(const CdBlockStream &Block,
+	SIZE64 Need) const
+{
+	if (fGrowthRatio > 0)
+	{
+		// geometric growth, limited by fGrowthMaxSize
+		SIZE64 n = (SIZE64)(Block.fBlockCapacity * fGrowthRatio);
+		if (n > fGrowthMaxSize) n = fGrowthMaxSize;
+		if (n > Need) return n;
+	}
+	return Need;
+}
+
+void CdBlockCollection::_SetStreamSize(SIZE64 NewSize)
+{
+	SIZE64 OldSize = fStreamSize;
+	fStream->SetSize(NewSize);
+	fStreamSize = NewSize;
+	// the result is ignored, since it is only a hint for file system
+	if (fPreallocate && (NewSize > OldSize))
+		fStream->Preallocate(OldSize, NewSize - OldSize);
+}
+
+CdBlockStream::TBlockInfo *CdBlockCollection::_FindFree(SIZE64 Size,
+	SIZE64 Limit)
+{
+	set< pair<SIZE64, SIZE64> >::iterator it =
+		fFreeSize.lower_bound(pair<SIZE64, SIZE64>(Size, 0));
+	for (; it != fFreeSize.end(); it++)
+	{
+		if (it->second < Limit)
+			return fFreePos[it->second];
+	}
+	return NULL;
+}
+
+CdBlockStream::TBlockInfo *CdBlockCollection::_NeedBlock(
+	SIZE64 Size, bool Head, PdBlockStream_BlockInfo Free)
+{
+	if (Head)
+		Size += CdBlockStream::TBlockInfo::HEAD_SIZE;
+
+	// First, find the best-fit unused block
+	CdBlockStream::TBlockInfo *rv = Free ? Free : _FindFree(Size, fStreamSize);
+
+	// Secend, no such block
+	if (rv == NULL)
+	{
+		SIZE64 Pos = fStreamSize;
+		_SetStreamSize(fStreamSize + 2*GDS_POS_SIZE + Size);
+
+		// Result
+		rv = new CdBlockStream::TBlockInfo;
+		rv->StreamStart = Pos + 2*GDS_POS_SIZE +
+			(Head ? CdBlockStream::TBlockInfo::HEAD_SIZE : 0);
+		rv->Head = Head;
+		rv->SetSize2(*fStream,
+			Size - (Head ? CdBlockStream::TBlockInfo::HEAD_SIZE : 0), 0);
+
+	} else {
+		// Remove it from the unused list
+		_EraseFree(rv);
+		// the remaining part is still unused
+		if (rv->BlockSize - Size >= FREE_SPLIT_MIN_SIZE)
+			_SplitFree(rv, Size);
+
+		// Have such block
+		rv->Head = Head;
+		if (Head)
+		{
+			// any unused block with 'Head = false'
+			rv->BlockSize -= CdBlockStream::TBlockInfo::HEAD_SIZE;
+			rv->StreamStart += CdBlockStream::TBlockInfo::HEAD_SIZE;
+		}
+		rv->SetSize2(*fStream, rv->BlockSize, 0);
+	}
+
+	return rv;
+}
+
+void CdBlockCollection::_InsertFree(CdBlockStream::TBlockInfo *p)
+{
+	map<SIZE64, PdBlockStream_BlockInfo>::iterator it =
+		fFreePos.insert(pair<SIZE64, PdBlockStream_BlockInfo>(
+		p->AbsStart(), p)).first;
+	fFreeSize.insert(pair<SIZE64, SIZE64>(p->BlockSize, p->AbsStart()));
+
+	// link in order of position
+	map<SIZE64, PdBlockStream_BlockInfo>::iterator n = it;
+	++n;
+	p->Next = (n != fFreePos.end()) ? n->second : NULL;
+	if (it != fFreePos.begin())
+		(--it)->second->Next = p;
+	else
+		fUnuse = p;
+}
+
+void CdBlockCollection::_EraseFree(CdBlockStream::TBlockInfo *p)
+{
+	map<SIZE64, PdBlockStream_BlockInfo>::iterator it =
+		fFreePos.find(p->AbsStart());
+	if ((it == fFreePos.end()) || (it->second != p))
+		throw ErrStream("Internal Error: invalid unused block.");
+
+	// unlink
+	map<SIZE64, PdBlockStream_BlockInfo>::iterator n = it;
+	++n;
+	CdBlockStream::TBlockInfo *next = (n != fFreePos.end()) ? n->second : NULL;
+	if (it != fFreePos.begin())
+	{
+		n = it;
+		(--n)->second->Next = next;
+	} else
+		fUnuse = next;
+
+	fFreeSize.erase(pair<SIZE64, SIZE64>(p->BlockSize, p->AbsStart()));
+	fFreePos.erase(it);
+	p->Next = NULL;
+}
+
+void CdBlockCollection::_AddFree(CdBlockStream::TBlockInfo *p)
+{
+	if (p->Head)
+	{
+		// any unused block with 'Head = false'
+		p->BlockSize += CdBlockStream::TBlockInfo::HEAD_SIZE;
+		p->StreamStart -= CdBlockStream::TBlockInfo::HEAD_SIZE;
+		p->Head = false;
+	}
+
+	// merge with the previous unused block
+	map<SIZE64, PdBlockStream_BlockInfo>::iterator it =
+		fFreePos.lower_bound(p->AbsStart());
+	if (it != fFreePos.begin())
+	{
+		CdBlockStream::TBlockInfo *q = (--it)->second;
+		if (q->StreamStart + q->BlockSize == p->AbsStart())
+		{
+			_EraseFree(q);
+			q->BlockSize += 2*GDS_POS_SIZE + p->BlockSize;
+			delete p;
+			p = q;
+		}
+	}
+	// merge with the next unused block
+	it = fFreePos.find(p->StreamStart + p->BlockSize);
+	if (it != fFreePos.end())
+	{
+		CdBlockStream::TBlockInfo *q = it->second;
+		_EraseFree(q);
+		p->BlockSize += 2*GDS_POS_SIZE + q->BlockSize;
+		delete q;
+	}
+
+	if (p->StreamStart + p->BlockSize == fStreamSize)
+	{
+		// the last block, truncate the stream
+		fStreamSize = p->AbsStart();
+		fStream->SetSize(fStreamSize);
+		delete p;
+	} else {
+		p->SetSize2(*fStream, p->BlockSize, 0);
+		_InsertFree(p);
+	}
+}
+
+void CdBlockCollection::_SplitFree(CdBlockStream::TBlockInfo *p, SIZE64 Size)
+{
+	const SIZE64 Rest = p->BlockSize - Size - 2*GDS_POS_SIZE;
+	if (Rest <= 0) return;
+	CdBlockStream::TBlockInfo *q = new CdBlockStream::TBlockInfo;
+	q->Head = false;
+	q->StreamStart = p->StreamStart + Size + 2*GDS_POS_SIZE;
+	q->BlockSize = Rest;
+	p->SetSize(*fStream, Size);
+	_AddFree(q);
+}
+
+// the table of contents (TOC):
+//   a head block with TOC_BLOCK_ID at the end of stream, which consists of
+//   the block map and a trailer (payload size, CRC32 of payload, magic)
+
+static const C_UInt32 TOC_BLOCK_ID = 0xFFFFFFFF;
+static const char TOC_MAGIC[8] = { 'C','O','R','E','A','T','O','C' };
+static const SIZE64 TOC_HEAD_SIZE =
+	2*GDS_POS_SIZE + CdBlockStream::TBlockInfo::HEAD_SIZE;
+static const SIZE64 TOC_TRAILER_SIZE = 8 + 4 + sizeof(TOC_MAGIC);
+
+static void xPutLE(vector<C_UInt8> &buf, C_UInt64 val, int nbyte)
+{
+	for (int i=0; i < nbyte; i++, val >>= 8)
+		buf.push_back(val & 0xFF);
+}
+
+static C_UInt64 xGetLE(const C_UInt8 *p, int nbyte)
+{
+	C_UInt64 rv = 0;
+	for (int i=nbyte-1; i >= 0; i--)
+		rv = (rv << 8) | p[i];
 	return rv;
 }
 
-void CdBlockStream::SyncSizeInfo()
-{
-	if (fNeedSyncSize)
+/// sequential reader of the TOC payload
+struct COREARRAY_DLL_LOCAL TTocReader
+{
+	const C_UInt8 *p, *end;
+	bool fail;
+
+	TTocReader(const C_UInt8 *s, const C_UInt8 *e)
+		{ p = s; end = e; fail = false; }
+	C_UInt64 Get(int nbyte)
+	{
+		if (p + nbyte > end) { fail = true; return 0; }
+		C_UInt64 rv = xGetLE(p, nbyte);
+		p += nbyte;
+		return rv;
+	}
+};
+
+/// check the block header in the stream
+static bool xCheckHeader(CdStream *s, const CdBlockStream::TBlockInfo *p,
+	SIZE64 Next, TdGDSBlockID ID, SIZE64 Size)
+{
+	C_UInt8 buf[TOC_HEAD_SIZE];
+	ssize_t L = p->Head ? TOC_HEAD_SIZE : 2*GDS_POS_SIZE;
+	if (s->ReadAt(p->AbsStart(), buf, L) != L) return false;
+	SIZE64 sz = p->BlockSize + L;
+	if (p->Head) sz |= GDS_STREAM_POS_MASK_HEAD_BIT;
+	if ((SIZE64)xGetLE(buf, GDS_POS_SIZE) != sz) return false;
+	if ((SIZE64)xGetLE(buf + GDS_POS_SIZE, GDS_POS_SIZE) != Next) return false;
+	if (p->Head)
 	{
-		if (fList)
-		{
-			CdStream *s = fCollection.Stream();
-			s->SetPosition(fList->StreamStart - GDS_POS_SIZE);
-			BYTE_LE<CdStream>(*s) << TdGDSPos(fBlockSize);
-        }
-    	fNeedSyncSize = false;
+		if (xGetLE(buf + 2*GDS_POS_SIZE, GDS_BLOCK_ID_SIZE) != ID.Get())
+			return false;
+		if ((SIZE64)xGetLE(buf + 2*GDS_POS_SIZE + GDS_BLOCK_ID_SIZE,
+				GDS_POS_SIZE) != Size)
+			return false;
 	}
+	return true;
 }
 
-CdBlockStream::TBlockInfo *CdBlockStream::_FindCur(const SIZE64 Pos)
+void CdBlockCollection::SetGrowthPolicy(double Ratio, SIZE64 MaxSize,
+	bool Prealloc)
 {
-	if (Pos < fBlockCapacity)
-	{
-		TBlockInfo *p = fCurrent;
-		if (p == NULL) p = fList;
-		if (p == NULL) return NULL;
-		if (Pos < p->BlockStart) p = fList;
+	if (Ratio < 0)
+		throw ErrStream("Invalid growth ratio: %g.", Ratio);
+	if (MaxSize < 0)
+		throw ErrStream("Invalid maximum size of reservation.");
+	TdAutoMutex _m(&fMutex);
+	fGrowthRatio = Ratio;
+	fGrowthMaxSize = MaxSize;
+	fPreallocate = Prealloc;
+}
+
+void CdBlockCollection::ReleaseReserved()
+{
+	if (!fStream || fReadOnly) return;
+	TdAutoMutex _m(&fMutex);
 
-		TBlockInfo *n = p;
-		while ((p != NULL) && (Pos >= p->BlockStart))
+	if (fTocBlock) _DropTOC();
+	vector<CdBlockStream*>::iterator it;
+	for (it=fBlockList.begin(); it != fBlockList.end(); it++)
+	{
+		CdBlockStream &B = **it;
+		if (!B.fList) continue;
+		B.SyncSizeInfo();
+		const SIZE64 Size = B.fBlockSize;
+		if (B.fBlockCapacity <= Size) continue;
+
+		// the whole blocks after the end
+		_DecStreamSize(B, Size);
+
+		// the tail of the last block
+		CdBlockStream::TBlockInfo *p = B.fExtent.back();
+		const SIZE64 Slack = B.fBlockCapacity - Size;
+		if (p->StreamStart + p->BlockSize == fStreamSize)
 		{
-			n = p; p = p->Next;
+			p->SetSize(*fStream, p->BlockSize - Slack);
+			fStreamSize -= Slack;
+			fStream->SetSize(fStreamSize);
+		} else {
+			// it becomes an unused block
+			_SplitFree(p, p->BlockSize - Slack);
 		}
-		return n;
-	} else
-		return NULL;
+		B.fBlockCapacity = p->BlockStart + p->BlockSize;
+	}
 }
 
-
-// =====================================================================
-// CdBlockCollection
-
-CdBlockCollection::CdBlockCollection(const SIZE64 vCodeStart)
+static bool xTimeOut(double Start, double TimeLimit)
 {
-	fStream = NULL;
-	fStreamSize = 0;
-	fUnuse = NULL;
-	vNextID = 1; // start from 1
-	fCodeStart = vCodeStart;
-	fClassMgr = &dObjManager();
-	fReadOnly = false;
+	return (TimeLimit > 0) && (MonotonicSeconds() - Start >= TimeLimit);
 }
 
-CdBlockCollection::~CdBlockCollection()
+void CdBlockCollection::_MoveStream(CdBlockStream &Block,
+	CdBlockStream::TBlockInfo *Free)
 {
-	Clear();
-}
+	const SIZE64 HEAD_SIZE = CdBlockStream::TBlockInfo::HEAD_SIZE;
+	const SIZE64 Size = Block.fBlockSize;
+	// not a head until the data is copied, so it is unused if failed
+	CdBlockStream::TBlockInfo *n = _NeedBlock(Size + HEAD_SIZE, false, Free);
 
-void CdBlockCollection::_IncStreamSize(CdBlockStream &Block,
-	const SIZE64 NewCapacity)
-{
-	// NewCapacity > fBlockCapacity
-	if (Block.fList != NULL)
+	// copy data
+	vector<C_UInt8> buf(COMPACT_BUFFER_SIZE);
+	for (CdBlockStream::TBlockInfo *p=Block.fList; p; p=p->Next)
 	{
-		CdBlockStream::TBlockInfo *p = Block.fList;
-		while (p->Next) p = p->Next;
-
-		SIZE64 L = p->BlockSize + p->StreamStart;
-
-		// to check if it is the last block
-		if (L == fStreamSize)
-		{
-			// immediately increase size of the original stream
-			L += NewCapacity - Block.fBlockCapacity;
-			fStream->SetSize(L); fStreamSize = L;
-			// set size
-			p->SetSize(*fStream, NewCapacity - p->BlockStart);
-			Block.fBlockCapacity = NewCapacity;
-			// check Block.fCurrent
-			if (Block.fCurrent == NULL)
-			{
-				p = Block.fList;
-				while (p->Next) p = p->Next;
-				Block.fCurrent = p;
-			}
-		} else if (L < fStreamSize)
+		SIZE64 L = Size - p->BlockStart;
+		if (L > p->BlockSize) L = p->BlockSize;
+		for (SIZE64 i=0; i < L; )
 		{
-			// Need a new block
-			CdBlockStream::TBlockInfo *n =
-				_NeedBlock(NewCapacity - Block.fBlockCapacity, false);
+			ssize_t m = (L - i < (SIZE64)buf.size()) ?
+				(ssize_t)(L - i) : (ssize_t)buf.size();
+			if (fStream->ReadAt(p->StreamStart + i, &buf[0], m) != m)
+				throw ErrStream(ErrMoveBlock, Block.fID.Get());
+			if (fStream->WriteAt(n->StreamStart + HEAD_SIZE + p->BlockStart + i,
+					&buf[0], m) != m)
+				throw ErrStream(ErrMoveBlock, Block.fID.Get());
+			i += m;
+		}
+	}
+	fStream->SetPosition(n->StreamStart);
+	BYTE_LE<CdStream>(fStream) << Block.fID << Block.fBlockSize;
+	fStream->Sync();
+
+	// publish the new head before releasing the original blocks, if it is
+	//   interrupted, LoadStream() keeps one of the two heads with the same ID
+	n->Head = true;
+	n->StreamStart += HEAD_SIZE;
+	n->SetSize(*fStream, n->BlockSize - HEAD_SIZE);
+	n->BlockStart = 0; n->Next = NULL;
+	fStream->Sync();
+
+	CdBlockStream::TBlockInfo *p = Block.fList;
+	while (p != NULL)
+	{
+		CdBlockStream::TBlockInfo *q = p;
+		p = p->Next;
+		_AddFree(q);
+	}
+	Block.fList = Block.fCurrent = n;
+	Block.fBlockCapacity = n->BlockSize;
+	Block._RebuildExtent();
+	Block.fNeedSyncSize = false;
+}
 
-			n->BlockStart = p->BlockStart + p->BlockSize;
-			p->Next = n; n->Next = NULL;
-			p->SetNext(*fStream, n->AbsStart());
+bool CdBlockCollection::Compact(double TimeLimit)
+{
+	if (!fStream || fReadOnly) return true;
+	TdAutoMutex _m(&fMutex);
 
-			Block.fBlockCapacity = n->BlockStart + n->BlockSize;
-			if (Block.fCurrent == NULL)
-				Block.fCurrent = n;
-		} else
-			throw ErrStream(ErrInvalidBlockLength);
+	if (fTocBlock) _DropTOC();
+	ReleaseReserved();
 
-	} else {
-		// Need a new block
-		CdBlockStream::TBlockInfo *n =
-			_NeedBlock(NewCapacity - Block.fBlockCapacity, true);
+	// at least one stream is moved in each call
+	const double Start = MonotonicSeconds();
+	bool Moved = false;
 
-		n->BlockStart = 0; n->Next = NULL;
-		Block.fBlockCapacity = n->BlockSize;
-		Block.fList = Block.fCurrent = n;
+	// the fragmented streams
+	vector<CdBlockStream*>::iterator it;
+	for (it=fBlockList.begin(); it != fBlockList.end(); it++)
+	{
+		CdBlockStream &B = **it;
+		if (B.fList && B.fList->Next)
+		{
+			if (Moved && xTimeOut(Start, TimeLimit)) return false;
+			_MoveStream(B, NULL);
+			Moved = true;
+		}
+	}
 
-		fStream->SetPosition(n->StreamStart -
-			CdBlockStream::TBlockInfo::HEAD_SIZE);
-		BYTE_LE<CdStream>(fStream) << Block.fID << TdGDSPos(0);
+	// the streams at the end, moved into the unused space before them
+	while (fUnuse != NULL)
+	{
+		CdBlockStream *B = NULL;
+		for (it=fBlockList.begin(); it != fBlockList.end(); it++)
+		{
+			CdBlockStream::TBlockInfo *p = (*it)->fList;
+			if (p && (p->StreamStart + p->BlockSize == fStreamSize))
+				{ B = *it; break; }
+		}
+		if (!B) break;
+		CdBlockStream::TBlockInfo *Free = _FindFree(
+			B->fBlockSize + CdBlockStream::TBlockInfo::HEAD_SIZE,
+			B->fList->AbsStart());
+		if (!Free) break;
+		if (Moved && xTimeOut(Start, TimeLimit)) return false;
+		_MoveStream(*B, Free);
+		Moved = true;
 	}
+
+	return true;
 }
 
-void CdBlockCollection::_DecStreamSize(CdBlockStream &Block,
-	const SIZE64 NewSize)
+void CdBlockCollection::WriteTOC()
 {
-	// NewSize < fBlockCapacity
-	CdBlockStream::TBlockInfo *p, *q;
+	if (!fStream || fReadOnly || fTocBlock) return;
+	TdAutoMutex _m(&fMutex);
 
-	p = Block.fList; q = NULL;
-	while ((p!=NULL) && (p->BlockStart < NewSize))
+	vector<CdBlockStream*>::iterator it;
+	C_UInt32 nStream = 0;
+	for (it=fBlockList.begin(); it != fBlockList.end(); it++)
 	{
-		q = p;
-		p = p->Next;
+		(*it)->SyncSizeInfo();
+		if ((*it)->fList) nStream ++;
 	}
 
-	if (p != NULL)
+	// the block map
+	vector<C_UInt8> buf(TOC_HEAD_SIZE, 0);
+	xPutLE(buf, nStream, 4);
+	for (it=fBlockList.begin(); it != fBlockList.end(); it++)
 	{
-		if (p == Block.fList)
+		CdBlockStream *bs = *it;
+		if (!bs->fList) continue;
+		xPutLE(buf, bs->fID.Get(), GDS_BLOCK_ID_SIZE);
+		xPutLE(buf, (C_Int64)bs->fBlockSize, GDS_POS_SIZE);
+		xPutLE(buf, bs->fExtent.size(), 4);
+		vector<CdBlockStream::TBlockInfo*>::iterator e;
+		for (e=bs->fExtent.begin(); e != bs->fExtent.end(); e++)
 		{
-			// skip the header
-			q = p;
-			p = p->Next;
+			xPutLE(buf, (*e)->AbsStart(), GDS_POS_SIZE);
+			xPutLE(buf, (*e)->BlockSize, GDS_POS_SIZE);
 		}
+	}
+	C_UInt32 nFree = 0;
+	CdBlockStream::TBlockInfo *p;
+	for (p=fUnuse; p != NULL; p = p->Next) nFree ++;
+	xPutLE(buf, nFree, 4);
+	for (p=fUnuse; p != NULL; p = p->Next)
+	{
+		xPutLE(buf, p->AbsStart(), GDS_POS_SIZE);
+		xPutLE(buf, p->BlockSize, GDS_POS_SIZE);
+		xPutLE(buf, p->StreamNext, GDS_POS_SIZE);
+	}
 
-		// delete the link
-		q->Next = NULL;
-		q->SetNext(*fStream, 0);
+	// the trailer
+	const size_t L = buf.size() - TOC_HEAD_SIZE;
+	uLong crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(crc, &buf[TOC_HEAD_SIZE], L);
+	xPutLE(buf, L, 8);
+	xPutLE(buf, crc, 4);
+	buf.insert(buf.end(), TOC_MAGIC, TOC_MAGIC + sizeof(TOC_MAGIC));
+
+	// the block header
+	const SIZE64 BlockSize = buf.size() - TOC_HEAD_SIZE;
+	vector<C_UInt8> hd;
+	xPutLE(hd, (BlockSize + TOC_HEAD_SIZE) | GDS_STREAM_POS_MASK_HEAD_BIT,
+		GDS_POS_SIZE);
+	xPutLE(hd, 0, GDS_POS_SIZE);
+	xPutLE(hd, TOC_BLOCK_ID, GDS_BLOCK_ID_SIZE);
+	xPutLE(hd, BlockSize, GDS_POS_SIZE);
+	memcpy(&buf[0], &hd[0], TOC_HEAD_SIZE);
+
+	// append to the end of stream
+	const SIZE64 Pos = fStreamSize;
+	fStreamSize += buf.size();
+	fStream->SetSize(fStreamSize);
+	if (fStream->WriteAt(Pos, &buf[0], buf.size()) != (ssize_t)buf.size())
+		throw ErrStream("Fail to write the table of contents.");
+
+	p = new CdBlockStream::TBlockInfo;
+	p->Head = true;
+	p->StreamStart = Pos + TOC_HEAD_SIZE;
+	p->BlockSize = BlockSize;
+	fTocBlock = p;
+}
+
+bool CdBlockCollection::_LoadTOC()
+{
+	// the trailer
+	const SIZE64 MinSize = TOC_HEAD_SIZE + TOC_TRAILER_SIZE;
+	if (fStreamSize - fCodeStart < MinSize) return false;
+	C_UInt8 tr[TOC_TRAILER_SIZE];
+	if (fStream->ReadAt(fStreamSize - TOC_TRAILER_SIZE, tr,
+			TOC_TRAILER_SIZE) != TOC_TRAILER_SIZE)
+		return false;
+	if (memcmp(tr + 12, TOC_MAGIC, sizeof(TOC_MAGIC)) != 0)
+		return false;
+	const SIZE64 L = xGetLE(tr, 8);
+	if ((L < 0) || (L > fStreamSize - fCodeStart - MinSize))
+		return false;
 
-		// delete the unused parts
-		while (p != NULL)
+	// the TOC block
+	CdBlockStream::TBlockInfo toc;
+	toc.Head = true;
+	toc.BlockSize = L + TOC_TRAILER_SIZE;
+	toc.StreamStart = fStreamSize - toc.BlockSize;
+	const SIZE64 TocStart = toc.AbsStart();
+	if (!xCheckHeader(fStream, &toc, 0, TOC_BLOCK_ID, toc.BlockSize))
+		return false;
+
+	vector<C_UInt8> buf(L);
+	if (L > 0)
+	{
+		if (fStream->ReadAt(toc.StreamStart, &buf[0], L) != L)
+			return false;
+	}
+	uLong crc = crc32(0L, Z_NULL, 0);
+	if (L > 0) crc = crc32(crc, &buf[0], L);
+	if (crc != xGetLE(tr + 8, 4)) return false;
+
+	// parse the block map
+	TTocReader R(L > 0 ? &buf[0] : NULL, L > 0 ? &buf[0] + L : NULL);
+	vector<CdBlockStream*> lst;
+	CdBlockStream::TBlockInfo *unuse=NULL, *last=NULL;
+	bool ok = true;
+
+	C_UInt32 nStream = R.Get(4);
+	for (C_UInt32 i=0; ok && !R.fail && (i < nStream); i++)
+	{
+		CdBlockStream *bs = new CdBlockStream(*this);
+		bs->AddRef();
+		lst.push_back(bs);
+		bs->fID = (C_UInt32)R.Get(GDS_BLOCK_ID_SIZE);
+		bs->fBlockSize = (C_Int64)R.Get(GDS_POS_SIZE);
+		C_UInt32 nBlock = R.Get(4);
+		if (nBlock == 0) ok = false;
+		CdBlockStream::TBlockInfo *p = NULL;
+		for (C_UInt32 j=0; ok && !R.fail && (j < nBlock); j++)
 		{
-			Block.fBlockCapacity -= p->BlockSize;
-			p->SetSize2(*fStream, p->BlockSize, 0);
-			q = p;
-			p = p->Next;
-			// insert into fUnuse
-			q->Next = fUnuse;
-			fUnuse = q;
+			CdBlockStream::TBlockInfo *n = new CdBlockStream::TBlockInfo;
+			SIZE64 st = R.Get(GDS_POS_SIZE);
+			n->BlockSize = R.Get(GDS_POS_SIZE);
+			n->Head = (j == 0);
+			n->StreamStart = st + (n->Head ? TOC_HEAD_SIZE : 2*GDS_POS_SIZE);
+			if (p)
+			{
+				p->Next = n; p->StreamNext = st;
+				n->BlockStart = p->BlockStart + p->BlockSize;
+			} else
+				bs->fList = bs->fCurrent = n;
+			bs->fExtent.push_back(n);
+			bs->fBlockCapacity += n->BlockSize;
+			if ((st < fCodeStart) || (n->BlockSize < 0) ||
+					(n->StreamStart + n->BlockSize > TocStart))
+				ok = false;
+			p = n;
+		}
+		if (ok && !R.fail)
+		{
+			// check the header of the first and last blocks
+			CdBlockStream::TBlockInfo *h = bs->fList;
+			ok = xCheckHeader(fStream, h, h->StreamNext, bs->fID,
+				bs->fBlockSize);
+			if (ok && (p != h))
+				ok = xCheckHeader(fStream, p, 0, bs->fID, 0);
 		}
 	}
-}
 
-CdBlockStream::TBlockInfo *CdBlockCollection::_NeedBlock(
-	SIZE64 Size, bool Head)
-{
-	if (Head)
-		Size += CdBlockStream::TBlockInfo::HEAD_SIZE;
+	C_UInt32 nFree = R.Get(4);
+	for (C_UInt32 i=0; ok && !R.fail && (i < nFree); i++)
+	{
+		CdBlockStream::TBlockInfo *n = new CdBlockStream::TBlockInfo;
+		SIZE64 st = R.Get(GDS_POS_SIZE);
+		n->BlockSize = R.Get(GDS_POS_SIZE);
+		n->StreamNext = R.Get(GDS_POS_SIZE);
+		n->StreamStart = st + 2*GDS_POS_SIZE;
+		if (last) last->Next = n; else unuse = n;
+		last = n;
+		if ((st < fCodeStart) || (n->BlockSize < 0) ||
+				(n->StreamStart + n->BlockSize > TocStart))
+			ok = false;
+		else
+			ok = xCheckHeader(fStream, n, n->StreamNext, 0, 0);
+	}
 
-	// First, find a suitable block for Unuse
-	CdBlockStream::TBlockInfo *p = fUnuse;
-	CdBlockStream::TBlockInfo *rv, *q, *qrv;
-	rv = q = qrv = NULL;
-	while (p != NULL)
+	if (ok && !R.fail && (R.p == R.end))
 	{
-		if (p->BlockSize >= Size)
+		// the streams have distinct IDs, and all blocks tile the stream
+		// before the TOC without any gap or overlap
+		set<C_UInt32> ids;
+		map<SIZE64, SIZE64> ext;
+		vector<CdBlockStream*>::iterator it;
+		for (it=lst.begin(); ok && (it != lst.end()); it++)
 		{
-			if (rv != NULL)
+			CdBlockStream *bs = *it;
+			if (!ids.insert(bs->fID.Get()).second ||
+					(bs->fID.Get() == TOC_BLOCK_ID) || (bs->fBlockSize < 0) ||
+					(bs->fBlockSize > bs->fBlockCapacity))
+				ok = false;
+			vector<CdBlockStream::TBlockInfo*>::iterator e;
+			for (e=bs->fExtent.begin(); ok && (e != bs->fExtent.end()); e++)
 			{
-				if (p->BlockSize < rv->BlockSize)
-				{
-					qrv = q; rv = p;
-				}
-			} else {
-				qrv = q; rv = p;
+				ok = ext.insert(pair<SIZE64, SIZE64>((*e)->AbsStart(),
+					(*e)->StreamStart + (*e)->BlockSize)).second;
 			}
 		}
-		q = p; p = p->Next;
+		for (CdBlockStream::TBlockInfo *p=unuse; ok && p; p=p->Next)
+		{
+			ok = ext.insert(pair<SIZE64, SIZE64>(p->AbsStart(),
+				p->StreamStart + p->BlockSize)).second;
+		}
+		SIZE64 Pos = fCodeStart;
+		map<SIZE64, SIZE64>::iterator m;
+		for (m=ext.begin(); ok && (m != ext.end()); m++)
+		{
+			if (m->first != Pos) ok = false;
+			Pos = m->second;
+		}
+		if (Pos != TocStart) ok = false;
 	}
 
-	// Secend, no such block
-	if (rv == NULL)
+	if (!ok || R.fail || (R.p != R.end))
 	{
-		SIZE64 Pos = fStreamSize;
-		fStreamSize += 2*GDS_POS_SIZE + Size;
-		fStream->SetSize(fStreamSize);
-
-		// Result
-		rv = new CdBlockStream::TBlockInfo;
-		rv->StreamStart = Pos + 2*GDS_POS_SIZE +
-			(Head ? CdBlockStream::TBlockInfo::HEAD_SIZE : 0);
-		rv->Head = Head;
-		rv->SetSize2(*fStream,
-			Size - (Head ? CdBlockStream::TBlockInfo::HEAD_SIZE : 0), 0);
-
-	} else {
-		// Remove it from the unused list
-		if (qrv)
-			qrv->Next = rv->Next;
-		else
-        	fUnuse = rv->Next;
-		rv->Next = NULL;
+		vector<CdBlockStream*>::iterator it;
+		for (it=lst.begin(); it != lst.end(); it++)
+			(*it)->Release();
+		xClearList(unuse);
+		return false;
+	}
 
-		// Have such block
-		rv->Head = Head;
-		if (Head)
-		{
-			// any unused block with 'Head = false'
-			rv->BlockSize -= CdBlockStream::TBlockInfo::HEAD_SIZE;
-			rv->StreamStart += CdBlockStream::TBlockInfo::HEAD_SIZE;
-		}
-		rv->SetSize2(*fStream, rv->BlockSize, 0);
+	fBlockList.insert(fBlockList.end(), lst.begin(), lst.end());
+	while (unuse != NULL)
+	{
+		CdBlockStream::TBlockInfo *n = unuse->Next;
+		_InsertFree(unuse);
+		unuse = n;
 	}
+	fTocBlock = new CdBlockStream::TBlockInfo(toc);
+	return true;
+}
 
-	return rv;
+void CdBlockCollection::_DropTOC()
+{
+	if (!fTocBlock || fReadOnly) return;
+
+	CdBlockStream::TBlockInfo *p = fTocBlock;
+	fTocBlock = NULL;
+	// it becomes an unused block, or the stream is truncated if it is last
+	_AddFree(p);
 }
 
 CdBlockStream *CdBlockCollection::NewBlockStream()
@@ -3311,6 +6941,7 @@ CdBlockStream *CdBlockCollection::NewBlockStream()
 	#endif
 
 	// Need a new ID
+	TdAutoMutex _m(&fMutex);
 	while (HaveID(vNextID)) ++vNextID;
 
 	// New
@@ -3324,6 +6955,7 @@ CdBlockStream *CdBlockCollection::NewBlockStream()
 
 bool CdBlockCollection::HaveID(TdGDSBlockID id)
 {
+	TdAutoMutex _m(&fMutex);
 	vector<CdBlockStream*>::const_iterator it;
 	for (it=fBlockList.begin(); it != fBlockList.end(); it++)
 		if ((*it)->fID == id)
@@ -3333,20 +6965,14 @@ bool CdBlockCollection::HaveID(TdGDSBlockID id)
 
 int CdBlockCollection::NumOfFragment()
 {
+	TdAutoMutex _m(&fMutex);
 	int Cnt = 0;
 
 	vector<CdBlockStream*>::const_iterator it;
 	for (it=fBlockList.begin(); it != fBlockList.end(); it++)
 		Cnt += (*it)->ListCount();
 
-	CdBlockStream::TBlockInfo *p = fUnuse;
-	while (p != NULL)
-	{
-		p = p->Next;
-		Cnt ++;
-	}
-
-	return Cnt;
+	return Cnt + (int)fFreePos.size();
 }
 
 void CdBlockCollection::LoadStream(CdStream *vStream, bool vReadOnly)
@@ -3358,13 +6984,25 @@ void CdBlockCollection::LoadStream(CdStream *vStream, bool vReadOnly)
 	(fStream=vStream)->AddRef();
     fReadOnly = vReadOnly;
 
+	// direct access to the memory-mapped view if available
+	CdMmapFileStream *ms = dynamic_cast<CdMmapFileStream*>(vStream);
+	if (ms && vReadOnly)
+	{
+		fMapMemory = ms->Memory();
+		fMapSize = fMapMemory ? ms->MapSize() : 0;
+	}
+
+	fStreamSize = fStream->GetSize();
+
+	// the block map from the table of contents if it is valid
+	if (_LoadTOC()) return;
+
 	// Start to screen
-	CdBlockStream::TBlockInfo *p, *q, *n;
+	CdBlockStream::TBlockInfo *p, *n;
+	vector<CdBlockStream::TBlockInfo*> blocks;
 
 	fStream->SetPosition(fCodeStart);
-	fStreamSize = fStream->GetSize();
 
-	p = fUnuse;
 	while (fStream->Position() < fStreamSize)
 	{
 		TdGDSPos sSize, sNext;
@@ -3372,77 +7010,138 @@ void CdBlockCollection::LoadStream(CdStream *vStream, bool vReadOnly)
 		SIZE64 sPos = fStream->Position() +
 			(sSize & GDS_STREAM_POS_MASK) - 2*GDS_POS_SIZE;
 
-		CdBlockStream::TBlockInfo *n = new CdBlockStream::TBlockInfo;
+		n = new CdBlockStream::TBlockInfo;
 		n->Head = (sSize & GDS_STREAM_POS_MASK_HEAD_BIT) != 0;
 		int L = n->Head ? CdBlockStream::TBlockInfo::HEAD_SIZE : 0;
 		n->BlockSize = (sSize & GDS_STREAM_POS_MASK) - L - 2*GDS_POS_SIZE;
 		n->StreamStart = fStream->Position() + L;
 		n->StreamNext = sNext;
-
-		if (p) p->Next = n; else fUnuse = n;
-		p = n;
+		blocks.push_back(n);
 
 		fStream->SetPosition(sPos);
 	}
 
 	// Reorganize Block
-	while (fUnuse != NULL)
+	//   the blocks are scanned in order, so 'blocks' is sorted by AbsStart(),
+	//   and the block linked by StreamNext is located by binary search
+	const size_t nBlock = blocks.size();
+	vector<bool> used(nBlock, false);
+	bool err_head = false;
+	for (size_t i=0; (i < nBlock) && !err_head; i++)
 	{
-		// find the head
-		p = fUnuse; q = NULL;
-		while (p != NULL)
-		{
-			if (p->Head) break;
-			q = p; p = p->Next;
-        }
+		p = blocks[i];
+		if (!p->Head) continue;
+		used[i] = true;
+
+		// a new block stream
+		CdBlockStream *bs = new CdBlockStream(*this);
+		bs->AddRef();
+		fBlockList.push_back(bs);
+
+		// block list
+		fStream->SetPosition(p->StreamStart -
+			CdBlockStream::TBlockInfo::HEAD_SIZE);
+		BYTE_LE<CdStream>(fStream) >> bs->fID >> bs->fBlockSize;
+		bs->fBlockCapacity = p->BlockSize;
+		bs->fList = bs->fCurrent = p;
+		p->Next = NULL;
 
-		// find all blocks linked to the head
-		if (p != NULL)
+		// find a list of blocks linked to the head
+		while (p->StreamNext != 0)
 		{
-        	// delete p
-			if (q) q->Next = p->Next; else fUnuse = p->Next;
+			size_t lo = 0, hi = nBlock;
+			while (lo < hi)
+			{
+				size_t mid = (lo + hi) >> 1;
+				if (blocks[mid]->AbsStart() < p->StreamNext)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			if ((lo >= nBlock) || used[lo] ||
+					(blocks[lo]->AbsStart() != p->StreamNext))
+				break;
+
+			n = blocks[lo];
+			if (n->Head)
+			{
+				err_head = true; break;
+			}
+			used[lo] = true;
+			p->Next = n;
+			// update stream info
+			n->BlockStart = p->BlockStart + p->BlockSize;
+			bs->fBlockCapacity += n->BlockSize;
+			p = n; p->Next = NULL;
+		}
+		bs->_RebuildExtent();
+
+		// need checking codes
+	}
 
-			// a new block stream
-			CdBlockStream *bs = new CdBlockStream(*this);
-			bs->AddRef();
-			fBlockList.push_back(bs);
+	// the remaining blocks are unused
+	for (size_t i=0; i < nBlock; i++)
+	{
+		if (!used[i]) _InsertFree(blocks[i]);
+	}
 
-			// block list
-			fStream->SetPosition(p->StreamStart -
-				CdBlockStream::TBlockInfo::HEAD_SIZE);
-			BYTE_LE<CdStream>(fStream) >> bs->fID >> bs->fBlockSize;
-			bs->fBlockCapacity = p->BlockSize;
-			bs->fList = bs->fCurrent = p;
-			p->Next = NULL;
+	if (err_head)
+		throw ErrStream("Internal Error: it should not be a head.");
 
-			// find a list of blocks linked to the head
-			n = fUnuse; q = NULL;
-			while ((n != NULL) && (p->StreamNext != 0))
+	// a stale table of contents
+	vector<CdBlockStream*>::iterator it;
+	for (it=fBlockList.begin(); it != fBlockList.end(); it++)
+	{
+		CdBlockStream *bs = *it;
+		if (bs->fID.Get() == TOC_BLOCK_ID)
+		{
+			fBlockList.erase(it);
+			fTocBlock = bs->fList;
+			p = fTocBlock->Next;
+			fTocBlock->Next = NULL;
+			while (p != NULL)
 			{
-				if (p->StreamNext == n->AbsStart())
-				{
-					if  (!n->Head)
-					{
-						// remove 'n'
-						if (q) q->Next = n->Next; else fUnuse = n->Next;
-						p->Next = n;
-						// update stream info
-						n->BlockStart = p->BlockStart + p->BlockSize;
-						bs->fBlockCapacity += n->BlockSize;
-						p = n; p->Next = NULL;
-						// restart searching
-						n = fUnuse; q = NULL;
-					} else {
-						throw ErrStream("Internal Error: it should not be a head.");
-					}
-				} else {
-					q = n; n = n->Next;
-                }
+				n = p->Next;
+				_InsertFree(p);
+				p = n;
 			}
+			bs->fList = bs->fCurrent = NULL;
+			bs->fExtent.clear();
+			bs->Release();
+			_DropTOC();
+			break;
+		}
+	}
 
-			// need checking codes
-		} else
-        	break;
+	// two heads with the same ID if a block move was interrupted, both hold
+	//   the whole data, and the first one in file order is kept
+	set<C_UInt32> ids;
+	for (size_t i=0; i < fBlockList.size(); )
+	{
+		CdBlockStream *bs = fBlockList[i];
+		if (ids.insert(bs->fID.Get()).second)
+			{ i++; continue; }
+		fBlockList.erase(fBlockList.begin() + i);
+		p = bs->fList;
+		bs->fList = bs->fCurrent = NULL;
+		bs->fExtent.clear();
+		bs->Release();
+		while (p != NULL)
+		{
+			n = p->Next;
+			if (fReadOnly)
+			{
+				if (p->Head)
+				{
+					p->BlockSize += CdBlockStream::TBlockInfo::HEAD_SIZE;
+					p->StreamStart -= CdBlockStream::TBlockInfo::HEAD_SIZE;
+					p->Head = false;
+				}
+				_InsertFree(p);
+			} else
+				_AddFree(p);
+			p = n;
+		}
 	}
 }
 
@@ -3459,6 +7158,7 @@ void CdBlockCollection::WriteStream(CdStream *vStream)
 
 void CdBlockCollection::Clear()
 {
+	CdRABlockCache::Purge(this);
 	vector<CdBlockStream*>::iterator it;
 	for (it=fBlockList.begin(); it != fBlockList.end(); it++)
 	{
@@ -3485,38 +7185,40 @@ void CdBlockCollection::Clear()
 	#endif
 		fStream = NULL;
 	}
+	fMapMemory = NULL;
+	fMapSize = 0;
 
 	xClearList(fUnuse);
 	fUnuse = NULL;
+	fFreePos.clear();
+	fFreeSize.clear();
+	if (fTocBlock)
+	{
+		delete fTocBlock;
+		fTocBlock = NULL;
+	}
 }
 
 void CdBlockCollection::DeleteBlockStream(TdGDSBlockID id)
 {
+	TdAutoMutex _m(&fMutex);
 	vector<CdBlockStream*>::iterator it;
 	for (it=fBlockList.begin(); it != fBlockList.end(); it++)
 	{
 		if ((*it)->fID == id)
 		{
+			if (fTocBlock) _DropTOC();
 			CdBlockStream::TBlockInfo *p, *q;
-			p = (*it)->fList; q = NULL;
+			p = (*it)->fList;
 			while (p != NULL)
 			{
-				if (p->Head)
-				{
-					p->BlockSize += CdBlockStream::TBlockInfo::HEAD_SIZE;
-					p->StreamStart -= CdBlockStream::TBlockInfo::HEAD_SIZE;
-					p->Head = false;
-				}
-				p->SetSize2(*fStream, p->BlockSize, 0);
             	q = p; p = p->Next;
+				_AddFree(q);
             }
-			if (q)
-			{
-				q->Next = fUnuse;
-				fUnuse = (*it)->fList;
-				(*it)->fList = NULL;
-            }
+			(*it)->fList = (*it)->fCurrent = NULL;
+			(*it)->fExtent.clear();
 
+			CdRABlockCache::Purge(this, id.Get());
 			(*it)->Release();
 			fBlockList.erase(it);
 			return;
@@ -3527,6 +7229,7 @@ void CdBlockCollection::DeleteBlockStream(TdGDSBlockID id)
 
 CdBlockStream *CdBlockCollection::operator[] (const TdGDSBlockID &id)
 {
+	TdAutoMutex _m(&fMutex);
 	vector<CdBlockStream*>::iterator it;
 	for (it=fBlockList.begin(); it != fBlockList.end(); it++)
 	{
@@ -63,9 +63,16 @@
 #   endif
 #endif
 
+// zstd library
+#ifndef COREARRAY_NO_ZSTD
+#   include <zstd.h>
+#endif
+
 
 #include <cstring>
 #include <vector>
+#include <map>
+#include <set>
 
 #ifdef COREARRAY_PLATFORM_UNIX
 #  include <sys/types.h>
@@ -90,10 +97,24 @@ namespace CoreArray
 		virtual SIZE64 Seek(SIZE64 Offset, TdSysSeekOrg Origin);
 		virtual void SetSize(SIZE64 NewSize);
 
+		/// positional read, Position() is not changed
+		virtual ssize_t ReadAt(SIZE64 Pos, void *Buffer, ssize_t Count);
+		/// positional write, Position() is not changed
+		virtual ssize_t WriteAt(SIZE64 Pos, const void *Buffer, ssize_t Count);
+		/// allocate disk space without changing the file size
+		virtual bool Preallocate(SIZE64 Pos, SIZE64 Count);
+		/// flush the written data to the storage device
+		virtual bool Sync();
+
 		COREARRAY_INLINE TSysHandle Handle() const { return fHandle; }
 
 	protected:
 		TSysHandle fHandle;
+	#ifdef COREARRAY_PLATFORM_WINDOWS
+		/// the stream position, since ReadFile() and WriteFile() with
+		/// OVERLAPPED in ReadAt() and WriteAt() move the file pointer
+		SIZE64 fPosition;
+	#endif
 	};
 
 
@@ -138,6 +159,9 @@ namespace CoreArray
 		virtual SIZE64 GetSize();
 		virtual void SetSize(SIZE64 NewSize);
 
+		virtual ssize_t ReadAt(SIZE64 Pos, void *Buffer, ssize_t Count);
+		virtual ssize_t WriteAt(SIZE64 Pos, const void *Buffer, ssize_t Count);
+
 	protected:
 	#ifdef COREARRAY_PLATFORM_UNIX
 		pid_t Current_PID;
@@ -148,6 +172,36 @@ namespace CoreArray
 	};
 
 
+	/// Read-only file stream using a memory-mapped view of the whole file
+	class COREARRAY_DLL_DEFAULT CdMmapFileStream: public CdFileStream
+	{
+	public:
+		CdMmapFileStream(const char * const AFileName);
+		virtual ~CdMmapFileStream();
+
+		/// Read block of data, and return number of read in bytes
+		virtual ssize_t Read(void *Buffer, ssize_t Count);
+		/// Not allowed, the stream is read-only
+		virtual ssize_t Write(const void *Buffer, ssize_t Count);
+
+		virtual SIZE64 Seek(SIZE64 Offset, TdSysSeekOrg Origin);
+		virtual SIZE64 GetSize();
+		virtual void SetSize(SIZE64 NewSize);
+
+		virtual ssize_t ReadAt(SIZE64 Pos, void *Buffer, ssize_t Count);
+
+		/// the start address of the mapped view, NULL if mapping is not used
+		COREARRAY_INLINE const C_UInt8 *Memory() const { return fMemory; }
+		/// the size of the mapped view
+		COREARRAY_INLINE SIZE64 MapSize() const { return fMapSize; }
+
+	protected:
+		C_UInt8 *fMemory;
+		SIZE64 fMapSize, fPosition;
+		TSysHandle fMapHandle;
+	};
+
+
 	/// Temporary stream, in which a temporary file is created
 	class COREARRAY_DLL_DEFAULT CdTempStream: public CdFileStream
 	{
@@ -327,22 +381,137 @@ namespace CoreArray
 			raDefault =  4    ///< the default value
 		};
 
+		/// the filter applied to the raw data of each block before compression
+		enum TFilter
+		{
+			rfNone       = 0,   ///< no filter
+			rfShuffle    = 1,   ///< transpose the bytes of elements
+			rfBitShuffle = 2,   ///< transpose the bits of elements
+			rfDelta      = 3,   ///< differences of consecutive elements
+			rfDelta2     = 4,   ///< differences of consecutive differences
+			rfLast       = 4    ///< the last valid value
+		};
+
+		/// the value type of elements in the zone map of blocks
+		enum TZoneMap
+		{
+			rzNone  = 0,   ///< no zone map
+			rzInt   = 1,   ///< signed integers
+			rzUInt  = 2,   ///< unsigned integers
+			rzFloat = 3,   ///< floating-point numbers
+			rzLast  = 3    ///< the last valid value
+		};
+
+		/// the zone map entry of a block
+		struct TZoneStat
+		{
+			C_UInt64 Min;    ///< the minimum, as C_Int64, C_UInt64 or C_Float64
+			C_UInt64 Max;    ///< the maximum, as C_Int64, C_UInt64 or C_Float64
+			C_UInt32 NumNA;  ///< the number of missing values
+		};
+
 		/// constructor
 		CdRAAlgorithm(CdRecodeStream &owner);
 		/// compression block information
 		COREARRAY_INLINE TBlockSize SizeType() const { return fSizeType; }
+		/// the filter of blocks
+		COREARRAY_INLINE TFilter Filter() const { return fFilter; }
+		/// the element size in bytes used by the filter
+		COREARRAY_INLINE int FilterSize() const { return fFilterSize; }
+		/// the value type of the zone map
+		COREARRAY_INLINE TZoneMap ZoneMap() const { return fZoneMap; }
+		/// the element size in bytes used by the zone map
+		COREARRAY_INLINE int ZoneSize() const { return fZoneSize; }
+		/// convert the minimum or maximum in TZoneStat to a real number,
+		/// 64-bit integers rounded downward or upward (Upper=true) if inexact
+		double ZoneValue(C_UInt64 Val, bool Upper) const;
 
 	protected:
 		/// the owner of this object
 		CdRecodeStream &fOwner;
 		/// the size of independent compressed block
 		TBlockSize fSizeType;
+		/// the filter of blocks, stored in the stream of version 0x12
+		TFilter fFilter;
+		/// the element size in bytes used by the filter
+		int fFilterSize;
+		/// the value type of the zone map, stored in the stream of version 0x13
+		TZoneMap fZoneMap;
+		/// the element size in bytes used by the zone map
+		int fZoneSize;
+
+		/// apply the filter to n bytes of Src, and store the result in Dst
+		void FilterData(C_UInt8 *Dst, const C_UInt8 *Src, ssize_t n);
+		/// restore n bytes of Src filtered by FilterData(), stored in Dst
+		void UnfilterData(C_UInt8 *Dst, const C_UInt8 *Src, ssize_t n);
+		/// get the range and the number of missing values of n bytes in Raw
+		void ZoneStat(const C_UInt8 *Raw, ssize_t n, TZoneStat &Out) const;
+		/// whether the blocks have the same filter and zone map as Src
+		bool SameBlockFormat(const CdRAAlgorithm &Src) const;
+	};
+
+	/// The process-wide LRU cache of decompressed blocks of random-access
+	/// streams, keyed by (file, stream ID, block index)
+	class COREARRAY_DLL_DEFAULT CdRABlockCache
+	{
+	public:
+		/// the statistics of the cache
+		struct TStat
+		{
+			SIZE64 Budget;     ///< the memory budget in bytes, 0 for disabled
+			SIZE64 Size;       ///< the total size of cached blocks in bytes
+			C_Int64 NumBlock;  ///< the number of cached blocks
+			C_Int64 Hit;       ///< the number of lookups found in the cache
+			C_Int64 Miss;      ///< the number of lookups not found
+			C_Int64 Evict;     ///< the number of blocks evicted
+		};
+
+		/// a cached block
+		struct TBlock;
+
+		/// set the memory budget in bytes, 0 to disable and free the cache
+		static void SetBudget(SIZE64 Size);
+		/// the memory budget in bytes
+		static SIZE64 Budget();
+		/// get the statistics
+		static void GetStat(TStat &Stat);
+		/// remove all blocks, and reset the counters if ResetStat
+		static void Clear(bool ResetStat);
+		/// remove the blocks of a stream in File
+		static void Purge(const void *File, C_UInt32 ID);
+		/// remove the blocks of all streams in File
+		static void Purge(const void *File);
+
+		/// return the referenced block and its data, or NULL if not found
+		static TBlock *Find(const void *File, C_UInt32 ID, C_Int32 Idx,
+			const C_UInt8 *&Data);
+		/// add a block by swapping Data, return the referenced block
+		static TBlock *Add(const void *File, C_UInt32 ID, C_Int32 Idx,
+			vector<C_UInt8> &Data, const C_UInt8 *&Ptr);
+		/// release the reference returned by Find() or Add()
+		static void Release(TBlock *Block);
 	};
 
+
+	class COREARRAY_DLL_LOCAL CdRA_ReadPool;
+
 	/// The reading algorithm with random access on data stream
 	class COREARRAY_DLL_DEFAULT CdRA_Read: public CdRAAlgorithm
 	{
 	public:
+		friend class CdRA_ReadPool;
+		friend class CdRA_Write;
+
+		/// the zone map entry of a block in the uncompressed data
+		struct TZoneBlock
+		{
+			SIZE64 Start;    ///< the starting element
+			SIZE64 Count;    ///< the number of elements
+			double Min;      ///< the minimum, NaN if no value
+			double Max;      ///< the maximum, NaN if no value
+			C_Int64 NumNA;   ///< the number of missing values
+		};
+
 		/// constructor
 		CdRA_Read(CdRecodeStream *owner);
 		/// destructor
@@ -352,6 +521,30 @@ namespace CoreArray
 		void GetUpdated();
 		/// get block lists
 		void GetBlockInfo(vector<SIZE64> &RawSize, vector<SIZE64> &CmpSize);
+		/// get the zone map of all blocks, return false if there is no zone map
+		bool GetZoneMap(vector<TZoneBlock> &Out);
+		/// get the zone map of the blocks having values within [Lower, Upper]
+		bool SelectZone(double Lower, double Upper, vector<TZoneBlock> &Out);
+
+		/// a range of uncompressed data being read
+		struct TAccess
+		{
+			SIZE64 Start;    ///< the starting position
+			SIZE64 Length;   ///< the number of bytes
+		};
+		/// start or stop recording the access trace, cleared when started
+		void SetTrace(bool Enable);
+		/// whether the access trace is being recorded
+		COREARRAY_INLINE bool Tracing() const { return fTracing; }
+		/// the access trace, the consecutive reads are merged
+		COREARRAY_INLINE const vector<TAccess> &Trace() const { return fTrace; }
+
+		/// the number of helper threads decompressing blocks, 0 for none
+		COREARRAY_INLINE int NumThread() const { return fNumThread; }
+		/// the version number of the stream
+		COREARRAY_INLINE C_UInt8 Version() const { return fVersion; }
+		/// whether the decompressed blocks have been modified by PatchWrite()
+		COREARRAY_INLINE bool Patched() const { return !fPatch.empty(); }
 
 	protected:
 		/// the version number
@@ -395,17 +588,90 @@ namespace CoreArray
 		virtual bool ReadMagicNumber(CdStream &Stream) = 0;
 		/// load the indexing information for version 0x11
 		void LoadIndexing();
+		/// the zone map of blocks, loaded by LoadZoneMap()
+		vector<TZoneStat> fZoneList;
+		/// load the zone map stored after the indexing for version 0x13
+		void LoadZoneMap();
+
+		/// whether to record the access trace
+		bool fTracing;
+		/// the access trace
+		vector<TAccess> fTrace;
+		/// add the reading of Count bytes at Position to the access trace
+		void TraceRead(SIZE64 Position, ssize_t Count);
+
+		/// the decompressed blocks modified by PatchWrite(), indexed by block
+		map<C_Int32, vector<C_UInt8> > fPatch;
+		/// the block in fPatchBlk, -1 for none
+		C_Int32 fPatchIdx;
+		/// the decompressed data of an unmodified block read by PatchRead()
+		vector<C_UInt8> fPatchBlk;
+		/// the decompressed data of block Idx, added to fPatch if Modify
+		C_UInt8 *PatchBlock(C_Int32 Idx, bool Modify);
+		/// read from the blocks with the modified ones starting at Position
+		ssize_t PatchRead(void *Buffer, ssize_t Count, SIZE64 &Position);
+		/// modify the decompressed blocks starting at Position, requiring
+		/// the block list (version 0x11), and the data size is not changed
+		ssize_t PatchWrite(const void *Buffer, ssize_t Count, SIZE64 &Position);
+
+		/// the number of helper threads
+		int fNumThread;
+		/// the helper threads and the decompressed blocks, or NULL
+		CdRA_ReadPool *fPool;
+		/// the block in fParBlock, -1 for none
+		C_Int32 fParIdx;
+		/// the decompressed data of block fParIdx
+		const C_UInt8 *fParBlock;
+
+		/// the block in the shared cache being read, or NULL
+		CdRABlockCache::TBlock *fCacheBlk;
+		/// the data of fCacheBlk, i.e., the current block
+		const C_UInt8 *fCacheData;
+
+		/// decompress the blocks ahead on Num helper threads when reading
+		/// sequentially, requiring the block list (version 0x11)
+		void SetNumThread(int Num);
+		/// read from the decompressed blocks starting at Position
+		ssize_t ParallelRead(void *Buffer, ssize_t Count, SIZE64 &Position);
+		/// locate the block of Position in parallel mode
+		void ParallelSeek(SIZE64 Position);
+		/// read the compressed data of block Idx
+		void LoadBlock(C_Int32 Idx, vector<C_UInt8> &Cmp);
+
+		/// move to the current block in the shared cache, the block is
+		/// decompressed and added if not found, return false if not cached
+		bool CacheSeek();
+		/// read from the current block in the shared cache starting at
+		/// Position, and go to the next block if it is ended
+		ssize_t CacheRead(void *Buffer, ssize_t Count, SIZE64 &Position);
+		/// release the current block in the shared cache
+		void CacheEnd();
+		/// reset the decoder at the start of current block
+		virtual void Reset() = 0;
+		/// stop the helper threads, called before a decoder is destroyed
+		void ParallelEnd();
+		/// decompress an independent block, called on helper threads
+		virtual void DecompressBlock(const C_UInt8 *Cmp, ssize_t CmpLen,
+			C_UInt8 *Raw, ssize_t RawLen) = 0;
+		/// decompress an independent block, and restore the filtered data
+		void DecodeBlock(const C_UInt8 *Cmp, ssize_t CmpLen,
+			C_UInt8 *Raw, ssize_t RawLen);
 
 	private:
 		/// get the header of block used in Version_1.0
 		inline void GetBlockHeader_v1_0();
 	};
 
+	class COREARRAY_DLL_LOCAL CdRA_WritePool;
+
 	/// The writing algorithm with random access on data stream
 	class COREARRAY_DLL_DEFAULT CdRA_Write: public CdRAAlgorithm
 	{
 	public:
+		friend class CdRA_WritePool;
+
 		CdRA_Write(CdRecodeStream *owner, TBlockSize bs);
+		~CdRA_Write();
 
 		/// initialize the stream with magic number and others
 		void InitWriteStream();
@@ -417,8 +683,25 @@ namespace CoreArray
 		/// finalize a compressed block
 		void DoneWriteBlock();
 
+		/// the number of helper threads compressing blocks, 0 for none
+		COREARRAY_INLINE int NumThread() const { return fNumThread; }
+
+		/// filter the raw data of blocks with the element size in bytes,
+		/// if nothing has been written, the blocks are always buffered
+		void SetFilter(TFilter Filter, int ElmSize);
+		/// save the zone map of blocks with the element type and size in bytes,
+		/// if nothing has been written, the blocks are always buffered
+		void SetZoneMap(TZoneMap Map, int ElmSize);
+		/// continue the stream Src (version 0x11 or later) if nothing has been
+		/// written: the blocks are kept except the last one if Tail is not
+		/// NULL, which is decompressed to Tail to be written again; if the
+		/// encoder is on another stream, the blocks are copied to it and the
+		/// blocks modified in Src are compressed again
+		void InitAppendStream(CdRA_Read &Src, vector<C_UInt8> *Tail);
+
 	protected:
-		/// the version number, 0x11 by default
+		/// the version number, 0x11 by default, 0x12 with a filter, 0x13 with
+		/// a zone map
 		C_UInt8 fVersion;
 		/// the total number of independent compressed block
 		C_Int32 fBlockNum;
@@ -434,9 +717,42 @@ namespace CoreArray
 		vector<C_UInt64> fBlockInfoList;
 		/// add indexing info to fBlockInfoList
 		inline void AddBlockInfo(C_UInt32 CmpLen, C_UInt32 RawLen);
+		/// the zone map of blocks written
+		vector<TZoneStat> fZoneList;
+		/// add the indexing info and zone map of the current block in Src
+		void CopyBlockInfo(CdRA_Read &Src);
+		/// set the version according to the filter and zone map, and rewrite
+		/// the stream header
+		void ResetVersion();
 
 		/// write the magic number on Stream
 		virtual void WriteMagicNumber(CdStream &Stream) = 0;
+
+		/// the number of helper threads
+		int fNumThread;
+		/// the helper threads and the queue of blocks, or NULL
+		CdRA_WritePool *fPool;
+		/// the target size of a compressed block
+		ssize_t fParBlockSize;
+		/// the total sizes of raw and compressed data in parallel blocks
+		SIZE64 fParRawTotal, fParCmpTotal;
+
+		/// compress blocks on Num helper threads, if nothing has been written
+		void SetNumThread(int Num);
+		/// buffer the data, and queue the full blocks for helper threads
+		void ParallelWrite(const void *Buffer, ssize_t Count);
+		/// wait for the oldest queued block, and write it
+		void ParallelRetire();
+		/// queue the buffered data, and write all compressed blocks in order
+		void ParallelFlush();
+		/// stop the helper threads, called before an encoder is destroyed
+		void ParallelEnd();
+		/// compress an independent block to Out, called on helper threads
+		virtual void CompressBlock(const C_UInt8 *Raw, ssize_t Len,
+			vector<C_UInt8> &Out) = 0;
+		/// apply the filter to an independent block, and compress it to Out
+		void EncodeBlock(const C_UInt8 *Raw, ssize_t Len,
+			vector<C_UInt8> &Out);
 	};
 
 
@@ -516,6 +832,7 @@ namespace CoreArray
 	{
 	public:
 		CdZEncoder_RA(CdStream &Dest, TLevel Level, TBlockSize BlockSize);
+		virtual ~CdZEncoder_RA();
 
 		virtual ssize_t Write(const void *Buffer, ssize_t Count);
 		virtual void Close();
@@ -527,14 +844,30 @@ namespace CoreArray
 		**/
 		virtual void CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count);
 
+		/// compress blocks on Num helper threads, if nothing has been written
+		COREARRAY_INLINE void SetNumThread(int Num)
+			{ CdRA_Write::SetNumThread(Num); }
+		/// filter the raw data of blocks, if nothing has been written
+		COREARRAY_INLINE void SetFilter(TFilter Filter, int ElmSize)
+			{ CdRA_Write::SetFilter(Filter, ElmSize); }
+		COREARRAY_INLINE void SetZoneMap(TZoneMap Map, int ElmSize)
+			{ CdRA_Write::SetZoneMap(Map, ElmSize); }
+		/// continue the stream Src, if nothing has been written
+		COREARRAY_INLINE void InitAppendStream(CdRA_Read &Src,
+			vector<C_UInt8> *Tail) { CdRA_Write::InitAppendStream(Src, Tail); }
+
 	protected:
 		ssize_t fBufferSize;
 		ssize_t fBlockZIPSize, fCurBlockZIPSize;
+		int fWindowBits;
 
 		/// write the magic number
 		virtual void WriteMagicNumber(CdStream &Stream);
 		/// finish and close a ZIP compressed block
 		void SyncFinishBlock();
+		/// compress an independent block to Out
+		virtual void CompressBlock(const C_UInt8 *Raw, ssize_t Len,
+			vector<C_UInt8> &Out);
 	};
 
 
@@ -546,15 +879,25 @@ namespace CoreArray
 		friend class CdZEncoder_RA;
 
 		CdZDecoder_RA(CdStream &Source);
+		virtual ~CdZDecoder_RA();
 
 		virtual ssize_t Read(void *Buffer, ssize_t Count);
+		/// modify the decompressed data without changing the size
+		virtual ssize_t Write(const void *Buffer, ssize_t Count);
 		virtual SIZE64 Seek(SIZE64 Offset, TdSysSeekOrg Origin);
 
+		/// decompress the blocks ahead on Num helper threads
+		COREARRAY_INLINE void SetNumThread(int Num)
+			{ CdRA_Read::SetNumThread(Num); }
+
 	protected:
 		/// read the magic number on Stream
 		virtual bool ReadMagicNumber(CdStream &Stream);
 		/// reset the variables internally
 		void Reset();
+		/// decompress an independent block
+		virtual void DecompressBlock(const C_UInt8 *Cmp, ssize_t CmpLen,
+			C_UInt8 *Raw, ssize_t RawLen);
 	};
 
 
@@ -685,6 +1028,18 @@ namespace CoreArray
 		COREARRAY_INLINE bool HaveClosed() const { return fHaveClosed; }
 		COREARRAY_INLINE CdRecodeStream::TLevel Level() const { return fLevel; }
 
+		/// compress blocks on Num helper threads, if nothing has been written
+		COREARRAY_INLINE void SetNumThread(int Num)
+			{ CdRA_Write::SetNumThread(Num); }
+		/// filter the raw data of blocks, if nothing has been written
+		COREARRAY_INLINE void SetFilter(TFilter Filter, int ElmSize)
+			{ CdRA_Write::SetFilter(Filter, ElmSize); }
+		COREARRAY_INLINE void SetZoneMap(TZoneMap Map, int ElmSize)
+			{ CdRA_Write::SetZoneMap(Map, ElmSize); }
+		/// continue the stream Src, if nothing has been written
+		COREARRAY_INLINE void InitAppendStream(CdRA_Read &Src,
+			vector<C_UInt8> *Tail) { CdRA_Write::InitAppendStream(Src, Tail); }
+
 		TdCompressRemainder *PtrExtRec;
 
 	protected:
@@ -704,6 +1059,9 @@ namespace CoreArray
 		virtual void WriteMagicNumber(CdStream &Stream);
 		/// compressing
 		void Compressing(int bufsize);
+		/// compress an independent block to Out
+		virtual void CompressBlock(const C_UInt8 *Raw, ssize_t Len,
+			vector<C_UInt8> &Out);
 	};
 
 	/// Output stream for LZ4 with the support of random access
@@ -714,14 +1072,19 @@ namespace CoreArray
 		friend class CdLZ4Encoder_RA;
 
 		CdLZ4Decoder_RA(CdStream &Source);
+		virtual ~CdLZ4Decoder_RA();
 
 		virtual ssize_t Read(void *Buffer, ssize_t Count);
+		/// modify the decompressed data without changing the size
 		virtual ssize_t Write(const void *Buffer, ssize_t Count);
 		virtual SIZE64 Seek(SIZE64 Offset, TdSysSeekOrg Origin);
 		virtual SIZE64 GetSize();
 		virtual void SetSize(SIZE64 NewSize);
 
 		COREARRAY_INLINE CdRecodeStream::TLevel Level() const { return fLevel; }
+		/// decompress the blocks ahead on Num helper threads
+		COREARRAY_INLINE void SetNumThread(int Num)
+			{ CdRA_Read::SetNumThread(Num); }
 
 	protected:
 		/// the compression level
@@ -741,6 +1104,9 @@ namespace CoreArray
 		virtual bool ReadMagicNumber(CdStream &Stream);
 		/// reset the variables internally
 		void Reset();
+		/// decompress an independent block
+		virtual void DecompressBlock(const C_UInt8 *Cmp, ssize_t CmpLen,
+			C_UInt8 *Raw, ssize_t RawLen);
 	};
 
 
@@ -801,6 +1167,8 @@ namespace CoreArray
 		bool fHaveClosed;
 		void SyncFinish();
 		void InitXZStream();
+		/// initialize an xz encoder with the compression level
+		static void InitXZStream(lzma_stream &XZ, TLevel Level);
 	};
 
 
@@ -829,6 +1197,7 @@ namespace CoreArray
 	{
 	public:
 		CdXZEncoder_RA(CdStream &Dest, TLevel Level, TBlockSize BlockSize);
+		virtual ~CdXZEncoder_RA();
 
 		virtual ssize_t Write(const void *Buffer, ssize_t Count);
 		virtual void Close();
@@ -840,6 +1209,18 @@ namespace CoreArray
 		**/
 		virtual void CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count);
 
+		/// compress blocks on Num helper threads, if nothing has been written
+		COREARRAY_INLINE void SetNumThread(int Num)
+			{ CdRA_Write::SetNumThread(Num); }
+		/// filter the raw data of blocks, if nothing has been written
+		COREARRAY_INLINE void SetFilter(TFilter Filter, int ElmSize)
+			{ CdRA_Write::SetFilter(Filter, ElmSize); }
+		COREARRAY_INLINE void SetZoneMap(TZoneMap Map, int ElmSize)
+			{ CdRA_Write::SetZoneMap(Map, ElmSize); }
+		/// continue the stream Src, if nothing has been written
+		COREARRAY_INLINE void InitAppendStream(CdRA_Read &Src,
+			vector<C_UInt8> *Tail) { CdRA_Write::InitAppendStream(Src, Tail); }
+
 	protected:
 		ssize_t fBufferSize;
 		ssize_t fBlockZIPSize, fCurBlockZIPSize;
@@ -848,6 +1229,9 @@ namespace CoreArray
 		virtual void WriteMagicNumber(CdStream &Stream);
 		/// finish and close a ZIP compressed block
 		void SyncFinishBlock();
+		/// compress an independent block to Out
+		virtual void CompressBlock(const C_UInt8 *Raw, ssize_t Len,
+			vector<C_UInt8> &Out);
 	};
 
 
@@ -859,15 +1243,25 @@ namespace CoreArray
 		friend class CdXZEncoder_RA;
 
 		CdXZDecoder_RA(CdStream &Source);
+		virtual ~CdXZDecoder_RA();
 
 		virtual ssize_t Read(void *Buffer, ssize_t Count);
+		/// modify the decompressed data without changing the size
+		virtual ssize_t Write(const void *Buffer, ssize_t Count);
 		virtual SIZE64 Seek(SIZE64 Offset, TdSysSeekOrg Origin);
 
+		/// decompress the blocks ahead on Num helper threads
+		COREARRAY_INLINE void SetNumThread(int Num)
+			{ CdRA_Read::SetNumThread(Num); }
+
 	protected:
 		/// read the magic number on Stream
 		virtual bool ReadMagicNumber(CdStream &Stream);
 		/// reset the variables internally
 		void Reset();
+		/// decompress an independent block
+		virtual void DecompressBlock(const C_UInt8 *Cmp, ssize_t CmpLen,
+			C_UInt8 *Raw, ssize_t RawLen);
 	};
 
 
@@ -889,6 +1283,154 @@ namespace CoreArray
 
 
 
+	// =====================================================================
+	// The classes of zstd stream
+	// =====================================================================
+
+#ifndef COREARRAY_NO_ZSTD
+
+	/// Input stream for zstd
+	class COREARRAY_DLL_DEFAULT CdZSTDEncoder:
+		public CdRecodeStream, public CdRecodeLevel
+	{
+	public:
+		CdZSTDEncoder(CdStream &Dest, TLevel Level);
+		virtual ~CdZSTDEncoder();
+
+		virtual ssize_t Read(void *Buffer, ssize_t Count);
+		virtual ssize_t Write(const void *Buffer, ssize_t Count);
+		virtual SIZE64 Seek(SIZE64 Offset, TdSysSeekOrg Origin);
+		virtual void SetSize(SIZE64 NewSize);
+		virtual void Close();
+
+		ssize_t Pending();
+		COREARRAY_INLINE bool HaveClosed() const { return fHaveClosed; }
+		TdCompressRemainder *PtrExtRec;
+
+	protected:
+		ZSTD_CCtx *fZStream;
+		bool fHaveClosed;
+		/// end the current frame and write out all buffered data
+		void SyncFinish();
+		/// set the parameters of a zstd context with the compression level
+		static void InitZSTDStream(ZSTD_CCtx *ZS, TLevel Level);
+	};
+
+
+	/// Output stream for zstd
+	class COREARRAY_DLL_DEFAULT CdZSTDDecoder: public CdRecodeStream
+	{
+	public:
+		CdZSTDDecoder(CdStream &Source);
+		virtual ~CdZSTDDecoder();
+
+		virtual ssize_t Read(void *Buffer, ssize_t Count);
+		virtual ssize_t Write(const void *Buffer, ssize_t Count);
+		virtual SIZE64 Seek(SIZE64 Offset, TdSysSeekOrg Origin);
+		virtual SIZE64 GetSize();
+		virtual void SetSize(SIZE64 NewSize);
+
+	protected:
+		ZSTD_DCtx *fZStream;
+		ZSTD_inBuffer fInput;
+		C_UInt8 fBuffer[16384];  // 2^14, 16K
+		SIZE64 fCurPosition;
+		/// set the parameters of a zstd decompression context
+		static void InitZSTDStream(ZSTD_DCtx *ZS);
+		/// start decoding a new frame
+		void ResetZSTDStream();
+	};
+
+
+	/// Input stream for zstd with the support of random access
+	class COREARRAY_DLL_DEFAULT CdZSTDEncoder_RA:
+		protected CdRA_Write, public CdZSTDEncoder
+	{
+	public:
+		CdZSTDEncoder_RA(CdStream &Dest, TLevel Level, TBlockSize BlockSize);
+		virtual ~CdZSTDEncoder_RA();
+
+		virtual ssize_t Write(const void *Buffer, ssize_t Count);
+		virtual void Close();
+
+		/// Copy from a CdStream object
+		/** \param Source  a stream object
+		 *  \param Pos     the starting position
+		 *  \param Count   the number of bytes, -1 for all data starting from Pos
+		**/
+		virtual void CopyFrom(CdStream &Source, SIZE64 Pos, SIZE64 Count);
+
+		/// compress blocks on Num helper threads, if nothing has been written
+		COREARRAY_INLINE void SetNumThread(int Num)
+			{ CdRA_Write::SetNumThread(Num); }
+		/// filter the raw data of blocks, if nothing has been written
+		COREARRAY_INLINE void SetFilter(TFilter Filter, int ElmSize)
+			{ CdRA_Write::SetFilter(Filter, ElmSize); }
+		COREARRAY_INLINE void SetZoneMap(TZoneMap Map, int ElmSize)
+			{ CdRA_Write::SetZoneMap(Map, ElmSize); }
+		/// continue the stream Src, if nothing has been written
+		COREARRAY_INLINE void InitAppendStream(CdRA_Read &Src,
+			vector<C_UInt8> *Tail) { CdRA_Write::InitAppendStream(Src, Tail); }
+
+	protected:
+		ssize_t fBlockZIPSize, fCurBlockZIPSize;
+
+		/// write the magic number
+		virtual void WriteMagicNumber(CdStream &Stream);
+		/// finish and close a zstd frame
+		void SyncFinishBlock();
+		/// compress an independent block to Out
+		virtual void CompressBlock(const C_UInt8 *Raw, ssize_t Len,
+			vector<C_UInt8> &Out);
+	};
+
+
+	/// Output stream for zstd with the support of random access
+	class COREARRAY_DLL_DEFAULT CdZSTDDecoder_RA:
+		public CdRA_Read, public CdZSTDDecoder
+	{
+	public:
+		friend class CdZSTDEncoder_RA;
+
+		CdZSTDDecoder_RA(CdStream &Source);
+		virtual ~CdZSTDDecoder_RA();
+
+		virtual ssize_t Read(void *Buffer, ssize_t Count);
+		/// modify the decompressed data without changing the size
+		virtual ssize_t Write(const void *Buffer, ssize_t Count);
+		virtual SIZE64 Seek(SIZE64 Offset, TdSysSeekOrg Origin);
+
+		/// decompress the blocks ahead on Num helper threads
+		COREARRAY_INLINE void SetNumThread(int Num)
+			{ CdRA_Read::SetNumThread(Num); }
+
+	protected:
+		/// read the magic number on Stream
+		virtual bool ReadMagicNumber(CdStream &Stream);
+		/// reset the variables internally
+		void Reset();
+		/// decompress an independent block
+		virtual void DecompressBlock(const C_UInt8 *Cmp, ssize_t CmpLen,
+			C_UInt8 *Raw, ssize_t RawLen);
+	};
+
+
+	/// Exception for zstd stream
+	class COREARRAY_DLL_EXPORT EZSTDError: public ErrRecodeStream
+	{
+	public:
+		EZSTDError(): ErrRecodeStream()
+			{ }
+		EZSTDError(const char *fmt, ...): ErrRecodeStream()
+			{ _COREARRAY_ERRMACRO_(fmt); }
+		EZSTDError(const std::string &msg): ErrRecodeStream()
+			{ fMessage = msg; }
+	};
+
+#endif
+
+
+
 	// =====================================================================
 	// GDS block stream
 	// =====================================================================
@@ -950,12 +1492,15 @@ namespace CoreArray
 		CdBlockCollection &fCollection;
 		TdGDSBlockID fID;
 		TBlockInfo *fList, *fCurrent;
+		/// the blocks in fList ordered by BlockStart, for binary search
+		vector<TBlockInfo*> fExtent;
 		SIZE64 fPosition, fBlockCapacity;
 		TdGDSPos fBlockSize;
 
 	private:
     	bool fNeedSyncSize;
 		TBlockInfo *_FindCur(const SIZE64 Pos);
+		void _RebuildExtent();
 	};
 
 	/// The pointer to the chunk stream
@@ -988,12 +1533,60 @@ namespace CoreArray
 
 		int NumOfFragment();
 
+		/// append the table of contents (block map) to the end of stream
+		void WriteTOC();
+		/// set the growth policy of block streams
+		/** \param Ratio     reserve Ratio times the current capacity when a
+		 *                   stream grows, 0 for exact growth
+		 *  \param MaxSize   the maximum size of a reservation in bytes
+		 *  \param Prealloc  allocate disk space for the growth if supported
+		**/
+		void SetGrowthPolicy(double Ratio, SIZE64 MaxSize=0x4000000,
+			bool Prealloc=true);
+		/// release the reserved space after the end of each stream
+		void ReleaseReserved();
+		/// compact the stream in place
+		/** move the fragmented blocks and the blocks at the end of stream
+		 *  into unused space, and truncate the stream
+		 *  \param TimeLimit  stop after TimeLimit seconds if > 0, checked
+		 *                    after each move of block stream
+		 *  \return true if finished, or false if it is stopped by the time
+		 *          limit and it can be resumed by calling it again
+		**/
+		bool Compact(double TimeLimit=0);
+
 		COREARRAY_INLINE CdStream *Stream() const
 			{ return fStream; }
 		COREARRAY_INLINE CdObjClassMgr *ClassMgr() const
 			{ return fClassMgr; }
 		COREARRAY_INLINE bool ReadOnly() const
 			{ return fReadOnly; }
+		/// whether read-only arrays prefetch data in background when scanned
+		COREARRAY_INLINE bool ReadAhead() const
+			{ return fReadAhead; }
+		COREARRAY_INLINE void SetReadAhead(bool Value)
+			{ fReadAhead = Value; }
+		/// whether arrays write their buffers to the stream in background,
+		/// it should be set before any array is opened
+		COREARRAY_INLINE bool WriteBehind() const
+			{ return fWriteBehind; }
+		COREARRAY_INLINE void SetWriteBehind(bool Value)
+			{ fWriteBehind = Value; }
+		/// the number of helper threads compressing the blocks of
+		/// random-access encoders, 0 for the calling thread
+		COREARRAY_INLINE int CompressThreads() const
+			{ return fCompressThreads; }
+		COREARRAY_INLINE void SetCompressThreads(int Value)
+			{ fCompressThreads = (Value > 0) ? Value : 0; }
+		/// the number of helper threads decompressing the blocks ahead for
+		/// random-access decoders, 0 for the calling thread
+		COREARRAY_INLINE int DecompressThreads() const
+			{ return fDecompressThreads; }
+		COREARRAY_INLINE void SetDecompressThreads(int Value)
+			{ fDecompressThreads = (Value > 0) ? Value : 0; }
+		/// the ratio of reservation when a stream grows, 0 for exact growth
+		COREARRAY_INLINE double GrowthRatio() const
+			{ return fGrowthRatio; }
 		COREARRAY_INLINE const vector<CdBlockStream*> &BlockList() const
 			{ return fBlockList; }
 		COREARRAY_INLINE const CdBlockStream::TBlockInfo* UnusedBlock() const
@@ -1002,15 +1595,61 @@ namespace CoreArray
 	protected:
 		CdStream *fStream;
 		SIZE64 fStreamSize;
+		/// the unused blocks linked by TBlockInfo::Next in order of position
 		PdBlockStream_BlockInfo fUnuse;
+		/// the unused blocks indexed by position
+		map<SIZE64, PdBlockStream_BlockInfo> fFreePos;
+		/// the unused blocks indexed by (size, position) for best-fit search
+		set< pair<SIZE64, SIZE64> > fFreeSize;
 		vector<CdBlockStream*> fBlockList;
 		SIZE64 fCodeStart;
 		CdObjClassMgr *fClassMgr;
 		bool fReadOnly;
-
+		bool fReadAhead;
+		bool fWriteBehind;
+		int fCompressThreads;
+		int fDecompressThreads;
+		/// serialize the changes of block map from background writers
+		CdThreadMutex fMutex;
+		const C_UInt8 *fMapMemory;  ///< memory-mapped view of fStream, or NULL
+		SIZE64 fMapSize;             ///< the size of memory-mapped view
+		/// the block of table of contents, or NULL if not available
+		PdBlockStream_BlockInfo fTocBlock;
+		double fGrowthRatio;     ///< the ratio of reservation for growth
+		SIZE64 fGrowthMaxSize;   ///< the maximum size of a reservation
+		bool fPreallocate;       ///< allocate disk space for the growth
+
+		/// the mutex serializing block streams, or NULL if no background
+		/// writer is allowed
+		COREARRAY_INLINE CdThreadMutex *_WriteMutex()
+			{ return fWriteBehind ? &fMutex : NULL; }
 		void _IncStreamSize(CdBlockStream &Block, const SIZE64 NewSize);
 		void _DecStreamSize(CdBlockStream &Block, const SIZE64 NewSize);
-		PdBlockStream_BlockInfo _NeedBlock(SIZE64 Size, bool Head);
+		/// allocate a block from Free, the best-fit unused block or the end
+		PdBlockStream_BlockInfo _NeedBlock(SIZE64 Size, bool Head,
+			PdBlockStream_BlockInfo Free=NULL);
+		/// the best-fit unused block starting before Limit, or NULL
+		PdBlockStream_BlockInfo _FindFree(SIZE64 Size, SIZE64 Limit);
+		/// move a stream to a new single block
+		void _MoveStream(CdBlockStream &Block, PdBlockStream_BlockInfo Free);
+
+		/// add a block to the unused blocks, without changing the stream
+		void _InsertFree(PdBlockStream_BlockInfo p);
+		/// remove a block from the unused blocks
+		void _EraseFree(PdBlockStream_BlockInfo p);
+		/// release a block, merged with the adjacent unused blocks
+		void _AddFree(PdBlockStream_BlockInfo p);
+		/// split the tail after Size bytes of a block to an unused block
+		void _SplitFree(PdBlockStream_BlockInfo p, SIZE64 Size);
+		/// the size to grow by when a stream needs Need bytes more
+		SIZE64 _GrowSize(const CdBlockStream &Block, SIZE64 Need) const;
+		/// resize the underlying stream, and preallocate the growth
+		void _SetStreamSize(SIZE64 NewSize);
+
+		/// load the block map from the table of contents, false if invalid
+		bool _LoadTOC();
+		/// remove the table of contents, since the block map is changing
+		void _DropTOC();
 
 	private:
 		TdGDSBlockID vNextID;
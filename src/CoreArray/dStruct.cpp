@@ -892,8 +892,12 @@ CdAllocArray::CdAllocArray(ssize_t vElmSize): CdAbstractArray()
 
 CdAllocArray::~CdAllocArray()
 {
-	CloseWriter();
-	if (fGDSStream) Synchronize();
+	// the error of writing is reported by CloseWriter() or Synchronize()
+	// when the file is closed, and a destructor must not throw
+	try {
+		CloseWriter();
+		if (fGDSStream) Synchronize();
+	} catch (...) { }
 }
 
 bool CdAllocArray::Empty()
@@ -1109,11 +1113,15 @@ void CdAllocArray::Synchronize()
 {
 	CdAbstractArray::Synchronize();
 
-	if (fGDSStream && (!fGDSStream->ReadOnly()) && fNeedUpdate)
+	if (fGDSStream && (!fGDSStream->ReadOnly()))
 	{
+		// also wait for the background writer if any
 		if (fAllocator.BufStream())
 			fAllocator.BufStream()->FlushWrite();
-		UpdateInfo(NULL);
+		if (fPipeInfo)
+			_SavePatch();
+		if (fNeedUpdate)
+			UpdateInfo(NULL);
 	}
 }
 
@@ -1139,7 +1147,8 @@ void CdAllocArray::CloseWriter()
 				if (fPipeInfo)
 					fPipeInfo->PushReadPipe(*fAllocator.BufStream());
 				vAllocStream->Release();
-            }
+            } else
+				_SavePatch();
 		} else {
 			fNeedUpdate = true;
 			Synchronize();
@@ -1147,6 +1156,88 @@ void CdAllocArray::CloseWriter()
 	}
 }
 
+bool CdAllocArray::ReopenWriter()
+{
+	CdBufStream *buf = fAllocator.BufStream();
+	if (!buf || !fPipeInfo || !vAllocStream || !fGDSStream)
+		return false;
+	CdRA_Read *Src = dynamic_cast<CdRA_Read*>(buf->Stream());
+	if (!Src || (Src->Version() < 0x11))
+		return false;
+	// elements of whole bytes or packed bits
+	if (!IsPrimitive() && (BitOf() % 8 == 0))
+		return false;
+	_CheckWritable();
+	buf->FlushWrite();
+	// the modified blocks are saved to a new stream first
+	if (Src->Patched())
+	{
+		_SavePatch();
+		buf = fAllocator.BufStream();
+		Src = dynamic_cast<CdRA_Read*>(buf->Stream());
+	}
+
+	// keep the decoder until the encoder continues its stream
+	buf->AddRef();
+	vAllocStream->AddRef();
+	vector<C_UInt8> Tail;
+	try {
+		vAllocStream->SetPosition(0);
+		fAllocator.Initialize(*vAllocStream, false, true);
+		fPipeInfo->PushAppendPipe(*fAllocator.BufStream(), *Src, &Tail);
+	} catch (...) {
+		buf->Release();
+		vAllocStream->Release();
+		throw;
+	}
+	buf->Release();
+	vAllocStream->Release();
+	if (fGDSStream->Collection().WriteBehind())
+		fAllocator.BufStream()->SetWriteBehind(true);
+
+	// write the data of the last block, and the incomplete byte of packed
+	// bits is kept in the remainder of the pipe
+	size_t n = Tail.size();
+	TdCompressRemainder &R = fPipeInfo->Remainder();
+	R.Size = 0;
+	if ((n > 0) && ((fTotalCount * BitOf()) % 8 != 0))
+	{
+		n --;
+		R.Size = 1;
+		R.Buf[0] = Tail[n];
+	}
+	fAllocator.SetPosition(fAllocator.BufStream()->Stream()->Position());
+	if (n > 0)
+		fAllocator.WriteData(&Tail[0], n);
+	return true;
+}
+
+bool CdAllocArray::CopyOnWrite()
+{
+	CdBufStream *buf = fAllocator.BufStream();
+	if (!buf || !fPipeInfo || !vAllocStream || !fGDSStream)
+		return false;
+	CdRA_Read *Src = dynamic_cast<CdRA_Read*>(buf->Stream());
+	if (!Src || (Src->Version() < 0x11))
+		return false;
+	// elements of whole bytes or packed bits
+	if (!IsPrimitive() && (BitOf() % 8 == 0))
+		return false;
+	_CheckWritable();
+
+	// the decoder accepts writing within the data
+	if (!fAllocator.CanWrite())
+	{
+		vAllocStream->AddRef();
+		fAllocator.Free();
+		vAllocStream->SetPosition(0);
+		fAllocator.Initialize(*vAllocStream, true, true);
+		fPipeInfo->PushReadPipe(*fAllocator.BufStream());
+		vAllocStream->Release();
+	}
+	return true;
+}
+
 void CdAllocArray::SetPackedMode(const char *Mode)
 {
 	_CheckWritable();
@@ -1273,6 +1364,9 @@ void CdAllocArray::Caching()
 	if (vAllocStream)
 	{
 		C_UInt8 Buffer[STREAM_BUFFER_SIZE];
+		// stop the read-ahead thread which may be reading vAllocStream
+		if (fAllocator.BufStream())
+			fAllocator.BufStream()->Stream();
 
 		SIZE64 SavePos = vAllocStream->Position();
 		vAllocStream->SetPosition(0);
@@ -1425,6 +1519,10 @@ void CdAllocArray::Loading(CdReader &Reader, TdVersion Version)
 		fAllocator.Initialize(*vAllocStream, true, !fGDSStream->ReadOnly());
 		if (fPipeInfo)
 			fPipeInfo->PushReadPipe(*fAllocator.BufStream());
+		if (fGDSStream->ReadOnly() && fGDSStream->Collection().ReadAhead())
+			fAllocator.BufStream()->SetReadAhead(true);
+		if (!fGDSStream->ReadOnly() && fGDSStream->Collection().WriteBehind())
+			fAllocator.BufStream()->SetWriteBehind(true);
 	}
 
 	fChanged = fNeedUpdate = false;
@@ -1455,6 +1553,8 @@ void CdAllocArray::Saving(CdWriter &Writer)
 			fAllocator.Initialize(*vAllocStream, true, true);
 			if (fPipeInfo)
 				fPipeInfo->PushWritePipe(*fAllocator.BufStream());
+			if (fGDSStream->Collection().WriteBehind())
+				fAllocator.BufStream()->SetWriteBehind(true);
 		}
 		TdGDSBlockID Entry = vAllocStream->ID();
 		Writer[VAR_DATA] << Entry;
@@ -1601,6 +1701,60 @@ void CdAllocArray::_SetFlushEvent()
 	fAllocator.BufStream()->OnFlush.Set(this, &CdAllocArray::UpdateInfo);
 }
 
+void CdAllocArray::_SavePatch()
+{
+	CdBufStream *buf = fAllocator.BufStream();
+	if (!buf || !vAllocStream || !fGDSStream) return;
+	CdRA_Read *Src = dynamic_cast<CdRA_Read*>(buf->Stream());
+	if (!Src) return;
+	buf->FlushWrite();
+	if (!Src->Patched()) return;
+
+	// copy on write: the encoder writes the kept blocks and the modified
+	// blocks compressed again to a new stream, which replaces the original
+	// one when it is complete
+	CdBlockCollection &Col = fGDSStream->Collection();
+	CdBlockStream *Old = vAllocStream;
+	CdBlockStream *New = Col.NewBlockStream();
+	buf->AddRef();
+	try {
+		fAllocator.Initialize(*New, false, true);
+		fPipeInfo->PushAppendPipe(*fAllocator.BufStream(), *Src, NULL);
+		fPipeInfo->Remainder().Size = 0;
+		fPipeInfo->ClosePipe(*fAllocator.BufStream());
+	} catch (...) {
+		// the modified blocks are discarded, the original stream is intact
+		fAllocator.Free();
+		Col.DeleteBlockStream(New->ID());
+		Old->SetPosition(0);
+		fAllocator.Initialize(*Old, true, true);
+		fPipeInfo->PushReadPipe(*fAllocator.BufStream());
+		buf->Release();
+		throw;
+	}
+	buf->Release();
+
+	// switch to the new stream after its data is on disk, and then the
+	// original stream is released
+	Col.Stream()->Sync();
+	vAllocStream = New;
+	vAllocID = New->ID();
+	if (vAlloc_Ptr != 0)
+	{
+		BYTE_LE<CdStream> W(fGDSStream);
+		W.SetPosition(vAlloc_Ptr);
+		W << vAllocID;
+	}
+	fNeedUpdate = true;
+	UpdateInfo(NULL);
+	fAllocator.Free();
+	Col.DeleteBlockStream(Old->ID());
+
+	vAllocStream->SetPosition(0);
+	fAllocator.Initialize(*vAllocStream, true, true);
+	fPipeInfo->PushReadPipe(*fAllocator.BufStream());
+}
+
 
 
 
@@ -455,6 +455,14 @@ namespace CoreArray
 
 		virtual void Synchronize();
         virtual void CloseWriter();
+		/// reopen the data compressed with random access for appending after
+		/// CloseWriter(), without recompressing the existing blocks; return
+		/// false if not supported by the compression method or the data type
+		bool ReopenWriter();
+		/// allow writing the data compressed with random access after
+		/// CloseWriter(), the modified blocks are compressed again when the
+		/// object is synchronized or closed; return false if not supported
+		bool CopyOnWrite();
 
 		virtual void SetPackedMode(const char *Mode);
 
@@ -545,6 +553,9 @@ namespace CoreArray
 		void _SetSmallBuffer();
 		void _SetLargeBuffer();
 		void _SetFlushEvent();
+		/// compress the blocks modified after CopyOnWrite() again, and write
+		/// all blocks to a new stream which replaces the original one
+		void _SavePatch();
 
 	private:
 		TdGDSBlockID vAllocID;
@@ -36,6 +36,13 @@
 #include "dVLIntGDS.h"
 #include <typeinfo>
 
+#ifdef COREARRAY_SIMD_SSSE3
+#   include <tmmintrin.h>
+#endif
+#if defined(COREARRAY_SIMD_AVX2) || defined(COREARRAY_TARGET_DISPATCH)
+#   include <immintrin.h>
+#endif
+
 
 using namespace std;
 using namespace CoreArray;
@@ -429,6 +436,853 @@ void CdVL_UInt::SetStreamPos(C_Int64 idx)
 }
 
 
+// =====================================================================
+// Stream-vbyte integers
+// =====================================================================
+
+/// the number of data bytes for a control byte
+static C_UInt8 SVB_Len[256];
+/// the shuffle masks for a control byte
+static C_UInt8 SVB_Shuf[256][16];
+
+/// get an integer with (Code+1) little-endian bytes, 's' should be readable
+/// for 4 bytes
+static inline C_UInt32 SVB_Get(const C_UInt8 *s, C_UInt8 Code)
+{
+	static const C_UInt32 Mask[4] = { 0xFF, 0xFFFF, 0xFFFFFF, 0xFFFFFFFF };
+	return (s[0] | (C_UInt32(s[1]) << 8) | (C_UInt32(s[2]) << 16) |
+		(C_UInt32(s[3]) << 24)) & Mask[Code];
+}
+
+/// zigzag decoding
+static inline C_UInt32 SVB_UnZigZag(C_UInt32 v)
+{
+	return (v >> 1) ^ (0 - (v & 0x01));
+}
+
+/// the number of data bytes for n codes from the slot 'Head' of Ctrl[0]
+static size_t SVB_Length(const C_UInt8 *Ctrl, ssize_t Head, ssize_t n)
+{
+	size_t rv = 0;
+	if (Head > 0)
+	{
+		C_UInt8 b = (*Ctrl++) >> (Head*2);
+		for (; (Head < 4) && (n > 0); Head++, n--, b >>= 2)
+			rv += (b & 0x03) + 1;
+	}
+	for (; n >= 4; n -= 4) rv += SVB_Len[*Ctrl++];
+	if (n > 0)
+	{
+		for (C_UInt8 b = *Ctrl; n > 0; n--, b >>= 2)
+			rv += (b & 0x03) + 1;
+	}
+	return rv;
+}
+
+static size_t SVB_Decode(C_UInt32 *p, const C_UInt8 *Ctrl, const C_UInt8 *Data,
+	size_t n, bool ZigZag)
+{
+	const C_UInt8 *s = Data;
+	for (; n > 0; n--)
+	{
+		C_UInt8 b = *Ctrl++;
+		for (int k=0; k < 4; k++, b >>= 2)
+		{
+			C_UInt32 v = SVB_Get(s, b & 0x03);
+			s += (b & 0x03) + 1;
+			*p++ = ZigZag ? SVB_UnZigZag(v) : v;
+		}
+	}
+	return s - Data;
+}
+
+
+#if defined(COREARRAY_SIMD_SSSE3) || defined(COREARRAY_TARGET_DISPATCH)
+
+COREARRAY_TARGET("ssse3")
+static size_t SVB_Decode_SSSE3(C_UInt32 *p, const C_UInt8 *Ctrl,
+	const C_UInt8 *Data, size_t n, bool ZigZag)
+{
+	const C_UInt8 *s = Data;
+	const __m128i one = _mm_set1_epi32(1), zero = _mm_setzero_si128();
+	for (; n > 0; n--, p+=4)
+	{
+		C_UInt8 b = *Ctrl++;
+		__m128i v = _mm_loadu_si128((__m128i const*)s);
+		v = _mm_shuffle_epi8(v, _mm_loadu_si128((__m128i const*)SVB_Shuf[b]));
+		if (ZigZag)
+		{
+			v = _mm_xor_si128(_mm_srli_epi32(v, 1),
+				_mm_sub_epi32(zero, _mm_and_si128(v, one)));
+		}
+		_mm_storeu_si128((__m128i*)p, v);
+		s += SVB_Len[b];
+	}
+	return s - Data;
+}
+
+#endif
+
+
+#if defined(COREARRAY_SIMD_AVX2) || defined(COREARRAY_TARGET_DISPATCH)
+
+COREARRAY_TARGET("avx2")
+static size_t SVB_Decode_AVX2(C_UInt32 *p, const C_UInt8 *Ctrl,
+	const C_UInt8 *Data, size_t n, bool ZigZag)
+{
+	const C_UInt8 *s = Data;
+	const __m256i one = _mm256_set1_epi32(1), zero = _mm256_setzero_si256();
+	// two control bytes in the two 128-bit lanes
+	for (; n >= 2; n-=2, p+=8)
+	{
+		C_UInt8 b0 = Ctrl[0], b1 = Ctrl[1];
+		Ctrl += 2;
+		const C_UInt8 *s1 = s + SVB_Len[b0];
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(
+			_mm_loadu_si128((__m128i const*)s)),
+			_mm_loadu_si128((__m128i const*)s1), 1);
+		__m256i m = _mm256_inserti128_si256(_mm256_castsi128_si256(
+			_mm_loadu_si128((__m128i const*)SVB_Shuf[b0])),
+			_mm_loadu_si128((__m128i const*)SVB_Shuf[b1]), 1);
+		v = _mm256_shuffle_epi8(v, m);
+		if (ZigZag)
+		{
+			v = _mm256_xor_si256(_mm256_srli_epi32(v, 1),
+				_mm256_sub_epi32(zero, _mm256_and_si256(v, one)));
+		}
+		_mm256_storeu_si256((__m256i*)p, v);
+		s = s1 + SVB_Len[b1];
+	}
+	if (n > 0)
+		s += SVB_Decode(p, Ctrl, s, n, ZigZag);
+	return s - Data;
+}
+
+#endif
+
+
+/// initialize the tables and select the kernel by the CPU features
+static TdSVBKernel SVB_SelectKernel()
+{
+	for (int b=0; b < 256; b++)
+	{
+		int k = 0;
+		for (int i=0; i < 4; i++)
+		{
+			int len = ((b >> (i*2)) & 0x03) + 1;
+			for (int j=0; j < 4; j++)
+				SVB_Shuf[b][i*4 + j] = (j < len) ? (k + j) : 0x80;
+			k += len;
+		}
+		SVB_Len[b] = k;
+	}
+
+	TdSVBKernel K;
+	const char *ISA = "none";
+	K.Decode = SVB_Decode;
+
+#if defined(COREARRAY_SIMD_SSSE3) || defined(COREARRAY_TARGET_DISPATCH)
+	C_UInt32 Flag = Mach::GetCPU_Features();
+#   ifdef COREARRAY_SIMD_SSSE3
+	Flag |= Mach::cpuSSSE3;
+#   endif
+#   ifdef COREARRAY_SIMD_AVX2
+	Flag |= Mach::cpuAVX2;
+#   endif
+	if (Flag & Mach::cpuSSSE3)
+	{
+		K.Decode = SVB_Decode_SSSE3;
+		ISA = "SSSE3";
+	}
+#   if defined(COREARRAY_SIMD_AVX2) || defined(COREARRAY_TARGET_DISPATCH)
+	if (Flag & Mach::cpuAVX2)
+	{
+		K.Decode = SVB_Decode_AVX2;
+		ISA = "AVX2";
+	}
+#   endif
+#endif
+
+	Mach::SetSIMD_Kernel("vl_int.svb", ISA);
+	return K;
+}
+
+TdSVBKernel CoreArray::dSVBKernel = SVB_SelectKernel();
+
+
+const ssize_t CdStreamVByte::BlockSize;
+const ssize_t CdStreamVByte::RecordSize;
+const ssize_t CdStreamVByte::BatchSize;
+
+CdStreamVByte::CdStreamVByte(bool ZigZag)
+{
+	fIndexingStream = NULL;
+	fTotalStreamSize = 0;
+	fZigZag = ZigZag;
+	fCurIndex = 0;
+	fCurStreamPosition = 0;
+}
+
+void CdStreamVByte::Read(CdAllocator &A, C_Int64 Idx, C_Int64 TotalCount,
+	C_UInt32 *p, ssize_t n)
+{
+	if (n <= 0) return;
+	if (Idx + n > TotalCount)
+		throw ErrArray("CdStreamVByte::Read: Invalid Index.");
+	SetStreamPos(A, Idx, TotalCount);
+
+	// the control bytes are loaded batch by batch
+	C_UInt8 Rec[(BatchSize/BlockSize) * RecordSize];
+	C_UInt8 Data[BlockSize*4 + 16];  // 16 bytes for loading SIMD registers
+	while (n > 0)
+	{
+		ssize_t Off = Idx & (BlockSize-1);
+		ssize_t Num = BatchSize - Off;
+		if (Num > n) Num = n;
+		C_Int64 Last = Idx + Num - 1;
+		SIZE64 RecStart = (Idx / BlockSize) * RecordSize + GDS_POS_SIZE +
+			(Off >> 2);
+		SIZE64 RecEnd = (Last / BlockSize) * RecordSize + GDS_POS_SIZE +
+			((Last & (BlockSize-1)) >> 2) + 1;
+		fIndexingStream->SetPosition(RecStart);
+		fIndexingStream->ReadData(Rec, RecEnd - RecStart);
+
+		const C_UInt8 *c = Rec;
+		for (ssize_t m; Num > 0; Num -= m, n -= m, Idx += m)
+		{
+			Off = Idx & (BlockSize-1);
+			m = BlockSize - Off;
+			if (m > Num) m = Num;
+			ssize_t Head = Off & 0x03;
+			A.ReadData(Data, SVB_Length(c, Head, m));
+
+			// decode
+			const C_UInt8 *s = Data;
+			ssize_t k = m;
+			if (Head > 0)
+			{
+				C_UInt8 b = (*c++) >> (Head*2);
+				for (; (Head < 4) && (k > 0); Head++, k--, b >>= 2)
+				{
+					C_UInt32 v = SVB_Get(s, b & 0x03);
+					s += (b & 0x03) + 1;
+					*p++ = fZigZag ? SVB_UnZigZag(v) : v;
+				}
+			}
+			if (k >= 4)
+			{
+				size_t ng = k >> 2;
+				s += dSVBKernel.Decode(p, c, s, ng, fZigZag);
+				p += ng*4; c += ng; k -= ng*4;
+			}
+			if (k > 0)
+			{
+				for (C_UInt8 b = *c++; k > 0; k--, b >>= 2)
+				{
+					C_UInt32 v = SVB_Get(s, b & 0x03);
+					s += (b & 0x03) + 1;
+					*p++ = fZigZag ? SVB_UnZigZag(v) : v;
+				}
+			}
+			// skip the data position of the next block
+			c += GDS_POS_SIZE;
+		}
+	}
+
+	fCurIndex = Idx;
+	fCurStreamPosition = A.Position();
+}
+
+void CdStreamVByte::Write(CdAllocator &A, C_Int64 Idx, const C_UInt32 *p,
+	ssize_t n)
+{
+	if (!fIndexingStream)
+		throw ErrArray("CdStreamVByte::Write: no indexing stream.");
+	A.SetPosition(fTotalStreamSize);
+
+	// the records of blocks and the data bytes are saved batch by batch,
+	//   and a batch starting in the middle of a block touches one more record
+	C_UInt8 Rec[(BatchSize/BlockSize + 1) * RecordSize];
+	C_UInt8 Data[BatchSize*4 + 3];  // 3 extra bytes for encoding
+	while (n > 0)
+	{
+		ssize_t Off = Idx & (BlockSize-1);
+		SIZE64 RecStart = (Idx / BlockSize) * RecordSize +
+			(Off ? (GDS_POS_SIZE + (Off >> 2)) : 0);
+		C_UInt8 *r = Rec, *s = Data;
+		for (ssize_t m=BatchSize; (m > 0) && (n > 0); )
+		{
+			Off = Idx & (BlockSize-1);
+			ssize_t Cnt = BlockSize - Off;
+			if (Cnt > n) Cnt = n;
+			if (Cnt > m) Cnt = m;
+			if (Off == 0)
+			{
+				// the data position of a new block
+				C_UInt64 Pos = fTotalStreamSize + (s - Data);
+				for (ssize_t k=0; k < GDS_POS_SIZE; k++, Pos >>= 8)
+					*r++ = Pos;
+			}
+			ssize_t C1 = Off >> 2, C2 = (Off + Cnt + 3) >> 2;
+			*r = 0;
+			if (Off & 0x03)
+			{
+				// the first control byte is partially used
+				fIndexingStream->SetPosition(RecStart);
+				fIndexingStream->ReadData(r, 1);
+			}
+			C_UInt8 b = *r, *pr = r;
+			for (ssize_t i=Off, iEnd=Off+Cnt; i < iEnd; )
+			{
+				C_UInt32 v = *p++;
+				if (fZigZag)
+					v = (v << 1) ^ C_UInt32(C_Int32(v) >> 31);
+				// without branches
+				C_UInt8 code = (v > 0xFF) + (v > 0xFFFF) + (v > 0xFFFFFF);
+				s[0] = v; s[1] = v >> 8; s[2] = v >> 16; s[3] = v >> 24;
+				s += code + 1;
+				b |= code << ((i & 0x03)*2);
+				if (!((++i) & 0x03))
+					{ *pr++ = b; b = 0; }
+			}
+			if (pr < r + (C2 - C1)) *pr = b;
+			r += C2 - C1;
+			Idx += Cnt; n -= Cnt; m -= Cnt;
+		}
+		fIndexingStream->SetPosition(RecStart);
+		fIndexingStream->WriteData(Rec, r - Rec);
+		A.WriteData(Data, s - Data);
+		fTotalStreamSize += s - Data;
+	}
+}
+
+void CdStreamVByte::SetStreamPos(CdAllocator &A, C_Int64 Idx,
+	C_Int64 TotalCount)
+{
+	if (fCurIndex != Idx)
+	{
+		if (Idx == TotalCount)
+		{
+			fCurStreamPosition = fTotalStreamSize;
+		} else if ((Idx > TotalCount) || (Idx < 0))
+		{
+			throw ErrArray("CdStreamVByte::SetStreamPos: Invalid Index.");
+		} else {
+			// the data position and the control bytes of the block
+			C_UInt8 Rec[RecordSize];
+			ssize_t Off = Idx & (BlockSize-1);
+			fIndexingStream->SetPosition((Idx / BlockSize) * RecordSize);
+			fIndexingStream->ReadData(Rec, GDS_POS_SIZE + ((Off + 3) >> 2));
+			C_UInt64 Pos = 0;
+			for (ssize_t k=GDS_POS_SIZE-1; k >= 0; k--)
+				Pos = (Pos << 8) | Rec[k];
+			fCurStreamPosition = Pos + SVB_Length(Rec + GDS_POS_SIZE, 0, Off);
+		}
+		fCurIndex = Idx;
+	}
+	A.SetPosition(fCurStreamPosition);
+}
+
+
+// =====================================================================
+
+CdSVB_Int::CdSVB_Int(): CdArray<TSVB_Int>(1), fSVB(true)
+{ }
+
+CdGDSObj *CdSVB_Int::NewObject()
+{
+	return (new CdSVB_Int)->AssignPipe(*this);
+}
+
+void CdSVB_Int::GetOwnBlockStream(vector<const CdBlockStream*> &Out) const
+{
+	CdArray<TSVB_Int>::GetOwnBlockStream(Out);
+	if (fSVB.fIndexingStream) Out.push_back(fSVB.fIndexingStream);
+}
+
+void CdSVB_Int::GetOwnBlockStream(vector<CdStream*> &Out)
+{
+	CdArray<TSVB_Int>::GetOwnBlockStream(Out);
+	if (fSVB.fIndexingStream) Out.push_back(fSVB.fIndexingStream);
+}
+
+void CdSVB_Int::Loading(CdReader &Reader, TdVersion Version)
+{
+	CdArray<TSVB_Int>::Loading(Reader, Version);
+	if (fGDSStream)
+	{
+		TdGDSBlockID ID;
+		Reader[VAR_INDEX] >> ID;
+		fSVB.fIndexingStream = fGDSStream->Collection()[ID];
+		// get the total size
+		if (fPipeInfo)
+		{
+			fSVB.fTotalStreamSize = fPipeInfo->StreamTotalIn();
+		} else {
+			if (fAllocator.BufStream())
+				fSVB.fTotalStreamSize = fAllocator.BufStream()->GetSize();
+		}
+	}
+}
+
+void CdSVB_Int::Saving(CdWriter &Writer)
+{
+	CdArray<TSVB_Int>::Saving(Writer);
+	if (fGDSStream != NULL)
+	{
+		if (!fSVB.fIndexingStream)
+			fSVB.fIndexingStream = fGDSStream->Collection().NewBlockStream();
+		TdGDSBlockID Entry = fSVB.fIndexingStream->ID();
+		Writer[VAR_INDEX] << Entry;
+	}
+}
+
+
+// =====================================================================
+
+CdSVB_UInt::CdSVB_UInt(): CdArray<TSVB_UInt>(1), fSVB(false)
+{ }
+
+CdGDSObj *CdSVB_UInt::NewObject()
+{
+	return (new CdSVB_UInt)->AssignPipe(*this);
+}
+
+void CdSVB_UInt::GetOwnBlockStream(vector<const CdBlockStream*> &Out) const
+{
+	CdArray<TSVB_UInt>::GetOwnBlockStream(Out);
+	if (fSVB.fIndexingStream) Out.push_back(fSVB.fIndexingStream);
+}
+
+void CdSVB_UInt::GetOwnBlockStream(vector<CdStream*> &Out)
+{
+	CdArray<TSVB_UInt>::GetOwnBlockStream(Out);
+	if (fSVB.fIndexingStream) Out.push_back(fSVB.fIndexingStream);
+}
+
+void CdSVB_UInt::Loading(CdReader &Reader, TdVersion Version)
+{
+	CdArray<TSVB_UInt>::Loading(Reader, Version);
+	if (fGDSStream)
+	{
+		TdGDSBlockID ID;
+		Reader[VAR_INDEX] >> ID;
+		fSVB.fIndexingStream = fGDSStream->Collection()[ID];
+		// get the total size
+		if (fPipeInfo)
+		{
+			fSVB.fTotalStreamSize = fPipeInfo->StreamTotalIn();
+		} else {
+			if (fAllocator.BufStream())
+				fSVB.fTotalStreamSize = fAllocator.BufStream()->GetSize();
+		}
+	}
+}
+
+void CdSVB_UInt::Saving(CdWriter &Writer)
+{
+	CdArray<TSVB_UInt>::Saving(Writer);
+	if (fGDSStream != NULL)
+	{
+		if (!fSVB.fIndexingStream)
+			fSVB.fIndexingStream = fGDSStream->Collection().NewBlockStream();
+		TdGDSBlockID Entry = fSVB.fIndexingStream->ID();
+		Writer[VAR_INDEX] << Entry;
+	}
+}
+
+
+// =====================================================================
+// Bit-packed frame-of-reference integers
+// =====================================================================
+
+static const C_Int32 FOR_NA = std::numeric_limits<C_Int32>::min();
+
+/// the flag of NA in the bit width of a block record
+static const C_UInt8 FOR_NA_FLAG = 0x80;
+
+/// get an integer of w bits from the bit position 'Bit' of s, 's' should be
+/// readable for 5 bytes from the byte of 'Bit'
+static inline C_UInt32 FOR_Get(const C_UInt8 *s, size_t Bit, int w)
+{
+	s += Bit >> 3;
+	C_UInt64 v = s[0] | (C_UInt64(s[1]) << 8) | (C_UInt64(s[2]) << 16) |
+		(C_UInt64(s[3]) << 24) | (C_UInt64(s[4]) << 32);
+	return (v >> (Bit & 0x07)) & ((C_UInt64(1) << w) - 1);
+}
+
+static void FOR_Unpack(C_Int32 *p, const C_UInt8 *s, size_t n, int Width,
+	C_Int32 Base, bool NA)
+{
+	const C_UInt32 NACode = NA ? C_UInt32((C_UInt64(1) << Width) - 1) : 0;
+	for (size_t i=0; i < n*8; i++)
+	{
+		C_UInt32 v = FOR_Get(s, i*Width, Width);
+		*p++ = (NA && (v == NACode)) ? FOR_NA : C_Int32(C_UInt32(Base) + v);
+	}
+}
+
+
+#if defined(COREARRAY_SIMD_AVX2) || defined(COREARRAY_TARGET_DISPATCH)
+
+/// the maximum bit width, 4 bytes cover an integer with any bit offset
+static const int FOR_AVX2_MAX_WIDTH = 25;
+/// the shuffle masks for 8 integers of a bit width
+static C_UInt8 FOR_Shuf[FOR_AVX2_MAX_WIDTH+1][32];
+/// the right shifts for 8 integers of a bit width
+static C_UInt32 FOR_Shift[FOR_AVX2_MAX_WIDTH+1][8];
+
+COREARRAY_TARGET("avx2")
+static void FOR_Unpack_AVX2(C_Int32 *p, const C_UInt8 *s, size_t n,
+	int Width, C_Int32 Base, bool NA)
+{
+	if (Width > FOR_AVX2_MAX_WIDTH)
+	{
+		FOR_Unpack(p, s, n, Width, Base, NA);
+		return;
+	}
+	// the second four integers are loaded to the upper 128-bit lane
+	const size_t h = (4*Width) >> 3;
+	const __m256i shuf = _mm256_loadu_si256((__m256i const*)FOR_Shuf[Width]);
+	const __m256i shift = _mm256_loadu_si256((__m256i const*)FOR_Shift[Width]);
+	const __m256i mask = _mm256_set1_epi32((1 << Width) - 1);
+	const __m256i base = _mm256_set1_epi32(Base);
+	const __m256i na = _mm256_set1_epi32(FOR_NA);
+	for (; n > 0; n--, s+=Width, p+=8)
+	{
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(
+			_mm_loadu_si128((__m128i const*)s)),
+			_mm_loadu_si128((__m128i const*)(s + h)), 1);
+		v = _mm256_and_si256(_mm256_srlv_epi32(
+			_mm256_shuffle_epi8(v, shuf), shift), mask);
+		__m256i r = _mm256_add_epi32(v, base);
+		if (NA)
+			r = _mm256_blendv_epi8(r, na, _mm256_cmpeq_epi32(v, mask));
+		_mm256_storeu_si256((__m256i*)p, r);
+	}
+}
+
+#endif
+
+
+/// initialize the tables and select the kernel by the CPU features
+static TdFORKernel FOR_SelectKernel()
+{
+	TdFORKernel K;
+	const char *ISA = "none";
+	K.Unpack = FOR_Unpack;
+
+#if defined(COREARRAY_SIMD_AVX2) || defined(COREARRAY_TARGET_DISPATCH)
+	for (int w=1; w <= FOR_AVX2_MAX_WIDTH; w++)
+	{
+		for (int i=0; i < 8; i++)
+		{
+			int bit = i*w - ((i < 4) ? 0 : ((4*w) >> 3) * 8);
+			for (int j=0; j < 4; j++)
+				FOR_Shuf[w][i*4 + j] = (bit >> 3) + j;
+			FOR_Shift[w][i] = bit & 0x07;
+		}
+	}
+	C_UInt32 Flag = Mach::GetCPU_Features();
+#   ifdef COREARRAY_SIMD_AVX2
+	Flag |= Mach::cpuAVX2;
+#   endif
+	if (Flag & Mach::cpuAVX2)
+	{
+		K.Unpack = FOR_Unpack_AVX2;
+		ISA = "AVX2";
+	}
+#endif
+
+	Mach::SetSIMD_Kernel("int32.for", ISA);
+	return K;
+}
+
+TdFORKernel CoreArray::dFORKernel = FOR_SelectKernel();
+
+
+/// decode m integers from the offset 'Off' of a block, 's' is the byte of
+/// the bit position Off*Width in the block
+static void FOR_Decode(C_Int32 *p, const C_UInt8 *s, ssize_t Off, ssize_t m,
+	int Width, C_Int32 Base, bool NA)
+{
+	const C_UInt32 NACode = NA ? C_UInt32((C_UInt64(1) << Width) - 1) : 0;
+	size_t Bit = (Off * Width) & 0x07;
+	// until the byte-aligned group of 8 integers
+	for (; (Off & 0x07) && (m > 0); Off++, m--, Bit+=Width)
+	{
+		C_UInt32 v = FOR_Get(s, Bit, Width);
+		*p++ = (NA && (v == NACode)) ? FOR_NA : C_Int32(C_UInt32(Base) + v);
+	}
+	if (m >= 8)
+	{
+		size_t ng = m >> 3;
+		dFORKernel.Unpack(p, s + (Bit >> 3), ng, Width, Base, NA);
+		p += ng*8; m -= ng*8; Bit += ng*8*Width;
+	}
+	for (; m > 0; m--, Bit+=Width)
+	{
+		C_UInt32 v = FOR_Get(s, Bit, Width);
+		*p++ = (NA && (v == NACode)) ? FOR_NA : C_Int32(C_UInt32(Base) + v);
+	}
+}
+
+/// encode a block of integers, return the number of data bytes
+static size_t FOR_Encode(const C_Int32 *p, C_UInt8 *Rec, C_UInt8 *Data,
+	C_UInt64 Pos)
+{
+	const ssize_t N = CdFrameOfReference::BlockSize;
+	C_Int32 MinV = p[0], MaxV = p[0];
+	for (ssize_t i=1; i < N; i++)
+	{
+		if (p[i] < MinV) MinV = p[i];
+		if (p[i] > MaxV) MaxV = p[i];
+	}
+	const bool NA = (MinV == FOR_NA);
+	if (NA)
+	{
+		// the minimum without NA
+		MinV = std::numeric_limits<C_Int32>::max();
+		for (ssize_t i=0; i < N; i++)
+		{
+			C_Int32 v = (p[i] == FOR_NA) ? MinV : p[i];
+			if (v < MinV) MinV = v;
+		}
+		if (MaxV == FOR_NA) MinV = MaxV = 0;
+	}
+	// the bit width, with an extra code for NA
+	C_UInt32 Range = C_UInt32(MaxV) - C_UInt32(MinV) + (NA ? 1 : 0);
+	int Width = 0;
+	for (; Range > 0; Range >>= 1) Width ++;
+
+	// the block record
+	for (ssize_t k=0; k < GDS_POS_SIZE; k++, Pos >>= 8)
+		*Rec++ = Pos;
+	C_UInt32 Base = MinV;
+	for (ssize_t k=0; k < 4; k++, Base >>= 8)
+		*Rec++ = Base;
+	*Rec = Width | (NA ? FOR_NA_FLAG : 0);
+
+	// pack bits
+	if (Width > 0)
+	{
+		const C_UInt32 NACode = C_UInt32((C_UInt64(1) << Width) - 1);
+		C_UInt8 *s = Data;
+		C_UInt64 Buf = 0;
+		int nBit = 0;
+		for (ssize_t i=0; i < N; i++)
+		{
+			C_UInt32 v = (NA && (p[i] == FOR_NA)) ? NACode :
+				(C_UInt32(p[i]) - C_UInt32(MinV));
+			Buf |= C_UInt64(v) << nBit;
+			nBit += Width;
+			if (nBit >= 32)
+			{
+				s[0] = Buf; s[1] = Buf >> 8; s[2] = Buf >> 16; s[3] = Buf >> 24;
+				s += 4; Buf >>= 32; nBit -= 32;
+			}
+		}
+		// N*Width is a multiple of 32
+		return s - Data;
+	}
+	return 0;
+}
+
+
+const ssize_t CdFrameOfReference::BlockSize;
+const ssize_t CdFrameOfReference::RecordSize;
+const ssize_t CdFrameOfReference::BatchSize;
+
+CdFrameOfReference::CdFrameOfReference()
+{
+	fIndexingStream = NULL;
+	fTotalStreamSize = 0;
+}
+
+void CdFrameOfReference::Read(CdAllocator &A, C_Int64 Idx,
+	C_Int64 TotalCount, C_Int32 *p, ssize_t n)
+{
+	if (n <= 0) return;
+	if ((Idx < 0) || (Idx + n > TotalCount))
+		throw ErrArray("CdFrameOfReference::Read: Invalid Index.");
+	const C_Int64 NumBlock = TotalCount / BlockSize;
+
+	// the block records are loaded batch by batch
+	C_UInt8 Rec[(BatchSize/BlockSize) * RecordSize];
+	C_UInt8 Data[BlockSize*4 + 32];  // 32 bytes for loading SIMD registers
+	memset(Data, 0, sizeof(Data));
+	while ((n > 0) && (Idx < NumBlock*BlockSize))
+	{
+		C_Int64 B = Idx / BlockSize;
+		C_Int64 Last = (Idx + n - 1) / BlockSize;
+		if (Last >= NumBlock) Last = NumBlock - 1;
+		if (Last - B >= BatchSize/BlockSize)
+			Last = B + BatchSize/BlockSize - 1;
+		fIndexingStream->SetPosition(B * RecordSize);
+		fIndexingStream->ReadData(Rec, (Last - B + 1) * RecordSize);
+
+		for (const C_UInt8 *r = Rec; B <= Last; B++, r += RecordSize)
+		{
+			ssize_t Off = Idx - B*BlockSize;
+			ssize_t m = BlockSize - Off;
+			if (m > n) m = n;
+			C_UInt64 Pos = 0;
+			for (ssize_t k=GDS_POS_SIZE-1; k >= 0; k--)
+				Pos = (Pos << 8) | r[k];
+			const C_UInt8 *s = r + GDS_POS_SIZE;
+			C_Int32 Base = s[0] | (C_UInt32(s[1]) << 8) |
+				(C_UInt32(s[2]) << 16) | (C_UInt32(s[3]) << 24);
+			int Width = s[4] & 0x3F;
+			bool NA = (s[4] & FOR_NA_FLAG) != 0;
+			if (Width > 0)
+			{
+				SIZE64 St = (SIZE64(Off) * Width) >> 3;
+				SIZE64 Ed = (SIZE64(Off + m) * Width + 7) >> 3;
+				A.SetPosition(Pos + St);
+				A.ReadData(Data, Ed - St);
+				FOR_Decode(p, Data, Off, m, Width, Base, NA);
+			} else {
+				for (ssize_t i=0; i < m; i++) p[i] = Base;
+			}
+			p += m; Idx += m; n -= m;
+		}
+	}
+
+	// the raw integers of the incomplete last block
+	if (n > 0)
+	{
+		fIndexingStream->SetPosition(NumBlock * RecordSize +
+			(Idx - NumBlock*BlockSize) * 4);
+		fIndexingStream->ReadData(p, n * 4);
+		COREARRAY_ENDIAN_LE_TO_NT_ARRAY(p, n);
+	}
+}
+
+void CdFrameOfReference::Write(CdAllocator &A, C_Int64 Idx,
+	const C_Int32 *p, ssize_t n)
+{
+	if (!fIndexingStream)
+		throw ErrArray("CdFrameOfReference::Write: no indexing stream.");
+	A.SetPosition(fTotalStreamSize);
+
+	// the block records (with the raw integers of the incomplete last block)
+	// and the packed bits are saved batch by batch
+	C_UInt8 Rec[(BatchSize/BlockSize) * RecordSize + BlockSize*4];
+	C_UInt8 Data[BatchSize*4];
+	C_Int32 Buf[BlockSize];
+	C_Int64 B = Idx / BlockSize;
+	ssize_t Off = Idx & (BlockSize-1);
+	SIZE64 RecStart = B * RecordSize;
+	C_UInt8 *r = Rec, *s = Data;
+	while (n >= BlockSize - Off)
+	{
+		const C_Int32 *v = p;
+		ssize_t m = BlockSize - Off;
+		if (Off > 0)
+		{
+			// complete the last block
+			fIndexingStream->SetPosition(RecStart);
+			fIndexingStream->ReadData(Buf, Off * 4);
+			COREARRAY_ENDIAN_LE_TO_NT_ARRAY(Buf, Off);
+			memcpy(Buf + Off, p, m * sizeof(C_Int32));
+			v = Buf;
+		}
+		s += FOR_Encode(v, r, s, fTotalStreamSize + (s - Data));
+		r += RecordSize;
+		p += m; n -= m; Off = 0; B ++;
+		if (r >= Rec + (BatchSize/BlockSize) * RecordSize)
+		{
+			fIndexingStream->SetPosition(RecStart);
+			fIndexingStream->WriteData(Rec, r - Rec);
+			A.WriteData(Data, s - Data);
+			fTotalStreamSize += s - Data;
+			RecStart += r - Rec;
+			r = Rec; s = Data;
+		}
+	}
+
+	// the remaining integers are saved raw
+	if (n > 0)
+	{
+		if (r == Rec) RecStart += Off * 4;
+		for (ssize_t i=0; i < n; i++)
+		{
+			C_UInt32 v = p[i];
+			r[0] = v; r[1] = v >> 8; r[2] = v >> 16; r[3] = v >> 24;
+			r += 4;
+		}
+	}
+	if (r > Rec)
+	{
+		fIndexingStream->SetPosition(RecStart);
+		fIndexingStream->WriteData(Rec, r - Rec);
+	}
+	if (s > Data)
+	{
+		A.WriteData(Data, s - Data);
+		fTotalStreamSize += s - Data;
+	}
+	// the raw integers of a completed block are no longer needed
+	SIZE64 Size = B * RecordSize + (Off + n) * 4;
+	if (fIndexingStream->GetSize() > Size)
+		fIndexingStream->SetSizeOnly(Size);
+}
+
+
+// =====================================================================
+
+CdFOR_Int32::CdFOR_Int32(): CdArray<TFOR_Int32>(1)
+{ }
+
+CdGDSObj *CdFOR_Int32::NewObject()
+{
+	return (new CdFOR_Int32)->AssignPipe(*this);
+}
+
+void CdFOR_Int32::GetOwnBlockStream(vector<const CdBlockStream*> &Out) const
+{
+	CdArray<TFOR_Int32>::GetOwnBlockStream(Out);
+	if (fFOR.fIndexingStream) Out.push_back(fFOR.fIndexingStream);
+}
+
+void CdFOR_Int32::GetOwnBlockStream(vector<CdStream*> &Out)
+{
+	CdArray<TFOR_Int32>::GetOwnBlockStream(Out);
+	if (fFOR.fIndexingStream) Out.push_back(fFOR.fIndexingStream);
+}
+
+void CdFOR_Int32::Loading(CdReader &Reader, TdVersion Version)
+{
+	CdArray<TFOR_Int32>::Loading(Reader, Version);
+	if (fGDSStream)
+	{
+		TdGDSBlockID ID;
+		Reader[VAR_INDEX] >> ID;
+		fFOR.fIndexingStream = fGDSStream->Collection()[ID];
+		// get the total size
+		if (fPipeInfo)
+		{
+			fFOR.fTotalStreamSize = fPipeInfo->StreamTotalIn();
+		} else {
+			if (fAllocator.BufStream())
+				fFOR.fTotalStreamSize = fAllocator.BufStream()->GetSize();
+		}
+	}
+}
+
+void CdFOR_Int32::Saving(CdWriter &Writer)
+{
+	CdArray<TFOR_Int32>::Saving(Writer);
+	if (fGDSStream != NULL)
+	{
+		if (!fFOR.fIndexingStream)
+			fFOR.fIndexingStream = fGDSStream->Collection().NewBlockStream();
+		TdGDSBlockID Entry = fFOR.fIndexingStream->ID();
+		Writer[VAR_INDEX] << Entry;
+	}
+}
+
+
 namespace CoreArray
 {
 	template<typename TClass> static CdObjRef *OnObjCreate()
@@ -445,6 +1299,9 @@ namespace CoreArray
 		// variable-length integers
 		REG_CLASS(TVL_Int, CdVL_Int, ctArray, "variable-length signed integer");
 		REG_CLASS(TVL_UInt, CdVL_UInt, ctArray, "variable-length unsigned integer");
+		REG_CLASS(TSVB_Int, CdSVB_Int, ctArray, "stream-vbyte signed integer");
+		REG_CLASS(TSVB_UInt, CdSVB_UInt, ctArray, "stream-vbyte unsigned integer");
+		REG_CLASS(TFOR_Int32, CdFOR_Int32, ctArray, "bit-packed frame-of-reference integer");
 
 		#undef REG_CLASS
 	}
@@ -86,6 +86,69 @@ namespace CoreArray
 	};
 
 
+	/// define stream-vbyte signed integer (32-bit)
+	typedef struct { C_Int8 Val; } TSVB_Int;
+
+	/// define stream-vbyte unsigned integer (32-bit)
+	typedef struct { C_UInt8 Val; } TSVB_UInt;
+
+
+	/// Traits of stream-vbyte signed integer
+	template<> struct COREARRAY_DLL_DEFAULT TdTraits<TSVB_Int>
+	{
+		typedef C_Int32 ElmType;
+
+		static const int trVal = COREARRAY_TR_VARIABLE_LENGTH_INTEGER;
+		static const unsigned BitOf = 32u;
+		static const bool IsPrimitive = false;
+		static const C_SVType SVType = svCustomInt;
+
+		static const char *StreamName() { return "dSVB_Int"; }
+		static const char *TraitName() { return StreamName()+1; }
+
+		COREARRAY_INLINE static C_Int32 Min() { return std::numeric_limits<C_Int32>::min(); }
+		COREARRAY_INLINE static C_Int32 Max() { return std::numeric_limits<C_Int32>::max(); }
+	};
+
+	/// Traits of stream-vbyte unsigned integer
+	template<> struct COREARRAY_DLL_DEFAULT TdTraits<TSVB_UInt>
+	{
+		typedef C_UInt32 ElmType;
+
+		static const int trVal = COREARRAY_TR_VARIABLE_LENGTH_INTEGER;
+		static const unsigned BitOf = 32u;
+		static const bool IsPrimitive = false;
+		static const C_SVType SVType = svCustomUInt;
+
+		static const char *StreamName() { return "dSVB_UInt"; }
+		static const char *TraitName() { return StreamName()+1; }
+
+		COREARRAY_INLINE static C_UInt32 Min() { return 0; }
+		COREARRAY_INLINE static C_UInt32 Max() { return std::numeric_limits<C_UInt32>::max(); }
+	};
+
+
+	/// define bit-packed frame-of-reference signed integer (32-bit)
+	typedef struct { C_Int8 Val; } TFOR_Int32;
+
+	/// Traits of bit-packed frame-of-reference signed integer
+	template<> struct COREARRAY_DLL_DEFAULT TdTraits<TFOR_Int32>
+	{
+		typedef C_Int32 ElmType;
+
+		static const int trVal = COREARRAY_TR_BIT_INTEGER;
+		static const unsigned BitOf = 32u;
+		static const bool IsPrimitive = false;
+		static const C_SVType SVType = svCustomInt;
+
+		static const char *StreamName() { return "dFOR_Int32"; }
+		static const char *TraitName() { return StreamName()+1; }
+
+		COREARRAY_INLINE static C_Int32 Min() { return std::numeric_limits<C_Int32>::min(); }
+		COREARRAY_INLINE static C_Int32 Max() { return std::numeric_limits<C_Int32>::max(); }
+	};
+
+
 
 	// =====================================================================
 	// Variable-length signed integers
@@ -541,6 +604,393 @@ namespace CoreArray
 		}
 	};
 
+
+
+	// =====================================================================
+	// Stream-vbyte integers
+	// =====================================================================
+
+	/// SIMD kernels of stream-vbyte decoding
+	struct COREARRAY_DLL_DEFAULT TdSVBKernel
+	{
+		/// decode 4*n integers from n control bytes, return the number of
+		/// data bytes used, 'Data' should be readable for 16 extra bytes
+		size_t (*Decode)(C_UInt32 *p, const C_UInt8 *Ctrl, const C_UInt8 *Data,
+			size_t n, bool ZigZag);
+	};
+
+	extern TdSVBKernel dSVBKernel;
+
+
+	/// Stream-vbyte codec of 32-bit integers
+	/** Each integer is stored in 1 to 4 little-endian data bytes, and its
+	 *  length is given by a 2-bit code in the control bytes (four codes per
+	 *  byte). The data bytes are saved in the allocator of the array, while
+	 *  the control bytes are saved in the indexing stream, block by block:
+	 *  every block of 'BlockSize' integers has a record of the data position
+	 *  (GDS_POS_SIZE bytes) followed by 'BlockSize/4' control bytes, so that
+	 *  locating any element costs no more than one block decode.
+	 *  Signed integers are mapped to unsigned by zigzag encoding.
+	**/
+	class COREARRAY_DLL_DEFAULT CdStreamVByte
+	{
+	public:
+		/// the number of integers in a block
+		static const ssize_t BlockSize = 1024;
+		/// the size of a block record in the indexing stream
+		static const ssize_t RecordSize = GDS_POS_SIZE + BlockSize/4;
+		/// the number of integers in a batch of reading or writing
+		static const ssize_t BatchSize = 8*BlockSize;
+
+		/// constructor
+		CdStreamVByte(bool ZigZag);
+
+		/// read n integers from the position Idx
+		void Read(CdAllocator &A, C_Int64 Idx, C_Int64 TotalCount,
+			C_UInt32 *p, ssize_t n);
+		/// append n integers, Idx should be the total number of integers
+		void Write(CdAllocator &A, C_Int64 Idx, const C_UInt32 *p, ssize_t n);
+
+		CdBlockStream *fIndexingStream; ///< the GDS stream for indexing
+		SIZE64 fTotalStreamSize;        ///< the total size of data bytes
+
+	protected:
+		bool fZigZag;
+		C_Int64 fCurIndex;
+		SIZE64 fCurStreamPosition;
+
+		/// set stream position to the corresponding array index
+		void SetStreamPos(CdAllocator &A, C_Int64 Idx, C_Int64 TotalCount);
+	};
+
+
+	/// Output types written by the stream-vbyte codec without conversion
+	template<typename MEM_TYPE> struct COREARRAY_DLL_DEFAULT SVB_DIRECT
+		{ static const bool Direct = false; };
+	template<> struct COREARRAY_DLL_DEFAULT SVB_DIRECT<C_Int32>
+		{ static const bool Direct = true; };
+	template<> struct COREARRAY_DLL_DEFAULT SVB_DIRECT<C_UInt32>
+		{ static const bool Direct = true; };
+
+
+	/// Container of stream-vbyte signed integers
+	class COREARRAY_DLL_DEFAULT CdSVB_Int: public CdArray<TSVB_Int>
+	{
+	public:
+		template<typename CLASS, typename INT_TYPE, typename MEM_TYPE>
+			friend struct SVB_ALLOC_FUNC;
+		typedef C_Int32 ElmType;
+
+		/// constructor
+		CdSVB_Int();
+
+		virtual CdGDSObj *NewObject();
+
+		/// get a list of CdBlockStream owned by this object, except fGDSStream
+		virtual void GetOwnBlockStream(vector<const CdBlockStream*> &Out) const;
+		/// get a list of CdStream owned by this object, except fGDSStream
+		virtual void GetOwnBlockStream(vector<CdStream*> &Out);
+
+	protected:
+		CdStreamVByte fSVB;
+
+		/// loading function for serialization
+		virtual void Loading(CdReader &Reader, TdVersion Version);
+		/// saving function for serialization
+		virtual void Saving(CdWriter &Writer);
+	};
+
+	/// Container of stream-vbyte unsigned integers
+	class COREARRAY_DLL_DEFAULT CdSVB_UInt: public CdArray<TSVB_UInt>
+	{
+	public:
+		template<typename CLASS, typename INT_TYPE, typename MEM_TYPE>
+			friend struct SVB_ALLOC_FUNC;
+		typedef C_UInt32 ElmType;
+
+		/// constructor
+		CdSVB_UInt();
+
+		virtual CdGDSObj *NewObject();
+
+		/// get a list of CdBlockStream owned by this object, except fGDSStream
+		virtual void GetOwnBlockStream(vector<const CdBlockStream*> &Out) const;
+		/// get a list of CdStream owned by this object, except fGDSStream
+		virtual void GetOwnBlockStream(vector<CdStream*> &Out);
+
+	protected:
+		CdStreamVByte fSVB;
+
+		/// loading function for serialization
+		virtual void Loading(CdReader &Reader, TdVersion Version);
+		/// saving function for serialization
+		virtual void Saving(CdWriter &Writer);
+	};
+
+
+	// =====================================================================
+	// Template for Allocator for stream-vbyte integers
+	// =====================================================================
+
+	/// Template functions for allocator of stream-vbyte integers
+	template<typename CLASS, typename INT_TYPE, typename MEM_TYPE>
+		struct COREARRAY_DLL_DEFAULT SVB_ALLOC_FUNC
+	{
+		/// read an array from CdAllocator
+		static MEM_TYPE *Read(CdIterator &I, MEM_TYPE *p, ssize_t n)
+		{
+			CLASS *IT = static_cast<CLASS*>(I.Handler);
+			if (SVB_DIRECT<MEM_TYPE>::Direct)
+			{
+				IT->fSVB.Read(*I.Allocator, I.Ptr, IT->fTotalCount,
+					(C_UInt32*)p, n);
+				I.Ptr += n;
+				return p + n;
+			}
+			C_UInt32 Buf[CdStreamVByte::BlockSize];
+			while (n > 0)
+			{
+				ssize_t Cnt = (n >= CdStreamVByte::BlockSize) ?
+					CdStreamVByte::BlockSize : n;
+				IT->fSVB.Read(*I.Allocator, I.Ptr, IT->fTotalCount, Buf, Cnt);
+				const INT_TYPE *s = (const INT_TYPE*)Buf;
+				for (ssize_t i=0; i < Cnt; i++)
+					*p++ = VAL_CONVERT(MEM_TYPE, INT_TYPE, s[i]);
+				I.Ptr += Cnt; n -= Cnt;
+			}
+			return p;
+		}
+
+		/// read an array from CdAllocator with selection
+		static MEM_TYPE *ReadEx(CdIterator &I, MEM_TYPE *p, ssize_t n,
+			const C_BOOL Sel[])
+		{
+			const SIZE64 End = I.Ptr + n;
+			// skip the unselected leading and trailing elements
+			for (; n>0 && !*Sel; n--, Sel++) I.Ptr++;
+			for (; n>0 && !Sel[n-1]; ) n--;
+			CLASS *IT = static_cast<CLASS*>(I.Handler);
+			C_UInt32 Buf[CdStreamVByte::BlockSize];
+			while (n > 0)
+			{
+				ssize_t Cnt = (n >= CdStreamVByte::BlockSize) ?
+					CdStreamVByte::BlockSize : n;
+				IT->fSVB.Read(*I.Allocator, I.Ptr, IT->fTotalCount, Buf, Cnt);
+				const INT_TYPE *s = (const INT_TYPE*)Buf;
+				for (ssize_t i=0; i < Cnt; i++)
+					if (*Sel++) *p++ = VAL_CONVERT(MEM_TYPE, INT_TYPE, s[i]);
+				I.Ptr += Cnt; n -= Cnt;
+			}
+			I.Ptr = End;
+			return p;
+		}
+
+		/// write an array to CdAllocator
+		static const MEM_TYPE *Write(CdIterator &I, const MEM_TYPE *p,
+			ssize_t n)
+		{
+			CLASS *IT = static_cast<CLASS*>(I.Handler);
+			if (I.Ptr < IT->fTotalCount)
+			{
+				throw ErrArray("Insert a stream-vbyte encoding integer wrong.");
+			} else if (I.Ptr == IT->fTotalCount)
+			{
+				C_UInt32 Buf[CdStreamVByte::BatchSize];
+				while (n > 0)
+				{
+					ssize_t Cnt = (n >= CdStreamVByte::BatchSize) ?
+						CdStreamVByte::BatchSize : n;
+					INT_TYPE *s = (INT_TYPE*)Buf;
+					for (ssize_t i=0; i < Cnt; i++)
+						s[i] = VAL_CONVERT(INT_TYPE, MEM_TYPE, *p++);
+					IT->fSVB.Write(*I.Allocator, I.Ptr, Buf, Cnt);
+					I.Ptr += Cnt; n -= Cnt;
+				}
+			} else
+				throw ErrArray("Invalid position for writing data.");
+			return p;
+		}
+	};
+
+	template<typename MEM_TYPE>
+		struct COREARRAY_DLL_DEFAULT ALLOC_FUNC<TSVB_Int, MEM_TYPE>:
+		public SVB_ALLOC_FUNC<CdSVB_Int, C_Int32, MEM_TYPE> { };
+
+	template<typename MEM_TYPE>
+		struct COREARRAY_DLL_DEFAULT ALLOC_FUNC<TSVB_UInt, MEM_TYPE>:
+		public SVB_ALLOC_FUNC<CdSVB_UInt, C_UInt32, MEM_TYPE> { };
+
+
+
+	// =====================================================================
+	// Bit-packed frame-of-reference integers
+	// =====================================================================
+
+	/// SIMD kernels of bit-packed frame-of-reference decoding
+	struct COREARRAY_DLL_DEFAULT TdFORKernel
+	{
+		/// unpack 8*n integers of 'Width' bits and add 'Base', the code of
+		/// all one bits is NA (the minimum of int32) if 'NA' is true; 's'
+		/// should be readable for 32 extra bytes
+		void (*Unpack)(C_Int32 *p, const C_UInt8 *s, size_t n, int Width,
+			C_Int32 Base, bool NA);
+	};
+
+	extern TdFORKernel dFORKernel;
+
+
+	/// Bit-packed frame-of-reference codec of 32-bit signed integers
+	/** Every block of 'BlockSize' integers is stored as the offsets to the
+	 *  minimum of the block, and the offsets are packed with the fewest bits
+	 *  for the range of the block. NA (the minimum of int32) is excluded from
+	 *  the range and stored as the code of all one bits. The packed bits are
+	 *  saved in the allocator of the array, while the indexing stream has a
+	 *  record for each block: the data position (GDS_POS_SIZE bytes), the
+	 *  base value (4 bytes) and the bit width (1 byte, 0x80 for NA), so that
+	 *  any element is located without decoding others. The integers of the
+	 *  incomplete last block are kept raw after the records, and they are
+	 *  packed once the block is full.
+	**/
+	class COREARRAY_DLL_DEFAULT CdFrameOfReference
+	{
+	public:
+		/// the number of integers in a block
+		static const ssize_t BlockSize = 1024;
+		/// the size of a block record in the indexing stream
+		static const ssize_t RecordSize = GDS_POS_SIZE + 5;
+		/// the number of integers in a batch of reading or writing
+		static const ssize_t BatchSize = 8*BlockSize;
+
+		/// constructor
+		CdFrameOfReference();
+
+		/// read n integers from the position Idx
+		void Read(CdAllocator &A, C_Int64 Idx, C_Int64 TotalCount,
+			C_Int32 *p, ssize_t n);
+		/// append n integers, Idx should be the total number of integers
+		void Write(CdAllocator &A, C_Int64 Idx, const C_Int32 *p, ssize_t n);
+
+		CdBlockStream *fIndexingStream; ///< the GDS stream for indexing
+		SIZE64 fTotalStreamSize;        ///< the total size of packed bits
+	};
+
+
+	/// Container of bit-packed frame-of-reference signed integers
+	class COREARRAY_DLL_DEFAULT CdFOR_Int32: public CdArray<TFOR_Int32>
+	{
+	public:
+		template<typename ALLOC_TYPE, typename MEM_TYPE> friend struct ALLOC_FUNC;
+		typedef C_Int32 ElmType;
+
+		/// constructor
+		CdFOR_Int32();
+
+		virtual CdGDSObj *NewObject();
+
+		/// get a list of CdBlockStream owned by this object, except fGDSStream
+		virtual void GetOwnBlockStream(vector<const CdBlockStream*> &Out) const;
+		/// get a list of CdStream owned by this object, except fGDSStream
+		virtual void GetOwnBlockStream(vector<CdStream*> &Out);
+
+	protected:
+		CdFrameOfReference fFOR;
+
+		/// loading function for serialization
+		virtual void Loading(CdReader &Reader, TdVersion Version);
+		/// saving function for serialization
+		virtual void Saving(CdWriter &Writer);
+	};
+
+
+	// =====================================================================
+	// Template for Allocator for bit-packed frame-of-reference integers
+	// =====================================================================
+
+	/// Template functions for allocator of frame-of-reference integers
+	template<typename MEM_TYPE>
+		struct COREARRAY_DLL_DEFAULT ALLOC_FUNC<TFOR_Int32, MEM_TYPE>
+	{
+		/// read an array from CdAllocator
+		static MEM_TYPE *Read(CdIterator &I, MEM_TYPE *p, ssize_t n)
+		{
+			CdFOR_Int32 *IT = static_cast<CdFOR_Int32*>(I.Handler);
+			if (SVB_DIRECT<MEM_TYPE>::Direct)
+			{
+				IT->fFOR.Read(*I.Allocator, I.Ptr, IT->fTotalCount,
+					(C_Int32*)p, n);
+				I.Ptr += n;
+				return p + n;
+			}
+			C_Int32 Buf[CdFrameOfReference::BlockSize];
+			while (n > 0)
+			{
+				ssize_t Cnt = (n >= CdFrameOfReference::BlockSize) ?
+					CdFrameOfReference::BlockSize : n;
+				IT->fFOR.Read(*I.Allocator, I.Ptr, IT->fTotalCount, Buf, Cnt);
+				for (ssize_t i=0; i < Cnt; i++)
+					*p++ = VAL_CONVERT(MEM_TYPE, C_Int32, Buf[i]);
+				I.Ptr += Cnt; n -= Cnt;
+			}
+			return p;
+		}
+
+		/// read an array from CdAllocator with selection
+		static MEM_TYPE *ReadEx(CdIterator &I, MEM_TYPE *p, ssize_t n,
+			const C_BOOL Sel[])
+		{
+			const SIZE64 End = I.Ptr + n;
+			// skip the unselected leading and trailing elements
+			for (; n>0 && !*Sel; n--, Sel++) I.Ptr++;
+			for (; n>0 && !Sel[n-1]; ) n--;
+			CdFOR_Int32 *IT = static_cast<CdFOR_Int32*>(I.Handler);
+			C_Int32 Buf[CdFrameOfReference::BlockSize];
+			while (n > 0)
+			{
+				// block by block, and skip the blocks without selection
+				ssize_t Cnt = CdFrameOfReference::BlockSize -
+					(I.Ptr & (CdFrameOfReference::BlockSize-1));
+				if (Cnt > n) Cnt = n;
+				ssize_t k = 0;
+				while ((k < Cnt) && !Sel[k]) k++;
+				if (k < Cnt)
+				{
+					IT->fFOR.Read(*I.Allocator, I.Ptr, IT->fTotalCount, Buf,
+						Cnt);
+					for (ssize_t i=0; i < Cnt; i++)
+						if (Sel[i]) *p++ = VAL_CONVERT(MEM_TYPE, C_Int32, Buf[i]);
+				}
+				Sel += Cnt; I.Ptr += Cnt; n -= Cnt;
+			}
+			I.Ptr = End;
+			return p;
+		}
+
+		/// write an array to CdAllocator
+		static const MEM_TYPE *Write(CdIterator &I, const MEM_TYPE *p,
+			ssize_t n)
+		{
+			CdFOR_Int32 *IT = static_cast<CdFOR_Int32*>(I.Handler);
+			if (I.Ptr < IT->fTotalCount)
+			{
+				throw ErrArray("Insert a frame-of-reference integer wrong.");
+			} else if (I.Ptr == IT->fTotalCount)
+			{
+				C_Int32 Buf[CdFrameOfReference::BatchSize];
+				while (n > 0)
+				{
+					ssize_t Cnt = (n >= CdFrameOfReference::BatchSize) ?
+						CdFrameOfReference::BatchSize : n;
+					for (ssize_t i=0; i < Cnt; i++)
+						Buf[i] = VAL_CONVERT(C_Int32, MEM_TYPE, *p++);
+					IT->fFOR.Write(*I.Allocator, I.Ptr, Buf, Cnt);
+					I.Ptr += Cnt; n -= Cnt;
+				}
+			} else
+				throw ErrArray("Invalid position for writing data.");
+			return p;
+		}
+	};
+
 }
 
 #endif /* _HEADER_COREARRAY_VL_INT_GDS_ */
@@ -84,6 +84,69 @@ namespace gdsfmt
 	}
 
 
+	/// open an existing GDS file (a read-only memory-mapped view if UseMmap)
+	COREARRAY_DLL_LOCAL PdGDSFile GDS_File_Open_Ex(const char *FileName,
+		C_BOOL ReadOnly, C_BOOL ForkSupport, C_BOOL UseMmap, C_BOOL ReadAhead,
+		C_BOOL WriteBehind, int DecompressThreads)
+	{
+		// to register CoreArray classes and objects
+		RegisterClass();
+
+		int gds_idx = GetEmptyFileIndex();
+		PdGDSFile file = NULL;
+
+		try {
+			file = new CdGDSFile;
+			file->SetReadAhead(ReadAhead);
+			file->SetWriteBehind(WriteBehind);
+			file->SetDecompressThreads(DecompressThreads);
+			if (UseMmap)
+				file->LoadFileMmap(FileName);
+			else if (!ForkSupport)
+				file->LoadFile(FileName, ReadOnly);
+			else
+				file->LoadFileFork(FileName, ReadOnly);
+
+			PKG_GDS_Files[gds_idx] = file;
+		}
+		catch (std::exception &E) {
+			string Msg = E.what();
+			if ((file!=NULL) && !file->Log().List().empty())
+			{
+				Msg.append(sLineBreak);
+				Msg.append("Log:");
+				for (size_t i=0; i < file->Log().List().size(); i++)
+				{
+					Msg.append(sLineBreak);
+					Msg.append(RawText(file->Log().List()[i].Msg));
+				}
+			}
+			if (file) delete file;
+			throw ErrGDSFmt(Msg);
+		}
+		catch (const char *E) {
+			string Msg = E;
+			if ((file!=NULL) && !file->Log().List().empty())
+			{
+				Msg.append(sLineBreak);
+				Msg.append("Log:");
+				for (size_t i=0; i < file->Log().List().size(); i++)
+				{
+					Msg.append(sLineBreak);
+					Msg.append(RawText(file->Log().List()[i].Msg));
+				}
+			}
+			if (file) delete file;
+			throw ErrGDSFmt(Msg);
+		}
+		catch (...) {
+			if (file) delete file;
+			throw;
+		}
+		return file;
+	}
+
+
 	/// a list of GDS objects
 	COREARRAY_DLL_LOCAL vector<PdGDSObj> GDSFMT_GDSObj_List;
 
@@ -980,56 +1043,8 @@ COREARRAY_DLL_EXPORT PdGDSFile GDS_File_Create(const char *FileName)
 COREARRAY_DLL_EXPORT PdGDSFile GDS_File_Open(const char *FileName,
 	C_BOOL ReadOnly, C_BOOL ForkSupport)
 {
-	// to register CoreArray classes and objects
-	RegisterClass();
-
-	int gds_idx = GetEmptyFileIndex();
-	PdGDSFile file = NULL;
-
-	try {
-		file = new CdGDSFile;
-		if (!ForkSupport)
-			file->LoadFile(FileName, ReadOnly);
-		else
-			file->LoadFileFork(FileName, ReadOnly);
-
-		PKG_GDS_Files[gds_idx] = file;
-	}
-	catch (std::exception &E) {
-		string Msg = E.what();
-		if ((file!=NULL) && !file->Log().List().empty())
-		{
-			Msg.append(sLineBreak);
-			Msg.append("Log:");
-			for (size_t i=0; i < file->Log().List().size(); i++)
-			{
-				Msg.append(sLineBreak);
-				Msg.append(RawText(file->Log().List()[i].Msg));
-			}
-		}
-		if (file) delete file;
-		throw ErrGDSFmt(Msg);
-	}
-	catch (const char *E) {
-		string Msg = E;
-		if ((file!=NULL) && !file->Log().List().empty())
-		{
-			Msg.append(sLineBreak);
-			Msg.append("Log:");
-			for (size_t i=0; i < file->Log().List().size(); i++)
-			{
-				Msg.append(sLineBreak);
-				Msg.append(RawText(file->Log().List()[i].Msg));
-			}
-		}
-		if (file) delete file;
-		throw ErrGDSFmt(Msg);
-	}
-	catch (...) {
-		if (file) delete file;
-		throw;
-	}
-	return file;
+	return GDS_File_Open_Ex(FileName, ReadOnly, ForkSupport, false, false,
+		false, 0);
 }
 
 COREARRAY_DLL_EXPORT void GDS_File_Close(PdGDSFile File)
@@ -38,6 +38,9 @@ namespace gdsfmt
 {
 	extern PdGDSFile PKG_GDS_Files[];
 	extern int GetFileIndex(PdGDSFile file, bool throw_error=true);
+	extern PdGDSFile GDS_File_Open_Ex(const char *FileName, C_BOOL ReadOnly,
+		C_BOOL ForkSupport, C_BOOL UseMmap, C_BOOL ReadAhead,
+		C_BOOL WriteBehind, int DecompressThreads);
 
 
 	/// initialization and finalization
@@ -150,6 +153,15 @@ namespace gdsfmt
 			ClassMap["integer"  ] = TdTraits< C_Int32 >::StreamName();
 			ClassMap["vl_int"   ] = TdTraits< TVL_Int >::StreamName();
 			ClassMap["vl_uint"  ] = TdTraits< TVL_UInt >::StreamName();
+			ClassMap["vl_int.svb" ] = TdTraits< TSVB_Int >::StreamName();
+			ClassMap["vl_uint.svb"] = TdTraits< TSVB_UInt >::StreamName();
+			ClassMap["int32.for"  ] = TdTraits< TFOR_Int32 >::StreamName();
+			ClassMap["sp.int8"    ] = TdTraits< TSpInt8 >::StreamName();
+			ClassMap["sp.int16"   ] = TdTraits< TSpInt16 >::StreamName();
+			ClassMap["sp.int32"   ] = TdTraits< TSpInt32 >::StreamName();
+			ClassMap["sp.int64"   ] = TdTraits< TSpInt64 >::StreamName();
+			ClassMap["sp.real32"  ] = TdTraits< TSpReal32 >::StreamName();
+			ClassMap["sp.real64"  ] = TdTraits< TSpReal64 >::StreamName();
 			ClassMap["float"    ] = TdTraits< C_Float32 >::StreamName();
 			ClassMap["single"   ] = TdTraits< C_Float32 >::StreamName();
 			ClassMap["numeric"  ] = TdTraits< C_Float64 >::StreamName();
@@ -280,13 +292,17 @@ extern SEXP gdsObjSetDim(SEXP Node, SEXP DLen, SEXP Permute);
 /// Create a GDS file
 /** \param FileName    [in] the file name
  *  \param AllowDup    [in] allow duplicate file
+ *  \param WriteBehind [in] write the buffers of arrays in background
+ *  \param ExtentGrowth [in] the ratio of reservation when a stream grows
+ *  \param CompressThreads [in] the number of threads compressing *_RA blocks
  *  \return
  *    $filename    the file name to be created
  *    $id          ID of GDS file, an integer, internal use
  *    $root        the root of hierachical structure
  *    $readonly	   whether it is read-only or not
 **/
-COREARRAY_DLL_EXPORT SEXP gdsCreateGDS(SEXP FileName, SEXP AllowDup)
+COREARRAY_DLL_EXPORT SEXP gdsCreateGDS(SEXP FileName, SEXP AllowDup,
+	SEXP WriteBehind, SEXP ExtentGrowth, SEXP CompressThreads)
 {
 	const char *fn = CHAR(STRING_ELT(FileName, 0));
 
@@ -294,6 +310,18 @@ COREARRAY_DLL_EXPORT SEXP gdsCreateGDS(SEXP FileName, SEXP AllowDup)
 	if (allow_dup == NA_LOGICAL)
 		error("'allow.duplicate' must be TRUE or FALSE.");
 
+	int write_behind = Rf_asLogical(WriteBehind);
+	if (write_behind == NA_LOGICAL)
+		error("'write.behind' must be TRUE or FALSE.");
+
+	double extent_growth = Rf_asReal(ExtentGrowth);
+	if (!R_FINITE(extent_growth) || (extent_growth < 0))
+		error("'extent.growth' must be a non-negative number.");
+
+	int compress_threads = Rf_asInteger(CompressThreads);
+	if ((compress_threads == NA_INTEGER) || (compress_threads < 0))
+		error("'compress.threads' must be a non-negative integer.");
+
 	COREARRAY_TRY
 
 		if (!allow_dup)
@@ -313,6 +341,9 @@ COREARRAY_DLL_EXPORT SEXP gdsCreateGDS(SEXP FileName, SEXP AllowDup)
 		}
 
 		CdGDSFile *file = GDS_File_Create(fn);
+		file->SetWriteBehind(write_behind);
+		file->SetGrowthPolicy(extent_growth);
+		file->SetCompressThreads(compress_threads);
 		PROTECT(rv_ans = NEW_LIST(4));
 			SET_ELEMENT(rv_ans, 0, FileName);
 			SET_ELEMENT(rv_ans, 1, ScalarInteger(GetFileIndex(file)));
@@ -329,6 +360,13 @@ COREARRAY_DLL_EXPORT SEXP gdsCreateGDS(SEXP FileName, SEXP AllowDup)
  *  \param ReadOnly    [in] if TRUE, read-only
  *  \param AllowDup    [in] allow duplicate file
  *  \param AllowFork   [in] allow opening in a forked process
+ *  \param UseMmap     [in] use a read-only memory-mapped view of the file
+ *  \param ReadAhead   [in] prefetch data in background for sequential reading
+ *  \param WriteBehind [in] write the buffers of arrays in background
+ *  \param ExtentGrowth [in] the ratio of reservation when a stream grows
+ *  \param CompressThreads [in] the number of threads compressing *_RA blocks
+ *  \param DecompressThreads [in] the number of threads decompressing *_RA
+ *                             blocks ahead
  *  \return
  *    $filename    the file name to be created
  *    $id          ID of GDS file, internal use
@@ -336,7 +374,9 @@ COREARRAY_DLL_EXPORT SEXP gdsCreateGDS(SEXP FileName, SEXP AllowDup)
  *    $readonly	   whether it is read-only or not
 **/
 COREARRAY_DLL_EXPORT SEXP gdsOpenGDS(SEXP FileName, SEXP ReadOnly,
-	SEXP AllowDup, SEXP AllowFork)
+	SEXP AllowDup, SEXP AllowFork, SEXP UseMmap, SEXP ReadAhead,
+	SEXP WriteBehind, SEXP ExtentGrowth, SEXP CompressThreads,
+	SEXP DecompressThreads)
 {
 	const char *fn = CHAR(STRING_ELT(FileName, 0));
 
@@ -352,6 +392,40 @@ COREARRAY_DLL_EXPORT SEXP gdsOpenGDS(SEXP FileName, SEXP ReadOnly,
 	if (allow_fork == NA_LOGICAL)
 		error("'allow.fork' must be TRUE or FALSE.");
 
+	int use_mmap = Rf_asLogical(UseMmap);
+	if (use_mmap == NA_LOGICAL)
+		error("'use.mmap' must be TRUE or FALSE.");
+	if (use_mmap && !readonly)
+		error("'use.mmap=TRUE' requires 'readonly=TRUE'.");
+
+	int read_ahead = Rf_asLogical(ReadAhead);
+	if (read_ahead == NA_LOGICAL)
+		error("'read.ahead' must be TRUE or FALSE.");
+	if (read_ahead && !readonly)
+		error("'read.ahead=TRUE' requires 'readonly=TRUE'.");
+
+	int write_behind = Rf_asLogical(WriteBehind);
+	if (write_behind == NA_LOGICAL)
+		error("'write.behind' must be TRUE or FALSE.");
+	if (write_behind && readonly)
+		error("'write.behind=TRUE' requires 'readonly=FALSE'.");
+
+	double extent_growth = Rf_asReal(ExtentGrowth);
+	if (!R_FINITE(extent_growth) || (extent_growth < 0))
+		error("'extent.growth' must be a non-negative number.");
+	if ((extent_growth > 0) && readonly)
+		error("'extent.growth' requires 'readonly=FALSE'.");
+
+	int compress_threads = Rf_asInteger(CompressThreads);
+	if ((compress_threads == NA_INTEGER) || (compress_threads < 0))
+		error("'compress.threads' must be a non-negative integer.");
+	if ((compress_threads > 0) && readonly)
+		error("'compress.threads' requires 'readonly=FALSE'.");
+
+	int decompress_threads = Rf_asInteger(DecompressThreads);
+	if ((decompress_threads == NA_INTEGER) || (decompress_threads < 0))
+		error("'decompress.threads' must be a non-negative integer.");
+
 	COREARRAY_TRY
 
 		if (!allow_dup)
@@ -370,7 +444,13 @@ COREARRAY_DLL_EXPORT SEXP gdsOpenGDS(SEXP FileName, SEXP ReadOnly,
 			}
 		}
 
-		CdGDSFile *file = GDS_File_Open(fn, readonly, allow_fork);
+		CdGDSFile *file = GDS_File_Open_Ex(fn, readonly, allow_fork,
+			use_mmap, read_ahead, write_behind, decompress_threads);
+		if (!readonly)
+		{
+			file->SetGrowthPolicy(extent_growth);
+			file->SetCompressThreads(compress_threads);
+		}
 		PROTECT(rv_ans = NEW_LIST(4));
 			SET_ELEMENT(rv_ans, 0, FileName);
 			SET_ELEMENT(rv_ans, 1, ScalarInteger(GetFileIndex(file)));
@@ -419,8 +499,12 @@ COREARRAY_DLL_EXPORT SEXP gdsFileSize(SEXP gdsfile)
 /// Clean up fragments of a GDS file
 /** \param FileName    [in] the file name
  *  \param Verbose     [in] if TRUE, show information
+ *  \param InPlace     [in] if TRUE, compact the file in place
+ *  \param TimeLimit   [in] the time limit in seconds for InPlace, or NA
+ *  \return TRUE if finished, FALSE if the compaction is stopped by TimeLimit
 **/
-COREARRAY_DLL_EXPORT SEXP gdsTidyUp(SEXP FileName, SEXP Verbose)
+COREARRAY_DLL_EXPORT SEXP gdsTidyUp(SEXP FileName, SEXP Verbose,
+	SEXP InPlace, SEXP TimeLimit)
 {
 	const char *fn = R_ExpandFileName(CHAR(STRING_ELT(FileName, 0)));
 
@@ -428,6 +512,13 @@ COREARRAY_DLL_EXPORT SEXP gdsTidyUp(SEXP FileName, SEXP Verbose)
 	if (verbose_flag == NA_LOGICAL)
 		error("'verbose' must be TRUE or FALSE.");
 
+	int in_place = Rf_asLogical(InPlace);
+	if (in_place == NA_LOGICAL)
+		error("'in.place' must be TRUE or FALSE.");
+
+	double time_limit = Rf_asReal(TimeLimit);
+	if (!R_FINITE(time_limit)) time_limit = 0;
+
 	COREARRAY_TRY
 
 		CdGDSFile file(fn, CdGDSFile::dmOpenReadWrite);
@@ -437,16 +528,33 @@ COREARRAY_DLL_EXPORT SEXP gdsTidyUp(SEXP FileName, SEXP Verbose)
 			Rprintf("Clean up the fragments of GDS file:\n");
 			Rprintf("    open the file '%s' (%s)\n", fn, fmt_size(old_s).c_str());
 			Rprintf("    # of fragments: %d\n", file.GetNumOfFragment());
-			Rprintf("    save to '%s.tmp'\n", fn);
+			if (in_place)
+				Rprintf("    compact in place\n");
+			else
+				Rprintf("    save to '%s.tmp'\n", fn);
 		}
-		file.TidyUp(false);
+
+		bool done = true;
+		if (in_place)
+			done = file.Compact(time_limit);
+		else
+			file.TidyUp(false);
+
 		if (verbose_flag == TRUE)
 		{
 			C_Int64 new_s = file.GetFileSize();
-			Rprintf("    rename '%s.tmp' (%s, reduced: %s)\n", fn,
-				fmt_size(new_s).c_str(), fmt_size(old_s-new_s).c_str());
+			if (in_place)
+			{
+				Rprintf("    %s (%s, reduced: %s)\n",
+					done ? "done" : "stopped by the time limit",
+					fmt_size(new_s).c_str(), fmt_size(old_s-new_s).c_str());
+			} else {
+				Rprintf("    rename '%s.tmp' (%s, reduced: %s)\n", fn,
+					fmt_size(new_s).c_str(), fmt_size(old_s-new_s).c_str());
+			}
 			Rprintf("    # of fragments: %d\n", file.GetNumOfFragment());
 		}
+		rv_ans = ScalarLogical(done);
 
 	COREARRAY_CATCH
 }
@@ -737,6 +845,128 @@ COREARRAY_DLL_EXPORT SEXP gdsDiagInfo2(SEXP Node)
 }
 
 
+/// Get the reader of random-access stream of a GDS node, or NULL
+static CdRA_Read *_RA_Reader(PdGDSObj Obj)
+{
+	CdAllocArray *Var = dynamic_cast<CdAllocArray*>(Obj);
+	if (Var)
+	{
+		CdAllocator &alloc = Var->Allocator();
+		if (alloc.BufStream())
+		{
+			if (Var->PipeInfo() &&
+					Var->PipeInfo()->WriteMode(*alloc.BufStream()))
+				throw ErrGDSFmt("Please call 'readmode.gdsn()' to finish writing.");
+			return dynamic_cast<CdRA_Read*>(alloc.BufStream()->Stream());
+		}
+	}
+	return NULL;
+}
+
+/// Get the zone map of a GDS node
+/** \param Node        [in] a GDS node
+ *  \param Range       [in] NULL for all blocks, or the lower and upper
+ *                     bounds of values for the blocks overlapping the range
+ *  \return a list of block starts, lengths, minimums, maximums and the
+ *          numbers of missing values, or NULL if no zone map
+**/
+COREARRAY_DLL_EXPORT SEXP gdsZoneMap(SEXP Node, SEXP Range)
+{
+	double lower = 0, upper = 0;
+	if (!Rf_isNull(Range))
+	{
+		lower = REAL(Range)[0]; upper = REAL(Range)[1];
+		if (ISNAN(lower) || ISNAN(upper))
+			error("'range' should not be NA.");
+	}
+
+	COREARRAY_TRY
+
+		PdGDSObj Obj = GDS_R_SEXP2Obj(Node, TRUE);
+		CdRA_Read *RA = _RA_Reader(Obj);
+
+		vector<CdRA_Read::TZoneBlock> Blk;
+		bool has = false;
+		if (RA)
+		{
+			has = Rf_isNull(Range) ? RA->GetZoneMap(Blk) :
+				RA->SelectZone(lower, upper, Blk);
+		}
+		if (has)
+		{
+			const size_t n = Blk.size();
+			PROTECT(rv_ans = NEW_LIST(5));
+			SEXP st = NEW_NUMERIC(n);
+			SET_ELEMENT(rv_ans, 0, st);
+			SEXP cnt = NEW_NUMERIC(n);
+			SET_ELEMENT(rv_ans, 1, cnt);
+			SEXP mn = NEW_NUMERIC(n);
+			SET_ELEMENT(rv_ans, 2, mn);
+			SEXP mx = NEW_NUMERIC(n);
+			SET_ELEMENT(rv_ans, 3, mx);
+			SEXP na = NEW_NUMERIC(n);
+			SET_ELEMENT(rv_ans, 4, na);
+			for (size_t i=0; i < n; i++)
+			{
+				REAL(st)[i] = Blk[i].Start + 1;
+				REAL(cnt)[i] = Blk[i].Count;
+				REAL(mn)[i] = Blk[i].Min;
+				REAL(mx)[i] = Blk[i].Max;
+				REAL(na)[i] = Blk[i].NumNA;
+			}
+			SEXP nm = PROTECT(NEW_CHARACTER(5));
+			SET_STRING_ELT(nm, 0, mkChar("start"));
+			SET_STRING_ELT(nm, 1, mkChar("count"));
+			SET_STRING_ELT(nm, 2, mkChar("min"));
+			SET_STRING_ELT(nm, 3, mkChar("max"));
+			SET_STRING_ELT(nm, 4, mkChar("num_na"));
+			SET_NAMES(rv_ans, nm);
+			UNPROTECT(2);
+		}
+
+	COREARRAY_CATCH
+}
+
+
+/// Record the access trace of a GDS node
+/** \param Node        [in] a GDS node
+ *  \param Enable      [in] TRUE to start recording, FALSE to stop, or NULL
+ *  \return a list of the offsets and sizes of uncompressed data being read
+**/
+COREARRAY_DLL_EXPORT SEXP gdsAccessTrace(SEXP Node, SEXP Enable)
+{
+	int enable = Rf_isNull(Enable) ? NA_LOGICAL : Rf_asLogical(Enable);
+
+	COREARRAY_TRY
+
+		PdGDSObj Obj = GDS_R_SEXP2Obj(Node, TRUE);
+		CdRA_Read *RA = _RA_Reader(Obj);
+		if (!RA)
+			throw ErrGDSFmt("The node is not compressed with random access.");
+		if (enable != NA_LOGICAL)
+			RA->SetTrace(enable == TRUE);
+
+		const vector<CdRA_Read::TAccess> &Trace = RA->Trace();
+		const size_t n = Trace.size();
+		PROTECT(rv_ans = NEW_LIST(2));
+		SEXP Offset = NEW_NUMERIC(n);
+		SET_ELEMENT(rv_ans, 0, Offset);
+		SEXP Size = NEW_NUMERIC(n);
+		SET_ELEMENT(rv_ans, 1, Size);
+		for (size_t i=0; i < n; i++)
+		{
+			REAL(Offset)[i] = Trace[i].Start;
+			REAL(Size)[i] = Trace[i].Length;
+		}
+		SEXP nm = PROTECT(NEW_CHARACTER(2));
+		SET_STRING_ELT(nm, 0, mkChar("offset"));
+		SET_STRING_ELT(nm, 1, mkChar("size"));
+		SET_NAMES(rv_ans, nm);
+		UNPROTECT(2);
+
+	COREARRAY_CATCH
+}
+
 
 // ----------------------------------------------------------------------------
 // File Structure Operations
@@ -2101,6 +2331,165 @@ COREARRAY_DLL_EXPORT SEXP gdsObjReadData(SEXP Node, SEXP Start, SEXP Count,
 }
 
 
+/// Read the nonzero entries of a sparse node as triplets
+/** \param Node        [in] a GDS node of sparse array
+ *  \param Start       [in] the starting position
+ *  \param Count       [in] the count of each dimension
+ *  \param Selection   [in] NULL, or a list of logical vectors or NULL
+ *  \return a list of 'i', 'j', 'x' and 'dim', where 'i' and 'j' are 1-based
+ *    row and column indices in the subset
+**/
+COREARRAY_DLL_EXPORT SEXP gdsObjReadSparse(SEXP Node, SEXP Start, SEXP Count,
+	SEXP Selection)
+{
+	if (!Rf_isNull(Start) && !Rf_isNumeric(Start))
+		error("'start' should be numeric.");
+	if (!Rf_isNull(Count) && !Rf_isNumeric(Count))
+		error("'count' should be numeric.");
+	if ((Rf_isNull(Start) && !Rf_isNull(Count)) ||
+			(!Rf_isNull(Start) && Rf_isNull(Count)))
+		error("'start' and 'count' should be both NULL.");
+
+	COREARRAY_TRY
+
+		// GDS object
+		PdGDSObj Obj = GDS_R_SEXP2Obj(Node, TRUE);
+		CdAbstractArray *_Obj = dynamic_cast<CdAbstractArray*>(Obj);
+		CdSpStruct *Sp = dynamic_cast<CdSpStruct*>(Obj);
+		if ((_Obj == NULL) || (Sp == NULL))
+			throw ErrGDSFmt("It is not a sparse array.");
+
+		const int Len = _Obj->DimCnt();
+		CdAbstractArray::TArrayDim DCnt, DStart, DLen;
+		_Obj->GetDim(DCnt);
+		for (int i=0; i < Len; i++)
+			{ DStart[i] = 0; DLen[i] = DCnt[i]; }
+
+		if (!Rf_isNull(Start))
+		{
+			SEXP st = PROTECT(Rf_coerceVector(Start, INTSXP));
+			SEXP cn = PROTECT(Rf_coerceVector(Count, INTSXP));
+			if (XLENGTH(st) != Len)
+				throw ErrGDSFmt("The length of 'start' is invalid.");
+			if (XLENGTH(cn) != Len)
+				throw ErrGDSFmt("The length of 'count' is invalid.");
+			for (int i=0; i < Len; i++)
+			{
+				int k = Len - i - 1, v = INTEGER(st)[i];
+				if ((v < 1) || (v > DCnt[k]))
+					throw ErrGDSFmt("'start' is invalid.");
+				DStart[k] = v - 1;
+				v = INTEGER(cn)[i];
+				if (v == -1) v = DCnt[k] - DStart[k];
+				if ((v < 0) || ((DStart[k] + v) > DCnt[k]))
+					throw ErrGDSFmt("'count' is invalid.");
+				DLen[k] = v;
+			}
+			UNPROTECT(2);
+		}
+
+		// the selection, in the order of dimensions in GDS
+		vector< vector<C_BOOL> > Select;
+		vector<C_BOOL*> SelList;
+		if (!Rf_isNull(Selection))
+		{
+			if (!Rf_isVectorList(Selection) || (XLENGTH(Selection) != Len))
+				throw ErrGDSFmt("The dimension of 'sel' is not correct.");
+			Select.resize(Len);
+			SelList.resize(Len);
+			for (int i=0; i < Len; i++)
+			{
+				SEXP tmp = VECTOR_ELT(Selection, i);
+				int k = Len - i - 1;
+				Select[k].resize(DLen[k]);
+				if (Rf_isLogical(tmp))
+				{
+					if (XLENGTH(tmp) != DLen[k])
+					{
+						throw ErrGDSFmt(
+							"The length of 'sel[[%d]]' is not correct.", i+1);
+					}
+					ValCvtArray<C_BOOL, C_Int32>(&(Select[k][0]), LOGICAL(tmp),
+						DLen[k]);
+				} else if (Rf_isNull(tmp))
+				{
+					memset(&(Select[k][0]), TRUE, DLen[k]);
+				} else {
+					throw ErrGDSFmt(
+						"'sel[[%d]]' should be a logical variable or NULL.", i+1);
+				}
+				SelList[k] = &(Select[k][0]);
+			}
+		}
+		const C_BOOL *const *pSel = SelList.empty() ? NULL : &SelList[0];
+
+		// the dimension of the subset
+		int nProtected = 0;
+		SEXP Dim = PROTECT(NEW_INTEGER(Len));
+		nProtected ++;
+		for (int i=0; i < Len; i++)
+		{
+			int k = Len - i - 1;
+			C_Int32 n = DLen[k];
+			if (pSel)
+			{
+				n = 0;
+				for (C_Int32 j=0; j < DLen[k]; j++)
+					if (Select[k][j]) n ++;
+			}
+			INTEGER(Dim)[i] = n;
+		}
+
+		// read the triplets
+		vector<C_Int32> Row, Col;
+		SEXP X;
+		C_SVType sv = _Obj->SVType();
+		if (COREARRAY_SV_INTEGER(sv) && (_Obj->BitOf() <= 32))
+		{
+			vector<C_Int32> Val;
+			Sp->ReadSparse(DStart, DLen, pSel, Row, Col, Val);
+			X = PROTECT(NEW_INTEGER(Val.size()));
+			if (!Val.empty())
+				memcpy(INTEGER(X), &Val[0], sizeof(int)*Val.size());
+		} else {
+			vector<C_Float64> Val;
+			Sp->ReadSparse(DStart, DLen, pSel, Row, Col, Val);
+			X = PROTECT(NEW_NUMERIC(Val.size()));
+			if (!Val.empty())
+				memcpy(REAL(X), &Val[0], sizeof(double)*Val.size());
+		}
+		nProtected ++;
+
+		const size_t n = Row.size();
+		SEXP I = PROTECT(NEW_INTEGER(n));
+		SEXP J = PROTECT(NEW_INTEGER(n));
+		nProtected += 2;
+		int *pI = INTEGER(I), *pJ = INTEGER(J);
+		for (size_t k=0; k < n; k++)
+		{
+			pI[k] = Row[k] + 1;
+			pJ[k] = Col[k] + 1;
+		}
+
+		rv_ans = PROTECT(NEW_LIST(4));
+		nProtected ++;
+		SET_VECTOR_ELT(rv_ans, 0, I);
+		SET_VECTOR_ELT(rv_ans, 1, J);
+		SET_VECTOR_ELT(rv_ans, 2, X);
+		SET_VECTOR_ELT(rv_ans, 3, Dim);
+		SEXP nm = PROTECT(NEW_CHARACTER(4));
+		nProtected ++;
+		SET_STRING_ELT(nm, 0, mkChar("i"));
+		SET_STRING_ELT(nm, 1, mkChar("j"));
+		SET_STRING_ELT(nm, 2, mkChar("x"));
+		SET_STRING_ELT(nm, 3, mkChar("dim"));
+		SET_NAMES(rv_ans, nm);
+		UNPROTECT(nProtected);
+
+	COREARRAY_CATCH
+}
+
+
 /// Read data from a node with a selection
 /** \param Node        [in] a GDS node
  *  \param Selection   [in] the logical variable of selection
@@ -2468,6 +2857,22 @@ COREARRAY_DLL_EXPORT SEXP gdsDataFmt(SEXP Data, SEXP Simplify, SEXP ValList)
 }
 
 
+/// Reopen a node compressed with random access for appending, if it has
+/// been closed
+static void _ReopenWriter(PdGDSObj Obj)
+{
+	CdAllocArray *Var = dynamic_cast<CdAllocArray*>(Obj);
+	if (Var) Var->ReopenWriter();
+}
+
+/// Allow writing to a node compressed with random access, if it has been
+/// closed
+static void _CopyOnWrite(PdGDSObj Obj)
+{
+	CdAllocArray *Var = dynamic_cast<CdAllocArray*>(Obj);
+	if (Var) Var->CopyOnWrite();
+}
+
 /// Append data to a node
 /** \param Node        [in] a GDS node
  *  \param Val         [in] the values
@@ -2490,6 +2895,7 @@ COREARRAY_DLL_EXPORT SEXP gdsObjAppend(SEXP Node, SEXP Val, SEXP Check)
 		CdAbstractArray *_Obj = dynamic_cast<CdAbstractArray*>(Obj);
 		if (_Obj == NULL)
 			throw ErrGDSFmt(ERR_NO_DATA);
+		_ReopenWriter(Obj);
 
 		int nProtected = 0;
 		C_SVType sv = _Obj->SVType();
@@ -2567,6 +2973,7 @@ COREARRAY_DLL_EXPORT SEXP gdsObjAppend2(SEXP Node, SEXP Src)
 
 		if (dynamic_cast<CdAbstractArray*>(Dest))
 		{
+			_ReopenWriter(Dest);
 			CdContainer *Array = static_cast<CdContainer*>(Source);
 			C_Int64 Count = Array->TotalCount();
 			CdIterator I = Array->IterBegin();
@@ -2775,6 +3182,7 @@ COREARRAY_DLL_EXPORT SEXP gdsObjWriteData(SEXP Node, SEXP Val,
 
 	COREARRAY_TRY
 
+		_CopyOnWrite(Obj);
 		int nProtected = 0;
 		C_SVType ObjSV = Obj->SVType();
 
@@ -3141,9 +3549,9 @@ COREARRAY_DLL_EXPORT SEXP gdsSystem()
 	COREARRAY_TRY
 
 		int nProtect = 0;
-		PROTECT(rv_ans = NEW_LIST(9));
+		PROTECT(rv_ans = NEW_LIST(11));
 		nProtect ++;
-		SEXP nm = PROTECT(NEW_CHARACTER(9));
+		SEXP nm = PROTECT(NEW_CHARACTER(11));
 		nProtect ++;
 		SET_NAMES(rv_ans, nm);
 
@@ -3249,12 +3657,97 @@ COREARRAY_DLL_EXPORT SEXP gdsSystem()
 			SET_STRING_ELT(Desp, i, mkChar(desp[i].c_str()));
 		}
 
+		// CPU features at run time
+		ss.clear();
+		C_UInt32 flag = Mach::GetCPU_Features();
+		if (flag & Mach::cpuSSE2) ss.push_back("SSE2");
+		if (flag & Mach::cpuSSSE3) ss.push_back("SSSE3");
+		if (flag & Mach::cpuSSE4_2) ss.push_back("SSE4.2");
+		if (flag & Mach::cpuPOPCNT) ss.push_back("POPCNT");
+		if (flag & Mach::cpuAVX) ss.push_back("AVX");
+		if (flag & Mach::cpuAVX2) ss.push_back("AVX2");
+		if (flag & Mach::cpuAVX512F) ss.push_back("AVX512F");
+		if (flag & Mach::cpuAVX512BW) ss.push_back("AVX512BW");
+		SEXP CPU = PROTECT(NEW_CHARACTER(ss.size()));
+		nProtect ++;
+		SET_ELEMENT(rv_ans, 9, CPU);
+		SET_STRING_ELT(nm, 9, mkChar("cpu.flag"));
+		for (int i=0; i < (int)ss.size(); i++)
+			SET_STRING_ELT(CPU, i, mkChar(ss[i].c_str()));
+
+		// SIMD kernels selected at run time
+		Mach::GetSIMD_Kernel(key, desp);
+		SEXP Kernel = PROTECT(NEW_CHARACTER(desp.size()));
+		nProtect ++;
+		SEXP KName = PROTECT(NEW_CHARACTER(key.size()));
+		nProtect ++;
+		SET_ELEMENT(rv_ans, 10, Kernel);
+		SET_STRING_ELT(nm, 10, mkChar("simd.kernel"));
+		for (int i=0; i < (int)key.size(); i++)
+		{
+			SET_STRING_ELT(KName, i, mkChar(key[i].c_str()));
+			SET_STRING_ELT(Kernel, i, mkChar(desp[i].c_str()));
+		}
+		SET_NAMES(Kernel, KName);
+
 		UNPROTECT(nProtect);
 
 	COREARRAY_CATCH
 }
 
 
+/// Configure the shared cache of decompressed blocks
+/** \param Budget      [in] the memory budget in bytes, or NULL for no change
+ *  \param Reset       [in] if TRUE, clear the cache and the counters
+ *  \return
+ *    $budget      the memory budget in bytes
+ *    $size        the total size of cached blocks in bytes
+ *    $num.block   the number of cached blocks
+ *    $hit         the number of lookups found in the cache
+ *    $miss        the number of lookups not found
+ *    $evict       the number of blocks evicted
+**/
+COREARRAY_DLL_EXPORT SEXP gdsBlockCache(SEXP Budget, SEXP Reset)
+{
+	int reset_flag = Rf_asLogical(Reset);
+	if (reset_flag == NA_LOGICAL)
+		error("'reset' must be TRUE or FALSE.");
+
+	COREARRAY_TRY
+
+		if (!Rf_isNull(Budget))
+		{
+			double b = Rf_asReal(Budget);
+			if (!R_FINITE(b) || (b < 0))
+				throw ErrGDSFmt("'budget' must be a non-negative number.");
+			CdRABlockCache::SetBudget((SIZE64)b);
+		}
+		if (reset_flag)
+			CdRABlockCache::Clear(true);
+
+		CdRABlockCache::TStat st;
+		CdRABlockCache::GetStat(st);
+		PROTECT(rv_ans = NEW_LIST(6));
+		SEXP nm = PROTECT(NEW_CHARACTER(6));
+		SET_NAMES(rv_ans, nm);
+		SET_ELEMENT(rv_ans, 0, ScalarReal(st.Budget));
+		SET_STRING_ELT(nm, 0, mkChar("budget"));
+		SET_ELEMENT(rv_ans, 1, ScalarReal(st.Size));
+		SET_STRING_ELT(nm, 1, mkChar("size"));
+		SET_ELEMENT(rv_ans, 2, ScalarReal(st.NumBlock));
+		SET_STRING_ELT(nm, 2, mkChar("num.block"));
+		SET_ELEMENT(rv_ans, 3, ScalarReal(st.Hit));
+		SET_STRING_ELT(nm, 3, mkChar("hit"));
+		SET_ELEMENT(rv_ans, 4, ScalarReal(st.Miss));
+		SET_STRING_ELT(nm, 4, mkChar("miss"));
+		SET_ELEMENT(rv_ans, 5, ScalarReal(st.Evict));
+		SET_STRING_ELT(nm, 5, mkChar("evict"));
+		UNPROTECT(2);
+
+	COREARRAY_CATCH
+}
+
+
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
 
@@ -4100,9 +4593,9 @@ COREARRAY_DLL_LOCAL void R_Init_RegCallMethods(DllInfo *info)
 
 	static R_CallMethodDef callMethods[] =
 	{
-		CALL(gdsCreateGDS, 2),          CALL(gdsOpenGDS, 4),
+		CALL(gdsCreateGDS, 5),          CALL(gdsOpenGDS, 10),
 		CALL(gdsCloseGDS, 1),           CALL(gdsSyncGDS, 1),
-		CALL(gdsTidyUp, 2),             CALL(gdsGetConnection, 0),
+		CALL(gdsTidyUp, 4),             CALL(gdsGetConnection, 0),
 		CALL(gdsDiagInfo, 1),           CALL(gdsDiagInfo2, 1),
 		CALL(gdsFileSize, 1),
 
@@ -4123,6 +4616,7 @@ COREARRAY_DLL_LOCAL void R_Init_RegCallMethods(DllInfo *info)
 		CALL(gdsObjSetDim, 3),
 		CALL(gdsObjAppend, 3),          CALL(gdsObjAppend2, 2),
 		CALL(gdsObjReadData, 6),        CALL(gdsObjReadExData, 4),
+		CALL(gdsObjReadSparse, 4),
 		CALL(gdsObjWriteAll, 3),        CALL(gdsObjWriteData, 5),
 		CALL(gdsDataFmt, 3),
 	
@@ -4132,6 +4626,8 @@ COREARRAY_DLL_LOCAL void R_Init_RegCallMethods(DllInfo *info)
 		CALL(gdsIsElement, 2),          CALL(gdsLastErrGDS, 0),
 		CALL(gdsSystem, 0),             CALL(gdsDigest, 3),
 		CALL(gdsFmtSize, 1),            CALL(gdsSummary, 1),
+		CALL(gdsBlockCache, 2),         CALL(gdsZoneMap, 2),
+		CALL(gdsAccessTrace, 2),
 
 		{ NULL, NULL, 0 }
 	};